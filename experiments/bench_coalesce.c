@@ -0,0 +1,129 @@
+/*
+ * File Name: bench_coalesce.c
+ * File Description: Runs identifies of one faceId each from many threads,
+ *                   sent one call each and then coalesced with
+ *                   face_identify_coalesced, and compares the calls sent,
+ *                   the latency and the throughput. Start the mock server
+ *                   with some latency, e.g.
+ *                   mock_server -d 20
+ *
+ * Usage: bench_coalesce [url] [threads] [requests per thread]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_THREADS 20
+#define BENCH_DEFAULT_REQUESTS 50
+#define BENCH_PGID "demo_group"
+
+typedef struct tagBenchThread {
+	pthread_t thread;
+	int coalesce;			// 1 to use face_identify_coalesced
+	int requests;
+	int failures;
+	double * lat;			// latency of each request
+} BenchThread;
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void * run_thread(void * arg)
+{
+	BenchThread * bench = (BenchThread *)arg;
+	struct json_object * resp;
+	FaceBody * body = face_body_acquire();
+	char fid[64];
+	char * fids[1] = { fid };
+	double start;
+	long status;
+	int i;
+
+	for (i = 0; i < bench->requests; ++i) {
+		snprintf(fid, sizeof(fid), "%08lx-0000-4000-8000-%012d", (unsigned long)pthread_self() & 0xffffffff, i);
+
+		start = now_ms();
+		if (bench->coalesce) {
+			status = face_identify_coalesced(BENCH_PGID, fids, 1, 0, -1, &resp);
+		}
+		else {
+			face_body_identify(body, BENCH_PGID, fids, 1, 0, -1);
+			status = face_identify_body(body, &resp);
+		}
+		bench->lat[i] = now_ms() - start;
+
+		// each caller gets back the result of its own faceId only
+		if (status != 200 || json_object_array_length(resp) != 1) {
+			bench->failures++;
+		}
+		json_object_put(resp);
+	}
+
+	face_body_release(body);
+	return NULL;
+}
+
+static void run(const char * label, int coalesce, int threads, int requests)
+{
+	BenchThread * benches = calloc(threads, sizeof(BenchThread));
+	double * lat = malloc(threads * requests * sizeof(double));
+	CoalesceStats before;
+	CoalesceStats after;
+	double start;
+	double elapsed;
+	int failures = 0;
+	int n = threads * requests;
+	int i;
+
+	face_get_coalesce_stats(&before);
+
+	start = now_ms();
+	for (i = 0; i < threads; ++i) {
+		benches[i].coalesce = coalesce;
+		benches[i].requests = requests;
+		benches[i].lat = lat + i * requests;
+		pthread_create(&benches[i].thread, NULL, run_thread, &benches[i]);
+	}
+	for (i = 0; i < threads; ++i) {
+		pthread_join(benches[i].thread, NULL);
+		failures += benches[i].failures;
+	}
+	elapsed = now_ms() - start;
+
+	face_get_coalesce_stats(&after);
+
+	qsort(lat, n, sizeof(double), compare_double);
+	printf("%-10s %8d %8lu %8.1f %8.1f %10.0f %8d\n", label, n,
+		coalesce ? after.batches - before.batches : (unsigned long)n,
+		lat[n / 2], lat[n * 99 / 100], n / (elapsed / 1000), failures);
+
+	free(lat);
+	free(benches);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int threads = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_THREADS;
+	int requests = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_REQUESTS;
+
+	face_login(url, "bench");
+
+	printf("%-10s %8s %8s %8s %8s %10s %8s\n", "", "faces", "calls", "p50", "p99", "faces/s", "failed");
+
+	run("separate", 0, threads, requests);
+	run("coalesced", 1, threads, requests);
+
+	return 0;
+}
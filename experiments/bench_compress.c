@@ -0,0 +1,71 @@
+/*
+ * File Name: bench_compress.c
+ * File Description: Measures the bytes received and the time taken by
+ *                   face_list_p on a large persongroup with and without
+ *                   response compression. Start the mock server with a
+ *                   roster and gzip on, e.g.
+ *                   mock_server -R 10000 -z
+ *
+ * Usage: bench_compress [url] [requests]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_REQUESTS 50
+#define BENCH_PGID "demo_group"
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static void run(const char * label, int requests)
+{
+	struct json_object * resp;
+	TransferStats before;
+	TransferStats after;
+	double start;
+	double elapsed;
+	size_t persons = 0;
+	int i;
+
+	face_get_transfer_stats(FACE_EP_LIST_P, &before);
+
+	start = now_ms();
+	for (i = 0; i < requests; ++i) {
+		face_list_p(BENCH_PGID, &resp);
+		if (resp) {
+			persons = json_object_array_length(resp);
+			json_object_put(resp);
+		}
+	}
+	elapsed = now_ms() - start;
+
+	face_get_transfer_stats(FACE_EP_LIST_P, &after);
+
+	printf("%-8s %8zu %12.0f %12.0f %10.1f\n", label, persons,
+		(double)(after.wire_bytes - before.wire_bytes) / requests,
+		(double)(after.body_bytes - before.body_bytes) / requests,
+		elapsed / requests);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int requests = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_REQUESTS;
+
+	face_login(url, "bench");
+
+	printf("%-8s %8s %12s %12s %10s\n", "", "persons", "wire bytes", "body bytes", "ms");
+
+	face_set_compression(0);
+	run("plain", requests);
+
+	face_set_compression(1);
+	run("gzip", requests);
+
+	return 0;
+}
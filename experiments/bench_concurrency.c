@@ -0,0 +1,83 @@
+/*
+ * File Name: bench_concurrency.c
+ * File Description: Keeps many threads sending detect requests and prints
+ *                   the adaptive concurrency limit once a second, so it can
+ *                   be watched following a service whose capacity changes.
+ *                   Start the mock server with a changing capacity, e.g.
+ *                   mock_server -d 20 -c 12 -P 5
+ *
+ * Usage: bench_concurrency [url] [threads] [seconds]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_THREADS 32
+#define BENCH_DEFAULT_SECONDS 20
+#define BENCH_IMAGE_SIZE 4096
+
+static volatile int running = 1;
+static unsigned long done = 0;			// requests answered with 2xx
+static unsigned long throttled = 0;		// requests answered with 429
+
+static void * worker(void * arg)
+{
+	static char image[BENCH_IMAGE_SIZE];
+	struct json_object * resp;
+	long status;
+
+	(void)arg;
+	while (running) {
+		status = face_detect_buffer(image, sizeof(image), NULL, &resp);
+		if (resp) json_object_put(resp);
+		if (status == 429) __sync_add_and_fetch(&throttled, 1);
+		else if (status >= 200 && status < 300) __sync_add_and_fetch(&done, 1);
+	}
+	return NULL;
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int threads = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_THREADS;
+	int seconds = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_SECONDS;
+	RetryPolicy policy;
+	ConcurrencyStats stats;
+	pthread_t tid[256];
+	unsigned long last_done = 0;
+	unsigned long last_throttled = 0;
+	int i;
+
+	if (threads > 256) threads = 256;
+
+	face_login(url, "bench");
+
+	// measuring the limit alone; retries would hide the 429s
+	face_get_retry_policy(FACE_EP_DETECT, &policy);
+	policy.max_attempts = 1;
+	face_set_retry_policy(FACE_EP_DETECT, &policy);
+
+	face_set_concurrency(1, threads, 4);
+	face_set_concurrency_targets(200, 0.02, 0.8);
+
+	for (i = 0; i < threads; ++i) {
+		pthread_create(&tid[i], NULL, worker, NULL);
+	}
+
+	printf("%4s %6s %9s %8s %10s %8s\n", "sec", "limit", "inflight", "p90 ms", "ok/sec", "429/sec");
+	for (i = 1; i <= seconds; ++i) {
+		sleep(1);
+		face_get_concurrency_stats(&stats);
+		printf("%4d %6d %9d %8.1f %10lu %8lu\n", i, stats.limit, stats.inflight, stats.p90,
+			done - last_done, throttled - last_throttled);
+		last_done = done;
+		last_throttled = throttled;
+	}
+
+	running = 0;
+	for (i = 0; i < threads; ++i) {
+		pthread_join(tid[i], NULL);
+	}
+
+	return 0;
+}
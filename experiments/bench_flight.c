@@ -0,0 +1,123 @@
+/*
+ * File Name: bench_flight.c
+ * File Description: Lists the persons of one persongroup from many threads
+ *                   at once, with and without face_set_single_flight, and
+ *                   compares the calls sent, the latency and the
+ *                   throughput. Start the mock server with some latency
+ *                   and a roster, e.g.
+ *                   mock_server -d 20 -R 1000
+ *
+ * Usage: bench_flight [url] [threads] [requests per thread]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_THREADS 20
+#define BENCH_DEFAULT_REQUESTS 50
+#define BENCH_PGID "demo_group"
+
+typedef struct tagBenchThread {
+	pthread_t thread;
+	int requests;
+	int failures;
+	size_t persons;			// persons listed by the first request
+	double * lat;			// latency of each request
+} BenchThread;
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void * run_thread(void * arg)
+{
+	BenchThread * bench = (BenchThread *)arg;
+	struct json_object * resp;
+	double start;
+	long status;
+	int i;
+
+	for (i = 0; i < bench->requests; ++i) {
+		start = now_ms();
+		status = face_list_p(BENCH_PGID, &resp);
+		bench->lat[i] = now_ms() - start;
+
+		// a shared response must be as whole as one of our own
+		if (status != 200 || !json_object_is_type(resp, json_type_array)) {
+			bench->failures++;
+		}
+		else if (!i) {
+			bench->persons = json_object_array_length(resp);
+		}
+		else if (json_object_array_length(resp) != bench->persons) {
+			bench->failures++;
+		}
+		json_object_put(resp);
+	}
+
+	return NULL;
+}
+
+static void run(const char * label, int shared, int threads, int requests)
+{
+	BenchThread * benches = calloc(threads, sizeof(BenchThread));
+	double * lat = malloc(threads * requests * sizeof(double));
+	FlightStats before;
+	FlightStats after;
+	double start;
+	double elapsed;
+	int failures = 0;
+	int n = threads * requests;
+	int i;
+
+	face_set_single_flight(shared);
+	face_get_flight_stats(&before);
+
+	start = now_ms();
+	for (i = 0; i < threads; ++i) {
+		benches[i].requests = requests;
+		benches[i].lat = lat + i * requests;
+		pthread_create(&benches[i].thread, NULL, run_thread, &benches[i]);
+	}
+	for (i = 0; i < threads; ++i) {
+		pthread_join(benches[i].thread, NULL);
+		failures += benches[i].failures;
+	}
+	elapsed = now_ms() - start;
+
+	face_get_flight_stats(&after);
+
+	qsort(lat, n, sizeof(double), compare_double);
+	printf("%-10s %8d %8lu %8.1f %8.1f %10.0f %8d\n", label, n,
+		shared ? after.flights - before.flights : (unsigned long)n,
+		lat[n / 2], lat[n * 99 / 100], n / (elapsed / 1000), failures);
+
+	free(lat);
+	free(benches);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int threads = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_THREADS;
+	int requests = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_REQUESTS;
+
+	face_login(url, "bench");
+
+	printf("%-10s %8s %8s %8s %8s %10s %8s\n", "", "lists", "calls", "p50", "p99", "lists/s", "failed");
+
+	run("separate", 0, threads, requests);
+	run("shared", 1, threads, requests);
+
+	return 0;
+}
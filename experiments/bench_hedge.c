@@ -0,0 +1,102 @@
+/*
+ * File Name: bench_hedge.c
+ * File Description: Measures the latency percentiles of face_detect_local
+ *                   and face_identify with and without hedging. Start the
+ *                   mock server in long tail mode, e.g.
+ *                   mock_server -d 10 -L 5 -T 300
+ *                   so that 5% of the requests take 300 ms longer.
+ *
+ * Usage: bench_hedge [url] [requests]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_REQUESTS 400
+#define BENCH_IMAGE_SIZE 65536
+#define BENCH_IDENTIFY_BODY "{\"personGroupId\":\"demo_group\",\"faceIds\":[\"c5c24a82-6845-4031-9d5d-978df9175426\"]}"
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void report(const char * label, double * lat, int n)
+{
+	qsort(lat, n, sizeof(double), compare_double);
+	printf("%-20s %8.1f %8.1f %8.1f %8.1f\n", label,
+		lat[n / 2], lat[n * 90 / 100], lat[n * 99 / 100], lat[n - 1]);
+}
+
+static void run(const char * label, FILE * image, int requests)
+{
+	struct json_object * body = json_tokener_parse(BENCH_IDENTIFY_BODY);
+	struct json_object * resp;
+	double * detect = malloc(requests * sizeof(double));
+	double * identify = malloc(requests * sizeof(double));
+	char name[64];
+	double start;
+	int i;
+
+	for (i = 0; i < requests; ++i) {
+		rewind(image);
+		start = now_ms();
+		face_detect_local(image, BENCH_IMAGE_SIZE, NULL, &resp);
+		detect[i] = now_ms() - start;
+		if (resp) json_object_put(resp);
+
+		start = now_ms();
+		face_identify(body, &resp);
+		identify[i] = now_ms() - start;
+		if (resp) json_object_put(resp);
+	}
+
+	snprintf(name, sizeof(name), "detect %s", label);
+	report(name, detect, requests);
+	snprintf(name, sizeof(name), "identify %s", label);
+	report(name, identify, requests);
+
+	json_object_put(body);
+	free(detect);
+	free(identify);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int requests = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_REQUESTS;
+	FILE * image = tmpfile();
+	HedgeStats stats;
+	int i;
+
+	for (i = 0; i < BENCH_IMAGE_SIZE; ++i) {
+		fputc(i & 0xff, image);
+	}
+	fflush(image);
+
+	face_login(url, "bench");
+
+	printf("%-20s %8s %8s %8s %8s   (ms)\n", "", "p50", "p90", "p99", "max");
+
+	run("plain", image, requests);
+
+	face_set_hedging(FACE_EP_DETECT, 1);
+	face_set_hedging(FACE_EP_IDENTIFY, 1);
+	run("hedged", image, requests);
+
+	face_get_hedge_stats(&stats);
+	printf("hedged %lu of %lu requests, %lu answered first, %lu over budget\n",
+		stats.hedged, stats.requests, stats.won, stats.denied);
+
+	fclose(image);
+	return 0;
+}
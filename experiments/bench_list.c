@@ -0,0 +1,80 @@
+/*
+ * File Name: bench_list.c
+ * File Description: Lists a large persongroup with face_list_p_each over
+ *                   more and more personId ranges at once, then with
+ *                   face_list_p, and compares the time taken and the
+ *                   memory held. The first face_list_p also mirrors the
+ *                   group, so it is timed again once the mirror is built.
+ *                   Start the mock server with some latency and a large
+ *                   roster, e.g.
+ *                   mock_server -d 20 -R 100000
+ *
+ * Usage: bench_list [url]
+ */
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_PGID "demo_group"
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+/* peak resident memory of the process so far */
+static long peak_kb()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static int count_person(struct json_object * person, void * data)
+{
+	(void)person;
+	(*(long *)data)++;
+	return 0;
+}
+
+/* ranges 0 lists with face_list_p */
+static void run(const char * name, int ranges)
+{
+	struct json_object * resp;
+	long persons = 0;
+	long peak = peak_kb();
+	long status;
+	double start = now_ms();
+
+	if (ranges) {
+		status = face_list_p_each(BENCH_PGID, 0, ranges, count_person, &persons);
+	}
+	else {
+		status = face_list_p(BENCH_PGID, &resp);
+		if (status == 200) persons = (long)json_object_array_length(resp);
+		json_object_put(resp);
+	}
+
+	printf("%-12s %8ld %10ld %10.1f %14ld\n", name, status, persons, now_ms() - start, peak_kb() - peak);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+
+	face_login(url, "bench");
+
+	printf("%-12s %8s %10s %10s %14s\n", "", "status", "persons", "ms", "peak grew kB");
+
+	// the peak only grows, so the list holding the most goes last
+	run("each x1", 1);
+	run("each x4", 4);
+	run("each x16", 16);
+	run("face_list_p", 0);
+	run("again", 0);
+
+	return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * File Name: bench_prewarm.c
+ * File Description: Measures the latency of the first face_detect_local of
+ *                   a new client, cold and after face_client_prewarm, and of
+ *                   a request made after the server closed idle connections,
+ *                   with and without refreshing them. Start the mock server
+ *                   with a handshake cost and an idle timeout, e.g.
+ *                   mock_server -d 10 -H 150 -I 2
+ *
+ * Usage: bench_prewarm [url] [clients]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_CLIENTS 20
+#define BENCH_IMAGE_SIZE 65536
+#define BENCH_IDLE_S 3				// longer than mock_server -I
+#define BENCH_REFRESH_MS 1000		// shorter than mock_server -I
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void report(const char * label, double * lat, int n)
+{
+	qsort(lat, n, sizeof(double), compare_double);
+	printf("%-20s %8.1f %8.1f %8.1f\n", label, lat[0], lat[n / 2], lat[n - 1]);
+}
+
+static double detect(FILE * image)
+{
+	struct json_object * resp;
+	double start;
+
+	rewind(image);
+	start = now_ms();
+	face_detect_local(image, BENCH_IMAGE_SIZE, NULL, &resp);
+	if (resp) json_object_put(resp);
+	return now_ms() - start;
+}
+
+/**
+ * Description:
+ *		Times the first request of fresh clients
+ *
+ * Params:
+ *		prewarm: whether to prewarm each client before the request
+ */
+static void first_request(const char * label, FILE * image, char * url, int clients, int prewarm)
+{
+	double * lat = malloc(clients * sizeof(double));
+	FaceClient * client;
+	int i;
+
+	for (i = 0; i < clients; ++i) {
+		client = face_client_new(0);
+		face_client_login(client, url, "bench");
+		face_client_bind(client);
+		if (prewarm) {
+			face_client_prewarm(client, 1, -1);
+		}
+
+		lat[i] = detect(image);
+
+		face_client_bind(NULL);
+		face_client_free(client);
+	}
+
+	report(label, lat, clients);
+	free(lat);
+}
+
+/**
+ * Description:
+ *		Times a request made after the connection sat idle for longer than
+ *		the server keeps it
+ *
+ * Params:
+ *		refresh: whether the client refreshes its connection meanwhile
+ */
+static void after_idle(const char * label, FILE * image, char * url, int refresh)
+{
+	double lat[3];
+	FaceClient * client;
+	int i;
+
+	client = face_client_new(0);
+	face_client_login(client, url, "bench");
+	face_client_bind(client);
+	face_client_prewarm(client, 1, refresh ? BENCH_REFRESH_MS : -1);
+
+	for (i = 0; i < 3; ++i) {
+		sleep(BENCH_IDLE_S);
+		lat[i] = detect(image);
+	}
+
+	face_client_bind(NULL);
+	face_client_free(client);
+	report(label, lat, 3);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int clients = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_CLIENTS;
+	FILE * image = tmpfile();
+	int i;
+
+	for (i = 0; i < BENCH_IMAGE_SIZE; ++i) {
+		fputc(i & 0xff, image);
+	}
+	fflush(image);
+
+	printf("%-20s %8s %8s %8s   (ms)\n", "", "min", "p50", "max");
+
+	first_request("first cold", image, url, clients, 0);
+	first_request("first prewarmed", image, url, clients, 1);
+	after_idle("idle", image, url, 0);
+	after_idle("idle refreshed", image, url, 1);
+
+	fclose(image);
+	return 0;
+}
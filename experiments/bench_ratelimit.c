@@ -0,0 +1,100 @@
+/*
+ * File Name: bench_ratelimit.c
+ * File Description: Sends the same burst of requests from several threads
+ *                   with and without the client side rate limit and counts
+ *                   how many of them the service throttled. Start the mock
+ *                   server with a subscription rate, e.g. mock_server -r 10,
+ *                   and pass the same rate here.
+ *
+ * Usage: bench_ratelimit [url] [tps] [threads] [requests per thread]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_TPS 10
+#define BENCH_DEFAULT_THREADS 4
+#define BENCH_DEFAULT_REQUESTS 10
+
+static int requests = BENCH_DEFAULT_REQUESTS;
+
+static double now_sec()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void * worker(void * arg)
+{
+	struct json_object * resp;
+	int i;
+
+	// every other thread is a background job
+	face_set_priority((long)arg % 2 ? FACE_PRIORITY_LOW : FACE_PRIORITY_HIGH);
+
+	for (i = 0; i < requests; ++i) {
+		face_get_pg("demo_group", &resp);
+		if (resp) json_object_put(resp);
+	}
+	return NULL;
+}
+
+static void run(const char * label, int threads)
+{
+	pthread_t tid[64];
+	RetryStats retry;
+	RateStats rate;
+	double start;
+	long i;
+
+	face_get_retry_stats(&retry);
+	unsigned long retries = retry.retries;
+
+	start = now_sec();
+	for (i = 0; i < threads; ++i) {
+		pthread_create(&tid[i], NULL, worker, (void *)i);
+	}
+	for (i = 0; i < threads; ++i) {
+		pthread_join(tid[i], NULL);
+	}
+
+	face_get_retry_stats(&retry);
+	memset(&rate, 0, sizeof(rate));
+	face_get_rate_stats(NULL, &rate);
+	printf("%-12s %8.2f s %10lu %10lu %12.1f %12.1f\n", label, now_sec() - start,
+		retry.retries - retries, rate.delayed,
+		rate.delayed ? rate.wait_total / rate.delayed : 0, rate.wait_max);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	double tps = argc > 2 ? atof(argv[2]) : BENCH_DEFAULT_TPS;
+	int threads = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_THREADS;
+	RetryPolicy policy;
+	int ep;
+
+	if (argc > 4) requests = atoi(argv[4]);
+	if (threads > 64) threads = 64;
+
+	face_login(url, "bench");
+
+	// no budget limit so every 429 is seen and retried
+	face_set_retry_budget(1, 1000);
+	for (ep = 0; ep < FACE_EP_COUNT; ++ep) {
+		face_get_retry_policy(ep, &policy);
+		policy.max_attempts = 20;
+		face_set_retry_policy(ep, &policy);
+	}
+
+	printf("%-12s %10s %10s %10s %12s %12s\n", "", "time", "429s", "delayed", "avg wait ms", "max wait ms");
+
+	run("unlimited", threads);
+
+	sleep(2);		// letting the server's bucket fill up again
+	face_set_rate_limit(tps, tps);
+	run("limited", threads);
+
+	return 0;
+}
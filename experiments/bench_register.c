@@ -0,0 +1,138 @@
+/*
+ * File Name: bench_register.c
+ * File Description: Registers the faces of a frame one after the other,
+ *                   creating each person then adding its face, and then
+ *                   with face_register_faces, and compares the time a
+ *                   frame takes. Start the mock server with some latency
+ *                   and several faces per image, e.g.
+ *                   mock_server -d 20 -F 10
+ *
+ * Usage: bench_register [url] [frames]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_FRAMES 10
+#define BENCH_PGID "demo_register"
+#define BENCH_IMAGE_SIZE 65536
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+/* the faces detect finds in the frame */
+static int detect(const char * image, RegResult ** results)
+{
+	struct json_object * resp;
+	struct json_object * rect;
+	struct json_object * value;
+	int count = 0;
+	int i;
+
+	if (face_detect_buffer(image, BENCH_IMAGE_SIZE, NULL, &resp) == 200) {
+		count = (int)json_object_array_length(resp);
+	}
+	*results = calloc(count ? count : 1, sizeof(RegResult));
+
+	for (i = 0; i < count; ++i) {
+		if (!json_object_object_get_ex(json_object_array_get_idx(resp, i), "faceRectangle", &rect)) continue;
+		if (json_object_object_get_ex(rect, "left", &value)) (*results)[i].rt.x = json_object_get_int(value);
+		if (json_object_object_get_ex(rect, "top", &value)) (*results)[i].rt.y = json_object_get_int(value);
+		if (json_object_object_get_ex(rect, "width", &value)) (*results)[i].rt.width = json_object_get_int(value);
+		if (json_object_object_get_ex(rect, "height", &value)) (*results)[i].rt.height = json_object_get_int(value);
+	}
+	json_object_put(resp);
+
+	return count;
+}
+
+/* registers the faces the way the demo did before face_register_faces */
+static int register_each(FaceBody * body, const char * image, RegResult * results, int count)
+{
+	struct json_object * resp;
+	struct json_object * param;
+	struct json_object * pid;
+	char rect[64];
+	int registered = 0;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		if (face_create_p_body(BENCH_PGID, body, &resp) != 200
+			|| !json_object_object_get_ex(resp, "personId", &pid)) {
+			json_object_put(resp);
+			continue;
+		}
+		snprintf(results[i].pid, sizeof(results[i].pid), "%s", json_object_get_string(pid));
+		json_object_put(resp);
+
+		snprintf(rect, sizeof(rect), "%d,%d,%d,%d", results[i].rt.x, results[i].rt.y, results[i].rt.width,
+			results[i].rt.height);
+		param = json_object_new_object();
+		json_object_object_add(param, "targetFace", json_object_new_string(rect));
+		if (face_add_face_buffer(image, BENCH_IMAGE_SIZE, BENCH_PGID, results[i].pid, param, &resp) == 200) {
+			registered++;
+		}
+		json_object_put(param);
+		json_object_put(resp);
+	}
+
+	return registered;
+}
+
+static void run(const char * name, int pipelined, FaceBody * body, const char * image, int frames)
+{
+	RegResult * results;
+	double total = 0;
+	double start;
+	long registered = 0;
+	int count = 0;
+	int i;
+
+	for (i = 0; i < frames; ++i) {
+		count = detect(image, &results);
+
+		start = now_ms();
+		if (pipelined) {
+			registered += face_register_faces(BENCH_PGID, body, image, BENCH_IMAGE_SIZE, results, NULL, count);
+		}
+		else {
+			registered += register_each(body, image, results, count);
+		}
+		total += now_ms() - start;
+
+		free(results);
+	}
+
+	printf("%-12s %8d %10.1f %12ld\n", name, count, total / frames, registered);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int frames = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_FRAMES;
+	char * image = calloc(1, BENCH_IMAGE_SIZE);
+	struct json_object * resp;
+	FaceBody * body;
+
+	face_login(url, "bench");
+
+	body = face_body_acquire();
+	face_body_create_pg(body, "bench", NULL, NULL);
+	face_ensure_pg(BENCH_PGID, body, &resp);
+	json_object_put(resp);
+	face_body_create_p(body, "person", NULL);
+
+	printf("%-12s %8s %10s %12s\n", "", "faces", "ms/frame", "registered");
+
+	run("each", 0, body, image, frames);
+	run("pipelined", 1, body, image, frames);
+
+	face_body_release(body);
+	free(image);
+
+	return 0;
+}
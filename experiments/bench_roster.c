@@ -0,0 +1,136 @@
+/*
+ * File Name: bench_roster.c
+ * File Description: Names identified persons from many threads, once with
+ *                   a PersonGroup Person Get call each and once from the
+ *                   roster mirror filled by face_mirror_roster, and
+ *                   compares the latency and the throughput. Start the mock
+ *                   server with some latency and a roster, e.g.
+ *                   mock_server -d 20 -R 1000
+ *
+ * Usage: bench_roster [url] [threads] [lookups per thread]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_THREADS 8
+#define BENCH_DEFAULT_LOOKUPS 100
+#define BENCH_PERSONS 1000		// persons mock_server -R lists
+#define BENCH_PGID "demo_group"
+
+typedef struct tagBenchThread {
+	pthread_t thread;
+	int mirror;				// 1 to look persons up in the mirror
+	int lookups;
+	int seed;
+	int failures;
+	double * lat;			// latency of each lookup
+} BenchThread;
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void * run_thread(void * arg)
+{
+	BenchThread * bench = (BenchThread *)arg;
+	struct json_object * resp;
+	RosterPerson person;
+	unsigned int seed = bench->seed;
+	char pid[64];
+	double start;
+	int i;
+	int n;
+
+	for (i = 0; i < bench->lookups; ++i) {
+		// the ids mock_server makes up for its roster
+		n = rand_r(&seed) % BENCH_PERSONS;
+		snprintf(pid, sizeof(pid), "%08x-4f7e-4a2b-9c1d-%012x",
+			(unsigned)((unsigned long long)n * 0x100000000ULL / BENCH_PERSONS), n);
+
+		start = now_ms();
+		if (bench->mirror) {
+			if (face_roster_lookup(BENCH_PGID, pid, &person)) {
+				bench->failures++;
+			}
+		}
+		else {
+			if (face_get_p(BENCH_PGID, pid, &resp) != 200) {
+				bench->failures++;
+			}
+			json_object_put(resp);
+		}
+		bench->lat[i] = now_ms() - start;
+	}
+
+	return NULL;
+}
+
+static void run(const char * label, int mirror, int threads, int lookups)
+{
+	BenchThread * benches = calloc(threads, sizeof(BenchThread));
+	double * lat = malloc(threads * lookups * sizeof(double));
+	double start;
+	double elapsed;
+	int failures = 0;
+	int n = threads * lookups;
+	int i;
+
+	start = now_ms();
+	for (i = 0; i < threads; ++i) {
+		benches[i].mirror = mirror;
+		benches[i].lookups = lookups;
+		benches[i].seed = i + 1;
+		benches[i].lat = lat + i * lookups;
+		pthread_create(&benches[i].thread, NULL, run_thread, &benches[i]);
+	}
+	for (i = 0; i < threads; ++i) {
+		pthread_join(benches[i].thread, NULL);
+		failures += benches[i].failures;
+	}
+	elapsed = now_ms() - start;
+
+	qsort(lat, n, sizeof(double), compare_double);
+	printf("%-8s %10d %10.4f %10.4f %12.0f %8d\n", label, n,
+		lat[n / 2], lat[n * 99 / 100], n / (elapsed / 1000), failures);
+
+	free(lat);
+	free(benches);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int threads = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_THREADS;
+	int lookups = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_LOOKUPS;
+	RosterStats stats;
+	double start;
+
+	face_login(url, "bench");
+
+	start = now_ms();
+	if (face_mirror_roster(BENCH_PGID) != 200) {
+		fprintf(stderr, "can't list %s\n", BENCH_PGID);
+		return 1;
+	}
+	face_get_roster_stats(&stats);
+	printf("mirrored %lu persons in %.1f ms\n\n", stats.persons, now_ms() - start);
+
+	printf("%-8s %10s %10s %10s %12s %8s\n", "", "lookups", "p50", "p99", "lookups/s", "failed");
+
+	run("call", 0, threads, lookups);
+	// a thousand times as many, or it is over before it is measured
+	run("mirror", 1, threads, lookups * 1000);
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * File Name: bench_search.c
+ * File Description: Searches the persons of a large persongroup by name,
+ *                   once by listing the group and scanning the list, the
+ *                   way it was done before, and once with face_search_p,
+ *                   and compares the latency. Start the mock server with a
+ *                   large roster, e.g.
+ *                   mock_server -d 20 -R 20000
+ *
+ * Usage: bench_search [url] [searches]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_SEARCHES 20
+#define BENCH_PGID "demo_group"
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* finds the persons whose name starts with prefix in a fresh list */
+static int scan_list(const char * prefix)
+{
+	struct json_object * resp;
+	struct json_object * name;
+	size_t len = strlen(prefix);
+	size_t i;
+	int found = 0;
+
+	if (face_list_p(BENCH_PGID, &resp) != 200) return -1;
+
+	for (i = 0; i < json_object_array_length(resp); ++i) {
+		if (json_object_object_get_ex(json_object_array_get_idx(resp, i), "name", &name)
+			&& !strncmp(json_object_get_string(name), prefix, len)) {
+			found++;
+		}
+	}
+	json_object_put(resp);
+	return found;
+}
+
+static void run(const char * label, int searches, int mode)
+{
+	struct json_object * resp;
+	double * lat = malloc(searches * sizeof(double));
+	char prefix[64];
+	double start;
+	int found = 0;
+	int i;
+
+	for (i = 0; i < searches; ++i) {
+		// the same 100 names for every kind of search
+		snprintf(prefix, sizeof(prefix), "person_%d", 100 + (i * 7919) % 100);
+
+		start = now_ms();
+		if (mode < 0) {
+			found += scan_list(prefix);
+		}
+		else {
+			found += face_search_p(BENCH_PGID, "name", prefix, mode, &resp);
+			json_object_put(resp);
+		}
+		lat[i] = now_ms() - start;
+	}
+
+	qsort(lat, searches, sizeof(double), compare_double);
+	printf("%-12s %10d %12.4f %12.4f %10.1f\n", label, searches, lat[searches / 2], lat[searches * 99 / 100],
+		(double)found / searches);
+
+	free(lat);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int searches = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_SEARCHES;
+	RosterStats stats;
+	double start;
+
+	face_login(url, "bench");
+
+	start = now_ms();
+	if (face_mirror_roster(BENCH_PGID) != 200) {
+		fprintf(stderr, "can't list %s\n", BENCH_PGID);
+		return 1;
+	}
+	face_get_roster_stats(&stats);
+	printf("mirrored %lu persons in %.1f ms\n\n", stats.persons, now_ms() - start);
+
+	printf("%-12s %10s %12s %12s %10s\n", "", "searches", "p50 ms", "p99 ms", "found/avg");
+
+	run("list+scan", searches, -1);
+	run("exact", searches * 1000, FACE_SEARCH_EXACT);
+	run("prefix", searches * 1000, FACE_SEARCH_PREFIX);
+
+	return 0;
+}
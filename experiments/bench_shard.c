@@ -0,0 +1,89 @@
+/*
+ * File Name: bench_shard.c
+ * File Description: Identifies faces with face_identify_sharded against
+ *                   LargePersonGroups spread over more and more shards,
+ *                   and compares the latency and the candidates merged.
+ *                   Start the mock server with some latency and a long
+ *                   tail, e.g.
+ *                   mock_server -d 20 -L 1 -T 200
+ *
+ * Usage: bench_shard [url] [identifies]
+ */
+
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_IDENTIFIES 100
+#define BENCH_PREFIX "demo_shard"
+#define BENCH_CANDIDATES 5
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void run(int shards, int identifies)
+{
+	struct json_object * resp;
+	struct json_object * candidates;
+	double * lat = malloc(identifies * sizeof(double));
+	char fid[64];
+	char * fids[1] = { fid };
+	double start;
+	long found = 0;
+	int failures = 0;
+	int i;
+
+	face_set_shards(BENCH_PREFIX, shards);
+
+	for (i = 0; i < identifies; ++i) {
+		snprintf(fid, sizeof(fid), "00000000-0000-4000-8000-%012d", i);
+
+		start = now_ms();
+		if (face_identify_sharded(fids, 1, BENCH_CANDIDATES, -1, &resp) != 200) {
+			failures++;
+		}
+		else if (json_object_object_get_ex(json_object_array_get_idx(resp, 0), "candidates", &candidates)) {
+			found += (long)json_object_array_length(candidates);
+		}
+		lat[i] = now_ms() - start;
+		json_object_put(resp);
+	}
+
+	qsort(lat, identifies, sizeof(double), compare_double);
+	printf("%8d %10d %8.1f %8.1f %12.1f %8d\n", shards, identifies, lat[identifies / 2],
+		lat[identifies * 99 / 100], (double)found / identifies, failures);
+
+	free(lat);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int identifies = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_IDENTIFIES;
+	ShardStats stats;
+
+	face_login(url, "bench");
+	face_set_large_groups(1);
+
+	printf("%8s %10s %8s %8s %12s %8s\n", "shards", "identifies", "p50", "p99", "candidates", "failed");
+
+	run(1, identifies);
+	run(4, identifies);
+	run(16, identifies);
+	run(64, identifies);
+
+	face_get_shard_stats(&stats);
+	printf("\n%lu identifies sent as %lu shard calls, %lu failed\n", stats.identifies, stats.calls, stats.failed);
+
+	return 0;
+}
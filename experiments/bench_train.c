@@ -0,0 +1,122 @@
+/*
+ * File Name: bench_train.c
+ * File Description: Registers persons into a persongroup, training it
+ *                   after each one with face_train_pg and then with
+ *                   face_schedule_train, and compares the registration
+ *                   rate, the trains sent and the time until the group is
+ *                   trained. Start the mock server with some latency and
+ *                   trains that take a while, e.g.
+ *                   mock_server -d 20 -G 500
+ *
+ * Usage: bench_train [url] [persons]
+ */
+
+#include <stdint.h>
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define BENCH_DEFAULT_URL "http://127.0.0.1:8080"
+#define BENCH_DEFAULT_PERSONS 50
+#define BENCH_PGID "demo_train"
+#define BENCH_QUIET 200
+#define BENCH_POLL 100
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+/* waits for a train sent with face_train_pg to finish */
+static long wait_trained()
+{
+	struct json_object * resp;
+	struct json_object * status;
+	long code;
+	int done = 0;
+
+	while (!done) {
+		code = face_get_training_pg(BENCH_PGID, &resp);
+		done = code != 200 || (json_object_object_get_ex(resp, "status", &status)
+			&& strcmp(json_object_get_string(status), "running"));
+		json_object_put(resp);
+		if (!done) usleep(BENCH_POLL * 1000);
+	}
+
+	return code;
+}
+
+static void run(const char * name, int scheduled, int persons)
+{
+	FaceBody * body = face_body_acquire();
+	struct json_object * resp;
+	TrainStats before;
+	TrainStats after;
+	double start;
+	double registered;
+	long status = 200;
+	long trains = persons;
+	int i;
+
+	face_body_create_p(body, "person", NULL);
+	face_get_train_stats(&before);
+	start = now_ms();
+
+	for (i = 0; i < persons; ++i) {
+		face_create_p_body(BENCH_PGID, body, &resp);
+		json_object_put(resp);
+
+		if (scheduled) {
+			face_schedule_train(BENCH_PGID);
+		}
+		else {
+			face_train_pg(BENCH_PGID, &resp);
+			json_object_put(resp);
+		}
+	}
+	registered = now_ms() - start;
+	face_body_release(body);
+
+	if (scheduled) {
+		status = (long)(intptr_t)face_future_wait(face_train_future(BENCH_PGID));
+		face_get_train_stats(&after);
+		trains = (long)(after.trains - before.trains);
+	}
+	else {
+		status = wait_trained();
+	}
+
+	printf("%-10s %10.1f %8ld %12.1f %8ld\n", name, persons * 1e3 / registered, trains,
+		now_ms() - start, status);
+}
+
+int main(int argc, char * argv[]) {
+	char * url = argc > 1 ? argv[1] : BENCH_DEFAULT_URL;
+	int persons = argc > 2 ? atoi(argv[2]) : BENCH_DEFAULT_PERSONS;
+	struct json_object * resp;
+	FaceBody * body;
+	TrainStats stats;
+
+	face_login(url, "bench");
+
+	body = face_body_acquire();
+	face_body_create_pg(body, "bench", NULL, NULL);
+	face_ensure_pg(BENCH_PGID, body, &resp);
+	json_object_put(resp);
+	face_body_release(body);
+
+	face_set_train_quiet(BENCH_QUIET);
+	face_set_train_poll(BENCH_POLL);
+
+	printf("%-10s %10s %8s %12s %8s\n", "", "persons/s", "trains", "trained ms", "status");
+
+	run("each", 0, persons);
+	run("scheduled", 1, persons);
+
+	face_get_train_stats(&stats);
+	printf("\n%lu changes marked, %lu trains sent, %lu polls, %lu failed\n", stats.marks, stats.trains,
+		stats.polls, stats.failed);
+
+	return 0;
+}
@@ -0,0 +1,614 @@
+/*
+ * File Name: mock_server.c
+ * File Description: A local stand-in for the Face API used by the
+ *                   experiments. It answers every endpoint with a canned
+ *                   response so the client can be measured without a
+ *                   subscription. Point the client at it with
+ *                   face_login("http://127.0.0.1:8080", "any key").
+ *
+ * Usage: mock_server [-p port] [-d delay_ms] [-t throttle_pct] [-e error_pct] [-r tps]
+ *                   [-c capacity] [-P period_s] [-L tail_pct] [-T tail_ms]
+ *                   [-H handshake_ms] [-I idle_s] [-R roster] [-G train_ms] [-F faces]
+ *                   [-X missing_pgid] [-z] [-v]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <zlib.h>
+
+#define MOCK_DEFAULT_PORT 8080
+#define MOCK_HEADER_SIZE 8192
+#define MOCK_BODY_SIZE 65536
+#define MOCK_RESPONSE_SIZE 65536
+#define MOCK_ROSTER_PERSON_SIZE 256		// room for one person of a roster listing
+#define MOCK_ROSTER_TOP 1000			// most persons listed per page, as the service does
+
+#define MOCK_DETECT_FACE "%s{\"faceId\":\"%s\",\"faceRectangle\":{\"top\":141,\"left\":%d,\"width\":205,\"height\":205},\"faceAttributes\":{\"gender\":\"male\",\"age\":31.0}}"
+#define MOCK_IDENTIFY_FACE "%s{\"faceId\":%.*s,\"candidates\":[{\"personId\":\"%s\",\"confidence\":%.2f}]}"
+#define MOCK_TRAINING "{\"status\":\"%s\"}"
+#define MOCK_VERIFY_RESULT "{\"isIdentical\":false,\"confidence\":0.1}"
+#define MOCK_PERSON_RESULT "{\"personId\":\"%s\"}"
+#define MOCK_FACE_RESULT "{\"persistedFaceId\":\"%s\"}"
+#define MOCK_ROSTER_PERSON "{\"personId\":\"%08x-4f7e-4a2b-9c1d-%012x\",\"name\":\"person_%d\",\"userData\":\"badge=%06d\",\"persistedFaceIds\":[\"%08x-0000-4000-8000-000000000001\",\"%08x-0000-4000-8000-000000000002\"]}"
+#define MOCK_PG_RESULT "{\"personGroupId\":\"demo_group\",\"name\":\"demo_group_1\",\"userData\":null}"
+#define MOCK_THROTTLED "{\"error\":{\"code\":\"RateLimitExceeded\",\"message\":\"Rate limit is exceeded\"}}"
+#define MOCK_UNAVAILABLE "{\"error\":{\"code\":\"ServiceUnavailable\",\"message\":\"Try again later\"}}"
+#define MOCK_NOT_FOUND "{\"error\":{\"code\":\"NotFound\",\"message\":\"Unknown path\"}}"
+#define MOCK_PG_NOT_FOUND "{\"error\":{\"code\":\"PersonGroupNotFound\",\"message\":\"Person group is not found\"}}"
+
+static int delay_ms = 0;			// fixed latency added to every response
+static int verbose = 0;				// print every request
+static int throttle_pct = 0;		// share of requests answered with 429
+static int error_pct = 0;			// share of requests answered with 503
+static double limit_tps = 0;		// requests per second allowed before 429; 0 is unlimited
+static double limit_tokens = 0;		// token bucket enforcing limit_tps
+static struct timespec limit_stamp;	// last refill of limit_tokens
+static pthread_mutex_t limit_lock = PTHREAD_MUTEX_INITIALIZER;
+static int capacity = 0;			// requests served at once before 429; 0 is unlimited
+static int capacity_period = 0;		// seconds between capacity drops and recoveries
+static int inflight = 0;			// requests being served
+static time_t started;				// start of the first capacity period
+static int tail_pct = 0;			// share of requests that are slow
+static int tail_ms = 0;				// extra latency of a slow request
+static int handshake_ms = 0;		// latency added to a new connection, like a tls handshake
+static int idle_s = 0;				// idle connections are closed after this; 0 keeps them
+static int roster = 0;				// persons listed by GET persons
+static int compress_gzip = 0;		// gzip responses for clients that accept it
+static int faces = 1;				// faces detect finds in every image
+static int train_ms = 0;			// a train runs this long; every group shares one clock
+static struct timespec train_stamp;	// when the last train was accepted
+static const char * missing_pg = NULL;	// persongroup that lives in another subscription
+static pthread_mutex_t train_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct tagMockRequest {
+	char method[16];
+	char path[1024];
+	long content_length;			// -1 if the body is chunked
+	int keep_alive;
+	int gzip;						// 1 if the client accepts gzip
+	size_t body_length;				// bytes of body received
+	char body[MOCK_BODY_SIZE];		// first MOCK_BODY_SIZE bytes of the body
+} MockRequest;
+
+typedef struct tagMockConn {
+	int fd;
+	char buffer[MOCK_HEADER_SIZE];	// bytes read but not consumed yet
+	size_t length;
+} MockConn;
+
+/* per thread random numbers; threads are seeded apart from each other */
+static int mock_rand()
+{
+	static unsigned int threads = 0;
+	static __thread unsigned int seed = 0;
+
+	if (!seed) {
+		seed = (unsigned int)time(NULL) ^ (__sync_add_and_fetch(&threads, 1) * 2654435761u);
+	}
+	return rand_r(&seed);
+}
+
+static void new_uuid(char * out)
+{
+	const char * hex = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < 36; ++i) {
+		if (i == 8 || i == 13 || i == 18 || i == 23) out[i] = '-';
+		else out[i] = hex[(mock_rand() >> 4) & 15];
+	}
+	out[36] = '\0';
+}
+
+/* reads at least one more byte into conn->buffer; 0 on EOF or error */
+static int conn_fill(MockConn * conn)
+{
+	ssize_t n;
+
+	if (conn->length == sizeof(conn->buffer)) return 0;
+	do {
+		n = read(conn->fd, conn->buffer + conn->length, sizeof(conn->buffer) - conn->length);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0) return 0;
+	conn->length += n;
+	return 1;
+}
+
+/* takes len bytes from the front of conn->buffer, reading more if needed */
+static int conn_take(MockConn * conn, MockRequest * rqst, size_t len)
+{
+	while (len) {
+		size_t n;
+		if (!conn->length && !conn_fill(conn)) return 0;
+
+		n = conn->length < len ? conn->length : len;
+		if (rqst->body_length < MOCK_BODY_SIZE - 1) {
+			size_t room = MOCK_BODY_SIZE - 1 - rqst->body_length;
+			memcpy(rqst->body + rqst->body_length, conn->buffer, n < room ? n : room);
+		}
+		rqst->body_length += n;
+		memmove(conn->buffer, conn->buffer + n, conn->length - n);
+		conn->length -= n;
+		len -= n;
+	}
+	return 1;
+}
+
+/* reads one line ending with \r\n from conn into line */
+static int conn_line(MockConn * conn, char * line, size_t size)
+{
+	char * end;
+
+	while (!(end = memchr(conn->buffer, '\n', conn->length))) {
+		if (!conn_fill(conn)) return 0;
+	}
+
+	size_t n = end - conn->buffer + 1;
+	size_t copy = n < size ? n : size - 1;
+	memcpy(line, conn->buffer, copy);
+	line[copy] = '\0';
+	memmove(conn->buffer, conn->buffer + n, conn->length - n);
+	conn->length -= n;
+	return 1;
+}
+
+static int read_request(MockConn * conn, MockRequest * rqst)
+{
+	char line[MOCK_HEADER_SIZE];
+	char version[16] = {0};
+
+	memset(rqst, 0, sizeof(MockRequest));
+	rqst->keep_alive = 1;
+
+	if (!conn_line(conn, line, sizeof(line))) return 0;
+	if (sscanf(line, "%15s %1023s %15s", rqst->method, rqst->path, version) != 3) return 0;
+
+	// reading headers
+	while (1) {
+		if (!conn_line(conn, line, sizeof(line))) return 0;
+		if (!strcmp(line, "\r\n") || !strcmp(line, "\n")) break;
+
+		if (!strncasecmp(line, "Content-Length:", 15)) {
+			rqst->content_length = atol(line + 15);
+		}
+		else if (!strncasecmp(line, "Transfer-Encoding:", 18) && strcasestr(line, "chunked")) {
+			rqst->content_length = -1;
+		}
+		else if (!strncasecmp(line, "Accept-Encoding:", 16) && strcasestr(line, "gzip")) {
+			rqst->gzip = 1;
+		}
+		else if (!strncasecmp(line, "Connection:", 11) && strcasestr(line, "close")) {
+			rqst->keep_alive = 0;
+		}
+		else if (!strncasecmp(line, "Expect:", 7) && strcasestr(line, "100-continue")) {
+			const char * cont = "HTTP/1.1 100 Continue\r\n\r\n";
+			if (write(conn->fd, cont, strlen(cont)) < 0) return 0;
+		}
+	}
+
+	// reading the body
+	if (rqst->content_length > 0) {
+		return conn_take(conn, rqst, rqst->content_length);
+	}
+
+	if (rqst->content_length < 0) {
+		while (1) {
+			long chunk;
+			if (!conn_line(conn, line, sizeof(line))) return 0;
+			chunk = strtol(line, NULL, 16);
+			if (!chunk) break;
+			if (!conn_take(conn, rqst, chunk)) return 0;
+			if (!conn_line(conn, line, sizeof(line))) return 0;		// chunk CRLF
+		}
+		// trailers end with an empty line
+		do {
+			if (!conn_line(conn, line, sizeof(line))) return 0;
+		} while (strcmp(line, "\r\n") && strcmp(line, "\n"));
+	}
+
+	return 1;
+}
+
+/* answers detect with faces side by side, each with its own faceId */
+static void detect_result(char * out, size_t size)
+{
+	char uuid[37];
+	size_t len = 0;
+	int i;
+
+	len += snprintf(out + len, size - len, "[");
+	for (i = 0; i < faces && len + 256 < size; ++i) {
+		new_uuid(uuid);
+		len += snprintf(out + len, size - len, MOCK_DETECT_FACE, i ? "," : "", uuid, 249 + i * 215);
+	}
+	snprintf(out + len, size - len, "]");
+}
+
+/* answers identify with one empty candidate list per faceId in the body */
+static void identify_result(MockRequest * rqst, char * out, size_t size)
+{
+	char * p = strstr(rqst->body, "\"faceIds\"");
+	char uuid[37];
+	size_t len = 0;
+	int first = 1;
+
+	len += snprintf(out + len, size - len, "[");
+	if (p && (p = strchr(p, '['))) {
+		char * end = strchr(p, ']');
+		while (end && (p = strchr(p + 1, '"')) && p < end) {
+			char * close = strchr(p + 1, '"');
+			if (!close || len + (close - p) + 128 >= size) break;
+			new_uuid(uuid);
+			len += snprintf(out + len, size - len, MOCK_IDENTIFY_FACE,
+				first ? "" : ",", (int)(close - p + 1), p, uuid, 0.5 + (mock_rand() % 50) / 100.0);
+			first = 0;
+			p = close;
+		}
+	}
+	snprintf(out + len, size - len, "]");
+}
+
+/* takes a token from the subscription's bucket; 0 if the rate is exceeded */
+static int limit_take()
+{
+	struct timespec now;
+	int ok;
+
+	pthread_mutex_lock(&limit_lock);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	limit_tokens += ((now.tv_sec - limit_stamp.tv_sec) + (now.tv_nsec - limit_stamp.tv_nsec) / 1e9) * limit_tps;
+	if (limit_tokens > limit_tps) limit_tokens = limit_tps;
+	limit_stamp = now;
+	ok = limit_tokens >= 1;
+	if (ok) limit_tokens -= 1;
+	pthread_mutex_unlock(&limit_lock);
+
+	return ok;
+}
+
+/* the first part of a roster person's id; spread over the whole range so
+   the roster can be split by personId */
+static unsigned roster_high(int i)
+{
+	return (unsigned)((unsigned long long)i * 0x100000000ULL / (unsigned)roster);
+}
+
+/* finds the first roster person whose id comes after start */
+static int roster_after(const char * start)
+{
+	char pid[64];
+	int low = 0;
+	int high = roster;
+	int mid;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		snprintf(pid, sizeof(pid), "%08x-4f7e-4a2b-9c1d-%012x", roster_high(mid), mid);
+		if (strcasecmp(pid, start) <= 0) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+/* lists a page of roster persons with made up but stable ids, in personId
+   order; query takes start, the personId listed last, and top */
+static void roster_result(const char * query, char * out, size_t size)
+{
+	char start[64] = "";
+	const char * param;
+	size_t len = 0;
+	int top = MOCK_ROSTER_TOP;
+	int first = 0;
+	int i;
+
+	if (query && (param = strstr(query, "start=")) && sscanf(param, "start=%63[^&]", start) == 1) {
+		first = roster_after(start);
+	}
+	if (query && (param = strstr(query, "top="))) {
+		top = atoi(param + 4);
+		if (top <= 0 || top > MOCK_ROSTER_TOP) top = MOCK_ROSTER_TOP;
+	}
+
+	out[len++] = '[';
+	for (i = first; i < roster && i < first + top && len + MOCK_ROSTER_PERSON_SIZE < size; ++i) {
+		if (i > first) out[len++] = ',';
+		len += snprintf(out + len, size - len, MOCK_ROSTER_PERSON, roster_high(i), i, i, i, i, i);
+	}
+	snprintf(out + len, size - len, "]");
+}
+
+/* gzips len bytes of body into out; returns the compressed length, 0 on failure */
+static size_t gzip_body(const char * body, size_t len, char * out, size_t size)
+{
+	z_stream zs = {0};
+	size_t out_len = 0;
+
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 0;
+	zs.next_in = (Bytef *)body;
+	zs.avail_in = len;
+	zs.next_out = (Bytef *)out;
+	zs.avail_out = size;
+	if (deflate(&zs, Z_FINISH) == Z_STREAM_END) {
+		out_len = zs.total_out;
+	}
+	deflateEnd(&zs);
+	return out_len;
+}
+
+static int route(MockRequest * rqst, char * out, size_t size)
+{
+	char uuid[37];
+	char * path = rqst->path;
+	char * query = strchr(path, '?');
+	char * p;
+
+	if (query) *query++ = '\0';
+	new_uuid(uuid);
+	out[0] = '\0';
+
+	if (limit_tps > 0 && !limit_take()) {
+		snprintf(out, size, MOCK_THROTTLED);
+		return 429;
+	}
+
+	// a group of another subscription, as after routing to the wrong one
+	if (missing_pg && (p = strstr(path, "groups/")) && !strncmp(p + 7, missing_pg, strlen(missing_pg))
+		&& (!p[7 + strlen(missing_pg)] || p[7 + strlen(missing_pg)] == '/')) {
+		snprintf(out, size, MOCK_PG_NOT_FOUND);
+		return 404;
+	}
+
+	if (throttle_pct || error_pct) {
+		int roll = mock_rand() % 100;
+		if (roll < throttle_pct) {
+			snprintf(out, size, MOCK_THROTTLED);
+			return 429;
+		}
+		if (roll < throttle_pct + error_pct) {
+			snprintf(out, size, MOCK_UNAVAILABLE);
+			return 503;
+		}
+	}
+
+	if (!strcmp(rqst->method, "POST")) {
+		if (strstr(path, "/detect")) {
+			detect_result(out, size);
+			return 200;
+		}
+		if (strstr(path, "/identify")) {
+			identify_result(rqst, out, size);
+			return 200;
+		}
+		if (strstr(path, "/verify")) {
+			snprintf(out, size, MOCK_VERIFY_RESULT);
+			return 200;
+		}
+		if (strstr(path, "/train")) {
+			pthread_mutex_lock(&train_lock);
+			clock_gettime(CLOCK_MONOTONIC, &train_stamp);
+			pthread_mutex_unlock(&train_lock);
+			return 202;
+		}
+		if (strstr(path, "/persistedFaces") || strstr(path, "/persistedfaces")) {
+			snprintf(out, size, MOCK_FACE_RESULT, uuid);
+			return 200;
+		}
+		if (strstr(path, "/persons")) {
+			snprintf(out, size, MOCK_PERSON_RESULT, uuid);
+			return 200;
+		}
+	}
+	else if (!strcmp(rqst->method, "GET")) {
+		if (strstr(path, "/persons")) {
+			roster_result(query, out, size);
+			return 200;
+		}
+		if (strstr(path, "/training")) {
+			struct timespec now;
+			double ran;
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			pthread_mutex_lock(&train_lock);
+			ran = (now.tv_sec - train_stamp.tv_sec) * 1e3 + (now.tv_nsec - train_stamp.tv_nsec) / 1e6;
+			snprintf(out, size, MOCK_TRAINING, ran < train_ms ? "running" : "succeeded");
+			pthread_mutex_unlock(&train_lock);
+			return 200;
+		}
+		if (strstr(path, "persongroups/")) {
+			snprintf(out, size, MOCK_PG_RESULT);
+			return 200;
+		}
+	}
+	else if (!strcmp(rqst->method, "PUT") || !strcmp(rqst->method, "DELETE")
+		|| !strcmp(rqst->method, "PATCH")) {
+		return 200;
+	}
+
+	snprintf(out, size, MOCK_NOT_FOUND);
+	return 404;
+}
+
+/* capacity right now; every other period it drops to a third */
+static int current_capacity()
+{
+	if (!capacity_period || !(((time(NULL) - started) / capacity_period) % 2)) return capacity;
+	return capacity / 3 > 1 ? capacity / 3 : 1;
+}
+
+static const char * status_text(int status)
+{
+	switch (status) {
+		case 200: return "OK";
+		case 202: return "Accepted";
+		case 404: return "Not Found";
+		case 429: return "Too Many Requests";
+		case 503: return "Service Unavailable";
+		default: return "Unknown";
+	}
+}
+
+static void * serve(void * arg)
+{
+	MockConn * conn = (MockConn *)arg;
+	MockRequest * rqst = (MockRequest *)malloc(sizeof(MockRequest));
+	size_t body_size = MOCK_RESPONSE_SIZE + (size_t)MOCK_ROSTER_TOP * MOCK_ROSTER_PERSON_SIZE;
+	char * body = (char *)malloc(body_size);
+	char * zipped = compress_gzip ? (char *)malloc(body_size + 64) : NULL;
+	char header[512];
+	struct timeval idle = { .tv_sec = idle_s };
+
+	if (idle_s) {
+		setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+	}
+	if (handshake_ms) {
+		usleep((useconds_t)handshake_ms * 1000);
+	}
+
+	while (rqst && body && read_request(conn, rqst)) {
+		int load = __sync_add_and_fetch(&inflight, 1);
+		int cap = capacity ? current_capacity() : 0;
+		int overloaded = cap && load > cap;
+		int status;
+		const char * out;
+		size_t blen;
+		size_t zlen = 0;
+		int hlen;
+
+		if (overloaded) {
+			snprintf(body, body_size, MOCK_THROTTLED);
+			status = 429;
+		}
+		else {
+			status = route(rqst, body, body_size);
+		}
+		blen = strlen(body);
+		out = body;
+
+		if (zipped && rqst->gzip && blen) {
+			zlen = gzip_body(body, blen, zipped, body_size + 64);
+			if (zlen) {
+				out = zipped;
+				blen = zlen;
+			}
+		}
+
+		if (verbose) {
+			printf("%s %s %zu bytes%s -> %d\n", rqst->method, rqst->path, rqst->body_length,
+				rqst->content_length < 0 ? " (chunked)" : "", status);
+			fflush(stdout);
+		}
+
+		// latency grows as the service fills up; overload is rejected at once
+		if (delay_ms && !overloaded) {
+			usleep((useconds_t)(delay_ms * 1000 * (cap ? 1.0 + (double)load / cap : 1.0)));
+		}
+		if (tail_pct && !overloaded && mock_rand() % 100 < tail_pct) {
+			usleep(tail_ms * 1000);
+		}
+		__sync_sub_and_fetch(&inflight, 1);
+
+		hlen = snprintf(header, sizeof(header),
+			"HTTP/1.1 %d %s\r\nContent-Type: application/json; charset=utf-8\r\n"
+			"Content-Length: %zu\r\n%s%s%s\r\n",
+			status, status_text(status), blen, status == 429 && !overloaded ? "Retry-After: 1\r\n" : "",
+			zlen ? "Content-Encoding: gzip\r\n" : "",
+			rqst->keep_alive ? "" : "Connection: close\r\n");
+
+		if (write(conn->fd, header, hlen) < 0) break;
+		if (blen && write(conn->fd, out, blen) < 0) break;
+		if (!rqst->keep_alive) break;
+	}
+
+	free(zipped);
+	free(body);
+	free(rqst);
+	close(conn->fd);
+	free(conn);
+	return NULL;
+}
+
+int main(int argc, char * argv[])
+{
+	int port = MOCK_DEFAULT_PORT;
+	struct sockaddr_in addr = {0};
+	int one = 1;
+	int opt;
+	int sock;
+
+	while ((opt = getopt(argc, argv, "p:d:t:e:r:c:P:L:T:H:I:R:G:F:X:zv")) != -1) {
+		switch (opt) {
+			case 'p': port = atoi(optarg); break;
+			case 'd': delay_ms = atoi(optarg); break;
+			case 't': throttle_pct = atoi(optarg); break;
+			case 'e': error_pct = atoi(optarg); break;
+			case 'r': limit_tps = atof(optarg); break;
+			case 'c': capacity = atoi(optarg); break;
+			case 'P': capacity_period = atoi(optarg); break;
+			case 'L': tail_pct = atoi(optarg); break;
+			case 'T': tail_ms = atoi(optarg); break;
+			case 'H': handshake_ms = atoi(optarg); break;
+			case 'I': idle_s = atoi(optarg); break;
+			case 'R': roster = atoi(optarg); break;
+			case 'G': train_ms = atoi(optarg); break;
+			case 'F': faces = atoi(optarg); break;
+			case 'X': missing_pg = optarg; break;
+			case 'z': compress_gzip = 1; break;
+			case 'v': verbose = 1; break;
+			default:
+				fprintf(stderr, "Usage: %s [-p port] [-d delay_ms] [-t throttle_pct] [-e error_pct] [-r tps]"
+					" [-c capacity] [-P period_s] [-L tail_pct] [-T tail_ms]"
+					" [-H handshake_ms] [-I idle_s] [-R roster] [-G train_ms] [-F faces] [-X missing_pgid] [-z] [-v]\n",
+					argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	limit_tokens = limit_tps;
+	started = time(NULL);
+	clock_gettime(CLOCK_MONOTONIC, &limit_stamp);
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) || listen(sock, 128)) {
+		fprintf(stderr, "Can't listen on port %d: %s\n", port, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	printf("mock server listening on http://127.0.0.1:%d\n", port);
+	fflush(stdout);
+
+	while (1) {
+		pthread_t thread;
+		MockConn * conn = (MockConn *)calloc(1, sizeof(MockConn));
+
+		conn->fd = accept(sock, NULL, NULL);
+		if (conn->fd < 0) {
+			free(conn);
+			continue;
+		}
+		setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		pthread_create(&thread, NULL, serve, conn);
+		pthread_detach(thread);
+	}
+
+	return 0;
+}
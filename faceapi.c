@@ -1,20 +1,12 @@
 
+#include <ctype.h>
+#include <strings.h>
 #include "faceapi.h"
 #include "faceapi_strings.h"
-
-static char region[BUFSIZ];
-static char key[BUFSIZ];
-static char login = 0;		// check if user have logged in
-
-Queue * request_queue;
-Queue * response_queue;
-
-sem_t request_counter;
-pthread_t request_thread;
-pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+#include "faceapi_internal.h"
 
 void setUriParam(CURLU * curlu, const char * name, struct json_object * value);
-void setUriBase(CURLU * curlu, const char * base);
+void setUriBase(CURLU * curlu, const char * rg, const char * base);
 int statusOk(long status);
 int reg_result_append(Table * table, void * item);
 int detect_result_append(Table * table, void * item);
@@ -27,7 +19,7 @@ void * queue_rear(Queue * queue);
 void * queue_front(Queue * queue);
 int dequeue(Queue * queue);
 int enqueue(Queue * queue, void * item);
-void * request();
+void * request(void * client);
 
 typedef struct ReadData
 {
@@ -35,16 +27,87 @@ typedef struct ReadData
 	size_t length;			// this is the length of the readData
 } ReadData;
 
+typedef struct ResponseData
+{
+	json_tokener * tok;				// parses the body as it arrives
+	struct json_object * obj;		// the parsed body; NULL until it is complete
+	size_t length;					// bytes of body received, once decompressed
+	int invalid;					// 1 once the body is known not to be json
+	FaceElementFunc each;			// takes each element of an array body; may be NULL
+	void * each_data;				// passed to each
+	int stream;						// FACE_STREAM_*: how the body is being read
+	int depth;						// arrays and objects open around the current byte
+	int in_string;					// 1 inside a json string
+	int escape;						// 1 after a backslash inside a string
+	char * element;					// bytes of the element being read
+	size_t element_length;			// bytes in element
+	size_t element_size;			// bytes allocated for element
+	size_t index;					// elements read by this attempt
+	size_t delivered;				// elements handed to each over every attempt
+} ResponseData;
+
+typedef struct FileCursor
+{
+	int fd;							// descriptor the image is read from
+	off_t offset;					// where the next read starts
+	size_t length;					// bytes left to read
+} FileCursor;
+
+typedef enum JpegState
+{
+	FACE_JPEG_MARKER,		// expecting 0xff before a marker code
+	FACE_JPEG_CODE,			// expecting a marker code
+	FACE_JPEG_LENGTH_HI,	// expecting the high byte of a segment length
+	FACE_JPEG_LENGTH_LO,	// expecting the low byte of a segment length
+	FACE_JPEG_SKIP,			// inside a segment
+	FACE_JPEG_ENTROPY,		// inside scan data
+	FACE_JPEG_ENTROPY_FF	// 0xff seen inside scan data
+} JpegState;
+
+/**
+ * Description:
+ *		Starts the demo thread of the calling thread's client, see
+ *		face_client_bind. Does nothing if it is already running, so the
+ *		queues and the thread are only set up once
+ */
 void face_init() {
-	QueueType type = FACE_QUEUETYPE_REQUEST;
-	request_queue = queue_new(type, FACE_QUEUE_CAPACITY);
-	type = FACE_QUEUETYPE_RESPONSE;
-	response_queue = queue_new(type, FACE_QUEUE_CAPACITY);
-	sem_init(&request_counter, 0, 0);
-	pthread_create(&request_thread, NULL, request, NULL);
+	FaceClient * client = face_client_current();
+
+	pthread_mutex_lock(&client->task_lock);
+	if (client->demo) {
+		pthread_mutex_unlock(&client->task_lock);
+		return;
+	}
+
+	client->request_queue = queue_new(FACE_QUEUETYPE_REQUEST, FACE_QUEUE_CAPACITY);
+	client->response_queue = queue_new(FACE_QUEUETYPE_RESPONSE, FACE_QUEUE_CAPACITY);
+	sem_init(&client->request_counter, 0, 0);
+	if (pthread_create(&client->request_thread, NULL, request, client)) {
+		fprintf(stderr, "Error: can't start the request thread\n");
+		queue_free(client->request_queue);
+		queue_free(client->response_queue);
+		sem_destroy(&client->request_counter);
+		pthread_mutex_unlock(&client->task_lock);
+		return;
+	}
+	client->demo = 1;
+	pthread_mutex_unlock(&client->task_lock);
 }
 
+/**
+ * Description:
+ *		Stops the demo thread of the calling thread's client
+ */
 void face_cleanup() {
+	face_client_demo_stop(face_client_current());
+}
+
+/**
+ * Description:
+ *		Stops the demo thread of a client once it has run every request
+ *		queued before, and frees its queues
+ */
+void face_client_demo_stop(FaceClient * client) {
 	Request rqst = {
 		.rqst_type = FACE_RQSTTYPE_END,
 		.file = NULL,
@@ -53,52 +116,51 @@ void face_cleanup() {
 		.rqst_func = NULL
 	};
 
-	// wait and send end signal if request_queue is full
-	while (enqueue(request_queue, &rqst)) {
-		sleep(1);
+	pthread_mutex_lock(&client->task_lock);
+	if (!client->demo) {
+		pthread_mutex_unlock(&client->task_lock);
+		return;
 	}
-	sem_post(&request_counter);
+	client->demo = 0;
+	pthread_mutex_unlock(&client->task_lock);
 
-	// testing
-	printf("Test cleanup\n");
-
-	while (1) {
-		// testing
-		printf("test cleanup while loop\n");
-		if (((Response *)(queue_rear(response_queue)))->resp_type == FACE_RQSTTYPE_END) {
-			queue_free(request_queue);
-			queue_free(response_queue);
-			break;
-		}
+	// wait and send end signal if request_queue is full
+	while (enqueue(client->request_queue, &rqst)) {
 		sleep(1);
 	}
+	sem_post(&client->request_counter);
+
+	pthread_join(client->request_thread, NULL);
+	queue_free(client->request_queue);
+	queue_free(client->response_queue);
+	sem_destroy(&client->request_counter);
+	client->request_queue = NULL;
+	client->response_queue = NULL;
 }
 
-void * request() {
+void * request(void * arg) {
+	FaceClient * client = arg;
+	Queue * request_queue = client->request_queue;
+	Queue * response_queue = client->response_queue;
+
+	// requests made from this thread go through the client that owns it
+	face_client_bind(client);
 
-	// detach this thread from main thread
-	pthread_detach(pthread_self());
+	// every demo works on the demo persongroup; keeping detect on the
+	// subscription owning it so its faceIds can be identified
+	face_set_affinity(FACE_DEMO_PGID);
 
 	while(1) {
 
 		// thread will only be activated when sem_post is called
-		sem_wait(&request_counter);
+		sem_wait(&client->request_counter);
 
 		// retrieve latest request from request_queue
 		Request * rqst = queue_rear(request_queue);
 
-		// send program end signal
+		// program end signal; whatever is left in response_queue is
+		// freed with it
 		if (rqst->rqst_type == FACE_RQSTTYPE_END) {
-			Response resp = {
-				.resp_type = rqst->rqst_type,
-				.table = NULL,
-				.file = NULL
-			};
-
-			// wait and pass on end signal if response_queue is full
-			while (enqueue(response_queue, &resp)) {
-				sleep(1);
-			}
 			break;	// closes this thread
 		}
 
@@ -127,67 +189,227 @@ void * request() {
 }
 
 Response * getResponse() {
-	if (queue_isempty(response_queue)) {
+	FaceClient * client = face_client_current();
+	Response * resp;
+
+	if (!client->demo || queue_isempty(client->response_queue)) {
 		return NULL;
 	}
-	Response * resp = queue_rear(response_queue);
-	dequeue(response_queue);
+	resp = queue_rear(client->response_queue);
+	dequeue(client->response_queue);
 	return resp;
 }
 
+/**
+ * Description:
+ *		Parses the element of an array body read so far and hands it to
+ *		each. Elements a failed attempt handed over already are skipped
+ */
+static void response_element(ResponseData * parse)
+{
+	struct json_object * element;
+
+	if (!parse->element_length) return;
+
+	element = json_tokener_parse(parse->element);
+	parse->element_length = 0;
+
+	if (element && parse->index++ >= parse->delivered) {
+		parse->each(element, parse->each_data);
+		parse->delivered++;
+	}
+	json_object_put(element);
+}
+
+/**
+ * Description:
+ *		Splits an array body into its elements as it arrives, so only one
+ *		element is held at a time however long the array is. A body that is
+ *		not an array, e.g. an error, is parsed whole as usual
+ */
+static void response_stream(ResponseData * parse, const char * data, size_t len)
+{
+	char * element;
+	size_t size;
+	size_t i;
+	char c;
+
+	for (i = 0; i < len; ++i) {
+		c = data[i];
+
+		if (parse->stream == FACE_STREAM_UNKNOWN) {
+			if (isspace((unsigned char)c)) continue;
+			if (c != '[') {
+				parse->stream = FACE_STREAM_WHOLE;
+				parse->obj = json_tokener_parse_ex(parse->tok, data + i, (int)(len - i));
+				if (!parse->obj && json_tokener_get_error(parse->tok) != json_tokener_continue) {
+					parse->invalid = 1;
+				}
+				return;
+			}
+			parse->stream = FACE_STREAM_ARRAY;
+			parse->depth = 1;
+			continue;
+		}
+
+		// anything after the array is ignored
+		if (!parse->depth) return;
+
+		if (!parse->in_string) {
+			if (c == '"') {
+				parse->in_string = 1;
+			}
+			else if (c == '[' || c == '{') {
+				parse->depth++;
+			}
+			else if (c == ']' || c == '}') {
+				if (!--parse->depth) {
+					response_element(parse);
+					return;
+				}
+			}
+			else if (parse->depth == 1 && (c == ',' || isspace((unsigned char)c))) {
+				if (c == ',') {
+					response_element(parse);
+				}
+				continue;
+			}
+		}
+		else if (parse->escape) {
+			parse->escape = 0;
+		}
+		else if (c == '\\') {
+			parse->escape = 1;
+		}
+		else if (c == '"') {
+			parse->in_string = 0;
+		}
+
+		if (parse->element_length + 1 >= parse->element_size) {
+			size = parse->element_size ? parse->element_size * 2 : FACE_BODY_INIT_SIZE;
+			element = (char *)realloc(parse->element, size);
+			if (!element) {
+				parse->invalid = 1;
+				parse->depth = 0;
+				return;
+			}
+			parse->element = element;
+			parse->element_size = size;
+		}
+		parse->element[parse->element_length++] = c;
+		parse->element[parse->element_length] = '\0';
+	}
+}
+
 /**
  * Description:
  *		This method is repeatedly called by curl_easy_setopt(curl, WRITEDATA, response)
- *		until all the contents in the http response is written into response
+ *		with the response body as it arrives, already decompressed by libcurl
+ *		if it was sent compressed. The body is fed to the json parser right
+ *		away instead of being collected first
  * 
  * Params: 
  *		contents: where the response will be written from
  *		size: size of the element to be written
  *		nmemb: number of elements to write; in this function this is always 1
- *		response: return parameter; accumulates the data written from this
- *		  			  function to form the complete http response
+ *		response: return parameter; ResponseData parsing the body
  *
  * Return:
  *		size of the data written
  */
 static size_t write_callback(void * contents, size_t size, size_t nmemb, void * response)
 {
-	errno = 0;								// setting errno for error detection
-	char * buffer = NULL;					// buffer for response in case realloc fail
+	ResponseData * parse = (ResponseData *)response;
+	size_t len = size * nmemb;
+
+	parse->length += len;
+
+#ifdef _DEBUG_
+	fprintf(stderr, FACE_WRITE_DATA, len);
+#endif
+
+	// anything after the first json value is ignored, as before
+	if (parse->obj || parse->invalid || !len) {
+		return len;
+	}
 
-	// copy from response if response is not null
-	if (((ReadData *)response)->content) {
-		buffer = ((ReadData *)response)->content;	
+	if (parse->each && parse->stream != FACE_STREAM_WHOLE) {
+		response_stream(parse, contents, len);
+		return len;
 	}
 
-	// dynamically adjust the buffer size
-	buffer = realloc(buffer, ((ReadData *)response)->length + size * nmemb);
+	parse->obj = json_tokener_parse_ex(parse->tok, contents, (int)len);
+	if (!parse->obj && json_tokener_get_error(parse->tok) != json_tokener_continue) {
+		parse->invalid = 1;
+	}
 
-	// setting pointer pointing to where memcpy should start copying to
-	char * start = buffer + ((ReadData *)response)->length;
+	return len;
+}
 
-	// checking for no memory error for realloc
-	if (errno == ENOMEM) {
-		fprintf(stderr, "Error: not enough memory\n");
-		free(buffer);
-		return EXIT_FAILURE;
+/**
+ * Description:
+ *		Gets a ResponseData ready for a new response, dropping what it
+ *		parsed so far
+ *
+ * Return:
+ *		0 if successful
+ */
+static int response_reset(ResponseData * response)
+{
+	if (!response->tok) {
+		response->tok = json_tokener_new();
+		if (!response->tok) {
+			fprintf(stderr, "Error: not enough memory\n");
+			return -1;
+		}
+	}
+	else {
+		json_tokener_reset(response->tok);
+	}
+
+	if (response->obj) {
+		json_object_put(response->obj);
 	}
+	response->obj = NULL;
+	response->length = 0;
+	response->invalid = 0;
 
-	// updating ReadData length
-	((ReadData *)response)->length += (size * nmemb);
+	// what was handed to each stays handed
+	response->stream = FACE_STREAM_UNKNOWN;
+	response->depth = 0;
+	response->in_string = 0;
+	response->escape = 0;
+	response->element_length = 0;
+	response->index = 0;
+	return 0;
+}
 
-	// copying the content to the response
-	memcpy(start, contents, size * nmemb);
+/**
+ * Description:
+ *		Ends the parse of a response and frees the parser
+ *
+ * Return:
+ *		the parsed body; NULL if it was empty or not json
+ */
+static struct json_object * response_finish(ResponseData * response)
+{
+	struct json_object * obj = response->obj;
 
-	// point the updated memory back to response
-	((ReadData *)response)->content = buffer;
+	// a number at the very end is only known to be over at the end
+	if (!obj && !response->invalid && response->length && response->tok && response->stream != FACE_STREAM_ARRAY) {
+		obj = json_tokener_parse_ex(response->tok, "", 1);
+	}
 
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_WRITE_DATA, size * nmemb);
-#endif
+	free(response->element);
+	response->element = NULL;
+	response->element_size = 0;
 
-	// return actual bytes written
-	return size * nmemb;
+	if (response->tok) {
+		json_tokener_free(response->tok);
+	}
+	response->tok = NULL;
+	response->obj = NULL;
+	return obj;
 }
 
 /**
@@ -216,36 +438,44 @@ static size_t read_image(void * buffer, size_t size, size_t nmemb, void * image)
 }
 
 /**
- * Description: 
+ * Description:
  *		This method is repeatedly called by curl_easy_setopt(curl, READDATA, response)
- *		until all the text is read into the buffer
+ *		until all the image data is read into the buffer. Unlike read_image it
+ *		reads at its own offset, so two requests can send the same file at once
  * 
  * Params:
- *		buffer: return parameter; where the text will be read into
+ *		buffer: return parameter; where the image data will be read into
  *		size: size of the element to be read
  *		nmemb: number of elements to be read
- *		text: where the text will be read from
+ *		cursor: FileCursor of the image; advanced by the number of bytes read
  *
  * Return:
  *		size of the data read
  */
-static size_t read_text(void * buffer, size_t size, size_t nmemb, void * text)
+static size_t read_file(void * buffer, size_t size, size_t nmemb, void * cursor)
 {
-	size_t retcode;
+	FileCursor * file = (FileCursor *)cursor;
+	size_t len = size * nmemb;
+	ssize_t retcode;
 
-	char * str = (char *)text;
-
-	if ((strlen(str) + 1) > (size * nmemb)) {
-		retcode = size * nmemb;
+	if (len > file->length) {
+		len = file->length;
 	}
-	else {
-		retcode = strlen(str) + 1;
+
+	do {
+		retcode = pread(file->fd, buffer, len, file->offset);
+	} while (retcode < 0 && errno == EINTR);
+
+	if (retcode < 0) {
+		fprintf(stderr, "Read Error: %s\n", strerror(errno));
+		return CURL_READFUNC_ABORT;
 	}
 
-	memcpy(buffer, text, retcode);
+	file->offset += retcode;
+	file->length -= retcode;
 
 #ifdef _DEBUG_
-	fprintf(stderr, FACE_READ_TEXT, retcode);
+	fprintf(stderr, FACE_READ_IMAGE, (size_t)retcode);
 #endif
 
 	return retcode;
@@ -253,1688 +483,2001 @@ static size_t read_text(void * buffer, size_t size, size_t nmemb, void * text)
 
 /**
  * Description:
- *		Sets the region and subscription key for calling Face API
+ *		This method is repeatedly called by curl_easy_setopt(curl, READDATA, response)
+ *		when the image size is unknown. Unlike read_image it returns as soon
+ *		as any data is available so the image is sent as it is produced.
+ *		The stream must not have been read through stdio before.
  *
  * Params:
- *		rg: sets the region
- *		ky: sets the subscription key
+ *		buffer: return parameter; where the image data will be read into
+ *		size: size of the element to be read
+ *		nmemb: number of elements to be read
+ *		stream: the FILE the image data will be read from
  *
  * Return:
- *		0 if successful; corresponding errno code if unsuccessful
+ *		size of the data read; 0 at the end of the stream
  */
-int face_login(char * rg, char * ky) {
-	errno = 0;
-	memset(region, 0, BUFSIZ);
-	memset(key, 0, BUFSIZ);
-	if (rg) {
-		strcpy(region, rg);
-	}
-	else {
-		strcpy(region, FACE_DEFAULT_REGION);
-	}
-	strcpy(key, ky);
+static size_t read_stream(void * buffer, size_t size, size_t nmemb, void * stream)
+{
+	ssize_t retcode;
 
-	if (errno) {
-		fprintf(stderr, "%s\n", strerror(errno));
-		return errno;
+	do {
+		retcode = read(fileno((FILE *)stream), buffer, size * nmemb);
+	} while (retcode < 0 && errno == EINTR);
+
+	if (retcode < 0) {
+		fprintf(stderr, "Read Error: %s\n", strerror(errno));
+		return CURL_READFUNC_ABORT;
 	}
-	login = 1;
-	return EXIT_SUCCESS;
+
+#ifdef _DEBUG_
+	fprintf(stderr, FACE_READ_IMAGE, (size_t)retcode);
+#endif
+
+	return retcode;
 }
 
 /**
  * Description:
- *		Creates a persongroup by calling PersonGroup Create (PUT)
+ *		Makes sure there are unread bytes in the frame stream's buffer,
+ *		reading whatever the producer has written so far if it is empty
  *
  * Params:
- *		pgid: the persongroupId chosed by the caller
- *		body: the request body
- *		resp: return parameter; collects the response
+ *		stream: the frame stream
  *
  * Return:
- *		http status code; -1 if user hasn't logged in via face_login
+ *		0 if there are bytes to read; -1 at the end of the stream or on error
  */
-long face_create_pg(char * pgid, struct json_object * body, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
+static int frame_stream_fill(FaceFrameStream * stream)
+{
+	ssize_t n;
 
-	errno = 0;						// setting errno for error detection
+	if (stream->start < stream->end) return 0;
+	if (stream->eof) return -1;
 
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
+	do {
+		n = read(stream->fd, stream->buffer, FACE_STREAM_BUFSIZE);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0) {
+		if (n < 0) fprintf(stderr, "Read Error: %s\n", strerror(errno));
+		stream->eof = 1;
 		return -1;
 	}
 
-	curlu = curl_url();
-
-	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-
-	// including the pgid in the request url
-	strcat(buffer, pgid);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		struct curl_slist * plist = curl_slist_append(NULL, FACE_JSON);
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		plist = curl_slist_append(plist, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type (CURLOPT_PUT is deprecated; use CURLOPT_UPLOAD instead)
-		curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
-
-		// setting read callback function and data
-		curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_text);
-		curl_easy_setopt(curl, CURLOPT_READDATA, json_object_to_json_string(body));
-
-		// setting size of request body
-		curl_easy_setopt(curl, CURLOPT_INFILESIZE, strlen(json_object_to_json_string(body)) + 1);
-
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
-
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
-
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
-
-		curl_slist_free_all(plist);
+	stream->start = 0;
+	stream->end = n;
+	return 0;
+}
 
-		/* always cleanup */
-		curl_easy_cleanup(curl);
+/**
+ * Description:
+ *		Feeds one byte of a JPEG image to the frame stream's parser. Segment
+ *		lengths are followed so that markers inside metadata (e.g. an EXIF
+ *		thumbnail) don't end the frame early
+ *
+ * Params:
+ *		stream: the frame stream
+ *		c: the next byte of the image
+ *
+ * Return:
+ *		1 if c is the last byte of the frame; 0 otherwise
+ */
+static int frame_stream_parse(FaceFrameStream * stream, unsigned char c)
+{
+	switch (stream->state) {
+		case FACE_JPEG_MARKER:
+			// 0xff may repeat as fill before a marker code
+			if (c == 0xFF) stream->state = FACE_JPEG_CODE;
+			return 0;
+
+		case FACE_JPEG_ENTROPY:
+			if (c == 0xFF) stream->state = FACE_JPEG_ENTROPY_FF;
+			return 0;
+
+		case FACE_JPEG_ENTROPY_FF:
+			// stuffed zero, restart markers and fill stay in scan data
+			if (c == 0x00 || (c >= 0xD0 && c <= 0xD7)) {
+				stream->state = FACE_JPEG_ENTROPY;
+				return 0;
+			}
+			if (c == 0xFF) return 0;
+			// any other code ends the scan
+			/* fall through */
+
+		case FACE_JPEG_CODE:
+			if (c == 0xFF) return 0;
+			if (c == 0xD9) {
+				stream->state = FACE_JPEG_MARKER;
+				return 1;
+			}
+			if (c == 0xD8 || c == 0x01 || (c >= 0xD0 && c <= 0xD7)) {
+				stream->state = FACE_JPEG_MARKER;
+				return 0;
+			}
+			stream->code = c;
+			stream->state = FACE_JPEG_LENGTH_HI;
+			return 0;
+
+		case FACE_JPEG_LENGTH_HI:
+			stream->skip = (size_t)c << 8;
+			stream->state = FACE_JPEG_LENGTH_LO;
+			return 0;
+
+		case FACE_JPEG_LENGTH_LO:
+			// the length counts its own two bytes
+			stream->skip |= c;
+			stream->skip = stream->skip > 2 ? stream->skip - 2 : 0;
+			stream->state = FACE_JPEG_SKIP;
+			if (stream->skip) return 0;
+			/* fall through */
+
+		case FACE_JPEG_SKIP:
+			if (stream->state == FACE_JPEG_SKIP && stream->skip) {
+				if (--stream->skip) return 0;
+			}
+			// scan data follows the start of scan header
+			stream->state = stream->code == 0xDA ? FACE_JPEG_ENTROPY : FACE_JPEG_MARKER;
+			return 0;
 	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
-
-	// printing http status code and latency
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
-
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+	return 0;
+}
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+/**
+ * Description:
+ *		Skips the frame stream forward to the next start of image marker
+ *
+ * Params:
+ *		stream: the frame stream
+ *
+ * Return:
+ *		0 if a frame was found; -1 at the end of the stream
+ */
+static int frame_stream_sync(FaceFrameStream * stream)
+{
+	int ff = 0;			// previous byte was 0xff
+
+	while (!frame_stream_fill(stream)) {
+		unsigned char c = stream->buffer[stream->start++];
+		if (ff && c == 0xD8) {
+			stream->state = FACE_JPEG_MARKER;
+			stream->soi = 2;
+			stream->done = 0;
+			return 0;
+		}
+		ff = (c == 0xFF);
+	}
 
-	return ret;
+	return -1;
 }
 
 /**
  * Description:
- *		detcts a face image from calling Face Detect (POST)
+ *		This method is repeatedly called by curl_easy_setopt(curl, READDATA, response)
+ *		to send one JPEG frame out of a FaceFrameStream. It stops right after
+ *		the frame's end of image marker, leaving the next frame in the stream
  *
  * Params:
- *		param: the query parameter of the request; use NULL for default
- *		body: the request body; needs to include the image url
- *		resp: return parameter; collects the response
+ *		buffer: return parameter; where the frame data will be read into
+ *		size: size of the element to be read
+ *		nmemb: number of elements to be read
+ *		stream: the FaceFrameStream the frame will be read from
  *
  * Return:
- *		http status code; -1 if user hasn't logged in via face_login
+ *		size of the data read; 0 at the end of the frame
  */
-long face_detect(struct json_object * param, struct json_object * body, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
+static size_t read_frame(void * buffer, size_t size, size_t nmemb, void * stream)
+{
+	FaceFrameStream * frames = (FaceFrameStream *)stream;
+	unsigned char * out = (unsigned char *)buffer;
+	size_t retcode = 0;
 
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
-		return -1;
-	}
+	if (frames->done) return 0;
 
-	curlu = curl_url();
+	// the start of image marker was consumed while looking for the frame
+	while (frames->soi && retcode < size * nmemb) {
+		out[retcode++] = frames->soi-- == 2 ? 0xFF : 0xD8;
+	}
+	if (retcode) return retcode;
 
-	// setting the request url
-	setUriBase(curlu, FACE_DETECT_URL);
+	// the stream ending in the middle of a frame fails the request
+	if (frame_stream_fill(frames)) return CURL_READFUNC_ABORT;
 
-	// setting request param
-	if (param) {
-		json_object_object_foreach(param, key, val) {
-			setUriParam(curlu, key, val);
+	while (retcode < size * nmemb && frames->start < frames->end) {
+		unsigned char c = frames->buffer[frames->start++];
+		out[retcode++] = c;
+		if (frame_stream_parse(frames, c)) {
+			frames->done = 1;
+			break;
 		}
 	}
 
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
 #ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
+	fprintf(stderr, FACE_READ_IMAGE, retcode);
 #endif
 
-	response = calloc(1, sizeof(ReadData));
+	return retcode;
+}
 
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
+/**
+ * Description:
+ *		Creates a frame stream that splits concatenated JPEG images, such as
+ *		the output of "ffmpeg -f mjpeg -" or gstreamer's jpegenc ! fdsink,
+ *		into frames for face_detect_frame
+ *
+ * Params:
+ *		fd: the descriptor frames are read from, e.g. a pipe or a socket
+ *
+ * Return:
+ *		the frame stream; NULL if out of memory
+ */
+FaceFrameStream * face_frame_stream_new(int fd) {
+	FaceFrameStream * stream = (FaceFrameStream *)calloc(1, sizeof(FaceFrameStream));
+	if (!stream) {
+		fprintf(stderr, "Calloc Error: %s\n", strerror(errno));
+		return NULL;
+	}
+	stream->fd = fd;
+	return stream;
+}
 
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		struct curl_slist * plist = curl_slist_append(NULL, FACE_JSON);
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		plist = curl_slist_append(plist, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_POST, 1L);
-
-		// setting posting data (request body)
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_object_to_json_string(body));
+/**
+ * Description:
+ *		Frees a frame stream; the descriptor is left open
+ *
+ * Params:
+ *		stream: the frame stream to be freed
+ */
+void face_frame_stream_free(FaceFrameStream * stream) {
+	free(stream);
+}
 
-		// libcurl will automatically measure the length of request body with
-		// strlen so no need to set CURLOPT_POSTFIELDSIZE
+/**
+ * Description:
+ *		Maps an image file into memory for uploading. Mappings are kept in
+ *		image_cache so that a file sent more than once in a batch (e.g. detect
+ *		followed by add face) is only opened and mapped once
+ *
+ * Params:
+ *		client: client whose image_cache keeps the mapping
+ *		path: path of the image file
+ *
+ * Return:
+ *		the mapping of the image; NULL if the file can't be mapped
+ */
+static ImageMap * image_map_acquire(FaceClient * client, const char * path)
+{
+	struct stat file_info;			// information of the image file
+	ImageMap * map = NULL;			// the mapping handed back
+	int fd;							// descriptor of the image file
+	int i;
 
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+	if (strlen(path) >= PATH_MAX) {
+		fprintf(stderr, "Error: image path too long\n");
+		return NULL;
+	}
 
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "Can't open file %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
 
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+	if (fstat(fd, &file_info) || !file_info.st_size) {
+		fprintf(stderr, "Can't map file %s: empty or unreadable\n", path);
+		close(fd);
+		return NULL;
+	}
 
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
+	pthread_mutex_lock(&client->image_cache_lock);
 
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
+	// reuse the mapping if the same unchanged file was mapped before
+	for (i = 0; i < FACE_IMAGE_CACHE_SIZE; ++i) {
+		ImageMap * slot = client->image_cache + i;
+		if (slot->data && slot->dev == file_info.st_dev && slot->ino == file_info.st_ino
+			&& slot->size == (size_t)file_info.st_size && slot->mtime == file_info.st_mtime) {
+			slot->refs++;
+			slot->used = ++client->image_clock;
+			pthread_mutex_unlock(&client->image_cache_lock);
+			close(fd);
+			return slot;
+		}
+	}
 
-		curl_slist_free_all(plist);
+	// pick an empty slot, or else the least recently used idle one
+	for (i = 0; i < FACE_IMAGE_CACHE_SIZE; ++i) {
+		ImageMap * slot = client->image_cache + i;
+		if (slot->refs) continue;
+		if (!map || !slot->data || (map->data && slot->used < map->used)) {
+			map = slot;
+		}
+	}
 
-		/* always cleanup */
-		curl_easy_cleanup(curl);
+	if (map) {
+		if (map->data) {
+			munmap(map->data, map->size);
+			map->data = NULL;
+		}
+		map->cached = 1;
+	}
+	else {
+		// every slot is in use; hand out a mapping that isn't cached
+		map = (ImageMap *)calloc(1, sizeof(ImageMap));
+		if (!map) {
+			pthread_mutex_unlock(&client->image_cache_lock);
+			close(fd);
+			return NULL;
+		}
 	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
 
-	// printing http status code
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
+	map->data = mmap(NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);		// the mapping stays valid without the descriptor
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
+	if (map->data == MAP_FAILED) {
+		fprintf(stderr, "Can't map file %s: %s\n", path, strerror(errno));
+		map->data = NULL;
+		if (!map->cached) free(map);
+		pthread_mutex_unlock(&client->image_cache_lock);
+		return NULL;
+	}
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+	// the image is read front to back exactly once per upload
+	madvise(map->data, file_info.st_size, MADV_SEQUENTIAL);
+	madvise(map->data, file_info.st_size, MADV_WILLNEED);
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+	strcpy(map->path, path);
+	map->dev = file_info.st_dev;
+	map->ino = file_info.st_ino;
+	map->mtime = file_info.st_mtime;
+	map->size = file_info.st_size;
+	map->refs = 1;
+	map->used = ++client->image_clock;
 
-	return ret;
+	pthread_mutex_unlock(&client->image_cache_lock);
+	return map;
 }
 
 /**
  * Description:
- *		detects a face image by calling Face Detect (POST)
- * 
- * Params: 
- *		image: the binary face image file to be detected
- *		fsize: the size of the image file
- *      param: the query parameter of the request; use NULL for default
- *		resp: return parameter; collects the response
+ *		Gives back a mapping acquired with image_map_acquire; the mapping
+ *		stays in image_cache until it is evicted or face_image_cache_flush
+ *		is called
  *
- * return:
- *		http status code; -1 if user hasn't logged in with face_login
+ * Params:
+ *		client: the client passed to image_map_acquire
+ *		map: the mapping to be released
  */
-long face_detect_local(FILE * image, size_t fsize, json_object * param, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
-
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
-		return -1;
+static void image_map_release(FaceClient * client, ImageMap * map)
+{
+	pthread_mutex_lock(&client->image_cache_lock);
+	map->refs--;
+	if (!map->cached) {
+		munmap(map->data, map->size);
+		free(map);
 	}
+	pthread_mutex_unlock(&client->image_cache_lock);
+}
 
-	curlu = curl_url();
-
-	// setting the request url
-	setUriBase(curlu, FACE_DETECT_URL);
+/**
+ * Description:
+ *		Unmaps every idle image kept by face_detect_path and
+ *		face_add_face_path; call it at the end of a batch
+ */
+void face_image_cache_flush() {
+	FaceClient * client = face_client_current();
+	int i;
 
-	// setting request parameter
-	if (param) {
-		json_object_object_foreach(param, key, val) {
-			setUriParam(curlu, key, val);
+	pthread_mutex_lock(&client->image_cache_lock);
+	for (i = 0; i < FACE_IMAGE_CACHE_SIZE; ++i) {
+		ImageMap * slot = client->image_cache + i;
+		if (slot->data && !slot->refs) {
+			munmap(slot->data, slot->size);
+			memset(slot, 0, sizeof(ImageMap));
 		}
 	}
+	pthread_mutex_unlock(&client->image_cache_lock);
+}
 
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-#ifdef _DEBUG_
-	printf("Image file size: %" CURL_FORMAT_CURL_OFF_T " bytes.\n", fsize);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		struct curl_slist * plist = curl_slist_append(NULL, FACE_OCTET);
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		plist = curl_slist_append(plist, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_POST, 1L);
-
-		// need to set CURLOPT_POSTFIELD option to NULL for libcurl to get
-		// post data from read callback
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
+/**
+ * Description:
+ *		This method is called by curl_easy_setopt(curl, HEADERFUNCTION, header)
+ *		once for every response header; it picks out Retry-After
+ *
+ * Params:
+ *		buffer: the header line, not null terminated
+ *		size: always 1
+ *		nitems: length of the header line
+ *		retry_after: return parameter; the Retry-After wait in ms
+ *
+ * Return:
+ *		size of the data handled
+ */
+static size_t header_callback(char * buffer, size_t size, size_t nitems, void * retry_after)
+{
+	size_t len = size * nitems;
+	size_t prefix = strlen(FACE_RETRY_AFTER);
+	char value[64];
 
-		// setting post data size
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, fsize);
+	if (len > prefix && len - prefix < sizeof(value)
+		&& !strncasecmp(buffer, FACE_RETRY_AFTER, prefix)) {
+		memcpy(value, buffer + prefix, len - prefix);
+		value[len - prefix] = '\0';
+		*(long *)retry_after = face_retry_after_parse(value);
+	}
 
-		// setting read callback function and data
-		curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_image);
-		curl_easy_setopt(curl, CURLOPT_READDATA, image);
+	return len;
+}
 
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+/**
+ * Description: 
+ *		This method is repeatedly called by curl_easy_setopt(curl, READDATA, response)
+ *		until all the text is read into the buffer
+ * 
+ * Params:
+ *		buffer: return parameter; where the text will be read into
+ *		size: size of the element to be read
+ *		nmemb: number of elements to be read
+ *		text: ReadData holding the text that is left to be sent; advanced
+ *			  by the number of bytes read on every call
+ *
+ * Return:
+ *		size of the data read
+ */
+static size_t read_text(void * buffer, size_t size, size_t nmemb, void * text)
+{
+	ReadData * upload = (ReadData *)text;
+	size_t retcode = size * nmemb;
 
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
+	// only copy what is left of the text
+	if (retcode > upload->length) {
+		retcode = upload->length;
+	}
 
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+	memcpy(buffer, upload->content, retcode);
 
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
+	// advance the cursor past the data handed to libcurl
+	upload->content += retcode;
+	upload->length -= retcode;
 
 #ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
+	fprintf(stderr, FACE_READ_TEXT, retcode);
 #endif
 
-		curl_slist_free_all(plist);
-
-		/* always cleanup */
-		curl_easy_cleanup(curl);
-	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
+	return retcode;
+}
 
-	// printing http status code
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
+/**
+ * Description:
+ *		Makes sure body has room for len more bytes
+ *
+ * Params:
+ *		body: the body to be grown
+ *		len: number of bytes about to be written
+ *
+ * Return:
+ *		0 if successful; -1 if out of memory
+ */
+static int body_reserve(FaceBody * body, size_t len)
+{
+	char * buffer;
+	size_t capacity;
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
+	if (body->length + len + 1 <= body->capacity) {
+		return 0;
+	}
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+	// grow geometrically so repeated writes stay linear
+	capacity = body->capacity ? body->capacity : FACE_BODY_INIT_SIZE;
+	while (capacity < body->length + len + 1) {
+		capacity *= 2;
+	}
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+	buffer = realloc(body->content, capacity);
+	if (!buffer) {
+		fprintf(stderr, "Error: not enough memory\n");
+		return -1;
+	}
 
-	return ret;
+	body->content = buffer;
+	body->capacity = capacity;
+	return 0;
 }
 
 /**
  * Description:
- *		verifies two face images or a face image with a person by calling
- *		Face Verify (POST)
- * 
+ *		Appends len raw bytes to body and keeps it null terminated
+ *
  * Params:
- *		body: the request body; should either contain 2 faceIds or 1 faceId,
- *			  1 persongoupId, and 1 personId
- *		resp: return parameter; collects the response
+ *		body: the body to be written
+ *		str: the bytes to be appended
+ *		len: number of bytes to be appended
  *
- * return:
- *		http status code; -1 if user hasn't logged in with face_login
+ * Return:
+ *		0 if successful; -1 if out of memory
  */
-long face_verify(struct json_object * body, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
-
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
+static int body_write(FaceBody * body, const char * str, size_t len)
+{
+	if (body_reserve(body, len)) {
 		return -1;
 	}
+	memcpy(body->content + body->length, str, len);
+	body->length += len;
+	body->content[body->length] = '\0';
+	return 0;
+}
 
-	curlu = curl_url();
+/**
+ * Description:
+ *		Appends str to body as a quoted and escaped json string
+ *
+ * Params:
+ *		body: the body to be written
+ *		str: the string to be appended
+ *
+ * Return:
+ *		0 if successful; -1 if out of memory
+ */
+static int body_write_string(FaceBody * body, const char * str)
+{
+	const char * start = str;		// start of the run that needs no escaping
+	char escape[7] = {0};			// buffer for one escape sequence
 
-	// setting the request url
-	setUriBase(curlu, FACE_VERIFY_URL);
+	if (body_write(body, "\"", 1)) return -1;
 
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
+	for (; *str; ++str) {
+		unsigned char c = (unsigned char)*str;
+		if (c != '"' && c != '\\' && c >= 0x20) {
+			continue;
+		}
 
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
+		// flush the plain run before the escaped character
+		if (body_write(body, start, str - start)) return -1;
+		start = str + 1;
+
+		switch (c) {
+			case '"': strcpy(escape, "\\\""); break;
+			case '\\': strcpy(escape, "\\\\"); break;
+			case '\b': strcpy(escape, "\\b"); break;
+			case '\f': strcpy(escape, "\\f"); break;
+			case '\n': strcpy(escape, "\\n"); break;
+			case '\r': strcpy(escape, "\\r"); break;
+			case '\t': strcpy(escape, "\\t"); break;
+			default: sprintf(escape, "\\u%04x", c); break;
+		}
+		if (body_write(body, escape, strlen(escape))) return -1;
+	}
 
-	response = calloc(1, sizeof(ReadData));
+	if (body_write(body, start, str - start)) return -1;
+	return body_write(body, "\"", 1);
+}
 
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
+/**
+ * Description:
+ *		Appends "key": to body
+ *
+ * Params:
+ *		body: the body to be written
+ *		key: the json key
+ *		first: 0 if a comma needs to be written before the key
+ *
+ * Return:
+ *		0 if successful; -1 if out of memory
+ */
+static int body_write_key(FaceBody * body, const char * key, int first)
+{
+	if (!first && body_write(body, ",", 1)) return -1;
+	if (body_write_string(body, key)) return -1;
+	return body_write(body, ":", 1);
+}
 
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
+/**
+ * Description:
+ *		Takes a FaceBody out of the body pool; allocates a new one if the
+ *		pool is empty
+ *
+ * Return:
+ *		an empty FaceBody; NULL if out of memory
+ */
+FaceBody * face_body_acquire() {
+	FaceClient * client = face_client_current();
+	FaceBody * body = NULL;
 
-		// setting request header
-		struct curl_slist * plist = curl_slist_append(NULL, FACE_JSON);
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		plist = curl_slist_append(plist, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
+	pthread_mutex_lock(&client->body_pool_lock);
+	if (client->body_pool_size) {
+		body = client->body_pool[--client->body_pool_size];
+	}
+	pthread_mutex_unlock(&client->body_pool_lock);
 
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_POST, 1L);
+	if (!body) {
+		body = (FaceBody *)calloc(1, sizeof(FaceBody));
+		if (!body) {
+			fprintf(stderr, "Calloc Error: %s\n", strerror(errno));
+			return NULL;
+		}
+	}
 
-		// setting posting data (request body)
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_object_to_json_string(body));
+	body->length = 0;
+	body->client = client;
+	return body;
+}
 
-		// libcurl will automatically measure the length of request body with
-		// strlen so no need to set CURLOPT_POSTFIELDSIZE
+/**
+ * Description:
+ *		Gives a FaceBody back to the pool of the client it was acquired
+ *		from so its buffer can be reused; bodies that grew past
+ *		FACE_BODY_POOL_MAXSIZE are freed instead
+ *
+ * Params:
+ *		body: the body to be released
+ */
+void face_body_release(FaceBody * body) {
+	FaceClient * client;
 
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+	if (!body) return;
 
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
+	client = body->client;
+	body->length = 0;
+	free(body->pgid);
+	body->pgid = NULL;
 
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+	pthread_mutex_lock(&client->body_pool_lock);
+	if (body->capacity <= FACE_BODY_POOL_MAXSIZE && client->body_pool_size < FACE_BODY_POOL_SIZE) {
+		client->body_pool[client->body_pool_size++] = body;
+		body = NULL;
+	}
+	pthread_mutex_unlock(&client->body_pool_lock);
 
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
+	if (body) {
+		free(body->content);
+		free(body);
+	}
+}
 
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
+/**
+ * Description:
+ *		Serializes the request body of Face Identify into body; the group
+ *		is a LargePersonGroup if face_set_large_groups is on
+ *
+ * Params:
+ *		body: return parameter; the body to be written
+ *		pgid: the persongroupId to identify from
+ *		fids: array of faceIds to be identified
+ *		nfids: length of fids
+ *		maxCandidates: maxNumOfCandidatesReturned; 0 for default
+ *		threshold: confidenceThreshold, clamped to 1; negative for
+ *				   default
+ *
+ * Return:
+ *		0 if successful; -1 if out of memory
+ */
+int face_body_identify(FaceBody * body, const char * pgid, char ** fids, int nfids, int maxCandidates, double threshold) {
+	char buffer[64] = {0};			// buffer for number formatting
+	long micros;					// threshold in millionths
+	int len;
+	int i;
 
-		curl_slist_free_all(plist);
+	body->length = 0;
 
-		/* always cleanup */
-		curl_easy_cleanup(curl);
-	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
+	// kept for face_identify_body to route the request by
+	free(body->pgid);
+	if (!(body->pgid = strdup(pgid))) return -1;
 
-	// printing http status code
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
+	if (body_write(body, "{", 1)) return -1;
+	if (body_write_key(body, face_pg_key(), 1)) return -1;
+	if (body_write_string(body, pgid)) return -1;
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
+	if (body_write_key(body, FACE_FIDS, 0)) return -1;
+	if (body_write(body, "[", 1)) return -1;
+	for (i = 0; i < nfids; ++i) {
+		if (i && body_write(body, ",", 1)) return -1;
+		if (body_write_string(body, fids[i])) return -1;
+	}
+	if (body_write(body, "]", 1)) return -1;
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+	if (maxCandidates > 0) {
+		if (body_write_key(body, FACE_MAXCANDIDATES, 0)) return -1;
+		snprintf(buffer, sizeof(buffer), "%d", maxCandidates);
+		if (body_write(body, buffer, strlen(buffer))) return -1;
+	}
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+	if (threshold >= 0) {
+		if (body_write_key(body, FACE_THRESHOLD, 0)) return -1;
+		// written from integers, as %g follows the locale's decimal point
+		// and turns infinity into inf, neither of which is json
+		micros = threshold >= 1 ? 1000000 : (long)(threshold * 1e6 + 0.5);
+		len = snprintf(buffer, sizeof(buffer), "%ld.%06ld", micros / 1000000, micros % 1000000);
+		while (len > 3 && buffer[len - 1] == '0') {
+			buffer[--len] = '\0';
+		}
+		if (body_write(body, buffer, len)) return -1;
+	}
 
-	return ret;
+	return body_write(body, "}", 1);
 }
 
 /**
  * Description:
- *		identifies a face image from a persongroup by calling Face Identify (POST)
- * 
+ *		Serializes the request body of PersonGroup Person Create into body
+ *
  * Params:
- *		body: the request body; should contain 1 faceId, 1 persongoupId,
- *			  and 1 personId
- *		resp: return parameter; collects the response
+ *		body: return parameter; the body to be written
+ *		name: name of the person
+ *		userData: user data of the person; NULL to leave out
  *
- * return:
- *		http status code; -1 if user hasn't logged in with face_login
+ * Return:
+ *		0 if successful; -1 if out of memory
  */
-long face_identify(struct json_object * body, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
-
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
-		return -1;
-	}
-
-	curlu = curl_url();
-
-	// setting the request url
-	setUriBase(curlu, FACE_IDENTIFY_URL);
-
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		struct curl_slist * plist = curl_slist_append(NULL, FACE_JSON);
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		plist = curl_slist_append(plist, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_POST, 1L);
-
-		// setting posting data (request body)
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_object_to_json_string(body));
-
-		// libcurl will automatically measure the length of request body with
-		// strlen so no need to set CURLOPT_POSTFIELDSIZE
-
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
-
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
-
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
+int face_body_create_p(FaceBody * body, const char * name, const char * userData) {
+	body->length = 0;
 
-		curl_slist_free_all(plist);
+	if (body_write(body, "{", 1)) return -1;
+	if (body_write_key(body, FACE_NAME, 1)) return -1;
+	if (body_write_string(body, name)) return -1;
 
-		/* always cleanup */
-		curl_easy_cleanup(curl);
+	if (userData) {
+		if (body_write_key(body, FACE_USERDATA, 0)) return -1;
+		if (body_write_string(body, userData)) return -1;
 	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
 
-	// printing http status code
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
-
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
+	return body_write(body, "}", 1);
+}
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+/**
+ * Description:
+ *		Serializes the request body of PersonGroup Create into body
+ *
+ * Params:
+ *		body: return parameter; the body to be written
+ *		name: name of the persongroup
+ *		userData: user data of the persongroup; NULL to leave out
+ *		recognitionModel: recognition model of the persongroup; NULL for default
+ *
+ * Return:
+ *		0 if successful; -1 if out of memory
+ */
+int face_body_create_pg(FaceBody * body, const char * name, const char * userData, const char * recognitionModel) {
+	if (face_body_create_p(body, name, userData)) return -1;
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+	if (recognitionModel) {
+		// reopen the object written by face_body_create_p
+		body->length--;
+		if (body_write_key(body, FACE_RECOGNITION_MODEL, 0)) return -1;
+		if (body_write_string(body, recognitionModel)) return -1;
+		if (body_write(body, "}", 1)) return -1;
+	}
 
-	return ret;
+	return 0;
 }
 
 /**
  * Description:
- *		Creates a person by calling PersonGroup Person Create (POST)
- * 
+ *		Sets up a duplicate of curl if the breaker of the endpoint lets it
+ *		through and a slot, a rate token and a hedge are there right away.
+ *		The hedge is only spent once the duplicate exists
+ *
  * Params:
- *		pgid: the persongroupId chosed by the user
- *		body: the request body; should at least contain 1 persongoupId and person name
- *		resp: return parameter; collects the response
+ *		client: client sending the request
+ *		call: the request
+ *		backend: where the request goes
+ *		curl: handle to duplicate
+ *		response: collects the duplicate's response
+ *		breaker: return parameter; admitted the duplicate, pass to
+ *				 face_breaker_cancel once it is done
  *
- * return:
- *		http status code; -1 if user hasn't logged in with face_login
+ * Return:
+ *		the duplicate; NULL if it should not be sent
  */
-long face_create_p(char * pgid, struct json_object * body, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
+static CURL * hedge_start(FaceClient * client, FaceCall * call, FaceBackend * backend, CURL * curl,
+	ResponseData * response, FaceBreaker ** breaker)
+{
+	CURL * hedge = NULL;
 
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
-		return -1;
+	if (!face_breaker_allow(&client->breaker, call->ep, backend->region, breaker)) {
+		return NULL;
+	}
+	if (!face_limit_try(&client->limit)) {
+		face_breaker_cancel(&client->breaker, *breaker);
+		return NULL;
 	}
 
-	curlu = curl_url();
+	if (response_reset(response) || !(hedge = curl_easy_duphandle(curl)) || !face_hedge_withdraw(&client->hedge)) {
+		goto fail;
+	}
+	if (!face_rate_try(&client->rate, backend->key)) {
+		face_hedge_refund(&client->hedge);
+		goto fail;
+	}
 
-	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	strcat(buffer, pgid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	curl_url_set(curlu, CURLUPART_URL, FACE_URLPART_P, 0);
-	memset(buffer, 0, BUFSIZ);
+	return hedge;
 
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
+fail:
+	if (hedge) {
+		curl_easy_cleanup(hedge);
+	}
+	face_limit_cancel(&client->limit);
+	face_breaker_cancel(&client->breaker, *breaker);
+	return NULL;
+}
 
+/**
+ * Description:
+ *		Performs one attempt of a request on curl, sending a duplicate on a
+ *		second handle if no response came within hedge_delay. Whichever
+ *		finishes first wins and the other one is cancelled
+ *
+ * Params:
+ *		client: client sending the request
+ *		call: the request
+ *		backend: where the request goes; the duplicate is held to its rate
+ *				 limit and circuit breaker like any other request
+ *		curl: handle set up for the attempt
+ *		hedge_delay: ms to wait before sending the duplicate
+ *		start: where the image starts in call->image
+ *		response: return parameter; collects the winner's response
+ *		retry_after: return parameter; the winner's Retry-After in ms
+ *		winner: return parameter; the handle that finished, either curl or
+ *				a duplicate the caller has to clean up
+ *
+ * Return:
+ *		result of the winning transfer
+ */
+static CURLcode perform_hedged(FaceClient * client, FaceCall * call, FaceBackend * backend, CURL * curl,
+	long hedge_delay, off_t start, ResponseData * response, long * retry_after, CURL ** winner)
+{
+	CURLM * multi;					// drives both transfers
+	CURLMsg * msg;					// a finished transfer
+	CURL * hedge = NULL;			// the duplicate request
+	FaceBreaker * breaker = NULL;	// admitted the duplicate
+	ResponseData hedge_response = {0};	// parses the duplicate's response
+	long hedge_retry_after = -1;	// Retry-After of the duplicate
+	FileCursor cursors[2];			// separate reads of the image for each
+	CURLcode res = CURLE_OK;
+	struct timespec begin;
+	struct timespec now;
+	long elapsed;
+	int running = 1;
+	int queued;
+
+	*winner = NULL;
+
+	// both transfers read the image at their own offset
+	if (call->image) {
+		cursors[0].fd = cursors[1].fd = fileno(call->image);
+		cursors[0].offset = cursors[1].offset = start;
+		cursors[0].length = cursors[1].length = call->fsize;
+		curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_file);
+		curl_easy_setopt(curl, CURLOPT_READDATA, &cursors[0]);
+	}
+
+	multi = curl_multi_init();
+	curl_multi_add_handle(multi, curl);
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	while (!*winner && running) {
+		curl_multi_perform(multi, &running);
+
+		while ((msg = curl_multi_info_read(multi, &queued))) {
+			if (msg->msg != CURLMSG_DONE) continue;
+
+			// an error is only taken if the other transfer can't do better
+			if (msg->data.result != CURLE_OK && running) {
+				curl_multi_remove_handle(multi, msg->easy_handle);
+				continue;
+			}
+			*winner = msg->easy_handle;
+			res = msg->data.result;
+			break;
+		}
+		if (*winner || !running) break;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (now.tv_sec - begin.tv_sec) * 1000 + (now.tv_nsec - begin.tv_nsec) / 1000000;
+
+		if (!hedge && elapsed >= hedge_delay) {
+			// the duplicate is only sent if it goes out at once; it never
+			// waits on the breaker, the concurrency limit or the rate limit
+			hedge = hedge_start(client, call, backend, curl, &hedge_response, &breaker);
+			if (hedge) {
+				// the share handle is not copied by curl_easy_duphandle
+				curl_easy_setopt(hedge, CURLOPT_SHARE, client->share);
+				curl_easy_setopt(hedge, CURLOPT_WRITEDATA, &hedge_response);
+				curl_easy_setopt(hedge, CURLOPT_HEADERDATA, &hedge_retry_after);
+				if (call->image) {
+					curl_easy_setopt(hedge, CURLOPT_READDATA, &cursors[1]);
+				}
+				curl_multi_add_handle(multi, hedge);
+				running++;
 #ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
+				fprintf(stderr, FACE_HEDGE, elapsed);
 #endif
+				continue;
+			}
+			// no budget or no room; waiting the request out
+			hedge_delay = LONG_MAX;
+		}
 
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
+		curl_multi_poll(multi, NULL, 0,
+			hedge ? FACE_HEDGE_POLL : (int)(hedge_delay - elapsed < FACE_HEDGE_POLL ? hedge_delay - elapsed : FACE_HEDGE_POLL),
+			NULL);
+	}
 
-		// setting request header
-		struct curl_slist * plist = curl_slist_append(NULL, FACE_JSON);
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		plist = curl_slist_append(plist, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
+	// a transfer that failed after the other one was given up on
+	if (!*winner) {
+		*winner = curl;
+		res = CURLE_SEND_ERROR;
+	}
 
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_POST, 1L);
+	curl_multi_remove_handle(multi, curl);
+	if (hedge) {
+		curl_multi_remove_handle(multi, hedge);
+	}
+	curl_multi_cleanup(multi);
 
-		// setting posting data (request body)
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_object_to_json_string(body));
+	// only one of the two slots is released with the outcome of the winner
+	if (hedge) {
+		face_limit_cancel(&client->limit);
+		face_breaker_cancel(&client->breaker, breaker);
+	}
 
-		// libcurl will automatically measure the length of request body with
-		// strlen so no need to set CURLOPT_POSTFIELDSIZE
+	if (*winner == hedge) {
+		face_hedge_won(&client->hedge);
+		json_object_put(response_finish(response));
+		*response = hedge_response;
+		*retry_after = hedge_retry_after;
+	}
+	else {
+		json_object_put(response_finish(&hedge_response));
+		if (hedge) {
+			curl_easy_cleanup(hedge);
+		}
+	}
 
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+	return res;
+}
 
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
+/**
+ * Description:
+ *		Sleeps for ms milliseconds
+ */
+void face_sleep_ms(long ms) {
+	struct timespec ts;
 
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	while (nanosleep(&ts, &ts) && errno == EINTR);
+}
 
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
+/**
+ * Description:
+ *		Builds the url and the headers of a request to a backend, freeing
+ *		the ones built for the backend it went to before
+ *
+ * Params:
+ *		call: the request
+ *		backend: where the request goes
+ *		url: return parameter; the request url; NULL at first
+ *		plist: return parameter; the request headers; NULL at first
+ */
+static void call_target(FaceCall * call, const FaceBackend * backend, char ** url, struct curl_slist ** plist)
+{
+	CURLU * curlu = curl_url();		// handle for the request url
+	char buffer[sizeof(FACE_KEYTYPE) + BUFSIZ] = {0};	// buffer for the key header
 
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
+	if (*url) {
+		curl_free(*url);
+		*url = NULL;
+	}
+	curl_slist_free_all(*plist);
+	*plist = NULL;
 
-		curl_slist_free_all(plist);
+	// setting the request url
+	setUriBase(curlu, backend->region, call->base);
+	if (call->path[0]) {
+		curl_url_set(curlu, CURLUPART_URL, call->path, 0);
+	}
 
-		/* always cleanup */
-		curl_easy_cleanup(curl);
+	// setting request parameter
+	if (call->query) {
+		curl_url_set(curlu, CURLUPART_QUERY, call->query, CURLU_APPENDQUERY);
+	}
+	if (call->param) {
+		json_object_object_foreach(call->param, name, val) {
+			setUriParam(curlu, name, val);
+		}
 	}
+
+	// retrieving the url from curlu
+	curl_url_get(curlu, CURLUPART_URL, url, CURLU_NON_SUPPORT_SCHEME);
 	curl_url_cleanup(curlu);
-	curl_global_cleanup();
 
-	// printing http status code and latency
 #ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
+	fprintf(stderr, FACE_REQUEST_URL, *url);
 #endif
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
-
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
-
-	// memory deallocation
-	free(response->content);
-	free(response);
-
-	return ret;
+	// setting request header
+	if (call->ctype) {
+		*plist = curl_slist_append(*plist, call->ctype);
+	}
+	snprintf(buffer, sizeof(buffer), "%s%s", FACE_KEYTYPE, backend->key);
+	*plist = curl_slist_append(*plist, buffer);
+	if (call->frames || (call->image && call->fsize == FACE_FSIZE_UNKNOWN)) {
+		// send the body as it is produced instead of waiting on
+		// 100-continue before the first chunk
+		*plist = curl_slist_append(*plist, FACE_CHUNKED);
+		*plist = curl_slist_append(*plist, FACE_NO_EXPECT);
+	}
 }
 
 /**
  * Description:
- *		Adds a face image to a Person by calling PersonGroup Person Add Face (POST)
- * 
+ *		Sends a request described by call and collects its response; failed
+ *		attempts are retried following the endpoint's RetryPolicy, see
+ *		face_set_retry_policy. A retry of a request that isn't about a
+ *		persongroup goes to another backend if there is one, and a request
+ *		about a group its backend doesn't have looks for it on the others
+ *
  * Params:
- *		pgid: the persongroupId of the person group the person is located in
- *		pid: the personId of the person the face is added to
- *		param: the query parameter of the request; use NULL for default
- *		body: the request body; should contain the image url
- *		resp: return parameter; collects the response
+ *		call: the request
+ *		resp: return parameter; collects the response of the last attempt
  *
- * return:
- *		http status code; -1 if user hasn't logged in with face_login
+ * Return:
+ *		http status code; -1 if user hasn't logged in via face_login;
+ *		FACE_CIRCUIT_OPEN if the endpoint's circuit breaker is open
  */
-long face_add_face(char * pgid, char * pid, struct json_object * param, struct json_object * body, struct json_object ** resp) {
+static long perform_call(FaceClient * client, FaceCall * call, struct json_object ** resp)
+{
 	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-	
+	CURLcode res = CURLE_OK;		// result of the curl command
+	ResponseData response = {		// parses the response body
+		.each = call->each,
+		.each_data = call->each_data
+	};
+	ReadData upload;				// cursor over the request body
+	RetryPolicy policy;				// retry policy of the endpoint
+	struct curl_slist * plist = NULL;	// request headers
+	char * url = NULL;				// the request url
+	off_t start = 0;				// where the image starts in call->image
+	long retry_after;				// Retry-After of the last response in ms
+	long delay;						// wait before the next attempt in ms
+	long ret = 0;					// response http status code
+	double lat = 0;					// latency
+	curl_off_t wire = 0;			// body bytes received before decompression
+	long hedge_delay;				// wait before hedging in ms; -1 to not hedge
+	CURL * done;					// handle that finished the attempt
+	FaceBackend * backend;			// subscription the request goes to
+	FaceBackend * next;				// subscription the next attempt goes to
+	unsigned int tried = 0;			// backends that didn't have the persongroup
+#ifdef _DEBUG_
+	double wait;					// time spent on the rate limit in ms
+#endif
+	FaceBreaker * breaker;			// circuit breaker of the endpoint
+	int rewindable = 1;				// 1 if the body can be sent more than once
+	int attempt;					// attempts made so far
+
 	errno = 0;						// setting errno for error detection
+	*resp = NULL;
 
 	// check if region and key are initialized
-	if (!login) {
+	if (!client->login) {
 		fprintf(stderr, FACE_LOGIN_ERROR);
 		return -1;
 	}
+	if (!(backend = face_backend_acquire(&client->backend, call->ep, call->pgid))) {
+		return -1;
+	}
 
-	curlu = curl_url();
-
-	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	strcat(buffer, pgid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, FACE_URLPART_P);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, pid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	curl_url_set(curlu, CURLUPART_URL, FACE_URLPART_FACE, 0);
+	call_target(call, backend, &url, &plist);
 
+	pthread_mutex_lock(&client->retry.lock);
+	policy = client->retry.policies[call->ep];
+	pthread_mutex_unlock(&client->retry.lock);
 
-	// setting request param
-	if (param) {
-		json_object_object_foreach(param, key, val) {
-			setUriParam(curlu, key, val);
+	// a body read from a pipe or a frame stream can't be sent twice
+	if (call->frames || (call->image && call->fsize == FACE_FSIZE_UNKNOWN)) {
+		rewindable = 0;
+	}
+	else if (call->image) {
+		start = ftello(call->image);
+		if (start < 0) {
+			rewindable = 0;
 		}
 	}
+	if (!rewindable) {
+		policy.max_attempts = 1;
+	}
 
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
+	face_retry_begin(&client->retry);
 
-	response = calloc(1, sizeof(ReadData));
+	// loading up curl_easy interface; the handle is kept for every attempt
+	// and takes connections from the client's share so requests reuse
+	// them; libcurl itself was set up once with the client
+	curl = curl_easy_init();
+	if (curl && response_reset(&response)) {
+		curl_easy_cleanup(curl);
+		curl = NULL;
+	}
+	if (curl) {
+		curl_easy_setopt(curl, CURLOPT_SHARE, client->share);
+		face_tls_apply(client, curl);
 
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
+		// "" accepts every encoding libcurl can decode; it decompresses
+		// as the body arrives and write_callback parses what comes out
+		if (face_transfer_compress(&client->transfer)) {
+			curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+		}
 
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
+		// a region that stopped answering has to fail, or the breaker
+		// never hears of it; a streamed body takes as long as its producer
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, policy.connect_timeout_ms);
+		if (rewindable) {
+			curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, policy.timeout_ms);
+		}
+	}
+	for (attempt = 1; curl; ++attempt) {
 		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		struct curl_slist * plist = curl_slist_append(NULL, FACE_JSON);
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		plist = curl_slist_append(plist, buffer);
 		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
 
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_POST, 1L);
-
-		// setting posting data (request body)
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_object_to_json_string(body));
+		if (!strcmp(call->method, FACE_GET)) {
+			curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+		}
+		else if (!strcmp(call->method, FACE_PUT)) {
+			// setting request type (CURLOPT_PUT is deprecated; use CURLOPT_UPLOAD instead)
+			curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+
+			// setting read callback function and data; the cursor starts
+			// over on every attempt
+			upload.content = (char *)call->body;
+			upload.length = call->blen;
+			curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_text);
+			curl_easy_setopt(curl, CURLOPT_READDATA, &upload);
+
+			// setting size of request body
+			curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)call->blen);
+		}
+		else if (!strcmp(call->method, FACE_POST)) {
+			curl_easy_setopt(curl, CURLOPT_POST, 1L);
+
+			if (call->frames) {
+				curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
+				curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)-1);
+				curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_frame);
+				curl_easy_setopt(curl, CURLOPT_READDATA, call->frames);
+			}
+			else if (call->image) {
+				// need to set CURLOPT_POSTFIELD option to NULL for libcurl to get
+				// post data from read callback
+				curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
+
+				// setting post data size; -1 makes libcurl send the body chunked
+				if (call->fsize == FACE_FSIZE_UNKNOWN) {
+					curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)-1);
+					curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_stream);
+				}
+				else {
+					curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)call->fsize);
+					curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_image);
+				}
+				curl_easy_setopt(curl, CURLOPT_READDATA, call->image);
+			}
+			else {
+				// posting straight from the body; libcurl does not copy it
+				curl_easy_setopt(curl, CURLOPT_POSTFIELDS, call->body ? call->body : "");
+				curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)call->blen);
+			}
+		}
+		else {
+			curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, call->method);
+		}
 
-		// libcurl will automatically measure the length of request body with
-		// strlen so no need to set CURLOPT_POSTFIELDSIZE
+		// setting header callback to catch Retry-After
+		retry_after = -1;
+		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, &retry_after);
 
 		// setting write callback function and buffer
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+
+		// failing fast while the service is known to be down
+		if (!face_breaker_allow(&client->breaker, call->ep, backend->region, &breaker)) {
+#ifdef _DEBUG_
+			fprintf(stderr, FACE_BREAKER_REJECTED);
+#endif
+			ret = FACE_CIRCUIT_OPEN;
+			break;
+		}
+
+		// every attempt that is sent counts against the subscription's
+		// rate; one failed fast by the breaker does not spend a token
+#ifdef _DEBUG_
+		wait = face_rate_acquire(&client->rate, backend->key);
+		if (wait > 0) {
+			fprintf(stderr, FACE_RATE_WAIT, wait);
+		}
+#else
+		face_rate_acquire(&client->rate, backend->key);
+#endif
+
+		// waiting for a slot under the adaptive concurrency limit
+		face_limit_acquire(&client->limit);
 
 		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
+		// elements handed out can't be taken back from a losing duplicate
+		hedge_delay = rewindable && !call->each ? face_hedge_delay(&client->hedge, call->ep) : -1;
+		if (hedge_delay >= 0) {
+			res = perform_hedged(client, call, backend, curl, hedge_delay, start, &response, &retry_after, &done);
+		}
+		else {
+			res = curl_easy_perform(curl);
+			done = curl;
+		}
 
 		/* Check for errors */
 		if(res != CURLE_OK)
 			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
 
 		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
+		ret = 0;
+		curl_easy_getinfo(done, CURLINFO_RESPONSE_CODE, &ret);
+
+		// the download size counts the body as it came over the wire
+		curl_easy_getinfo(done, CURLINFO_SIZE_DOWNLOAD_T, &wire);
+		face_transfer_record(&client->transfer, call->ep, (size_t)wire, response.length);
+
+		// acquire latency; a duplicate was sent hedge_delay late
+		curl_easy_getinfo(done, CURLINFO_TOTAL_TIME, &lat);
+		if (done != curl) {
+			lat += hedge_delay / 1000.0;
+			curl_easy_cleanup(done);
+		}
+
+		face_limit_release(&client->limit, lat * 1000, ret, res);
+		face_breaker_record(&client->breaker, breaker, lat * 1000, ret, res);
+		if (res == CURLE_OK && statusOk(ret)) {
+			face_hedge_record(&client->hedge, call->ep, lat * 1000);
+		}
 
 #ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
+		// printing http status code and latency
+		fprintf(stderr, FACE_HTTP_STATUS, ret);
+		fprintf(stderr, FACE_LATENCY, lat);
 #endif
 
-		curl_slist_free_all(plist);
-
-		/* always cleanup */
-		curl_easy_cleanup(curl);
-	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
+		// a group pinned where its first request went may live in another
+		// subscription; looking for it doesn't count as a retry
+		next = NULL;
+		if (ret == 404 && call->pgid && rewindable && face_pg_missing(response.obj)) {
+			next = face_backend_probe(&client->backend, backend, call->pgid, &tried);
+		}
+		if (next) {
+			attempt--;
+			delay = 0;
+		}
+		else if (!face_retry_should(&client->retry, call, &policy, attempt, ret, res, retry_after, &delay)) {
+			break;
+		}
+		else {
+			next = face_backend_reroute(&client->backend, backend, call->pgid);
+		}
 
-	// printing http status code and latency
 #ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
+		fprintf(stderr, FACE_RETRY, attempt + 1, delay);
 #endif
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
+		// moving on to the next backend
+		if (next != backend) {
+			face_backend_release(&client->backend, backend, res != CURLE_OK || ret >= 500, lat * 1000);
+			backend = next;
+			call_target(call, backend, &url, &plist);
+		}
+
+		// dropping the failed response and rewinding the image
+		response_reset(&response);
+		if (call->image && fseeko(call->image, start, SEEK_SET)) {
+			break;
+		}
+
+		face_sleep_ms(delay);
+	}
+
+	// an open breaker fails fast, which would otherwise look like the
+	// least loaded backend
+	face_backend_release(&client->backend, backend, res != CURLE_OK || ret >= 500 || ret == FACE_CIRCUIT_OPEN, lat * 1000);
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+	/* always cleanup */
+	if (curl) {
+		curl_easy_cleanup(curl);
+	}
+	curl_slist_free_all(plist);
+	curl_free(url);
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+	// the body was parsed as it arrived
+	*resp = response_finish(&response);
 
 	return ret;
 }
 
 /**
  * Description:
- *		Adds a face image to a Person by calling PersonGroup Person Add Face (POST)
- * 
+ *		Sends a request described by call and collects its response. Every
+ *		endpoint goes through here. A request identical to one in flight
+ *		shares its response instead, see face_set_single_flight
+ *
  * Params:
- *		image: the binary data of the face image
- *		fsize: the size of the image
- *		pgid: the persongroupId of the person group the person is located in
- *		pid: the personId of the person the face is added to
- *		param: the query parameter of the request; use NULL for default
- *		resp: return parameter; collects the response
+ *		call: the request
+ *		resp: return parameter; collects the response of the last attempt
  *
- * return:
- *		http status code; -1 if user hasn't logged in with face_login
+ * Return:
+ *		http status code; -1 if user hasn't logged in via face_login;
+ *		FACE_CIRCUIT_OPEN if the endpoint's circuit breaker is open
  */
-long face_add_face_local(FILE * image, size_t fsize, char * pgid, char * pid, struct json_object * param, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
+long face_perform(FaceCall * call, struct json_object ** resp) {
+	FaceClient * client = face_client_current();	// client sending the request
+	FaceFlight * flight;			// this request in flight; NULL if not shared
 	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
 
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
-		return -1;
-	}
-
-	curlu = curl_url();
-
-	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	strcat(buffer, pgid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, FACE_URLPART_P);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, pid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	curl_url_set(curlu, CURLUPART_URL, FACE_URLPART_FACE, 0);
+	if (!face_flight_join(&client->flight, call, &flight, &ret, resp)) {
+		ret = perform_call(client, call, resp);
 
-	// setting request parameter
-	if (param) {
-		json_object_object_foreach(param, key, val) {
-			setUriParam(curlu, key, val);
+		if (flight) {
+			face_flight_land(&client->flight, flight, ret, *resp);
 		}
 	}
 
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
+	// keeping track of the persongroup the request was about
+	face_pg_record(&client->pgcache, call, ret, *resp);
+	face_roster_record(&client->roster, call, ret, *resp);
 
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
+	return ret;
+}
 
-#ifdef _DEBUG_
-	printf("Image file size: %" CURL_FORMAT_CURL_OFF_T " bytes.\n", fsize);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		struct curl_slist * plist = curl_slist_append(NULL, FACE_OCTET);
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		plist = curl_slist_append(plist, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_POST, 1L);
-
-		// need to set CURLOPT_POSTFIELD option to NULL for libcurl to get
-		// post data from read callback
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
-
-		// setting post data size
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, fsize);
-
-		// setting read callback function and data
-		curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_image);
-		curl_easy_setopt(curl, CURLOPT_READDATA, image);
-
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+/**
+ * Description:
+ *		Sets the region and subscription key of the calling thread's client,
+ *		see face_client_login
+ *
+ * Params:
+ *		rg: sets the region; a full url such as http://127.0.0.1:8080 sends
+ *			requests there instead (used with experiments/mock_server)
+ *		ky: sets the subscription key
+ *
+ * Return:
+ *		0 if successful; corresponding errno code if unsuccessful
+ */
+int face_login(char * rg, char * ky) {
+	return face_client_login(face_client_current(), rg, ky);
+}
 
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
+/**
+ * Description:
+ *		Creates a persongroup by calling PersonGroup Create (PUT)
+ *
+ * Params:
+ *		pgid: the persongroupId chosed by the caller
+ *		body: the request body
+ *		resp: return parameter; collects the response
+ *
+ * Return:
+ *		http status code; -1 if user hasn't logged in via face_login
+ */
+long face_create_pg(char * pgid, struct json_object * body, struct json_object ** resp) {
+	// serialize once and send the text as a preserialized body
+	const char * text = json_object_to_json_string(body);
+	FaceBody view = {
+		.content = (char *)text,
+		.length = strlen(text),
+		.capacity = 0
+	};
 
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+	return face_create_pg_body(pgid, &view, resp);
+}
 
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
+/**
+ * Description:
+ *		Creates a persongroup by calling PersonGroup Create (PUT) with a
+ *		preserialized request body
+ *
+ * Params:
+ *		pgid: the persongroupId chosed by the caller
+ *		body: the request body; see face_body_create_pg
+ *		resp: return parameter; collects the response
+ *
+ * Return:
+ *		http status code; -1 if user hasn't logged in via face_login
+ */
+long face_create_pg_body(char * pgid, FaceBody * body, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_CREATE_PG,
+		.pgid = pgid,
+		.method = FACE_PUT,
+		.base = face_pg_base(),
+		.ctype = FACE_JSON,
+		.body = body->content,
+		.blen = body->length
+	};
 
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
+	// including the pgid in the request url
+	snprintf(call.path, sizeof(call.path), "%s", pgid);
 
-		curl_slist_free_all(plist);
+	return face_perform(&call, resp);
+}
 
-		/* always cleanup */
-		curl_easy_cleanup(curl);
-	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
+/**
+ * Description:
+ *		detcts a face image from calling Face Detect (POST)
+ *
+ * Params:
+ *		param: the query parameter of the request; use NULL for default
+ *		body: the request body; needs to include the image url
+ *		resp: return parameter; collects the response
+ *
+ * Return:
+ *		http status code; -1 if user hasn't logged in via face_login
+ */
+long face_detect(struct json_object * param, struct json_object * body, struct json_object ** resp) {
+	// serialized once so the exact size can be handed to libcurl
+	const char * text = json_object_to_json_string(body);
+	FaceCall call = {
+		.ep = FACE_EP_DETECT,
+		.method = FACE_POST,
+		.base = FACE_DETECT_URL,
+		.param = param,
+		.ctype = FACE_JSON,
+		.body = text,
+		.blen = strlen(text)
+	};
 
-	// printing http status code and latency
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
+	return face_perform(&call, resp);
+}
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
+/**
+ * Description:
+ *		detects a face image by calling Face Detect (POST)
+ * 
+ * Params: 
+ *		image: the binary face image file to be detected
+ *		fsize: the size of the image file; FACE_FSIZE_UNKNOWN to send the
+ *			   image chunked as it is read, e.g. from a pipe or a socket
+ *      param: the query parameter of the request; use NULL for default
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_detect_local(FILE * image, size_t fsize, json_object * param, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_DETECT,
+		.method = FACE_POST,
+		.base = FACE_DETECT_URL,
+		.param = param,
+		.ctype = FACE_OCTET,
+		.image = image,
+		.fsize = fsize
+	};
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+	return face_perform(&call, resp);
+}
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+/**
+ * Description:
+ *		detects a face image by calling Face Detect (POST)
+ * 
+ * Params: 
+ *		data: the binary face image in memory
+ *		size: the size of the image
+ *      param: the query parameter of the request; use NULL for default
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_detect_buffer(const void * data, size_t size, json_object * param, struct json_object ** resp) {
+	// posting straight from the caller's buffer; libcurl does not copy
+	// it, so it has to stay valid until the request is done
+	FaceCall call = {
+		.ep = FACE_EP_DETECT,
+		.method = FACE_POST,
+		.base = FACE_DETECT_URL,
+		.param = param,
+		.ctype = FACE_OCTET,
+		.body = data,
+		.blen = size
+	};
 
-	return ret;
+	return face_perform(&call, resp);
 }
 
 /**
  * Description:
- *		Deletes a face image by calling PersonGroup Person Delete Face (DELETE)
+ *		detects a face image by calling Face Detect (POST); the image is
+ *		memory mapped and posted straight from the mapping
  * 
- * Params:
- *		pgid: the persongroupId of the person group the person is located in
- *		pid: the personId of the person the face is deleted from
- *		fid: the faceId of the face to be deleted
+ * Params: 
+ *		path: path of the face image file to be detected
+ *      param: the query parameter of the request; use NULL for default
  *		resp: return parameter; collects the response
  *
  * return:
- *		http status code; -1 if user hasn't logged in with face_login
+ *		http status code; -1 if user hasn't logged in with face_login or
+ *		the image can't be mapped
  */
-long face_delete_face(char * pgid, char * pid, char * fid, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
+long face_detect_path(const char * path, json_object * param, struct json_object ** resp) {
+	FaceClient * client = face_client_current();	// client keeping the mapping
+	ImageMap * map;					// mapping of the image
 	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
 
 	// check if region and key are initialized
-	if (!login) {
+	if (!client->login) {
 		fprintf(stderr, FACE_LOGIN_ERROR);
 		return -1;
 	}
 
-	curlu = curl_url();
-
-	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	strcat(buffer, pgid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, FACE_URLPART_P);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, pid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, FACE_URLPART_FACE);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	curl_url_set(curlu, CURLUPART_URL, fid, 0);
-
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		struct curl_slist * plist = curl_slist_append(NULL, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, FACE_DELETE);
-
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
-
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
-
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
-
-		curl_slist_free_all(plist);
-
-		/* always cleanup */
-		curl_easy_cleanup(curl);
+	map = image_map_acquire(client, path);
+	if (!map) {
+		return -1;
 	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
-
-	// printing http status code
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
-
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
-
-	// memory deallocation
-	free(response->content);
-	free(response);
+	ret = face_detect_buffer(map->data, map->size, param, resp);
 
+	image_map_release(client, map);
 	return ret;
 }
 
 /**
  * Description:
- *		Deletes a Person by calling PersonGroup Person Delete (DELETE)
+ *		detects the next frame of a frame stream by calling Face Detect
+ *		(POST); the frame is sent chunked while it is being read
  * 
- * Params:
- *		pgid: the persongroupId of the person group the person is located in
- *		pid: the personId of the person to be deleted
+ * Params: 
+ *		stream: the frame stream, see face_frame_stream_new
+ *      param: the query parameter of the request; use NULL for default
  *		resp: return parameter; collects the response
  *
  * return:
- *		http status code; -1 if user hasn't logged in with face_login
+ *		http status code; 0 if the stream has no more frames; -1 if user
+ *		hasn't logged in with face_login
  */
-long face_delete_p(char * pgid, char * pid, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
+long face_detect_frame(FaceFrameStream * stream, json_object * param, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_DETECT,
+		.method = FACE_POST,
+		.base = FACE_DETECT_URL,
+		.param = param,
+		.ctype = FACE_OCTET,
+		.frames = stream
+	};
+
+	*resp = NULL;
 
 	// check if region and key are initialized
-	if (!login) {
+	if (!face_client_current()->login) {
 		fprintf(stderr, FACE_LOGIN_ERROR);
 		return -1;
 	}
 
-	curlu = curl_url();
-
-	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	strcat(buffer, pgid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, FACE_URLPART_P);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	curl_url_set(curlu, CURLUPART_URL, pid, 0);
-
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		struct curl_slist * plist = curl_slist_append(NULL, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, FACE_DELETE);
-
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
-
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
-
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
-
-		curl_slist_free_all(plist);
-
-		/* always cleanup */
-		curl_easy_cleanup(curl);
+	// finding the start of the next frame before anything is sent
+	if (frame_stream_sync(stream)) {
+		return 0;
 	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
-
-	// printing http status code and latency
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
-
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+	return face_perform(&call, resp);
+}
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+/**
+ * Description:
+ *		verifies two face images or a face image with a person by calling
+ *		Face Verify (POST)
+ * 
+ * Params:
+ *		body: the request body; should either contain 2 faceIds or 1 faceId,
+ *			  1 persongoupId, and 1 personId
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_verify(struct json_object * body, struct json_object ** resp) {
+	// serialized once so the exact size can be handed to libcurl
+	const char * text = json_object_to_json_string(body);
+	FaceCall call = {
+		.ep = FACE_EP_VERIFY,
+		.method = FACE_POST,
+		.base = FACE_VERIFY_URL,
+		.ctype = FACE_JSON,
+		.body = text,
+		.blen = strlen(text)
+	};
 
-	return ret;
+	return face_perform(&call, resp);
 }
 
 /**
  * Description:
- *		Deletes a Person Group by calling PersonGroup Delete (DELETE)
+ *		identifies a face image from a persongroup by calling Face Identify (POST)
  * 
  * Params:
- *		pgid: the persongroupId of the person group to be deleted
+ *		body: the request body; should contain 1 faceId, 1 persongoupId,
+ *			  and 1 personId
  *		resp: return parameter; collects the response
  *
  * return:
  *		http status code; -1 if user hasn't logged in with face_login
  */
-long face_delete_pg(char * pgid, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
+long face_identify(struct json_object * body, struct json_object ** resp) {
+	// serialize once and send the text as a preserialized body
+	const char * text = json_object_to_json_string(body);
+	struct json_object * pgid;
+	FaceBody view = {
+		.content = (char *)text,
+		.length = strlen(text),
+		.capacity = 0
+	};
 
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
-		return -1;
+	if (json_object_object_get_ex(body, FACE_PGID, &pgid) || json_object_object_get_ex(body, FACE_LPGID, &pgid)) {
+		view.pgid = (char *)json_object_get_string(pgid);
 	}
 
-	curlu = curl_url();
-
-	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	curl_url_set(curlu, CURLUPART_URL, pgid, 0);
-
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
+	return face_identify_body(&view, resp);
+}
 
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
+/**
+ * Description:
+ *		identifies face images from a persongroup by calling Face Identify
+ *		(POST) with a preserialized request body
+ * 
+ * Params:
+ *		body: the request body; see face_body_identify
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_identify_body(FaceBody * body, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_IDENTIFY,
+		.method = FACE_POST,
+		.base = FACE_IDENTIFY_URL,
+		.ctype = FACE_JSON,
+		.body = body->content,
+		.blen = body->length,
+		// identify has to go to the subscription owning the persongroup
+		.pgid = body->pgid
+	};
 
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
+	return face_perform(&call, resp);
+}
 
-		// setting request header
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		struct curl_slist * plist = curl_slist_append(NULL, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
+/**
+ * Description:
+ *		Creates a person by calling PersonGroup Person Create (POST)
+ * 
+ * Params:
+ *		pgid: the persongroupId chosed by the user
+ *		body: the request body; should at least contain 1 persongoupId and person name
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_create_p(char * pgid, struct json_object * body, struct json_object ** resp) {
+	// serialize once and send the text as a preserialized body
+	const char * text = json_object_to_json_string(body);
+	FaceBody view = {
+		.content = (char *)text,
+		.length = strlen(text),
+		.capacity = 0
+	};
 
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, FACE_DELETE);
+	return face_create_p_body(pgid, &view, resp);
+}
 
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+/**
+ * Description:
+ *		Creates a person by calling PersonGroup Person Create (POST) with a
+ *		preserialized request body
+ * 
+ * Params:
+ *		pgid: the persongroupId chosed by the user
+ *		body: the request body; see face_body_create_p
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_create_p_body(char * pgid, FaceBody * body, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_CREATE_P,
+		.pgid = pgid,
+		.method = FACE_POST,
+		.base = face_pg_base(),
+		.ctype = FACE_JSON,
+		.body = body->content,
+		.blen = body->length
+	};
 
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
+	// setting the request url
+	snprintf(call.path, sizeof(call.path), "%s/%s", pgid, FACE_URLPART_P);
 
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+	return face_perform(&call, resp);
+}
 
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
+/**
+ * Description:
+ *		Adds a face image to a Person by calling PersonGroup Person Add Face (POST)
+ * 
+ * Params:
+ *		pgid: the persongroupId of the person group the person is located in
+ *		pid: the personId of the person the face is added to
+ *		param: the query parameter of the request; use NULL for default
+ *		body: the request body; should contain the image url
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_add_face(char * pgid, char * pid, struct json_object * param, struct json_object * body, struct json_object ** resp) {
+	// serialized once so the exact size can be handed to libcurl
+	const char * text = json_object_to_json_string(body);
+	FaceCall call = {
+		.ep = FACE_EP_ADD_FACE,
+		.pgid = pgid,
+		.pid = pid,
+		.method = FACE_POST,
+		.base = face_pg_base(),
+		.param = param,
+		.ctype = FACE_JSON,
+		.body = text,
+		.blen = strlen(text)
+	};
 
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
+	// setting the request url
+	snprintf(call.path, sizeof(call.path), "%s/%s/%s/%s", pgid, FACE_URLPART_P, pid, FACE_URLPART_FACE);
 
-		curl_slist_free_all(plist);
+	return face_perform(&call, resp);
+}
 
-		/* always cleanup */
-		curl_easy_cleanup(curl);
-	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
+/**
+ * Description:
+ *		Adds a face image to a Person by calling PersonGroup Person Add Face (POST)
+ * 
+ * Params:
+ *		image: the binary data of the face image
+ *		fsize: the size of the image; FACE_FSIZE_UNKNOWN to send the image
+ *			   chunked as it is read, e.g. from a pipe or a socket
+ *		pgid: the persongroupId of the person group the person is located in
+ *		pid: the personId of the person the face is added to
+ *		param: the query parameter of the request; use NULL for default
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_add_face_local(FILE * image, size_t fsize, char * pgid, char * pid, struct json_object * param, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_ADD_FACE,
+		.pgid = pgid,
+		.pid = pid,
+		.method = FACE_POST,
+		.base = face_pg_base(),
+		.param = param,
+		.ctype = FACE_OCTET,
+		.image = image,
+		.fsize = fsize
+	};
 
-	// printing http status code and latency
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
+	// setting the request url
+	snprintf(call.path, sizeof(call.path), "%s/%s/%s/%s", pgid, FACE_URLPART_P, pid, FACE_URLPART_FACE);
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
+	return face_perform(&call, resp);
+}
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+/**
+ * Description:
+ *		Adds a face image to a Person by calling PersonGroup Person Add Face (POST)
+ * 
+ * Params:
+ *		data: the binary face image in memory
+ *		size: the size of the image
+ *		pgid: the persongroupId of the person group the person is located in
+ *		pid: the personId of the person the face is added to
+ *		param: the query parameter of the request; use NULL for default
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_add_face_buffer(const void * data, size_t size, char * pgid, char * pid, struct json_object * param, struct json_object ** resp) {
+	// posting straight from the caller's buffer; libcurl does not copy
+	// it, so it has to stay valid until the request is done
+	FaceCall call = {
+		.ep = FACE_EP_ADD_FACE,
+		.pgid = pgid,
+		.pid = pid,
+		.method = FACE_POST,
+		.base = face_pg_base(),
+		.param = param,
+		.ctype = FACE_OCTET,
+		.body = data,
+		.blen = size
+	};
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+	// setting the request url
+	snprintf(call.path, sizeof(call.path), "%s/%s/%s/%s", pgid, FACE_URLPART_P, pid, FACE_URLPART_FACE);
 
-	return ret;
+	return face_perform(&call, resp);
 }
 
 /**
  * Description:
- *		Gets a Person Group's information by calling PersonGroup Get (GET)
+ *		Adds a face image to a Person by calling PersonGroup Person Add Face
+ *		(POST); the image is memory mapped and posted straight from the mapping
  * 
  * Params:
- *		pgid: the persongroupId of the person group to get information from
+ *		path: path of the face image file
+ *		pgid: the persongroupId of the person group the person is located in
+ *		pid: the personId of the person the face is added to
+ *		param: the query parameter of the request; use NULL for default
  *		resp: return parameter; collects the response
  *
  * return:
- *		http status code; -1 if user hasn't logged in with face_login
+ *		http status code; -1 if user hasn't logged in with face_login or
+ *		the image can't be mapped
  */
-long face_get_pg(char * pgid, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
+long face_add_face_path(const char * path, char * pgid, char * pid, struct json_object * param, struct json_object ** resp) {
+	FaceClient * client = face_client_current();	// client keeping the mapping
+	ImageMap * map;					// mapping of the image
 	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
 
 	// check if region and key are initialized
-	if (!login) {
+	if (!client->login) {
 		fprintf(stderr, FACE_LOGIN_ERROR);
 		return -1;
 	}
 
-	curlu = curl_url();
-
-	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	curl_url_set(curlu, CURLUPART_URL, pgid, 0);
-
-	// hard coding request parameter to always return recognition model
-	curl_url_set(curlu, CURLUPART_QUERY, FACE_URLPART_GET_PG_PARAM, CURLU_APPENDQUERY);
-
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		struct curl_slist * plist = curl_slist_append(NULL, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_HTTPGET, 1);
-
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
-
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
-
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
-
-		curl_slist_free_all(plist);
-
-		/* always cleanup */
-		curl_easy_cleanup(curl);
+	map = image_map_acquire(client, path);
+	if (!map) {
+		return -1;
 	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
-
-	// printing http status code and latency
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
-
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
-
-	// memory deallocation
-	free(response->content);
-	free(response);
+	ret = face_add_face_buffer(map->data, map->size, pgid, pid, param, resp);
 
+	image_map_release(client, map);
 	return ret;
 }
 
 /**
  * Description:
- *		Gets a Person's information by calling PersonGroup Person Get (GET)
+ *		Deletes a face image by calling PersonGroup Person Delete Face (DELETE)
  * 
  * Params:
  *		pgid: the persongroupId of the person group the person is located in
- *		pid: the personId of the person to get information from
+ *		pid: the personId of the person the face is deleted from
+ *		fid: the faceId of the face to be deleted
  *		resp: return parameter; collects the response
  *
  * return:
  *		http status code; -1 if user hasn't logged in with face_login
  */
-long face_get_p(char * pgid, char * pid, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
-
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
-		return -1;
-	}
-
-	curlu = curl_url();
+long face_delete_face(char * pgid, char * pid, char * fid, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_DELETE_FACE,
+		.pgid = pgid,
+		.pid = pid,
+		.method = FACE_DELETE,
+		.base = face_pg_base()
+	};
 
 	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	strcat(buffer, pgid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, FACE_URLPART_P);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	curl_url_set(curlu, CURLUPART_URL, pid, 0);
-
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
+	snprintf(call.path, sizeof(call.path), "%s/%s/%s/%s/%s", pgid, FACE_URLPART_P, pid, FACE_URLPART_FACE, fid);
 
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		struct curl_slist * plist = curl_slist_append(NULL, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_HTTPGET, 1);
+	return face_perform(&call, resp);
+}
 
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+/**
+ * Description:
+ *		Deletes a Person by calling PersonGroup Person Delete (DELETE)
+ * 
+ * Params:
+ *		pgid: the persongroupId of the person group the person is located in
+ *		pid: the personId of the person to be deleted
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_delete_p(char * pgid, char * pid, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_DELETE_P,
+		.pgid = pgid,
+		.pid = pid,
+		.method = FACE_DELETE,
+		.base = face_pg_base()
+	};
 
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
+	// setting the request url
+	snprintf(call.path, sizeof(call.path), "%s/%s/%s", pgid, FACE_URLPART_P, pid);
 
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+	return face_perform(&call, resp);
+}
 
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
+/**
+ * Description:
+ *		Deletes a Person Group by calling PersonGroup Delete (DELETE)
+ * 
+ * Params:
+ *		pgid: the persongroupId of the person group to be deleted
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_delete_pg(char * pgid, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_DELETE_PG,
+		.pgid = pgid,
+		.method = FACE_DELETE,
+		.base = face_pg_base()
+	};
 
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
+	// setting the request url
+	snprintf(call.path, sizeof(call.path), "%s", pgid);
 
-		curl_slist_free_all(plist);
+	return face_perform(&call, resp);
+}
 
-		/* always cleanup */
-		curl_easy_cleanup(curl);
-	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
+/**
+ * Description:
+ *		Gets a Person Group's information by calling PersonGroup Get (GET)
+ * 
+ * Params:
+ *		pgid: the persongroupId of the person group to get information from
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_get_pg(char * pgid, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_GET_PG,
+		.pgid = pgid,
+		.method = FACE_GET,
+		.base = face_pg_base(),
+		// hard coding request parameter to always return recognition model
+		.query = FACE_URLPART_GET_PG_PARAM
+	};
 
-	// printing http status code and latency
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
+	// setting the request url
+	snprintf(call.path, sizeof(call.path), "%s", pgid);
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
+	return face_perform(&call, resp);
+}
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+/**
+ * Description:
+ *		Gets a Person's information by calling PersonGroup Person Get (GET)
+ * 
+ * Params:
+ *		pgid: the persongroupId of the person group the person is located in
+ *		pid: the personId of the person to get information from
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_get_p(char * pgid, char * pid, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_GET_P,
+		.pgid = pgid,
+		.pid = pid,
+		.method = FACE_GET,
+		.base = face_pg_base()
+	};
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+	// setting the request url
+	snprintf(call.path, sizeof(call.path), "%s/%s/%s", pgid, FACE_URLPART_P, pid);
 
-	return ret;
+	return face_perform(&call, resp);
 }
 
 /**
@@ -1951,121 +2494,18 @@ long face_get_p(char * pgid, char * pid, struct json_object ** resp) {
  *		http status code; -1 if user hasn't logged in with face_login
  */
 long face_get_face(char * pgid, char * pid, char * fid, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-
-	errno = 0;						// setting errno for error detection
-
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
-		return -1;
-	}
-
-	curlu = curl_url();
+	FaceCall call = {
+		.ep = FACE_EP_GET_FACE,
+		.pgid = pgid,
+		.pid = pid,
+		.method = FACE_GET,
+		.base = face_pg_base()
+	};
 
 	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	strcat(buffer, pgid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, FACE_URLPART_P);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, pid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	strcat(buffer, FACE_URLPART_FACE);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	curl_url_set(curlu, CURLUPART_URL, fid, 0);
-
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		struct curl_slist * plist = curl_slist_append(NULL, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_HTTPGET, 1);
-
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
-
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
-
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
-
-		curl_slist_free_all(plist);
-
-		/* always cleanup */
-		curl_easy_cleanup(curl);
-	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
-
-	// printing http status code and latency
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
+	snprintf(call.path, sizeof(call.path), "%s/%s/%s/%s/%s", pgid, FACE_URLPART_P, pid, FACE_URLPART_FACE, fid);
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
-
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
-
-	// memory deallocation
-	free(response->content);
-	free(response);
-
-	return ret;
+	return face_perform(&call, resp);
 }
 
 /**
@@ -2080,259 +2520,190 @@ long face_get_face(char * pgid, char * pid, char * fid, struct json_object ** re
  *		http status code; -1 if user hasn't logged in with face_login
  */
 long face_train_pg(char * pgid, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-
-	errno = 0;						// setting errno for error detection
-
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
-		return -1;
-	}
-
-	curlu = curl_url();
+	FaceCall call = {
+		.ep = FACE_EP_TRAIN_PG,
+		.pgid = pgid,
+		.method = FACE_POST,
+		.base = face_pg_base()
+	};
 
 	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	strcat(buffer, pgid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	curl_url_set(curlu, CURLUPART_URL, FACE_URLPART_TRAIN, 0);
+	snprintf(call.path, sizeof(call.path), "%s/%s", pgid, FACE_URLPART_TRAIN);
 
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		struct curl_slist * plist = curl_slist_append(NULL, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_POST, 1L);
-
-		// explicitly setting post field size because CURLOPT_POSTFIELD is not
-		// set, thus, is not capable of setting field size
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, 0);
-
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
-
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
-
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
-
-		curl_slist_free_all(plist);
-
-		/* always cleanup */
-		curl_easy_cleanup(curl);
-	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
+	return face_perform(&call, resp);
+}
 
-	// printing http status code and latency
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
+/**
+ * Description:
+ *		Gets the training status of a person group by calling PersonGroup
+ *		Get Training Status (GET)
+ *
+ * Params:
+ *		pgid: the persongroupId of the person group
+ *		resp: return parameter; collects the response
+ *
+ * return:
+ *		http status code; -1 if user hasn't logged in with face_login
+ */
+long face_get_training_pg(char * pgid, struct json_object ** resp) {
+	FaceCall call = {
+		.ep = FACE_EP_GET_TRAINING,
+		.pgid = pgid,
+		.method = FACE_GET,
+		.base = face_pg_base()
+	};
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
+	// setting the request url
+	snprintf(call.path, sizeof(call.path), "%s/%s", pgid, FACE_URLPART_TRAINING);
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
+	return face_perform(&call, resp);
+}
 
-	// memory deallocation
-	free(response->content);
-	free(response);
+static int list_collect(struct json_object * person, void * data)
+{
+	json_object_array_add((struct json_object *)data, json_object_get(person));
+	return 0;
+}
 
-	return ret;
+static int compare_person(const void * a, const void * b)
+{
+	struct json_object * x = *(struct json_object * const *)a;
+	struct json_object * y = *(struct json_object * const *)b;
+	struct json_object * xpid = NULL;
+	struct json_object * ypid = NULL;
+
+	json_object_object_get_ex(x, FACE_PID, &xpid);
+	json_object_object_get_ex(y, FACE_PID, &ypid);
+	return strcasecmp(json_object_get_string(xpid) ? json_object_get_string(xpid) : "",
+		json_object_get_string(ypid) ? json_object_get_string(ypid) : "");
 }
 
 /**
  * Description:
  *		Lists all the person in a person group by calling PersonGroup Person
- *		List (GET)
+ *		List (GET) a page at a time, FACE_LIST_RANGES personId ranges at
+ *		once. The group is mirrored, see face_roster_lookup; to list a large
+ *		group without holding it whole, use face_list_p_each
  * 
  * Params:
  *		pgid: the persongroupId of the person group to list persons from
- *		resp: return parameter; collects the response
+ *		resp: return parameter; collects the persons in personId order, or
+ *			  the response of the first page that failed
  *
  * return:
  *		http status code; -1 if user hasn't logged in with face_login
  */
 long face_list_p(char * pgid, struct json_object ** resp) {
-	CURL * curl;					// handle of the libcurl interface
-	CURLU * curlu;					// handle for the request url
-	CURLcode res;					// result of the curl command
-	ReadData * response;			// collects response
-	char * url;						// the request url
-	char buffer[BUFSIZ] = {0};		// buffer for url parsing
-	long ret;						// response http status code
-	double lat;						// latency
-	
-	errno = 0;						// setting errno for error detection
+	struct json_object * list = json_object_new_array();
+	struct json_object * error;
+	long status;
 
-	// check if region and key are initialized
-	if (!login) {
-		fprintf(stderr, FACE_LOGIN_ERROR);
-		return -1;
+	status = face_list_run(pgid, FACE_LIST_TOP, FACE_LIST_RANGES, 0, 1, list_collect, list, &error);
+	if (!statusOk(status)) {
+		json_object_put(list);
+		*resp = error;
+		return status;
 	}
 
-	curlu = curl_url();
-
-	// setting the request url
-	setUriBase(curlu, FACE_PG_URL);
-	strcat(buffer, pgid);
-	strcat(buffer, FACE_SLASH);
-	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
-	memset(buffer, 0, BUFSIZ);
-	curl_url_set(curlu, CURLUPART_URL, FACE_URLPART_P, 0);
-
-	// retrieving the url from curlu
-	curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME);
-
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_REQUEST_URL, url);
-#endif
-
-	response = calloc(1, sizeof(ReadData));
-
-	// loading up libcurl environment
-	curl_global_init(CURL_GLOBAL_ALL);
-
-	// loading up curl_easy interface
-	curl = curl_easy_init();
-	if(curl)
-	{
-		/* First set the URL that is about to receive our POST. This URL can
-		   just as well be a https:// URL if that is what should receive the
-		   data. */
-		curl_easy_setopt(curl, CURLOPT_URL, url);
-
-		// setting request header
-		strcat(buffer, FACE_KEYTYPE);
-		strcat(buffer, key);
-		struct curl_slist * plist = curl_slist_append(NULL, buffer);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, plist);
-
-		// setting request type
-		curl_easy_setopt(curl, CURLOPT_HTTPGET, 1);
-
-		// setting write callback function and buffer
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
-
-		/* Perform the request, res will get the return code */ 
-		res = curl_easy_perform(curl);
-
-		/* Check for errors */
-		if(res != CURLE_OK)
-			fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-
-		// acquire http status code
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &ret);
-
-#ifdef _DEBUG_
-		// acquire latency
-		curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &lat);
-#endif
-
-		curl_slist_free_all(plist);
+	// the ranges were listed side by side
+	json_object_array_sort(list, compare_person);
+	*resp = list;
+	return status;
+}
 
-		/* always cleanup */
-		curl_easy_cleanup(curl);
+/**
+ * Description:
+ *		Reads a whole image file into memory
+ *
+ * Params:
+ *		fsize: the size of the image; FACE_FSIZE_UNKNOWN to read to the end
+ *		size: return parameter; the size read
+ *
+ * Return:
+ *		the image, to be freed; NULL if it can't be read
+ */
+static char * demo_read_image(FILE * image, size_t fsize, size_t * size)
+{
+	size_t capacity = fsize != FACE_FSIZE_UNKNOWN ? fsize : BUFSIZ;
+	char * data = malloc(capacity ? capacity : 1);
+	char * grown;
+	size_t n;
+
+	*size = 0;
+	if (!data) {
+		fprintf(stderr, "Malloc Error: %s\n", strerror(errno));
+		return NULL;
 	}
-	curl_url_cleanup(curlu);
-	curl_global_cleanup();
-
-	// printing http status code and latency
-#ifdef _DEBUG_
-	fprintf(stderr, FACE_HTTP_STATUS, ret);
-	fprintf(stderr, FACE_LATENCY, lat);
-#endif
 
-	// null terminating the response string
-	response->content = realloc(response->content, response->length + 1);
-	response->content[response->length] = '\0';
-	response->length++;
+	fseek(image, 0, SEEK_SET);
+	while ((n = fread(data + *size, 1, capacity - *size, image)) > 0) {
+		*size += n;
+		if (*size < capacity) continue;
+		if (fsize != FACE_FSIZE_UNKNOWN) break;
 
-	// copying the result to resp
-	*resp = json_tokener_parse(response->content);
-
-	// memory deallocation
-	free(response->content);
-	free(response);
+		if (!(grown = realloc(data, capacity * 2))) {
+			fprintf(stderr, "Realloc Error: %s\n", strerror(errno));
+			free(data);
+			return NULL;
+		}
+		data = grown;
+		capacity *= 2;
+	}
 
-	return ret;
+	if (!*size) {
+		free(data);
+		return NULL;
+	}
+	return data;
 }
 
 int _demo_register(FILE * image, size_t fsize, Table * table) {
 	char * pgName = "demo_group_1";			// default persongroup name	
 	char * pName = "demo_person";			// default person name
-	json_object * body;						// request body
-	json_object * param;					// request parameter
-	json_object * detect_resp;				// response from detect
+	FaceBody * body;						// request body
+	json_object * detect_resp = NULL;		// response from detect
 	json_object * resp;						// response from api call
-	json_object * tmp_obj;					// temporary json object
 	long status;							// HTTP request status code
-	int len;								// length of the response array
-	RegResult reg_result = {0};				// stores result of registration
-	char buffer[BUFSIZ] = {0};				// string buffer
+	int len = 0;							// length of the response array
+	RegResult * reg_results = NULL;			// stores result of registration, in detect order
+	long * reg_status = NULL;				// status of each face's registration
+	char * data;							// the image in memory
+	size_t size;							// size of the image
+	int registered = 0;						// faces registered
 	int i;
 
+	// reading the image once; detect and every face's add face post it
+	data = demo_read_image(image, fsize, &size);
+	if (!data) {
+		return -1;
+	}
+
 	// creating the request body for create_pg
-	body = json_object_new_object();
-	json_object_object_add(body, "name", json_object_new_string(pgName));
+	body = face_body_acquire();
+	if (!body) {
+		free(data);
+		return -1;
+	}
+	face_body_create_pg(body, pgName, NULL, NULL);
+
+	// creating the default person group unless it is known to exist
+	face_ensure_pg(FACE_DEMO_PGID, body, &resp);
+	json_object_put(resp);
 
-	// creating the default person group if it is not already created
-	face_create_pg(FACE_DEMO_PGID, body, &resp);
+	// creating the request body for create_p; it is the same for every face
+	face_body_create_p(body, pName, NULL);
 
 	// detect the image to check for number and location of faces
-	status = face_detect_local(image, fsize, NULL, &detect_resp);
+	status = face_detect_buffer(data, size, NULL, &detect_resp);
 
 	if(detect_resp != NULL && table != NULL && statusOk(status)){
 		len = json_object_array_length(detect_resp);
+		reg_results = (RegResult *)calloc(len ? len : 1, sizeof(RegResult));
+		reg_status = (long *)calloc(len ? len : 1, sizeof(long));
+		if (!reg_results || !reg_status) {
+			fprintf(stderr, "Calloc Error: %s\n", strerror(errno));
+			len = 0;
+		}
 		for (i = 0; i < len; ++i) {
 			json_object * mem = NULL;
 			json_object *detect_rect = NULL;
@@ -2346,10 +2717,10 @@ int _demo_register(FILE * image, size_t fsize, Table * table) {
 					json_object_object_get_ex(detect_rect, "width", &width);
 					json_object_object_get_ex(detect_rect, "height", &height);
 					if(top != NULL && left != NULL && width != NULL && height != NULL){
-						reg_result.rt.x = json_object_get_int(left);
-						reg_result.rt.y = json_object_get_int(top);
-						reg_result.rt.width = json_object_get_int(width);
-						reg_result.rt.height = json_object_get_int(height);
+						reg_results[i].rt.x = json_object_get_int(left);
+						reg_results[i].rt.y = json_object_get_int(top);
+						reg_results[i].rt.width = json_object_get_int(width);
+						reg_results[i].rt.height = json_object_get_int(height);
 					}
 					else
 						printf("top or left or width or height is null\n");
@@ -2359,68 +2730,40 @@ int _demo_register(FILE * image, size_t fsize, Table * table) {
 			}
 			else
 				printf("mem is null\n");
+		}
 
-			// creating the request body for create_p
-			json_object_put(body);
-			body = json_object_new_object();
-			json_object_object_add(body, "name", json_object_new_string(pName));
-
-			// creating a new person for the face image
-			status = face_create_p(FACE_DEMO_PGID, body, &resp);
-
-			if (!statusOk(status)) {
-				printf("Create Person fail:\n");
-				printf("%s\n", json_object_to_json_string(resp));
-				json_object_put(body);
-				return -1;
-			}
+		// registering every face at once, each add face following its
+		// create_p; a face that fails halfway has its person deleted
+		registered = face_register_faces(FACE_DEMO_PGID, body, data, size, reg_results, reg_status, len);
 
-			// extracting the personId from the response of create_p
-			json_object_object_get_ex(resp, FACE_PID, &tmp_obj);
-			strcpy(reg_result.pid, json_object_get_string(tmp_obj));
-
-			// building add face's param
-			param = json_object_new_object();
-			sprintf(buffer, "%d,%d,%d,%d", reg_result.rt.x, reg_result.rt.y, reg_result.rt.width, reg_result.rt.height);
-			tmp_obj = json_object_new_string(buffer);
-			memset(buffer, 0, BUFSIZ);
-			json_object_object_add(param, "targetFace", tmp_obj);
-
-			// adding face image to the person just created
-			fseek(image, 0, SEEK_SET);
-			status = face_add_face_local(image, fsize, FACE_DEMO_PGID, reg_result.pid, param, &resp);
-
-			if (!statusOk(status)) {
-				printf("Add face fail:\n");
-				printf("%s\n", json_object_to_json_string(resp));
-				return -1;
+		// appending in detect order
+		for (i = 0; i < len; ++i) {
+			if (!statusOk(reg_status[i])) {
+				printf("Register fail: %ld\n", reg_status[i]);
+				continue;
 			}
 
-			printf("Register successful\npid: %s\n", reg_result.pid);
-
-			table->append(table, &reg_result);
-			memset(&reg_result, 0, sizeof(RegResult));
+			printf("Register successful\npid: %s\n", reg_results[i].pid);
+			table->append(table, &reg_results[i]);
 		}
 	}
 
-
-
-	// training the person group after a new person is added
-	status = face_train_pg(FACE_DEMO_PGID, &resp);
-
-	if (!statusOk(status)) {
-		printf("train fail:\n");
-		printf("%s\n", json_object_to_json_string(resp));
-		return -1;
+	// training the person group once new persons stop coming in
+	if (registered > 0 && face_schedule_train(FACE_DEMO_PGID)) {
+		printf("train fail\n");
+		registered = -1;
 	}
 
-	// deallocating json_objects
-	json_object_put(body);
-	json_object_put(resp);
+	// giving the request body back to the pool
+	face_body_release(body);
+
+	// deallocating
 	json_object_put(detect_resp);
-	json_object_put(tmp_obj);
+	free(reg_results);
+	free(reg_status);
+	free(data);
 
-	return 0;
+	return registered == len ? 0 : -1;
 }
 
 int _demo_detect(FILE * image, size_t fsize, Table * table) {
@@ -2507,16 +2850,15 @@ int _demo_detect(FILE * image, size_t fsize, Table * table) {
 }
 
 int _demo_identify(FILE * image, size_t fsize, Table * table) {
-	json_object * body = NULL;				// request body
 	json_object * tmp_obj = NULL;			// temporary json object
 	json_object * tmp_obj2 = NULL;			// second temp json object
-	json_object * faceIds = NULL;			// faceIds array used for identify
-	char fid[BUFSIZ] = {0};					// stores faceId
-	long detect_status, ident_status;		// HTTP request status code
+	char ** fids = NULL;					// faceIds used for identify
+	long detect_status, ident_status = -1;	// HTTP request status code
 	int i;									// foreach iterator
 	int len;								// length of the response array
 	json_object *detect_resp = NULL, *ident_resp = NULL;
 	IdentResult ident_result = {0};			// stores identification result
+	RosterPerson person;					// identified person from the roster mirror
 
 	// detect the face image to acquire its faceId
 	detect_status = face_detect_local(image, fsize, NULL, &detect_resp);
@@ -2534,34 +2876,28 @@ int _demo_identify(FILE * image, size_t fsize, Table * table) {
 		return -1;
 	}
 
-	// creating the "faceIds" array in the request body
-	faceIds = json_object_new_array();
+	// collecting the faceIds; the strings stay owned by detect_resp
+	fids = (char **)calloc(len ? len : 1, sizeof(char *));
+	if (!fids) {
+		json_object_put(detect_resp);
+		return -1;
+	}
 
 	for (i = 0; i < len; ++i) {
 		// extracting the faceId from the response of detect
 		tmp_obj = json_object_array_get_idx(detect_resp, i);
 		json_object_object_get_ex(tmp_obj, FACE_FID, &tmp_obj2);
-		strcpy(fid, json_object_get_string(tmp_obj2));
-
-		// add the face id to the "faceIds" array
-		json_object_array_add(faceIds, json_object_new_string(fid));
-
-		// creating request body for identify
-		body = json_object_new_object();
-
-		memset(fid, 0, BUFSIZ);
+		fids[i] = tmp_obj2 ? (char *)json_object_get_string(tmp_obj2) : "";
 	}
 
-	// adding the "faceIds" array to the request body
-	json_object_object_add(body, FACE_FIDS, faceIds);
-
-	// adding the default persongroupId to the request body
-	json_object_object_add(body, FACE_PGID, json_object_new_string(FACE_DEMO_PGID));
-
-	// identify the face image in the default persongroup
-	ident_status = face_identify(body, &ident_resp);
+	// identify the face image in the default persongroup; frames identified
+	// at the same time by other threads share the call, and frames with
+	// more than 10 faces are split
+	if (len) {
+		ident_status = face_identify_coalesced(FACE_DEMO_PGID, fids, len, 0, -1, &ident_resp);
+	}
 
-	json_object_put(body);
+	free(fids);
 
 
 	if(detect_resp != NULL && ident_resp != NULL && table != NULL && statusOk(detect_status) && statusOk(ident_status)){
@@ -2612,6 +2948,11 @@ int _demo_identify(FILE * image, size_t fsize, Table * table) {
 					if (pid && confidence) {
 						strcpy(ident_result.pid, json_object_get_string(pid));
 						ident_result.confidence = json_object_get_double(confidence);
+
+						// naming the person without a call
+						if (!face_roster_lookup(FACE_DEMO_PGID, ident_result.pid, &person)) {
+							snprintf(ident_result.name, sizeof(ident_result.name), "%s", person.name);
+						}
 					}
 					else
 						printf("pid or confidence is null\n");
@@ -2652,13 +2993,23 @@ void setUriParam(CURLU * curlu, const char * name, struct json_object * value) {
  * Sets the base of the request url
  *
  * param: curlu: CURLU handle used for parsing url
+ *		  rg: the region the request goes to
  *		  base: the url base of the given request
  */
-void setUriBase(CURLU * curlu, const char * base) {
+void setUriBase(CURLU * curlu, const char * rg, const char * base) {
 	char buffer[BUFSIZ] = {0};
-	strcat(buffer, FACE_HTTPS);
-	strcat(buffer, region);
-	strcat(buffer, base);
+
+	// a region given as a full url (e.g. a local mock server) replaces the
+	// service host; only the path of base is kept
+	if (strstr(rg, FACE_SCHEME_SEP)) {
+		strcat(buffer, rg);
+		strcat(buffer, base + strlen(FACE_HOST));
+	}
+	else {
+		strcat(buffer, FACE_HTTPS);
+		strcat(buffer, rg);
+		strcat(buffer, base);
+	}
 	curl_url_set(curlu, CURLUPART_URL, buffer, 0);
 	return;
 }
@@ -2830,11 +3181,17 @@ int demo_detect(FILE * image, size_t fsize, Table * table) {
 		.table = table,
 		.rqst_func = _demo_detect
 	};
-	if (enqueue(request_queue, &rqst)) {
+	FaceClient * client = face_client_current();
+
+	if (!client->demo) {
+		fprintf(stderr, "Error: call face_init first\n");
+		return -1;
+	}
+	if (enqueue(client->request_queue, &rqst)) {
 		fprintf(stderr, "Request queue full\n");
 		return -1;
 	}
-	sem_post(&request_counter);
+	sem_post(&client->request_counter);
 	return 0;
 }
 
@@ -2846,11 +3203,17 @@ int demo_register(FILE * image, size_t fsize, Table * table) {
 		.table = table,
 		.rqst_func = _demo_register
 	};
-	if (enqueue(request_queue, &rqst)) {
+	FaceClient * client = face_client_current();
+
+	if (!client->demo) {
+		fprintf(stderr, "Error: call face_init first\n");
+		return -1;
+	}
+	if (enqueue(client->request_queue, &rqst)) {
 		fprintf(stderr, "Request queue full\n");
 		return -1;
 	}
-	sem_post(&request_counter);
+	sem_post(&client->request_counter);
 	return 0;
 }
 
@@ -2862,11 +3225,17 @@ int demo_identify(FILE * image, size_t fsize, Table * table) {
 		.table = table,
 		.rqst_func = _demo_identify
 	};
-	if (enqueue(request_queue, &rqst)) {
+	FaceClient * client = face_client_current();
+
+	if (!client->demo) {
+		fprintf(stderr, "Error: call face_init first\n");
+		return -1;
+	}
+	if (enqueue(client->request_queue, &rqst)) {
 		fprintf(stderr, "Request queue full\n");
 		return -1;
 	}
-	sem_post(&request_counter);
+	sem_post(&client->request_counter);
 	return 0;
 }
 
@@ -2875,6 +3244,7 @@ Queue * queue_new(QueueType type, unsigned int capacity) {
 	new_queue->capacity = capacity;
 	new_queue->rear = capacity - 1;
 	new_queue->type = type;
+	pthread_mutex_init(&new_queue->lock, NULL);
 	switch (type) {
 		case FACE_QUEUETYPE_REQUEST:
 			new_queue->arr.rqstArr = (Request *)calloc((int)capacity, sizeof(Request));
@@ -2894,7 +3264,7 @@ Queue * queue_new(QueueType type, unsigned int capacity) {
 void queue_free(Queue * queue) {
 
 	// mutex lock
-	pthread_mutex_lock(&queue_lock);
+	pthread_mutex_lock(&queue->lock);
 
 	switch (queue->type) {
 		case FACE_QUEUETYPE_REQUEST:
@@ -2905,12 +3275,14 @@ void queue_free(Queue * queue) {
 			break;
 		default:
 			fprintf(stderr, "Error: Queue type not supported\n");
+			pthread_mutex_unlock(&queue->lock);
 			return;
 	}
-	free(queue);
 
 	// mutex unlock
-	pthread_mutex_unlock(&queue_lock);
+	pthread_mutex_unlock(&queue->lock);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue);
 
 	return;
 }
@@ -2959,12 +3331,12 @@ int dequeue(Queue * queue) {
 
 	// mutex lock
 	printf("[waiting] dequeue thread id: %.4x\n", pthread_self());
-	pthread_mutex_lock(&queue_lock);
+	pthread_mutex_lock(&queue->lock);
 
 	printf("[entry] dequeue thread id: %.4x\n", pthread_self());
 
 	if (queue_isempty(queue)) {
-		pthread_mutex_unlock(&queue_lock);
+		pthread_mutex_unlock(&queue->lock);
 		printf("[exit] dequeue thread id: %.4x\n", pthread_self());
 		return -1;
 	}
@@ -2973,7 +3345,7 @@ int dequeue(Queue * queue) {
 	queue->size = queue->size - 1;
 
 	// mutex unlock
-	pthread_mutex_unlock(&queue_lock);
+	pthread_mutex_unlock(&queue->lock);
 	printf("[exit] dequeue thread id: %.4x\n", pthread_self());
 
 	return 0;
@@ -2983,12 +3355,12 @@ int enqueue(Queue * queue, void * item) {
 
 	// mutex lock
 	printf("[waiting] enqueue thread id: %.4x\n", pthread_self());
-	pthread_mutex_lock(&queue_lock);
+	pthread_mutex_lock(&queue->lock);
 
 	printf("[entry] enqueue thread id: %.4x\n", pthread_self());
 
 	if (queue_isfull(queue)) {
-		pthread_mutex_unlock(&queue_lock);
+		pthread_mutex_unlock(&queue->lock);
 		printf("[exit] enqueue thread id: %.4x\n", pthread_self());
 		return -1;
 	}
@@ -3014,7 +3386,7 @@ int enqueue(Queue * queue, void * item) {
 
 	// mutex unlock
 	printf("[exit] enqueue thread id: %.4x\n", pthread_self());
-	pthread_mutex_unlock(&queue_lock);
+	pthread_mutex_unlock(&queue->lock);
 
 	return 0;
 }
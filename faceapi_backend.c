@@ -0,0 +1,613 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+static __thread char affinity[FACE_PGID_SIZE];		// persongroup this thread works on
+
+/**
+ * Description:
+ *		Sets up an empty backend pool; face_client_login adds the first
+ *		backend
+ */
+void face_backend_init(BackendPool * pool) {
+	memset(pool, 0, sizeof(BackendPool));
+	pool->route_mode = FACE_ROUTE_LEAST_OUTSTANDING;
+	pool->route_fastest = -1;
+	pthread_mutex_init(&pool->lock, NULL);
+}
+
+/**
+ * Description:
+ *		Releases what face_backend_init set up
+ */
+void face_backend_destroy(BackendPool * pool) {
+	pthread_mutex_destroy(&pool->lock);
+}
+
+/**
+ * Description:
+ *		Drops every backend and persongroup pin; used by face_client_login
+ */
+void face_backend_reset(BackendPool * pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->count = 0;
+	pool->pin_count = 0;
+	pool->route_fastest = -1;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Description:
+ *		Adds a subscription to spread the requests of a client over
+ *
+ * Params:
+ *		client: the client
+ *		rg: the region, or a full url as with face_login
+ *		ky: the subscription key
+ *		weight: share of the requests relative to the other backends
+ *		tps: requests per second allowed by the key's tier; 0 to use the
+ *			 limit set by face_set_rate_limit
+ *
+ * Return:
+ *		index of the backend; -1 if there are already FACE_BACKEND_MAX
+ */
+int face_backend_add(FaceClient * client, const char * rg, const char * ky, int weight, double tps) {
+	BackendPool * pool = &client->backend;
+	FaceBackend * backend;
+	int index;
+
+	if (!rg || !ky) return -1;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->count == FACE_BACKEND_MAX) {
+		pthread_mutex_unlock(&pool->lock);
+		fprintf(stderr, "Error: no more than %d backends\n", FACE_BACKEND_MAX);
+		return -1;
+	}
+
+	index = pool->count;
+	backend = &pool->backends[index];
+	memset(backend, 0, sizeof(FaceBackend));
+	snprintf(backend->region, sizeof(backend->region), "%s", rg);
+	snprintf(backend->key, sizeof(backend->key), "%s", ky);
+	backend->weight = weight < 1 ? 1 : weight;
+	pool->count++;
+	pthread_mutex_unlock(&pool->lock);
+
+	if (tps > 0) {
+		face_rate_configure(&client->rate, ky, tps, tps);
+	}
+
+	return index;
+}
+
+/**
+ * Description:
+ *		Adds a subscription to spread requests over. face_login sets up the
+ *		first one; each added region and key gets its own rate limit
+ *
+ * Params:
+ *		rg: the region, or a full url as with face_login
+ *		ky: the subscription key
+ *		weight: share of the requests relative to the other backends
+ *		tps: requests per second allowed by the key's tier; 0 to use the
+ *			 limit set by face_set_rate_limit
+ *
+ * Return:
+ *		index of the backend; -1 if there are already FACE_BACKEND_MAX
+ */
+int face_add_backend(const char * rg, const char * ky, int weight, double tps) {
+	return face_backend_add(face_client_current(), rg, ky, weight, tps);
+}
+
+/**
+ * Description:
+ *		Gets the number of backends
+ */
+int face_backend_count() {
+	BackendPool * pool = &face_client_current()->backend;
+	int count;
+
+	pthread_mutex_lock(&pool->lock);
+	count = pool->count;
+	pthread_mutex_unlock(&pool->lock);
+	return count;
+}
+
+/**
+ * Description:
+ *		Gets the load and health of a backend
+ *
+ * Params:
+ *		index: index of the backend, see face_add_backend
+ *		stats: return parameter; the metrics
+ *
+ * Return:
+ *		0 if successful; -1 if index is out of range
+ */
+int face_get_backend_stats(int index, BackendStats * stats) {
+	BackendPool * pool = &face_client_current()->backend;
+	struct timespec now;
+
+	if (!stats) return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&pool->lock);
+	if (index < 0 || index >= pool->count) {
+		pthread_mutex_unlock(&pool->lock);
+		return -1;
+	}
+	stats->region = pool->backends[index].region;
+	stats->outstanding = pool->backends[index].outstanding;
+	stats->healthy = now.tv_sec >= pool->backends[index].down_until;
+	stats->requests = pool->backends[index].requests;
+	stats->errors = pool->backends[index].errors;
+	stats->latency = pool->backends[index].latency;
+	stats->error_rate = pool->backends[index].error_rate;
+	stats->routed = pool->backends[index].routed;
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/**
+ * Description:
+ *		Sends every request of the calling thread to the backend owning a
+ *		persongroup. FaceIds only work in the subscription that detected
+ *		them, so detect calls whose faceIds are identified against a group
+ *		have to go where the group is
+ *
+ * Params:
+ *		pgid: the persongroupId; NULL to spread requests again
+ */
+void face_set_affinity(const char * pgid) {
+	snprintf(affinity, sizeof(affinity), "%s", pgid ? pgid : "");
+}
+
+/**
+ * Description:
+ *		Finds the pin of a persongroup and marks it used. Must hold
+ *		pool->lock
+ *
+ * Return:
+ *		the pin; NULL if the group isn't pinned
+ */
+static PgPin * pin_find(BackendPool * pool, const char * pgid)
+{
+	int i;
+
+	for (i = 0; i < pool->pin_count; ++i) {
+		if (!strcmp(pool->pins[i].pgid, pgid)) {
+			pool->pins[i].used = ++pool->pin_clock;
+			return &pool->pins[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Description:
+ *		Pins a persongroup to a backend. Once every pin is in use the least
+ *		recently used learned one makes room; pins set with face_pin_pg are
+ *		never evicted. Must hold pool->lock
+ *
+ * Params:
+ *		pool: the pool
+ *		pgid: the persongroupId
+ *		backend: index of the backend owning the group
+ *		learned: 1 if the backend is only where the group's first request
+ *				 went
+ *
+ * Return:
+ *		the pin; NULL if every pin was set with face_pin_pg
+ */
+static PgPin * pin_add(BackendPool * pool, const char * pgid, int backend, int learned)
+{
+	PgPin * pin = pin_find(pool, pgid);
+	int i;
+
+	if (!pin && pool->pin_count < FACE_PIN_MAX) {
+		pin = &pool->pins[pool->pin_count++];
+		pin->pgid[0] = '\0';
+	}
+	else if (!pin) {
+		for (i = 0; i < pool->pin_count; ++i) {
+			if (pool->pins[i].learned && (!pin || pool->pins[i].used < pin->used)) {
+				pin = &pool->pins[i];
+			}
+		}
+		if (!pin) {
+			return NULL;
+		}
+	}
+
+	if (strcmp(pin->pgid, pgid)) {
+#ifdef _DEBUG_
+		if (pin->pgid[0]) {
+			fprintf(stderr, FACE_PIN_EVICTED, pin->pgid);
+		}
+#endif
+		snprintf(pin->pgid, sizeof(pin->pgid), "%s", pgid);
+	}
+	pin->backend = backend;
+	pin->learned = learned;
+	pin->used = ++pool->pin_clock;
+
+	return pin;
+}
+
+/**
+ * Description:
+ *		Pins a persongroup to the backend of a region. Groups that aren't
+ *		pinned are pinned to the backend chosen for their first request,
+ *		and moved if that backend doesn't have them, see
+ *		face_backend_probe; pinning spares the probing
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *		rg: region of the backend that owns the group
+ *
+ * Return:
+ *		0 if successful; -1 if no backend has the region or FACE_PIN_MAX
+ *		groups are pinned already
+ */
+int face_pin_pg(const char * pgid, const char * rg) {
+	BackendPool * pool = &face_client_current()->backend;
+	int i;
+
+	if (!pgid || !rg || strlen(pgid) >= FACE_PGID_SIZE) return -1;
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < pool->count && strcmp(pool->backends[i].region, rg); ++i);
+	if (i == pool->count || !pin_add(pool, pgid, i, 0)) {
+		pthread_mutex_unlock(&pool->lock);
+		return -1;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/**
+ * Description:
+ *		Sets how detect and verify calls that aren't tied to a persongroup
+ *		are routed
+ *
+ * Params:
+ *		mode: FACE_ROUTE_LEAST_OUTSTANDING spreads them like every other
+ *			  call; FACE_ROUTE_FASTEST sends them to the healthy backend
+ *			  with the lowest moving average latency
+ */
+void face_set_routing(RouteMode mode) {
+	BackendPool * pool = &face_client_current()->backend;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->route_mode = mode;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Description:
+ *		Gets the routing decisions made for stateless calls
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_routing_stats(RoutingStats * stats) {
+	BackendPool * pool = &face_client_current()->backend;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&pool->lock);
+	*stats = pool->route_stats;
+	stats->fastest = pool->route_fastest;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Description:
+ *		Picks the backend with the lowest latency among those that are
+ *		healthy and whose error rate hasn't regressed. A share of the calls
+ *		goes to another backend so its estimate stays current. Must hold
+ *		pool->lock
+ *
+ * Return:
+ *		index of the backend; -1 if no backend qualifies
+ */
+static int backend_fastest(BackendPool * pool, const struct timespec * now)
+{
+	static __thread unsigned int seed = 0;		// per thread seed for exploring
+	int best = -1;
+	int i;
+
+	if (!seed) {
+		seed = (unsigned int)time(NULL) ^ (unsigned int)pthread_self();
+	}
+
+	// exploring; any backend but the current fastest
+	if (pool->count > 1 && rand_r(&seed) % 100 < FACE_ROUTE_EXPLORE) {
+		i = rand_r(&seed) % pool->count;
+		if (i != pool->route_fastest && now->tv_sec >= pool->backends[i].down_until) {
+			pool->route_stats.explorations++;
+			pool->backends[i].routed++;
+			return i;
+		}
+	}
+
+	for (i = 0; i < pool->count; ++i) {
+		if (now->tv_sec < pool->backends[i].down_until) continue;
+		if (pool->backends[i].error_rate > FACE_ROUTE_MAX_ERRORS) continue;
+
+		// backends not measured yet are tried first
+		if (best < 0 || pool->backends[i].latency < pool->backends[best].latency) {
+			best = i;
+		}
+	}
+
+	if (best >= 0) {
+		pool->route_stats.decisions++;
+		pool->backends[best].routed++;
+		if (best != pool->route_fastest) {
+			pool->route_stats.switches++;
+#ifdef _DEBUG_
+			fprintf(stderr, FACE_ROUTE_SWITCH, pool->backends[best].region, pool->backends[best].latency);
+#endif
+			pool->route_fastest = best;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Description:
+ *		Picks the healthy backend with the fewest outstanding requests for
+ *		its weight, or any backend if none is healthy. Must hold pool->lock
+ *
+ * Params:
+ *		pool: the pool
+ *		now: the monotonic time
+ *		skip: index of a backend not to pick; -1 for none
+ *
+ * Return:
+ *		index of the backend; -1 if skip is the only one
+ */
+static int backend_pick(BackendPool * pool, const struct timespec * now, int skip)
+{
+	int best = -1;
+	int healthy;
+	int i;
+	int k;
+
+	for (healthy = 1; healthy >= 0 && best < 0; --healthy) {
+		for (k = 0; k < pool->count; ++k) {
+			// starting from a different backend each time to break ties
+			i = (pool->turn + k) % pool->count;
+			if (i == skip) continue;
+			if (healthy && now->tv_sec < pool->backends[i].down_until) continue;
+
+			// comparing (outstanding + 1) / weight without dividing
+			if (best < 0 || (long)(pool->backends[i].outstanding + 1) * pool->backends[best].weight
+				< (long)(pool->backends[best].outstanding + 1) * pool->backends[i].weight) {
+				best = i;
+			}
+		}
+	}
+	pool->turn++;
+
+	return best;
+}
+
+/**
+ * Description:
+ *		Chooses the backend a request goes to and counts it as outstanding.
+ *		Requests about a persongroup go to the backend that owns it
+ *
+ * Params:
+ *		pool: backends of the client sending the request
+ *		ep: endpoint of the request
+ *		pgid: persongroup the request is about; NULL if none
+ *
+ * Return:
+ *		the backend; NULL if there is none. Give it back with
+ *		face_backend_release
+ */
+FaceBackend * face_backend_acquire(BackendPool * pool, FaceEndpoint ep, const char * pgid) {
+	FaceBackend * backend;
+	struct timespec now;
+	PgPin * pin;
+	int index = -1;
+
+	if (!pgid && affinity[0]) {
+		pgid = affinity;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&pool->lock);
+	if (!pool->count) {
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+
+	if (pgid && pgid[0]) {
+		if ((pin = pin_find(pool, pgid))) {
+			index = pin->backend;
+		}
+		else {
+			// pinning the group to wherever its first request goes; a
+			// group that turns out to live elsewhere is moved on its 404
+			index = backend_pick(pool, &now, -1);
+			if (!pin_add(pool, pgid, index, 1)) {
+				pthread_mutex_unlock(&pool->lock);
+				fprintf(stderr, FACE_PIN_ERROR, pgid, FACE_PIN_MAX);
+				return NULL;
+			}
+		}
+	}
+	else {
+		if (pool->route_mode == FACE_ROUTE_FASTEST && (ep == FACE_EP_DETECT || ep == FACE_EP_VERIFY)) {
+			index = backend_fastest(pool, &now);
+		}
+		if (index < 0) {
+			index = backend_pick(pool, &now, -1);
+		}
+	}
+
+	backend = &pool->backends[index];
+	backend->outstanding++;
+	backend->requests++;
+	pthread_mutex_unlock(&pool->lock);
+
+	return backend;
+}
+
+/**
+ * Description:
+ *		Gives back a backend taken by face_backend_acquire. After
+ *		FACE_BACKEND_MAX_FAILURES failures in a row it is left out for
+ *		FACE_BACKEND_COOLDOWN seconds unless no other backend is healthy
+ *
+ * Params:
+ *		pool: the pool the backend was taken from
+ *		backend: the backend
+ *		failed: 1 if the request failed with a 5xx, a network error or an
+ *				open circuit breaker
+ *		latency: time the last attempt took in ms
+ */
+void face_backend_release(BackendPool * pool, FaceBackend * backend, int failed, double latency) {
+	struct timespec now;
+
+	pthread_mutex_lock(&pool->lock);
+	backend->outstanding--;
+
+	// moving averages of latency and errors for routing
+	if (!failed) {
+		backend->latency = backend->latency > 0
+			? backend->latency + FACE_ROUTE_ALPHA * (latency - backend->latency)
+			: latency;
+	}
+	backend->error_rate += FACE_ROUTE_ALPHA * (failed - backend->error_rate);
+
+	if (failed) {
+		backend->errors++;
+		if (++backend->failures >= FACE_BACKEND_MAX_FAILURES) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			backend->down_until = now.tv_sec + FACE_BACKEND_COOLDOWN;
+			backend->failures = 0;
+		}
+	}
+	else {
+		backend->failures = 0;
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Description:
+ *		Chooses the backend the retry of a failed request goes to. A request
+ *		about a persongroup stays with the backend owning the group; any
+ *		other moves to the least loaded healthy backend but the one that
+ *		failed, if there is one
+ *
+ * Params:
+ *		pool: backends of the client sending the request
+ *		failed: the backend the request failed on
+ *		pgid: persongroup the request is about; NULL if none
+ *
+ * Return:
+ *		the backend of the retry; failed if it stays. A new one is counted
+ *		as outstanding and failed still has to be given back with
+ *		face_backend_release
+ */
+FaceBackend * face_backend_reroute(BackendPool * pool, FaceBackend * failed, const char * pgid) {
+	FaceBackend * backend = failed;
+	struct timespec now;
+	int index;
+
+	if ((pgid && pgid[0]) || affinity[0]) {
+		return failed;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&pool->lock);
+	index = backend_pick(pool, &now, (int)(failed - pool->backends));
+	if (index >= 0) {
+		backend = &pool->backends[index];
+		backend->outstanding++;
+		backend->requests++;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+#ifdef _DEBUG_
+	if (backend != failed) {
+		fprintf(stderr, FACE_REROUTE, backend->region);
+	}
+#endif
+
+	return backend;
+}
+
+/**
+ * Description:
+ *		Looks for the backend owning a persongroup after the one it was
+ *		pinned to answered that it doesn't have it, as happens when the
+ *		group's first request since a restart picked the wrong one. Only a
+ *		pin learned from the first request moves, to the next backend not
+ *		tried yet; one set with face_pin_pg stays. Once every backend was
+ *		tried the pin is dropped, so the group is pinned again where it
+ *		gets created
+ *
+ * Params:
+ *		pool: backends of the client sending the request
+ *		missing: the backend that doesn't have the group
+ *		pgid: the persongroupId
+ *		tried: bitmask of the backends tried by the request; 0 at first
+ *
+ * Return:
+ *		the backend to try next, counted as outstanding; NULL if there is
+ *		none. missing still has to be given back with face_backend_release
+ */
+FaceBackend * face_backend_probe(BackendPool * pool, FaceBackend * missing, const char * pgid, unsigned int * tried) {
+	FaceBackend * backend = NULL;
+	PgPin * pin;
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pin = pin_find(pool, pgid);
+	if (pin && !pin->learned) {
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+
+	*tried |= 1u << (missing - pool->backends);
+	for (i = 0; i < pool->count && (*tried & (1u << i)); ++i);
+
+	if (i < pool->count) {
+		if (pin) {
+			pin->backend = i;
+		}
+		else {
+			pin_add(pool, pgid, i, 1);
+		}
+		backend = &pool->backends[i];
+		backend->outstanding++;
+		backend->requests++;
+	}
+	else if (pin) {
+		*pin = pool->pins[--pool->pin_count];
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+#ifdef _DEBUG_
+	if (backend) {
+		fprintf(stderr, FACE_PIN_MOVED, pgid, missing->region, backend->region);
+	}
+#endif
+
+	return backend;
+}
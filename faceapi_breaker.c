@@ -0,0 +1,304 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+static const BreakerPolicy breaker_defaults = {
+	.window = FACE_BREAKER_WINDOW,
+	.min_requests = FACE_BREAKER_MIN_REQUESTS,
+	.failure_rate = FACE_BREAKER_FAILURE_RATE,
+	.slow_ms = FACE_BREAKER_SLOW,
+	.open_ms = FACE_BREAKER_OPEN_TIME,
+	.max_open_ms = FACE_BREAKER_MAX_OPEN_TIME,
+	.probes = FACE_BREAKER_PROBES
+};
+
+/**
+ * Description:
+ *		Sets up the circuit breakers of a client with the default policy
+ */
+void face_breaker_init(BreakerTable * table) {
+	table->count = 0;
+	table->policy = breaker_defaults;
+	pthread_mutex_init(&table->lock, NULL);
+}
+
+/**
+ * Description:
+ *		Releases what face_breaker_init set up and the breakers' regions
+ */
+void face_breaker_destroy(BreakerTable * table) {
+	int i;
+
+	for (i = 0; i < table->count; ++i) {
+		free(table->breakers[i].region);
+	}
+	pthread_mutex_destroy(&table->lock);
+}
+
+/**
+ * Description:
+ *		Sets when breakers open and how they recover; applies to every
+ *		endpoint and region
+ *
+ * Params:
+ *		policy: the new policy; window of 0 turns the breakers off
+ */
+void face_set_breaker_policy(const BreakerPolicy * policy) {
+	BreakerTable * table = &face_client_current()->breaker;
+	int i;
+
+	if (!policy) return;
+
+	pthread_mutex_lock(&table->lock);
+	table->policy = *policy;
+	if (table->policy.window > FACE_BREAKER_MAX_WINDOW) {
+		table->policy.window = FACE_BREAKER_MAX_WINDOW;
+	}
+	if (table->policy.probes < 1) {
+		table->policy.probes = 1;
+	}
+
+	// starting over with the new window
+	for (i = 0; i < table->count; ++i) {
+		table->breakers[i].state = FACE_BREAKER_CLOSED;
+		table->breakers[i].count = table->breakers[i].next = table->breakers[i].failures = 0;
+	}
+	pthread_mutex_unlock(&table->lock);
+}
+
+/**
+ * Description:
+ *		Finds the breaker of an endpoint and region, creating a closed one
+ *		the first time. Must hold table->lock
+ *
+ * Return:
+ *		the breaker; NULL if the table is full
+ */
+static FaceBreaker * breaker_find(BreakerTable * table, FaceEndpoint ep, const char * region)
+{
+	FaceBreaker * breaker;
+	int i;
+
+	for (i = 0; i < table->count; ++i) {
+		if (table->breakers[i].ep == ep && !strcmp(table->breakers[i].region, region)) {
+			return &table->breakers[i];
+		}
+	}
+
+	if (table->count == FACE_BREAKER_MAX) {
+		return NULL;
+	}
+
+	breaker = &table->breakers[table->count];
+	memset(breaker, 0, sizeof(FaceBreaker));
+	breaker->region = strdup(region);
+	if (!breaker->region) {
+		return NULL;
+	}
+	breaker->ep = ep;
+	breaker->state = FACE_BREAKER_CLOSED;
+	breaker->open_ms = table->policy.open_ms;
+	table->count++;
+	return breaker;
+}
+
+/**
+ * Description:
+ *		Gets the state of the breaker of an endpoint and region
+ *
+ * Params:
+ *		ep: the endpoint
+ *		region: the region as given to face_login
+ *		stats: return parameter; the state and counters
+ *
+ * Return:
+ *		0 if successful; -1 if no request went to the endpoint and region
+ */
+int face_get_breaker_stats(FaceEndpoint ep, const char * region, BreakerStats * stats) {
+	BreakerTable * table = &face_client_current()->breaker;
+	int i;
+
+	if (!stats || !region) return -1;
+
+	pthread_mutex_lock(&table->lock);
+	for (i = 0; i < table->count; ++i) {
+		FaceBreaker * breaker = &table->breakers[i];
+		if (breaker->ep != ep || strcmp(breaker->region, region)) continue;
+
+		stats->state = breaker->state;
+		stats->failure_rate = breaker->count ? (double)breaker->failures / breaker->count : 0;
+		stats->trips = breaker->trips;
+		stats->rejected = breaker->rejected;
+		pthread_mutex_unlock(&table->lock);
+		return 0;
+	}
+	pthread_mutex_unlock(&table->lock);
+
+	return -1;
+}
+
+/**
+ * Description:
+ *		Opens a breaker, doubling how long it stays open if it failed again
+ *		while half-open. Must hold table->lock
+ */
+static void breaker_open(BreakerTable * table, FaceBreaker * breaker)
+{
+	if (breaker->state == FACE_BREAKER_HALF_OPEN) {
+		breaker->open_ms *= 2;
+		if (breaker->open_ms > table->policy.max_open_ms) {
+			breaker->open_ms = table->policy.max_open_ms;
+		}
+	}
+	else {
+		breaker->open_ms = table->policy.open_ms;
+	}
+
+	breaker->state = FACE_BREAKER_OPEN;
+	clock_gettime(CLOCK_MONOTONIC, &breaker->opened);
+	breaker->trips++;
+
+#ifdef _DEBUG_
+	fprintf(stderr, FACE_BREAKER_OPENED, breaker->region, breaker->ep, breaker->open_ms);
+#endif
+}
+
+/**
+ * Description:
+ *		Checks if a request to ep in region may be sent. While open every
+ *		request is turned away; once open_ms has passed the breaker goes
+ *		half-open and lets a growing number of probes through
+ *
+ * Params:
+ *		table: circuit breakers of the client sending the request
+ *		ep: the endpoint
+ *		region: the region the request goes to
+ *		breaker: return parameter; pass to face_breaker_record once the
+ *				 request is done
+ *
+ * Return:
+ *		1 if the request may be sent; 0 if it should fail fast
+ */
+int face_breaker_allow(BreakerTable * table, FaceEndpoint ep, const char * region, FaceBreaker ** breaker) {
+	struct timespec now;
+	FaceBreaker * b;
+	long elapsed;
+	int allow = 1;
+
+	*breaker = NULL;
+
+	pthread_mutex_lock(&table->lock);
+	if (!table->policy.window || !(b = breaker_find(table, ep, region))) {
+		pthread_mutex_unlock(&table->lock);
+		return 1;
+	}
+
+	if (b->state == FACE_BREAKER_OPEN) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (now.tv_sec - b->opened.tv_sec) * 1000
+			+ (now.tv_nsec - b->opened.tv_nsec) / 1000000;
+		if (elapsed >= b->open_ms) {
+			b->state = FACE_BREAKER_HALF_OPEN;
+			b->probes = 0;
+			b->probe_limit = 1;
+			b->successes = 0;
+		}
+	}
+
+	switch (b->state) {
+		case FACE_BREAKER_OPEN:
+			allow = 0;
+			break;
+		case FACE_BREAKER_HALF_OPEN:
+			allow = b->probes < b->probe_limit;
+			if (allow) b->probes++;
+			break;
+		default:
+			break;
+	}
+
+	if (allow) {
+		*breaker = b;
+	}
+	else {
+		b->rejected++;
+	}
+	pthread_mutex_unlock(&table->lock);
+
+	return allow;
+}
+
+/**
+ * Description:
+ *		Records how a request let through by face_breaker_allow went. A
+ *		5xx, a network error or a response slower than slow_ms counts as a
+ *		failure; a 429 does not, as the service is only asking for less
+ *
+ * Params:
+ *		table: the table passed to face_breaker_allow
+ *		breaker: as returned by face_breaker_allow; may be NULL
+ *		latency: time the request took in ms
+ *		status: http status; 0 if there was no response
+ *		res: libcurl result of the request
+ */
+void face_breaker_record(BreakerTable * table, FaceBreaker * breaker, double latency, long status, CURLcode res) {
+	int failed;
+
+	if (!breaker) return;
+
+	pthread_mutex_lock(&table->lock);
+	failed = res != CURLE_OK || status >= 500 || latency > table->policy.slow_ms;
+	if (breaker->state == FACE_BREAKER_HALF_OPEN) {
+		if (breaker->probes > 0) breaker->probes--;
+		if (failed) {
+			breaker_open(table, breaker);
+		}
+		else if (++breaker->successes >= table->policy.probes) {
+			// recovered; starting with a clean window
+			breaker->state = FACE_BREAKER_CLOSED;
+			breaker->count = breaker->next = breaker->failures = 0;
+		}
+		else {
+			// letting twice as many probes through after each success
+			breaker->probe_limit *= 2;
+		}
+	}
+	else if (breaker->state == FACE_BREAKER_CLOSED) {
+		if (breaker->count == table->policy.window) {
+			breaker->failures -= breaker->outcomes[breaker->next];
+		}
+		else {
+			breaker->count++;
+		}
+		breaker->outcomes[breaker->next] = failed;
+		breaker->failures += failed;
+		breaker->next = (breaker->next + 1) % table->policy.window;
+
+		if (breaker->count >= table->policy.min_requests
+			&& breaker->failures >= table->policy.failure_rate * breaker->count) {
+			breaker_open(table, breaker);
+		}
+	}
+	pthread_mutex_unlock(&table->lock);
+}
+
+/**
+ * Description:
+ *		Gives back the admission of a request let through by
+ *		face_breaker_allow that was cancelled before it finished, so it
+ *		neither counts as an outcome nor holds on to a half-open probe
+ *
+ * Params:
+ *		table: the table passed to face_breaker_allow
+ *		breaker: as returned by face_breaker_allow; may be NULL
+ */
+void face_breaker_cancel(BreakerTable * table, FaceBreaker * breaker) {
+	if (!breaker) return;
+
+	pthread_mutex_lock(&table->lock);
+	if (breaker->state == FACE_BREAKER_HALF_OPEN && breaker->probes > 0) {
+		breaker->probes--;
+	}
+	pthread_mutex_unlock(&table->lock);
+}
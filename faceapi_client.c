@@ -0,0 +1,531 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+static FaceClient default_client;					// client of threads not bound to one
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+static pthread_once_t global_once = PTHREAD_ONCE_INIT;
+static __thread FaceClient * bound_client = NULL;	// client of this thread; NULL for the default
+
+static int client_init(FaceClient * client, int workers);
+
+/**
+ * Description:
+ *		Sets up libcurl for the whole process; clients only pay for it once
+ */
+static void global_init()
+{
+	curl_global_init(CURL_GLOBAL_ALL);
+}
+
+static void default_init()
+{
+	client_init(&default_client, 0);
+}
+
+static void share_lock(CURL * handle, curl_lock_data data, curl_lock_access access, void * client)
+{
+	(void)handle;
+	(void)access;
+	pthread_mutex_lock(&((FaceClient *)client)->share_locks[data]);
+}
+
+static void share_unlock(CURL * handle, curl_lock_data data, void * client)
+{
+	(void)handle;
+	pthread_mutex_unlock(&((FaceClient *)client)->share_locks[data]);
+}
+
+/**
+ * Description:
+ *		Sets up a client with nothing shared with any other client: its
+ *		own backends, limits, pools and a share handle so that its requests
+ *		reuse each other's dns lookups, connections and tls sessions
+ *
+ * Params:
+ *		client: the client; zeroed here
+ *		workers: threads running submitted tasks; 0 for FACE_CLIENT_WORKERS
+ *
+ * Return:
+ *		0 if successful
+ */
+static int client_init(FaceClient * client, int workers)
+{
+	int i;
+
+	pthread_once(&global_once, global_init);
+
+	memset(client, 0, sizeof(FaceClient));
+	face_retry_init(&client->retry);
+	face_rate_init(&client->rate);
+	face_limit_init(&client->limit);
+	face_hedge_init(&client->hedge);
+	face_transfer_init(&client->transfer);
+	face_coalesce_init(&client->coalesce);
+	face_flight_init(&client->flight);
+	face_pg_init(&client->pgcache);
+	face_roster_init(&client->roster);
+	face_shard_init(&client->shard);
+	face_train_init(&client->train);
+	face_breaker_init(&client->breaker);
+	face_backend_init(&client->backend);
+	face_prewarm_init(&client->prewarm);
+	face_tls_init(&client->tls);
+	pthread_mutex_init(&client->body_pool_lock, NULL);
+	pthread_mutex_init(&client->image_cache_lock, NULL);
+	pthread_mutex_init(&client->task_lock, NULL);
+	pthread_cond_init(&client->task_cond, NULL);
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; ++i) {
+		pthread_mutex_init(&client->share_locks[i], NULL);
+	}
+
+	// without a share handle every request opens its own connection,
+	// which is slower but still works
+	client->share = curl_share_init();
+	if (client->share) {
+		curl_share_setopt(client->share, CURLSHOPT_LOCKFUNC, share_lock);
+		curl_share_setopt(client->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+		curl_share_setopt(client->share, CURLSHOPT_USERDATA, client);
+		curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+		curl_share_setopt(client->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+	}
+
+	if (workers <= 0) {
+		workers = FACE_CLIENT_WORKERS;
+	}
+	client->worker_count = workers > FACE_CLIENT_MAX_WORKERS ? FACE_CLIENT_MAX_WORKERS : workers;
+
+	return 0;
+}
+
+/**
+ * Description:
+ *		Stops a client's threads and releases everything it owns
+ */
+static void client_destroy(FaceClient * client)
+{
+	int i;
+
+	// workers finish the tasks already submitted before leaving
+	pthread_mutex_lock(&client->task_lock);
+	client->stopping = 1;
+	pthread_cond_broadcast(&client->task_cond);
+	pthread_mutex_unlock(&client->task_lock);
+	for (i = 0; i < client->workers_started; ++i) {
+		pthread_join(client->workers[i], NULL);
+	}
+	free(client->workers);
+
+	face_client_demo_stop(client);
+	face_train_destroy(&client->train);
+	face_roster_destroy(&client->roster);
+	face_prewarm_destroy(&client->prewarm);
+
+	if (client->share) {
+		curl_share_cleanup(client->share);
+	}
+	face_tls_destroy(&client->tls);
+
+	for (i = 0; i < client->body_pool_size; ++i) {
+		free(client->body_pool[i]->content);
+		free(client->body_pool[i]);
+	}
+	for (i = 0; i < FACE_IMAGE_CACHE_SIZE; ++i) {
+		if (client->image_cache[i].data) {
+			munmap(client->image_cache[i].data, client->image_cache[i].size);
+		}
+	}
+
+	face_retry_destroy(&client->retry);
+	face_rate_destroy(&client->rate);
+	face_limit_destroy(&client->limit);
+	face_hedge_destroy(&client->hedge);
+	face_transfer_destroy(&client->transfer);
+	face_coalesce_destroy(&client->coalesce);
+	face_flight_destroy(&client->flight);
+	face_pg_destroy(&client->pgcache);
+	face_shard_destroy(&client->shard);
+	face_breaker_destroy(&client->breaker);
+	face_backend_destroy(&client->backend);
+	pthread_mutex_destroy(&client->body_pool_lock);
+	pthread_mutex_destroy(&client->image_cache_lock);
+	pthread_mutex_destroy(&client->task_lock);
+	pthread_cond_destroy(&client->task_cond);
+	for (i = 0; i < CURL_LOCK_DATA_LAST; ++i) {
+		pthread_mutex_destroy(&client->share_locks[i]);
+	}
+}
+
+/**
+ * Description:
+ *		Creates a client. Clients share no state or locks with each other,
+ *		so several can run in one process, e.g. one per subscription
+ *
+ * Params:
+ *		workers: threads running tasks given to face_client_submit; 0 for
+ *				 FACE_CLIENT_WORKERS. They are started on the first submit
+ *
+ * Return:
+ *		the client; NULL if out of memory. Log it in with face_client_login
+ */
+FaceClient * face_client_new(int workers) {
+	FaceClient * client;
+
+	client = (FaceClient *)malloc(sizeof(FaceClient));
+	if (!client) {
+		fprintf(stderr, "Malloc Error: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	client_init(client, workers);
+	return client;
+}
+
+/**
+ * Description:
+ *		Frees a client once its submitted tasks and demo requests are done.
+ *		No thread may use the client afterwards
+ *
+ * Params:
+ *		client: the client; the default client can't be freed
+ */
+void face_client_free(FaceClient * client) {
+	if (!client || client == &default_client) return;
+
+	if (bound_client == client) {
+		bound_client = NULL;
+	}
+
+	client_destroy(client);
+	free(client);
+}
+
+/**
+ * Description:
+ *		Sets the region and subscription key of a client and makes it the
+ *		first backend. Logging in again with the same region and key keeps
+ *		the backends as they are, so it is cheap to repeat
+ *
+ * Params:
+ *		client: the client
+ *		rg: the region; a full url such as http://127.0.0.1:8080 sends
+ *			requests there instead (used with experiments/mock_server);
+ *			NULL for FACE_DEFAULT_REGION
+ *		ky: the subscription key
+ *
+ * Return:
+ *		0 if successful; corresponding errno code if unsuccessful
+ */
+int face_client_login(FaceClient * client, const char * rg, const char * ky) {
+	if (!rg) {
+		rg = FACE_DEFAULT_REGION;
+	}
+
+	if (!client || !ky || strlen(rg) >= BUFSIZ || strlen(ky) >= BUFSIZ) {
+		fprintf(stderr, "%s\n", strerror(EINVAL));
+		return EINVAL;
+	}
+
+	if (client->login && !strcmp(client->region, rg) && !strcmp(client->key, ky)) {
+		return EXIT_SUCCESS;
+	}
+
+	snprintf(client->region, sizeof(client->region), "%s", rg);
+	snprintf(client->key, sizeof(client->key), "%s", ky);
+
+	// starting the backend pool over with this subscription; its
+	// persongroups are not the last one's
+	face_backend_reset(&client->backend);
+	face_pg_reset(&client->pgcache);
+	face_roster_reset(&client->roster);
+	face_backend_add(client, client->region, client->key, 1, 0);
+
+	client->login = 1;
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Description:
+ *		Makes every request of the calling thread go through a client.
+ *		Threads started by a client are bound to it already
+ *
+ * Params:
+ *		client: the client; NULL for the default client
+ */
+void face_client_bind(FaceClient * client) {
+	bound_client = client;
+}
+
+/**
+ * Description:
+ *		Gets the client of the calling thread, creating the default client
+ *		the first time it is needed
+ */
+FaceClient * face_client_current() {
+	if (bound_client) {
+		return bound_client;
+	}
+
+	pthread_once(&default_once, default_init);
+	return &default_client;
+}
+
+/**
+ * Description:
+ *		Runs submitted tasks until the client is freed
+ */
+static void * worker_run(void * arg)
+{
+	FaceClient * client = arg;
+	FaceFuture * future;
+	void * result;
+
+	face_client_bind(client);
+
+	pthread_mutex_lock(&client->task_lock);
+	while (1) {
+		while (!client->tasks && !client->stopping) {
+			pthread_cond_wait(&client->task_cond, &client->task_lock);
+		}
+		if (!client->tasks) {
+			break;
+		}
+
+		future = client->tasks;
+		client->tasks = future->next;
+		if (!client->tasks) {
+			client->tasks_tail = NULL;
+		}
+		future->state = FACE_TASK_RUNNING;
+		pthread_mutex_unlock(&client->task_lock);
+
+		result = future->func(future->arg);
+
+		pthread_mutex_lock(&client->task_lock);
+		future->result = result;
+		future->state = FACE_TASK_DONE;
+		pthread_cond_broadcast(&client->task_cond);
+	}
+	pthread_mutex_unlock(&client->task_lock);
+
+	return NULL;
+}
+
+/**
+ * Description:
+ *		Starts the workers of a client. Must hold client->task_lock
+ *
+ * Return:
+ *		0 if at least one worker is running
+ */
+static int workers_start(FaceClient * client)
+{
+	client->workers = (pthread_t *)calloc(client->worker_count, sizeof(pthread_t));
+	if (!client->workers) {
+		fprintf(stderr, "Calloc Error: %s\n", strerror(errno));
+		return -1;
+	}
+
+	while (client->workers_started < client->worker_count) {
+		if (pthread_create(&client->workers[client->workers_started], NULL, worker_run, client)) {
+			break;
+		}
+		client->workers_started++;
+	}
+
+	return client->workers_started ? 0 : -1;
+}
+
+/**
+ * Description:
+ *		Runs a task on one of the client's workers. Face API calls made by
+ *		the task go through the client
+ *
+ * Params:
+ *		client: the client
+ *		func: the task
+ *		arg: passed to func
+ *
+ * Return:
+ *		a future to get func's result from with face_future_wait; NULL if
+ *		the task can't be submitted
+ */
+FaceFuture * face_client_submit(FaceClient * client, FaceTaskFunc func, void * arg) {
+	FaceFuture * future;
+
+	if (!client || !func) return NULL;
+
+	future = (FaceFuture *)calloc(1, sizeof(FaceFuture));
+	if (!future) {
+		fprintf(stderr, "Calloc Error: %s\n", strerror(errno));
+		return NULL;
+	}
+	future->client = client;
+	future->func = func;
+	future->arg = arg;
+	future->state = FACE_TASK_PENDING;
+
+	pthread_mutex_lock(&client->task_lock);
+	if (client->stopping || (!client->workers && workers_start(client))) {
+		pthread_mutex_unlock(&client->task_lock);
+		free(future);
+		return NULL;
+	}
+
+	if (client->tasks_tail) {
+		client->tasks_tail->next = future;
+	}
+	else {
+		client->tasks = future;
+	}
+	client->tasks_tail = future;
+	pthread_cond_broadcast(&client->task_cond);
+	pthread_mutex_unlock(&client->task_lock);
+
+	return future;
+}
+
+/**
+ * Description:
+ *		Waits for a submitted task and frees its future. A task no worker
+ *		has started yet is run by the caller instead, so tasks that wait on
+ *		other tasks of the same client can't deadlock it
+ *
+ * Params:
+ *		future: as returned by face_client_submit
+ *
+ * Return:
+ *		what the task returned
+ */
+void * face_future_wait(FaceFuture * future) {
+	FaceClient * client;
+	FaceClient * bound;
+	FaceFuture * prev = NULL;
+	FaceFuture * task;
+	void * result;
+
+	if (!future) return NULL;
+
+	client = future->client;
+
+	pthread_mutex_lock(&client->task_lock);
+	if (future->state == FACE_TASK_PENDING) {
+		for (task = client->tasks; task != future; prev = task, task = task->next);
+		if (prev) {
+			prev->next = future->next;
+		}
+		else {
+			client->tasks = future->next;
+		}
+		if (client->tasks_tail == future) {
+			client->tasks_tail = prev;
+		}
+		future->state = FACE_TASK_RUNNING;
+		pthread_mutex_unlock(&client->task_lock);
+
+		bound = bound_client;
+		bound_client = client;
+		result = future->func(future->arg);
+		bound_client = bound;
+
+		pthread_mutex_lock(&client->task_lock);
+		future->result = result;
+		future->state = FACE_TASK_DONE;
+	}
+
+	while (future->state != FACE_TASK_DONE) {
+		pthread_cond_wait(&client->task_cond, &client->task_lock);
+	}
+	pthread_mutex_unlock(&client->task_lock);
+
+	result = future->result;
+	free(future);
+	return result;
+}
+
+/**
+ * Description:
+ *		Runs func on every item of an array on the client's workers at once
+ *		and waits for all of them. The calling thread runs the first item,
+ *		and any item no worker has started by the time it is waited for, so
+ *		a fan-out made from a task can't deadlock the client
+ *
+ * Params:
+ *		client: the client whose workers run the items
+ *		func: the task; its result is ignored
+ *		items: the array
+ *		size: size of an item
+ *		count: number of items
+ */
+void face_client_fan(FaceClient * client, FaceTaskFunc func, void * items, size_t size, int count) {
+	FaceFuture ** futures = NULL;
+	FaceClient * bound;
+	int i;
+
+	if (count <= 0) return;
+
+	if (count > 1) {
+		futures = (FaceFuture **)calloc(count, sizeof(FaceFuture *));
+	}
+	for (i = 1; futures && i < count; ++i) {
+		futures[i] = face_client_submit(client, func, (char *)items + i * size);
+	}
+
+	bound = bound_client;
+	bound_client = client;
+	func(items);
+	for (i = 1; i < count; ++i) {
+		// an item that couldn't be submitted is run here too
+		if (futures && futures[i]) {
+			face_future_wait(futures[i]);
+		}
+		else {
+			func((char *)items + i * size);
+		}
+	}
+	bound_client = bound;
+
+	free(futures);
+}
+
+/**
+ * Description:
+ *		Makes a future for a result that comes from somewhere other than a
+ *		task, e.g. a train finishing. It is waited for with
+ *		face_future_wait like any other
+ *
+ * Return:
+ *		the future, to be completed with face_future_complete; NULL if out
+ *		of memory
+ */
+FaceFuture * face_future_new(FaceClient * client) {
+	FaceFuture * future = (FaceFuture *)calloc(1, sizeof(FaceFuture));
+
+	if (!future) {
+		fprintf(stderr, "Calloc Error: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	// never queued, so face_future_wait only waits for it
+	future->client = client;
+	future->state = FACE_TASK_RUNNING;
+	return future;
+}
+
+/**
+ * Description:
+ *		Sets the result of a future made by face_future_new and wakes its
+ *		waiter
+ */
+void face_future_complete(FaceFuture * future, void * result) {
+	FaceClient * client = future->client;
+
+	pthread_mutex_lock(&client->task_lock);
+	future->result = result;
+	future->state = FACE_TASK_DONE;
+	pthread_cond_broadcast(&client->task_cond);
+	pthread_mutex_unlock(&client->task_lock);
+}
@@ -0,0 +1,355 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/**
+ * Description:
+ *		Sets up identify coalescing of a client with the default window.
+ *		The condition variable times out on the monotonic clock
+ */
+void face_coalesce_init(CoalesceState * state) {
+	pthread_condattr_t attr;
+
+	memset(state, 0, sizeof(CoalesceState));
+	state->window_ms = FACE_COALESCE_WINDOW;
+	pthread_mutex_init(&state->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&state->cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Description:
+ *		Releases what face_coalesce_init set up. No identify may be waiting
+ */
+void face_coalesce_destroy(CoalesceState * state) {
+	pthread_cond_destroy(&state->cond);
+	pthread_mutex_destroy(&state->lock);
+}
+
+/**
+ * Description:
+ *		Sends one Face Identify for up to FACE_IDENTIFY_MAX_FIDS faceIds
+ *
+ * Return:
+ *		http status code; -1 if out of memory or not logged in
+ */
+static long identify_send(const char * pgid, char ** fids, int nfids, int maxCandidates, double threshold,
+	struct json_object ** resp)
+{
+	FaceBody * body;
+	long status = -1;
+
+	*resp = NULL;
+
+	body = face_body_acquire();
+	if (body && !face_body_identify(body, pgid, fids, nfids, maxCandidates, threshold)) {
+		status = face_identify_body(body, resp);
+	}
+	face_body_release(body);
+
+	return status;
+}
+
+/**
+ * Description:
+ *		Finds an open batch for the same persongroup and settings with room
+ *		for the faceIds; faceIds already in it take no room. Must hold the lock
+ */
+static IdentifyBatch * batch_find(CoalesceState * state, const char * pgid, char ** fids, int nfids,
+	int maxCandidates, double threshold)
+{
+	IdentifyBatch * batch;
+	int fresh;
+	int i;
+	int j;
+
+	for (batch = state->open; batch; batch = batch->next) {
+		if (batch->max_candidates != maxCandidates || batch->threshold != threshold
+			|| strcmp(batch->pgid, pgid)) {
+			continue;
+		}
+
+		for (i = 0, fresh = 0; i < nfids; ++i) {
+			for (j = 0; j < batch->nfids && strcmp(batch->fids[j], fids[i]); ++j);
+			fresh += j == batch->nfids;
+		}
+		if (batch->nfids + fresh <= FACE_IDENTIFY_MAX_FIDS) {
+			return batch;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Description:
+ *		Adds the faceIds a batch doesn't have yet. Must hold the lock
+ */
+static void batch_add(IdentifyBatch * batch, char ** fids, int nfids)
+{
+	int i;
+	int j;
+
+	for (i = 0; i < nfids; ++i) {
+		for (j = 0; j < batch->nfids && strcmp(batch->fids[j], fids[i]); ++j);
+		if (j == batch->nfids) {
+			snprintf(batch->fids[batch->nfids++], FACE_FID_SIZE, "%s", fids[i]);
+		}
+	}
+}
+
+/**
+ * Description:
+ *		Copies part of the response of a batch for one caller, parsed again
+ *		from its text; json-c objects can't be shared between threads, since
+ *		their reference counts aren't atomic. Must hold the lock
+ *
+ * Return:
+ *		the copy; NULL if obj is NULL or out of memory
+ */
+static struct json_object * batch_copy(struct json_object * obj)
+{
+	return obj ? json_tokener_parse(json_object_to_json_string(obj)) : NULL;
+}
+
+/**
+ * Description:
+ *		Picks a caller's results out of the response of a batch. Must hold
+ *		the lock
+ *
+ * Return:
+ *		an array with a copy of the result of each faceId of the caller, in
+ *		its order, or a copy of the whole response if the identify failed
+ */
+static struct json_object * batch_results(IdentifyBatch * batch, char ** fids, int nfids)
+{
+	struct json_object * results;
+	struct json_object * result;
+	struct json_object * fid;
+	int count;
+	int i;
+	int j;
+
+	if (!statusOk(batch->status) || !json_object_is_type(batch->resp, json_type_array)) {
+		return batch_copy(batch->resp);
+	}
+
+	results = json_object_new_array();
+	count = json_object_array_length(batch->resp);
+	for (i = 0; results && i < nfids; ++i) {
+		for (j = 0; j < count; ++j) {
+			result = json_object_array_get_idx(batch->resp, j);
+			if (json_object_object_get_ex(result, FACE_FID, &fid) && !strcmp(json_object_get_string(fid), fids[i])) {
+				break;
+			}
+		}
+		json_object_array_add(results, j < count ? batch_copy(result) : NULL);
+	}
+
+	return results;
+}
+
+/**
+ * Description:
+ *		Identifies up to FACE_IDENTIFY_MAX_FIDS faceIds together with the
+ *		other callers identifying against the same persongroup. The first
+ *		caller of a batch waits out the window, or until the batch is full,
+ *		then sends it; the others wait for its answer
+ */
+static long identify_coalesce(CoalesceState * state, const char * pgid, char ** fids, int nfids,
+	int maxCandidates, double threshold, struct json_object ** resp)
+{
+	IdentifyBatch * batch;
+	IdentifyBatch ** link;
+	struct timespec deadline;
+	char * batch_fids[FACE_IDENTIFY_MAX_FIDS];
+	struct json_object * batch_resp;
+	long window;
+	long status;
+	int sender = 0;
+	int i;
+
+	pthread_mutex_lock(&state->lock);
+	state->stats.requests++;
+	state->stats.faces += nfids;
+	window = state->window_ms;
+
+	batch = window > 0 ? batch_find(state, pgid, fids, nfids, maxCandidates, threshold) : NULL;
+	if (!batch) {
+		batch = (IdentifyBatch *)calloc(1, sizeof(IdentifyBatch));
+		if (!batch) {
+			pthread_mutex_unlock(&state->lock);
+			fprintf(stderr, "Calloc Error: %s\n", strerror(errno));
+			return -1;
+		}
+		snprintf(batch->pgid, sizeof(batch->pgid), "%s", pgid);
+		batch->max_candidates = maxCandidates;
+		batch->threshold = threshold;
+		sender = 1;
+
+		// a batch that won't wait is never open to others
+		if (window > 0) {
+			batch->next = state->open;
+			state->open = batch;
+		}
+	}
+	batch_add(batch, fids, nfids);
+	batch->waiters++;
+
+	if (sender) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += window / 1000;
+		deadline.tv_nsec += (window % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		while (window > 0 && batch->nfids < FACE_IDENTIFY_MAX_FIDS
+			&& pthread_cond_timedwait(&state->cond, &state->lock, &deadline) != ETIMEDOUT);
+
+		// closing the batch; nobody joins it from here on
+		for (link = &state->open; *link && *link != batch; link = &(*link)->next);
+		if (*link) {
+			*link = batch->next;
+		}
+		state->stats.batches++;
+		pthread_mutex_unlock(&state->lock);
+
+#ifdef _DEBUG_
+		fprintf(stderr, FACE_COALESCE_SEND, batch->nfids, batch->waiters);
+#endif
+
+		for (i = 0; i < batch->nfids; ++i) {
+			batch_fids[i] = batch->fids[i];
+		}
+		status = identify_send(batch->pgid, batch_fids, batch->nfids, maxCandidates, threshold, &batch_resp);
+
+		pthread_mutex_lock(&state->lock);
+		batch->status = status;
+		batch->resp = batch_resp;
+		batch->done = 1;
+		pthread_cond_broadcast(&state->cond);
+	}
+	else {
+		// waking the sender early once there is nothing left to wait for
+		if (batch->nfids == FACE_IDENTIFY_MAX_FIDS) {
+			pthread_cond_broadcast(&state->cond);
+		}
+		while (!batch->done) {
+			pthread_cond_wait(&state->cond, &state->lock);
+		}
+	}
+
+	status = batch->status;
+	*resp = batch_results(batch, fids, nfids);
+
+	if (!--batch->waiters) {
+		json_object_put(batch->resp);
+		free(batch);
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	return status;
+}
+
+/**
+ * Description:
+ *		Identifies faces from a persongroup like face_identify, but sends
+ *		the faceIds together with those of other threads identifying
+ *		against the same persongroup with the same settings. Face Identify
+ *		takes up to 10 faceIds per call; coalescing them saves calls and
+ *		round trips at the cost of waiting up to the window for others.
+ *		More than 10 faceIds are identified 10 at a time
+ *
+ * Params:
+ *		pgid: the persongroupId to identify from
+ *		fids: array of faceIds to be identified
+ *		nfids: length of fids
+ *		maxCandidates: maxNumOfCandidatesReturned; 0 for default
+ *		threshold: confidenceThreshold; negative for default
+ *		resp: return parameter; an array with the result of each faceId in
+ *			  the order of fids, or the error response
+ *
+ * Return:
+ *		http status code; -1 if the arguments are invalid, out of memory or
+ *		the user hasn't logged in via face_login
+ */
+long face_identify_coalesced(const char * pgid, char ** fids, int nfids, int maxCandidates, double threshold,
+	struct json_object ** resp) {
+	CoalesceState * state = &face_client_current()->coalesce;
+	struct json_object * part;
+	long status = -1;
+	int count;
+	int i;
+	int j;
+
+	*resp = NULL;
+
+	if (!pgid || strlen(pgid) >= FACE_PGID_SIZE || !fids || nfids <= 0) {
+		fprintf(stderr, "%s\n", strerror(EINVAL));
+		return -1;
+	}
+	for (i = 0; i < nfids; ++i) {
+		if (!fids[i] || strlen(fids[i]) >= FACE_FID_SIZE) {
+			fprintf(stderr, "%s\n", strerror(EINVAL));
+			return -1;
+		}
+	}
+
+	if (nfids <= FACE_IDENTIFY_MAX_FIDS) {
+		return identify_coalesce(state, pgid, fids, nfids, maxCandidates, threshold, resp);
+	}
+
+	// joining the results of every 10 faceIds
+	*resp = json_object_new_array();
+	for (i = 0; *resp && i < nfids; i += FACE_IDENTIFY_MAX_FIDS) {
+		count = nfids - i < FACE_IDENTIFY_MAX_FIDS ? nfids - i : FACE_IDENTIFY_MAX_FIDS;
+		status = identify_coalesce(state, pgid, fids + i, count, maxCandidates, threshold, &part);
+		if (!statusOk(status)) {
+			json_object_put(*resp);
+			*resp = part;
+			return status;
+		}
+		for (j = 0; j < count; ++j) {
+			json_object_array_add(*resp, json_object_get(json_object_array_get_idx(part, j)));
+		}
+		json_object_put(part);
+	}
+
+	return status;
+}
+
+/**
+ * Description:
+ *		Sets how long an identify waits for others to join it
+ *
+ * Params:
+ *		ms: the window; 0 sends every identify right away
+ */
+void face_set_coalesce_window(long ms) {
+	CoalesceState * state = &face_client_current()->coalesce;
+
+	pthread_mutex_lock(&state->lock);
+	state->window_ms = ms > 0 ? ms : 0;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Gets the coalescing counters of the calling thread's client
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_coalesce_stats(CoalesceStats * stats) {
+	CoalesceState * state = &face_client_current()->coalesce;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&state->lock);
+	*stats = state->stats;
+	pthread_mutex_unlock(&state->lock);
+}
@@ -0,0 +1,211 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/**
+ * Description:
+ *		Sets up the concurrency limit of a client; off until
+ *		face_set_concurrency
+ */
+void face_limit_init(LimitState * state) {
+	memset(state, 0, sizeof(LimitState));
+	state->target_p90 = FACE_LIMIT_TARGET_P90;
+	state->target_throttled = FACE_LIMIT_TARGET_429;
+	state->backoff = FACE_LIMIT_BACKOFF;
+	pthread_mutex_init(&state->lock, NULL);
+	pthread_cond_init(&state->cond, NULL);
+}
+
+/**
+ * Description:
+ *		Releases what face_limit_init set up
+ */
+void face_limit_destroy(LimitState * state) {
+	pthread_cond_destroy(&state->cond);
+	pthread_mutex_destroy(&state->lock);
+}
+
+/**
+ * Description:
+ *		Turns on adaptive concurrency. The number of requests in flight grows
+ *		by one every window in which p90 latency and the share of 429s stay
+ *		under their targets and is cut by the backoff factor when they don't
+ *
+ * Params:
+ *		min: fewest requests allowed in flight; at least 1
+ *		max: most requests allowed in flight; 0 turns the limit off
+ *		initial: requests allowed in flight to begin with
+ */
+void face_set_concurrency(int min, int max, int initial) {
+	LimitState * state = &face_client_current()->limit;
+
+	pthread_mutex_lock(&state->lock);
+	state->min = min < 1 ? 1 : min;
+	state->max = max < state->min ? (max > 0 ? state->min : 0) : max;
+	state->limit = initial < state->min ? state->min : initial;
+	if (state->max && state->limit > state->max) {
+		state->limit = state->max;
+	}
+	state->sample_count = 0;
+	state->throttled = 0;
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Sets what the adaptive concurrency limit aims for
+ *
+ * Params:
+ *		p90_ms: p90 latency to stay under in ms
+ *		throttled_rate: share of requests answered with 429 to stay under
+ *		factor: the limit is multiplied by this when a target is missed,
+ *				e.g. 0.9
+ */
+void face_set_concurrency_targets(double p90_ms, double throttled_rate, double factor) {
+	LimitState * state = &face_client_current()->limit;
+
+	pthread_mutex_lock(&state->lock);
+	state->target_p90 = p90_ms;
+	state->target_throttled = throttled_rate;
+	state->backoff = factor > 0 && factor < 1 ? factor : FACE_LIMIT_BACKOFF;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Gets the current concurrency limit and what it was last based on
+ *
+ * Params:
+ *		stats: return parameter; the metrics
+ */
+void face_get_concurrency_stats(ConcurrencyStats * stats) {
+	LimitState * state = &face_client_current()->limit;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&state->lock);
+	*stats = state->stats;
+	stats->limit = state->max ? (int)state->limit : 0;
+	stats->inflight = state->inflight;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Waits until fewer requests than the limit are in flight and takes a
+ *		slot; give it back with face_limit_release
+ */
+void face_limit_acquire(LimitState * state) {
+	pthread_mutex_lock(&state->lock);
+	while (state->max && state->inflight >= (int)state->limit) {
+		pthread_cond_wait(&state->cond, &state->lock);
+	}
+	state->inflight++;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Takes a slot only if fewer requests than the limit are in flight;
+ *		never waits
+ *
+ * Return:
+ *		1 if a slot was taken; 0 if the limit is reached
+ */
+int face_limit_try(LimitState * state) {
+	int ok;
+
+	pthread_mutex_lock(&state->lock);
+	ok = !state->max || state->inflight < (int)state->limit;
+	if (ok) {
+		state->inflight++;
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	return ok;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Description:
+ *		Moves the limit based on a full window of samples. Must hold
+ *		state->lock
+ */
+static void limit_update(LimitState * state)
+{
+	double p90;
+	double rate;
+
+	qsort(state->samples, state->sample_count, sizeof(double), compare_double);
+	p90 = state->samples[(state->sample_count * 9) / 10];
+	rate = (double)state->throttled / state->sample_count;
+
+	if (p90 > state->target_p90 || rate > state->target_throttled) {
+		state->limit *= state->backoff;
+		if (state->limit < state->min) state->limit = state->min;
+		state->stats.decreases++;
+	}
+	else if (state->inflight + 1 >= (int)state->limit) {
+		// only growing while the limit is actually what holds requests back
+		state->limit += 1;
+		if (state->limit > state->max) state->limit = state->max;
+		state->stats.increases++;
+	}
+
+	state->stats.p90 = p90;
+	state->stats.throttled_rate = rate;
+	state->sample_count = 0;
+	state->throttled = 0;
+}
+
+/**
+ * Description:
+ *		Gives back the slot taken by face_limit_acquire and records how the
+ *		request went
+ *
+ * Params:
+ *		state: concurrency limit the slot was taken from
+ *		latency: time the request took in ms
+ *		status: http status; 0 if there was no response
+ *		res: libcurl result of the request
+ */
+void face_limit_release(LimitState * state, double latency, long status, CURLcode res) {
+	pthread_mutex_lock(&state->lock);
+	state->inflight--;
+
+	if (state->max) {
+		state->samples[state->sample_count++] = latency;
+		if (status == 429 || res == CURLE_OPERATION_TIMEDOUT) {
+			state->throttled++;
+		}
+		if (state->sample_count == FACE_LIMIT_WINDOW) {
+			limit_update(state);
+		}
+	}
+
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Gives back a slot whose request was cancelled before it finished.
+ *		Nothing is recorded, as its latency says nothing about the service
+ *
+ * Params:
+ *		state: concurrency limit the slot was taken from
+ */
+void face_limit_cancel(LimitState * state) {
+	pthread_mutex_lock(&state->lock);
+	state->inflight--;
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->lock);
+}
@@ -0,0 +1,233 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/**
+ * Description:
+ *		Sets up single flight of a client; on until face_set_single_flight
+ */
+void face_flight_init(FlightState * state) {
+	memset(state, 0, sizeof(FlightState));
+	state->on = 1;
+	pthread_mutex_init(&state->lock, NULL);
+	pthread_cond_init(&state->cond, NULL);
+}
+
+/**
+ * Description:
+ *		Releases what face_flight_init set up. No request may be in flight
+ */
+void face_flight_destroy(FlightState * state) {
+	pthread_cond_destroy(&state->cond);
+	pthread_mutex_destroy(&state->lock);
+}
+
+static unsigned long long fnv1a(const char * data, size_t len)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/**
+ * Description:
+ *		Builds the key of a request: its method, url and query. Requests
+ *		with a body read from a file or a stream, those whose response is
+ *		streamed to a callback, and those that aren't idempotent, have none
+ *
+ * Return:
+ *		the key, to be freed; NULL if the request can't share a call
+ */
+static char * flight_key(const FaceCall * call)
+{
+	const char * param;
+	char * key;
+	size_t len;
+
+	if (call->image || call->frames || call->each
+		|| (strcmp(call->method, FACE_GET) && strcmp(call->method, FACE_PUT) && strcmp(call->method, FACE_DELETE))) {
+		return NULL;
+	}
+
+	param = call->param ? json_object_to_json_string_ext(call->param, JSON_C_TO_STRING_PLAIN) : "";
+	len = strlen(call->method) + strlen(call->base) + strlen(call->path)
+		+ (call->query ? strlen(call->query) : 0) + strlen(param) + 4;
+
+	key = (char *)malloc(len);
+	if (key) {
+		snprintf(key, len, "%s %s%s?%s&%s", call->method, call->base, call->path,
+			call->query ? call->query : "", param);
+	}
+	return key;
+}
+
+/**
+ * Description:
+ *		Waits for an identical request already in flight, or else marks this
+ *		one as in flight. A caller that waited gets its own copy of the
+ *		response, parsed from the text the sender left; json-c objects can't
+ *		be handed between threads, since their reference counts aren't atomic
+ *
+ * Params:
+ *		call: the request
+ *		flight: return parameter; the flight to land with face_flight_land
+ *				once the request is sent; NULL if it can't share a call
+ *		status: return parameter; http status of the shared response
+ *		resp: return parameter; the shared response
+ *
+ * Return:
+ *		1 if an identical request answered this one; 0 if it has to be sent
+ */
+int face_flight_join(FlightState * state, const FaceCall * call, FaceFlight ** flight, long * status,
+	struct json_object ** resp) {
+	FaceFlight * found;
+	char * key;
+	unsigned long long hash;
+	char * text = NULL;
+
+	*flight = NULL;
+
+	pthread_mutex_lock(&state->lock);
+	if (!state->on) {
+		pthread_mutex_unlock(&state->lock);
+		return 0;
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	key = flight_key(call);
+	if (!key) return 0;
+	hash = fnv1a(call->body ? call->body : "", call->body ? call->blen : 0);
+
+	pthread_mutex_lock(&state->lock);
+	state->stats.requests++;
+
+	for (found = state->flights; found; found = found->next) {
+		if (found->body_hash == hash && found->blen == call->blen && !strcmp(found->key, key)) {
+			break;
+		}
+	}
+
+	if (!found) {
+		// sending it; identical requests wait for this one
+		found = (FaceFlight *)calloc(1, sizeof(FaceFlight));
+		if (found) {
+			found->key = key;
+			found->body_hash = hash;
+			found->blen = call->blen;
+			found->refs = 1;
+			found->next = state->flights;
+			state->flights = found;
+			state->stats.flights++;
+			*flight = found;
+		}
+		else {
+			free(key);
+		}
+		pthread_mutex_unlock(&state->lock);
+		return 0;
+	}
+
+	free(key);
+	state->stats.shared++;
+	found->waiters++;
+	found->refs++;
+	while (!found->done) {
+		pthread_cond_wait(&state->cond, &state->lock);
+	}
+	*status = found->status;
+	if (found->text) {
+		text = strdup(found->text);
+	}
+	if (!--found->refs) {
+		free(found->key);
+		free(found->text);
+		free(found);
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	*resp = text ? json_tokener_parse(text) : NULL;
+	free(text);
+	return 1;
+}
+
+/**
+ * Description:
+ *		Hands the response of a request to the callers that waited for it.
+ *		Requests made from here on are sent again
+ *
+ * Params:
+ *		flight: as set by face_flight_join
+ *		status: http status of the response
+ *		resp: the response; stays the sender's
+ */
+void face_flight_land(FlightState * state, FaceFlight * flight, long status, struct json_object * resp) {
+	FaceFlight ** link;
+	const char * text;
+	int waiters;
+
+	pthread_mutex_lock(&state->lock);
+	for (link = &state->flights; *link && *link != flight; link = &(*link)->next);
+	if (*link) {
+		*link = flight->next;
+	}
+	waiters = flight->waiters;
+	pthread_mutex_unlock(&state->lock);
+
+	// nobody joins once the flight is off the list, so the text is only
+	// made if someone waited
+	if (waiters && resp) {
+		text = json_object_to_json_string_ext(resp, JSON_C_TO_STRING_PLAIN);
+		flight->text = text ? strdup(text) : NULL;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	flight->status = status;
+	flight->done = 1;
+	pthread_cond_broadcast(&state->cond);
+	if (!--flight->refs) {
+		free(flight->key);
+		free(flight->text);
+		free(flight);
+	}
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Turns single flight on or off. While on, a GET, PUT or DELETE that
+ *		is identical to one in flight, down to the body, waits for it and
+ *		gets a copy of its response instead of making its own call
+ *
+ * Params:
+ *		on: 1 to share identical requests, 0 not to
+ */
+void face_set_single_flight(int on) {
+	FlightState * state = &face_client_current()->flight;
+
+	pthread_mutex_lock(&state->lock);
+	state->on = on ? 1 : 0;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Gets the single flight counters of the calling thread's client
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_flight_stats(FlightStats * stats) {
+	FlightState * state = &face_client_current()->flight;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&state->lock);
+	*stats = state->stats;
+	pthread_mutex_unlock(&state->lock);
+}
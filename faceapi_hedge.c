@@ -0,0 +1,207 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/**
+ * Description:
+ *		Sets up hedging of a client; off for every endpoint until
+ *		face_set_hedging
+ */
+void face_hedge_init(HedgeState * state) {
+	memset(state, 0, sizeof(HedgeState));
+	state->ratio = FACE_HEDGE_BUDGET_RATIO;
+	pthread_mutex_init(&state->lock, NULL);
+}
+
+/**
+ * Description:
+ *		Releases what face_hedge_init set up
+ */
+void face_hedge_destroy(HedgeState * state) {
+	pthread_mutex_destroy(&state->lock);
+}
+
+/**
+ * Description:
+ *		Turns hedging on or off for an endpoint. Only read-only endpoints
+ *		can be hedged; a hedged request that hasn't been answered by the
+ *		endpoint's p95 latency is sent again and the first answer is used
+ *
+ * Params:
+ *		ep: the endpoint
+ *		on: 1 to hedge, 0 not to
+ *
+ * Return:
+ *		0 if successful; -1 if the endpoint is not read-only
+ */
+int face_set_hedging(FaceEndpoint ep, int on) {
+	HedgeState * state = &face_client_current()->hedge;
+
+	switch (ep) {
+		case FACE_EP_DETECT:
+		case FACE_EP_VERIFY:
+		case FACE_EP_IDENTIFY:
+		case FACE_EP_GET_PG:
+		case FACE_EP_GET_P:
+		case FACE_EP_LIST_P:
+		case FACE_EP_GET_FACE:
+		case FACE_EP_GET_TRAINING:
+			break;
+		default:
+			return -1;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	state->windows[ep].hedging = on ? 1 : 0;
+	pthread_mutex_unlock(&state->lock);
+	return 0;
+}
+
+/**
+ * Description:
+ *		Sets how much extra load hedging may add
+ *
+ * Params:
+ *		ratio: hedges allowed per request, e.g. 0.1 for 10%; hedging at the p95
+ *			   sends about 5% more requests before counting the slow ones
+ */
+void face_set_hedge_budget(double ratio) {
+	HedgeState * state = &face_client_current()->hedge;
+
+	pthread_mutex_lock(&state->lock);
+	state->ratio = ratio < 0 ? 0 : ratio;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Gets the hedging counters
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_hedge_stats(HedgeStats * stats) {
+	HedgeState * state = &face_client_current()->hedge;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&state->lock);
+	*stats = state->stats;
+	pthread_mutex_unlock(&state->lock);
+}
+
+static int compare_double(const void * a, const void * b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Description:
+ *		Gets how long a request to ep waits before it is hedged, and pays
+ *		the request's share into the hedge budget
+ *
+ * Params:
+ *		state: hedging state of the client sending the request
+ *		ep: the endpoint
+ *
+ * Return:
+ *		the endpoint's p95 latency in ms; -1 if it isn't hedged or there
+ *		aren't enough samples yet
+ */
+long face_hedge_delay(HedgeState * state, FaceEndpoint ep) {
+	HedgeWindow * window = &state->windows[ep];
+	double sorted[FACE_HEDGE_WINDOW];
+	long delay;
+	int count;
+
+	pthread_mutex_lock(&state->lock);
+	if (!window->hedging) {
+		pthread_mutex_unlock(&state->lock);
+		return -1;
+	}
+
+	state->stats.requests++;
+	state->tokens += state->ratio;
+	if (state->tokens > FACE_HEDGE_BUDGET_MAX) {
+		state->tokens = FACE_HEDGE_BUDGET_MAX;
+	}
+
+	count = window->count;
+	memcpy(sorted, window->latency, count * sizeof(double));
+	pthread_mutex_unlock(&state->lock);
+
+	if (count < FACE_HEDGE_MIN_SAMPLES) {
+		return -1;
+	}
+
+	qsort(sorted, count, sizeof(double), compare_double);
+	// rounding up; hedging a hair early duplicates most requests
+	delay = (long)sorted[(count * 95) / 100] + 1;
+	return delay < FACE_HEDGE_MIN_DELAY ? FACE_HEDGE_MIN_DELAY : delay;
+}
+
+/**
+ * Description:
+ *		Records the latency of a successful request to ep
+ */
+void face_hedge_record(HedgeState * state, FaceEndpoint ep, double latency) {
+	HedgeWindow * window = &state->windows[ep];
+
+	pthread_mutex_lock(&state->lock);
+	if (window->hedging) {
+		window->latency[window->next] = latency;
+		window->next = (window->next + 1) % FACE_HEDGE_WINDOW;
+		if (window->count < FACE_HEDGE_WINDOW) {
+			window->count++;
+		}
+	}
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Spends one hedge from the budget
+ *
+ * Return:
+ *		1 if the hedge may be sent; 0 if the budget is used up
+ */
+int face_hedge_withdraw(HedgeState * state) {
+	int ok;
+
+	pthread_mutex_lock(&state->lock);
+	ok = state->tokens >= 1;
+	if (ok) {
+		state->tokens -= 1;
+		state->stats.hedged++;
+	}
+	else {
+		state->stats.denied++;
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	return ok;
+}
+
+/**
+ * Description:
+ *		Puts back a hedge spent by face_hedge_withdraw that was not sent
+ */
+void face_hedge_refund(HedgeState * state) {
+	pthread_mutex_lock(&state->lock);
+	state->tokens += 1;
+	state->stats.hedged--;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Counts a hedge that answered before the request it duplicated
+ */
+void face_hedge_won(HedgeState * state) {
+	pthread_mutex_lock(&state->lock);
+	state->stats.won++;
+	pthread_mutex_unlock(&state->lock);
+}
@@ -0,0 +1,252 @@
+
+#include <strings.h>
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/*
+ * The service lists at most a page of persons per call, in personId order,
+ * each page starting after the personId the previous one ended with. Pages
+ * of one range follow each other, so to list several at once the personId
+ * space is split into ranges, each listed from its first personId until a
+ * person past its end shows up or a page comes back short. Streamed pages
+ * are read out of the response as it arrives and handed over a person at a
+ * time; others are parsed whole first, which lets identical pages listed at
+ * once share a call.
+ */
+
+typedef struct listRun {
+	FaceClient * client;			// client the ranges are listed with
+	const char * pgid;				// persongroup listed
+	int top;						// persons per page
+	int stream;						// 1 to read persons out of a page as it arrives
+	FacePersonFunc func;			// takes each person; may be NULL
+	void * data;					// passed to func
+	RosterMirror * mirror;			// mirror fed the persons
+	RosterList roster;				// the list as the mirror sees it
+	int stopped;					// 1 once func asked to stop
+	pthread_mutex_t lock;			// one person is handed over at a time
+} ListRun;
+
+typedef struct listRange {
+	ListRun * run;					// the listing the range belongs to
+	char start[FACE_PID_SIZE];		// personId the next page starts after; empty for the first
+	char end[FACE_PID_SIZE];		// first personId of the next range; empty for the last
+	int read;						// persons in the page being read
+	int done;						// 1 once the range is listed
+	long status;					// http status of the last page
+	struct json_object * error;		// response of a page that failed
+} ListRange;
+
+/**
+ * Description:
+ *		Takes a person as it is read out of a page
+ */
+static void list_element(struct json_object * person, void * data)
+{
+	ListRange * range = data;
+	ListRun * run = range->run;
+	struct json_object * pid;
+	const char * text;
+
+	range->read++;
+	if (range->done) return;
+
+	if (!json_object_object_get_ex(person, FACE_PID, &pid) || !(text = json_object_get_string(pid))) {
+		return;
+	}
+	// the rest of the page belongs to the next range
+	if (range->end[0] && strcasecmp(text, range->end) >= 0) {
+		range->done = 1;
+		return;
+	}
+	snprintf(range->start, sizeof(range->start), "%s", text);
+
+	pthread_mutex_lock(&run->lock);
+	if (!run->stopped) {
+		if (run->mirror) {
+			face_roster_list_person(run->mirror, &run->roster, person);
+		}
+		if (run->func && run->func(person, run->data)) {
+			run->stopped = 1;
+		}
+	}
+	pthread_mutex_unlock(&run->lock);
+}
+
+/**
+ * Description:
+ *		Lists the pages of a range one after the other
+ */
+static void * range_run(void * arg)
+{
+	ListRange * range = arg;
+	ListRun * run = range->run;
+	struct json_object * resp;
+	char query[FACE_PID_SIZE + 32];
+	size_t i;
+	int stopped = 0;
+	FaceCall call = {
+		.ep = FACE_EP_LIST_P,
+		.pgid = run->pgid,
+		.method = FACE_GET,
+		.base = face_pg_base(),
+		.query = query,
+		.each = run->stream ? list_element : NULL,
+		.each_data = range
+	};
+
+	snprintf(call.path, sizeof(call.path), "%s/%s", run->pgid, FACE_URLPART_P);
+
+	while (!range->done && !stopped) {
+		if (range->start[0]) {
+			snprintf(query, sizeof(query), FACE_LIST_QUERY_START, range->start, run->top);
+		}
+		else {
+			snprintf(query, sizeof(query), FACE_LIST_QUERY, run->top);
+		}
+
+		range->read = 0;
+		range->status = face_perform(&call, &resp);
+		if (!statusOk(range->status)) {
+			range->error = resp;
+			break;
+		}
+		if (!run->stream && json_object_is_type(resp, json_type_array)) {
+			for (i = 0; i < json_object_array_length(resp); ++i) {
+				list_element(json_object_array_get_idx(resp, i), range);
+			}
+		}
+		json_object_put(resp);
+
+		if (range->read < run->top) {
+			range->done = 1;
+		}
+
+		pthread_mutex_lock(&run->lock);
+		stopped = run->stopped;
+		pthread_mutex_unlock(&run->lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * Description:
+ *		Lists every person of a persongroup, several personId ranges at once,
+ *		handing each to func as it is read. func is called from the
+ *		client's workers, but one person at a time
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *		top: persons per page, at most FACE_LIST_TOP
+ *		ranges: ranges listed at once, at most FACE_LIST_MAX_RANGES
+ *		stream: 1 to hand persons over as a page arrives; 0 to parse each
+ *				page whole first
+ *		add: 1 to mirror the group; 0 to only update it if it is mirrored
+ *		func: takes each person; returns nonzero to stop the listing
+ *		data: passed to func
+ *		error: return parameter; response of the first page that failed,
+ *			   NULL if none did
+ *
+ * Return:
+ *		http status of the first page that failed; 200 if none did
+ */
+long face_list_run(const char * pgid, int top, int ranges, int stream, int add, FacePersonFunc func, void * data,
+	struct json_object ** error) {
+	ListRun run = {
+		.client = face_client_current(),
+		.pgid = pgid,
+		.top = top,
+		.stream = stream,
+		.func = func,
+		.data = data
+	};
+	ListRange range[FACE_LIST_MAX_RANGES];
+	long status = 200;
+	int i;
+
+	*error = NULL;
+
+	memset(range, 0, sizeof(range));
+	pthread_mutex_init(&run.lock, NULL);
+	run.mirror = &run.client->roster;
+	face_roster_list_begin(run.mirror, pgid, add, &run.roster);
+
+	for (i = 0; i < ranges; ++i) {
+		range[i].run = &run;
+		if (i) {
+			snprintf(range[i].start, sizeof(range[i].start), FACE_LIST_BOUND,
+				(unsigned)((unsigned long long)i * 0x100000000ULL / ranges));
+		}
+		if (i + 1 < ranges) {
+			snprintf(range[i].end, sizeof(range[i].end), FACE_LIST_BOUND,
+				(unsigned)((unsigned long long)(i + 1) * 0x100000000ULL / ranges));
+		}
+	}
+
+	face_client_fan(run.client, range_run, range, sizeof(ListRange), ranges);
+
+	for (i = 0; i < ranges; ++i) {
+		if (statusOk(range[i].status)) continue;
+
+		if (statusOk(status)) {
+			status = range[i].status;
+			*error = range[i].error;
+		}
+		else {
+			json_object_put(range[i].error);
+		}
+	}
+
+	face_roster_list_end(run.mirror, &run.roster, statusOk(status) && !run.stopped);
+	pthread_mutex_destroy(&run.lock);
+
+	return status;
+}
+
+/**
+ * Description:
+ *		Lists the persons of a persongroup by calling PersonGroup Person
+ *		List (GET) a page at a time, and hands each person to func as it is
+ *		read, so only a person per range is held at a time however large
+ *		the group is. func is called from several threads, but one person
+ *		at a time, in personId order within a range. A mirrored group is
+ *		kept current with the persons listed
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *		top: persons per page; 0 or over FACE_LIST_TOP for FACE_LIST_TOP
+ *		ranges: personId ranges listed at once; 0 for FACE_LIST_RANGES, at
+ *				most FACE_LIST_MAX_RANGES
+ *		func: takes each person, which is freed once it returns and must
+ *			  be copied to be kept; returns nonzero to stop the listing
+ *		data: passed to func
+ *
+ * Return:
+ *		http status code of the first page that failed, 200 if none did; -1
+ *		if user hasn't logged in via face_login
+ */
+long face_list_p_each(char * pgid, int top, int ranges, FacePersonFunc func, void * data) {
+	struct json_object * error;
+	long status;
+
+	if (!pgid || !func) {
+		fprintf(stderr, "%s\n", strerror(EINVAL));
+		return -1;
+	}
+	if (top <= 0 || top > FACE_LIST_TOP) top = FACE_LIST_TOP;
+	if (ranges <= 0) ranges = FACE_LIST_RANGES;
+	if (ranges > FACE_LIST_MAX_RANGES) ranges = FACE_LIST_MAX_RANGES;
+
+	status = face_list_run(pgid, top, ranges, 1, 0, func, data, &error);
+
+#ifdef _DEBUG_
+	if (error) {
+		fprintf(stderr, "%s\n", json_object_to_json_string(error));
+	}
+#endif
+	json_object_put(error);
+
+	return status;
+}
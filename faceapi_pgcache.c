@@ -0,0 +1,267 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/**
+ * Description:
+ *		Sets up the persongroup state of a client; nothing is known yet
+ */
+void face_pg_init(PgCache * cache) {
+	memset(cache, 0, sizeof(PgCache));
+	pthread_mutex_init(&cache->lock, NULL);
+}
+
+/**
+ * Description:
+ *		Releases what face_pg_init set up
+ */
+void face_pg_destroy(PgCache * cache) {
+	pthread_mutex_destroy(&cache->lock);
+}
+
+/**
+ * Description:
+ *		Forgets every persongroup; used by face_client_login
+ */
+void face_pg_reset(PgCache * cache) {
+	pthread_mutex_lock(&cache->lock);
+	cache->count = 0;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * Description:
+ *		Finds the entry of a persongroup, adding it if asked to. Must be
+ *		called with the lock held
+ *
+ * Return:
+ *		the entry; NULL if not found, or if there is no room to add it
+ */
+static PgEntry * pg_find(PgCache * cache, const char * pgid, int add)
+{
+	PgEntry * entry;
+	int i;
+
+	for (i = 0; i < cache->count; ++i) {
+		if (!strcmp(cache->entries[i].pgid, pgid)) {
+			return &cache->entries[i];
+		}
+	}
+
+	if (!add || cache->count == FACE_PG_CACHE_MAX || strlen(pgid) >= FACE_PGID_SIZE) {
+		return NULL;
+	}
+
+	entry = &cache->entries[cache->count++];
+	snprintf(entry->pgid, sizeof(entry->pgid), "%s", pgid);
+	entry->status.exists = FACE_PG_UNKNOWN;
+	entry->status.training = FACE_TRAIN_UNKNOWN;
+	return entry;
+}
+
+/**
+ * Description:
+ *		Checks if an error response says the persongroup doesn't exist, as
+ *		opposed to a person or face in it, or a training
+ */
+int face_pg_missing(struct json_object * resp) {
+	struct json_object * error;
+	struct json_object * code;
+	const char * text;
+	size_t len = strlen(FACE_PG_NOT_FOUND);
+
+	if (!resp || !json_object_object_get_ex(resp, FACE_ERROR, &error)
+		|| !json_object_object_get_ex(error, FACE_ERROR_CODE, &code)) {
+		return 0;
+	}
+
+	// PersonGroupNotFound or LargePersonGroupNotFound
+	text = json_object_get_string(code);
+	return text && strlen(text) >= len && !strcmp(text + strlen(text) - len, FACE_PG_NOT_FOUND);
+}
+
+/**
+ * Description:
+ *		Learns what a response says of the persongroup a request was
+ *		about. Deleting a group forgets it whatever the answer, since a
+ *		failed delete may still have gone through
+ *
+ * Params:
+ *		call: the request
+ *		status: http status of its response
+ *		resp: the response; NULL if there was none
+ */
+void face_pg_record(PgCache * cache, const FaceCall * call, long status, struct json_object * resp) {
+	struct json_object * value;
+	const char * training = NULL;
+	PgEntry * entry;
+	int i;
+
+	if (!call->pgid || status < 0) return;
+
+	pthread_mutex_lock(&cache->lock);
+
+	switch (call->ep) {
+	case FACE_EP_CREATE_PG:
+		// a 409 is a group that exists already, trained or not
+		if (statusOk(status) || status == 409) {
+			if ((entry = pg_find(cache, call->pgid, 1))) {
+				if (statusOk(status)) {
+					entry->status.training = FACE_TRAIN_NEEDED;
+				}
+				entry->status.exists = FACE_PG_EXISTS;
+			}
+		}
+		break;
+	case FACE_EP_GET_PG:
+	case FACE_EP_TRAIN_PG:
+		if (status == 404) {
+			if ((entry = pg_find(cache, call->pgid, 1))) {
+				entry->status.exists = FACE_PG_ABSENT;
+				entry->status.training = FACE_TRAIN_UNKNOWN;
+			}
+		}
+		else if (statusOk(status) && (entry = pg_find(cache, call->pgid, 1))) {
+			entry->status.exists = FACE_PG_EXISTS;
+			if (call->ep == FACE_EP_TRAIN_PG) {
+				entry->status.training = FACE_TRAIN_STARTED;
+			}
+		}
+		break;
+	case FACE_EP_GET_TRAINING:
+		// a group never trained answers 404 too
+		if (status == 404 && face_pg_missing(resp)) {
+			if ((entry = pg_find(cache, call->pgid, 1))) {
+				entry->status.exists = FACE_PG_ABSENT;
+				entry->status.training = FACE_TRAIN_UNKNOWN;
+			}
+			break;
+		}
+		if (!statusOk(status) && status != 404) break;
+		if (!(entry = pg_find(cache, call->pgid, 1))) break;
+
+		entry->status.exists = FACE_PG_EXISTS;
+		if (statusOk(status) && json_object_object_get_ex(resp, FACE_STATUS, &value)) {
+			training = json_object_get_string(value);
+		}
+
+		// a train sent before the last change doesn't cover it
+		if (!training || entry->status.training == FACE_TRAIN_NEEDED) break;
+		if (!strcmp(training, FACE_TRAIN_SUCCEEDED)) {
+			entry->status.training = FACE_TRAIN_FINISHED;
+		}
+		else if (!strcmp(training, FACE_TRAIN_FAILURE)) {
+			entry->status.training = FACE_TRAIN_ERRORED;
+		}
+		else {
+			entry->status.training = FACE_TRAIN_STARTED;
+		}
+		break;
+	case FACE_EP_DELETE_PG:
+		for (i = 0; i < cache->count; ++i) {
+			if (!strcmp(cache->entries[i].pgid, call->pgid)) {
+				cache->entries[i] = cache->entries[--cache->count];
+				break;
+			}
+		}
+		break;
+	case FACE_EP_CREATE_P:
+	case FACE_EP_DELETE_P:
+	case FACE_EP_ADD_FACE:
+	case FACE_EP_DELETE_FACE:
+		if (statusOk(status) && (entry = pg_find(cache, call->pgid, 1))) {
+			entry->status.exists = FACE_PG_EXISTS;
+			entry->status.training = FACE_TRAIN_NEEDED;
+		}
+		break;
+	default:
+		break;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * Description:
+ *		Gets what the calling thread's client knows of a persongroup, from
+ *		its own creates, gets, trains, training status polls and deletes
+ *		and the changes it made to the group's persons. Makes no call
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *		status: return parameter; FACE_PG_UNKNOWN and FACE_TRAIN_UNKNOWN
+ *				if the client knows nothing of the group
+ *
+ * Return:
+ *		0 if the client knew the group; -1 if not
+ */
+int face_get_pg_status(const char * pgid, PgStatus * status) {
+	PgCache * cache = &face_client_current()->pgcache;
+	PgEntry * entry;
+	int ret = -1;
+
+	if (!pgid || !status) return -1;
+
+	status->exists = FACE_PG_UNKNOWN;
+	status->training = FACE_TRAIN_UNKNOWN;
+
+	pthread_mutex_lock(&cache->lock);
+	cache->stats.lookups++;
+	if ((entry = pg_find(cache, pgid, 0)) && entry->status.exists != FACE_PG_UNKNOWN) {
+		*status = entry->status;
+		cache->stats.hits++;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return ret;
+}
+
+/**
+ * Description:
+ *		Creates a persongroup unless the client knows it exists. A group
+ *		that exists already (409) is as good as created
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *		body: the request body; see face_body_create_pg
+ *		resp: return parameter; collects the response; NULL if no call
+ *			  was made
+ *
+ * Return:
+ *		http status code; 200 without a call if the group is known to
+ *		exist; -1 if user hasn't logged in via face_login
+ */
+long face_ensure_pg(char * pgid, FaceBody * body, struct json_object ** resp) {
+	PgCache * cache = &face_client_current()->pgcache;
+	PgStatus status;
+
+	if (!face_get_pg_status(pgid, &status) && status.exists == FACE_PG_EXISTS) {
+		pthread_mutex_lock(&cache->lock);
+		cache->stats.skipped++;
+		pthread_mutex_unlock(&cache->lock);
+
+		*resp = NULL;
+		return 200;
+	}
+
+	return face_create_pg_body(pgid, body, resp);
+}
+
+/**
+ * Description:
+ *		Gets the persongroup state counters of the calling thread's client
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_pg_cache_stats(PgCacheStats * stats) {
+	PgCache * cache = &face_client_current()->pgcache;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,291 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/**
+ * Description:
+ *		Sets up prewarming of a client; off until face_client_prewarm. The
+ *		condition variable times out on the monotonic clock
+ */
+void face_prewarm_init(PrewarmState * state) {
+	pthread_condattr_t attr;
+
+	memset(state, 0, sizeof(PrewarmState));
+	pthread_mutex_init(&state->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&state->cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Description:
+ *		Stops the refresh thread and releases what face_prewarm_init set up.
+ *		Must be called before the client's share handle is cleaned up
+ */
+void face_prewarm_destroy(PrewarmState * state) {
+	pthread_mutex_lock(&state->lock);
+	state->stopping = 1;
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->lock);
+
+	if (state->running) {
+		pthread_join(state->thread, NULL);
+		state->running = 0;
+	}
+
+	pthread_cond_destroy(&state->cond);
+	pthread_mutex_destroy(&state->lock);
+}
+
+static size_t discard_callback(void * contents, size_t size, size_t nmemb, void * data)
+{
+	(void)contents;
+	(void)data;
+	return size * nmemb;
+}
+
+/**
+ * Description:
+ *		Opens connections to one backend, or keeps open ones alive, by
+ *		sending that many requests for the service root at once. They carry
+ *		no subscription key, so they aren't billed, and their connections
+ *		go back to the client's share for the next requests to use
+ *
+ * Params:
+ *		client: the client
+ *		region: region of the backend
+ *		connections: connections to open
+ *
+ * Return:
+ *		connections that opened
+ */
+static int prewarm_backend(FaceClient * client, const char * region, int connections)
+{
+	CURLM * multi;
+	CURL * handles[FACE_PREWARM_MAX];
+	CURLU * curlu;
+	CURLMsg * msg;
+	char * url;
+	int running;
+	int queued;
+	int opened = 0;
+	int i;
+
+	curlu = curl_url();
+	setUriBase(curlu, region, FACE_HOST);
+	curl_url_set(curlu, CURLUPART_PATH, FACE_SLASH, 0);
+	if (curl_url_get(curlu, CURLUPART_URL, &url, CURLU_NON_SUPPORT_SCHEME)) {
+		curl_url_cleanup(curlu);
+		return 0;
+	}
+
+	multi = curl_multi_init();
+	for (i = 0; i < connections; ++i) {
+		handles[i] = curl_easy_init();
+		if (!handles[i]) break;
+
+		curl_easy_setopt(handles[i], CURLOPT_URL, url);
+		curl_easy_setopt(handles[i], CURLOPT_SHARE, client->share);
+		face_tls_apply(client, handles[i]);
+		curl_easy_setopt(handles[i], CURLOPT_HTTPGET, 1L);
+		curl_easy_setopt(handles[i], CURLOPT_WRITEFUNCTION, discard_callback);
+		curl_easy_setopt(handles[i], CURLOPT_TIMEOUT_MS, (long)FACE_PREWARM_TIMEOUT);
+		curl_multi_add_handle(multi, handles[i]);
+	}
+	connections = i;
+
+	// any http answer means the connection is up
+	do {
+		curl_multi_perform(multi, &running);
+		while ((msg = curl_multi_info_read(multi, &queued))) {
+			if (msg->msg == CURLMSG_DONE && msg->data.result == CURLE_OK) {
+				opened++;
+			}
+		}
+		if (running) {
+			curl_multi_poll(multi, NULL, 0, FACE_PREWARM_POLL, NULL);
+		}
+	} while (running);
+
+	for (i = 0; i < connections; ++i) {
+		curl_multi_remove_handle(multi, handles[i]);
+		curl_easy_cleanup(handles[i]);
+	}
+	curl_multi_cleanup(multi);
+	curl_free(url);
+	curl_url_cleanup(curlu);
+
+	return opened;
+}
+
+/**
+ * Description:
+ *		Opens or refreshes the connections of every backend of a client
+ *
+ * Return:
+ *		connections that opened
+ */
+static int prewarm_round(FaceClient * client, int connections)
+{
+	char region[BUFSIZ];
+	struct timespec start;
+	struct timespec end;
+	double elapsed = 0;
+	int opened;
+	int total = 0;
+	int failed = 0;
+	int i;
+
+	for (i = 0; ; ++i) {
+		// backends are only ever added while logged in, so copying the
+		// region out is enough to not hold the lock while connecting
+		pthread_mutex_lock(&client->backend.lock);
+		if (i >= client->backend.count) {
+			pthread_mutex_unlock(&client->backend.lock);
+			break;
+		}
+		snprintf(region, sizeof(region), "%s", client->backend.backends[i].region);
+		pthread_mutex_unlock(&client->backend.lock);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		opened = prewarm_backend(client, region, connections);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsed = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+#ifdef _DEBUG_
+		fprintf(stderr, FACE_PREWARM, opened, connections, region, elapsed);
+#endif
+
+		total += opened;
+		failed += connections - opened;
+	}
+
+	pthread_mutex_lock(&client->prewarm.lock);
+	client->prewarm.stats.rounds++;
+	client->prewarm.stats.connections = total;
+	client->prewarm.stats.failures += failed;
+	client->prewarm.stats.last_ms = elapsed;
+	pthread_mutex_unlock(&client->prewarm.lock);
+
+	return total;
+}
+
+/**
+ * Description:
+ *		Refreshes a client's connections every refresh_ms until the client
+ *		is freed
+ */
+static void * prewarm_run(void * arg)
+{
+	FaceClient * client = arg;
+	PrewarmState * state = &client->prewarm;
+	struct timespec deadline;
+	int connections;
+
+	pthread_mutex_lock(&state->lock);
+	while (!state->stopping) {
+		if (!state->refresh_ms) {
+			pthread_cond_wait(&state->cond, &state->lock);
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += state->refresh_ms / 1000;
+		deadline.tv_nsec += (state->refresh_ms % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		if (pthread_cond_timedwait(&state->cond, &state->lock, &deadline) != ETIMEDOUT) {
+			// stopping, or the settings changed and the wait starts over
+			continue;
+		}
+
+		connections = state->connections;
+		pthread_mutex_unlock(&state->lock);
+
+		prewarm_round(client, connections);
+
+		pthread_mutex_lock(&state->lock);
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	return NULL;
+}
+
+/**
+ * Description:
+ *		Resolves the hosts of a client's backends and opens connections to
+ *		them before they are needed, so the first request doesn't pay for
+ *		dns, tcp and tls. The connections are then refreshed before the
+ *		service closes them as idle. Call it after face_client_login and
+ *		face_add_backend
+ *
+ * Params:
+ *		client: the client
+ *		connections: connections kept open per backend; 0 for
+ *					 FACE_PREWARM_CONNECTIONS
+ *		refresh_ms: time between refreshes; 0 for FACE_PREWARM_REFRESH,
+ *					negative to only open them now
+ *
+ * Return:
+ *		connections that opened; -1 if the client isn't logged in
+ */
+int face_client_prewarm(FaceClient * client, int connections, long refresh_ms) {
+	PrewarmState * state;
+	int start = 0;
+
+	if (!client || !client->login) {
+		fprintf(stderr, FACE_LOGIN_ERROR);
+		return -1;
+	}
+	state = &client->prewarm;
+
+	if (connections <= 0) {
+		connections = FACE_PREWARM_CONNECTIONS;
+	}
+	if (connections > FACE_PREWARM_MAX) {
+		connections = FACE_PREWARM_MAX;
+	}
+	if (!refresh_ms) {
+		refresh_ms = FACE_PREWARM_REFRESH;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	state->connections = connections;
+	state->refresh_ms = refresh_ms > 0 ? refresh_ms : 0;
+	if (state->refresh_ms && !state->running && !state->stopping) {
+		start = 1;
+		state->running = 1;
+	}
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->lock);
+
+	if (start && pthread_create(&state->thread, NULL, prewarm_run, client)) {
+		fprintf(stderr, "Error: can't start the prewarm thread\n");
+		pthread_mutex_lock(&state->lock);
+		state->running = 0;
+		pthread_mutex_unlock(&state->lock);
+	}
+
+	return prewarm_round(client, connections);
+}
+
+/**
+ * Description:
+ *		Gets the prewarm counters of the calling thread's client
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_prewarm_stats(PrewarmStats * stats) {
+	PrewarmState * state = &face_client_current()->prewarm;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&state->lock);
+	*stats = state->stats;
+	pthread_mutex_unlock(&state->lock);
+}
@@ -0,0 +1,337 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+static __thread int rate_priority = FACE_PRIORITY_NORMAL;	// priority of this thread's requests
+
+/**
+ * Description:
+ *		Sets up the rate limiter of a client; off until face_set_rate_limit.
+ *		The condition variable times out on the monotonic clock
+ */
+void face_rate_init(RateState * state) {
+	pthread_condattr_t attr;
+
+	memset(state->buckets, 0, sizeof(state->buckets));
+	state->count = 0;
+	state->tps = 0;
+	state->burst = 0;
+	pthread_mutex_init(&state->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&state->cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Description:
+ *		Releases what face_rate_init set up and the buckets' keys
+ */
+void face_rate_destroy(RateState * state) {
+	int i;
+
+	for (i = 0; i < state->count; ++i) {
+		free(state->buckets[i].key);
+	}
+	pthread_cond_destroy(&state->cond);
+	pthread_mutex_destroy(&state->lock);
+}
+
+#define BUCKET_TPS(state, bucket) ((bucket)->tps > 0 ? (bucket)->tps : (state)->tps)
+#define BUCKET_BURST(state, bucket) ((bucket)->tps > 0 ? (bucket)->burst : (state)->burst)
+
+static double elapsed_ms(const struct timespec * from, const struct timespec * to)
+{
+	return (to->tv_sec - from->tv_sec) * 1e3 + (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+/**
+ * Description:
+ *		Adds the tokens earned since the bucket was last refilled. Must hold
+ *		state->lock
+ */
+static void bucket_refill(RateState * state, RateBucket * bucket, const struct timespec * now)
+{
+	bucket->tokens += elapsed_ms(&bucket->stamp, now) / 1e3 * BUCKET_TPS(state, bucket);
+	if (bucket->tokens > BUCKET_BURST(state, bucket)) {
+		bucket->tokens = BUCKET_BURST(state, bucket);
+	}
+	bucket->stamp = *now;
+}
+
+/**
+ * Description:
+ *		Finds the bucket of a subscription key, creating a full one the first
+ *		time the key is seen. Must hold state->lock
+ *
+ * Return:
+ *		the bucket; NULL if the table is full
+ */
+static RateBucket * bucket_find(RateState * state, const char * key)
+{
+	RateBucket * bucket;
+	int i;
+
+	for (i = 0; i < state->count; ++i) {
+		if (!strcmp(state->buckets[i].key, key)) {
+			return &state->buckets[i];
+		}
+	}
+
+	if (state->count == FACE_RATE_MAX_KEYS) {
+		return NULL;
+	}
+
+	bucket = &state->buckets[state->count];
+	memset(bucket, 0, sizeof(RateBucket));
+	bucket->key = strdup(key);
+	if (!bucket->key) {
+		return NULL;
+	}
+	bucket->tokens = state->burst;
+	clock_gettime(CLOCK_MONOTONIC, &bucket->stamp);
+	state->count++;
+	return bucket;
+}
+
+/**
+ * Description:
+ *		Sets the rate limit shared by every thread using the client. Each
+ *		subscription key gets its own bucket of this size
+ *
+ * Params:
+ *		tps: requests per second allowed per key, as given by the
+ *			 subscription tier; 0 turns the limit off
+ *		burst: requests that may be sent at once after being idle; at
+ *			   least 1
+ */
+void face_set_rate_limit(double tps, double burst) {
+	RateState * state = &face_client_current()->rate;
+	int i;
+
+	pthread_mutex_lock(&state->lock);
+	state->tps = tps > 0 ? tps : 0;
+	state->burst = burst < 1 ? 1 : burst;
+	for (i = 0; i < state->count; ++i) {
+		if (state->buckets[i].tokens > BUCKET_BURST(state, &state->buckets[i])) {
+			state->buckets[i].tokens = BUCKET_BURST(state, &state->buckets[i]);
+		}
+	}
+	// waiters recompute how long to sleep with the new rate
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Gives one subscription key a rate of its own, e.g. for a backend on
+ *		a different tier than the others
+ *
+ * Params:
+ *		state: rate limiter of the client using the key
+ *		key: the subscription key
+ *		tps: requests per second allowed for the key
+ *		burst: requests that may be sent at once after being idle
+ *
+ * Return:
+ *		0 if successful; -1 if there are already FACE_RATE_MAX_KEYS keys
+ */
+int face_rate_configure(RateState * state, const char * key, double tps, double burst) {
+	RateBucket * bucket;
+
+	pthread_mutex_lock(&state->lock);
+	bucket = bucket_find(state, key);
+	if (!bucket) {
+		pthread_mutex_unlock(&state->lock);
+		return -1;
+	}
+	bucket->tps = tps > 0 ? tps : 0;
+	bucket->burst = burst < 1 ? 1 : burst;
+	bucket->tokens = BUCKET_BURST(state, bucket);
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->lock);
+
+	return 0;
+}
+
+/**
+ * Description:
+ *		Sets the priority of the requests made by the calling thread. When
+ *		requests wait on the rate limit, higher priority ones are sent first
+ *
+ * Params:
+ *		priority: FACE_PRIORITY_HIGH, FACE_PRIORITY_NORMAL or FACE_PRIORITY_LOW
+ */
+void face_set_priority(FacePriority priority) {
+	rate_priority = priority;
+}
+
+/**
+ * Description:
+ *		Gets the rate limit metrics of a subscription key
+ *
+ * Params:
+ *		key: the subscription key; NULL adds up every key
+ *		stats: return parameter; the metrics
+ *
+ * Return:
+ *		0 if successful; -1 if key has not sent any request yet
+ */
+int face_get_rate_stats(const char * key, RateStats * stats) {
+	RateState * state = &face_client_current()->rate;
+	struct timespec now;
+	int found = 0;
+	int i;
+
+	if (!stats) return -1;
+	memset(stats, 0, sizeof(RateStats));
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&state->lock);
+	for (i = 0; i < state->count; ++i) {
+		RateBucket * bucket = &state->buckets[i];
+		if (key && strcmp(bucket->key, key)) continue;
+
+		if (BUCKET_TPS(state, bucket) > 0) {
+			bucket_refill(state, bucket, &now);
+		}
+		stats->tokens += bucket->tokens;
+		stats->waiting += bucket->waiting;
+		stats->acquired += bucket->acquired;
+		stats->delayed += bucket->delayed;
+		stats->wait_total += bucket->wait_total;
+		if (bucket->wait_max > stats->wait_max) {
+			stats->wait_max = bucket->wait_max;
+		}
+		found = 1;
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	return found ? 0 : -1;
+}
+
+/**
+ * Description:
+ *		Waits until the rate limit of key lets one more request through.
+ *		Requests line up by priority and then by arrival; only the first in
+ *		line sleeps until the next token, the others wait for it to leave
+ *
+ * Params:
+ *		state: rate limiter of the client sending the request
+ *		key: subscription key the request is sent with
+ *
+ * Return:
+ *		ms spent waiting
+ */
+double face_rate_acquire(RateState * state, const char * key) {
+	RateBucket * bucket;
+	RateWaiter self;
+	RateWaiter ** pos;
+	struct timespec start;
+	struct timespec now;
+	struct timespec deadline;
+	double wait;
+	int waited = 0;					// 1 once the request had to wait
+
+	pthread_mutex_lock(&state->lock);
+	if (!(bucket = bucket_find(state, key)) || BUCKET_TPS(state, bucket) <= 0) {
+		pthread_mutex_unlock(&state->lock);
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// getting in line behind everyone of the same or higher priority
+	self.priority = rate_priority;
+	for (pos = &bucket->waiters; *pos && (*pos)->priority <= self.priority; pos = &(*pos)->next);
+	self.next = *pos;
+	*pos = &self;
+	bucket->waiting++;
+
+	while (1) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (BUCKET_TPS(state, bucket) <= 0) {
+			break;
+		}
+		bucket_refill(state, bucket, &now);
+
+		if (bucket->waiters != &self) {
+			waited = 1;
+			pthread_cond_wait(&state->cond, &state->lock);
+			continue;
+		}
+
+		if (bucket->tokens >= 1) {
+			bucket->tokens -= 1;
+			break;
+		}
+
+		// sleeping until the next token is earned
+		wait = (1 - bucket->tokens) / BUCKET_TPS(state, bucket);
+		deadline.tv_sec = now.tv_sec + (time_t)wait;
+		deadline.tv_nsec = now.tv_nsec + (long)((wait - (time_t)wait) * 1e9);
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		waited = 1;
+		pthread_cond_timedwait(&state->cond, &state->lock, &deadline);
+	}
+
+	// leaving the line and letting the next one in
+	for (pos = &bucket->waiters; *pos != &self; pos = &(*pos)->next);
+	*pos = self.next;
+	bucket->waiting--;
+	pthread_cond_broadcast(&state->cond);
+
+	wait = waited ? elapsed_ms(&start, &now) : 0;
+	bucket->acquired++;
+	if (waited) {
+		bucket->delayed++;
+		bucket->wait_total += wait;
+		if (wait > bucket->wait_max) {
+			bucket->wait_max = wait;
+		}
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	return wait;
+}
+
+/**
+ * Description:
+ *		Takes a token for key only if one is there right away and no request
+ *		is already waiting for it; never sleeps
+ *
+ * Params:
+ *		state: rate limiter of the client sending the request
+ *		key: subscription key the request is sent with
+ *
+ * Return:
+ *		1 if the request may be sent; 0 if it would have to wait
+ */
+int face_rate_try(RateState * state, const char * key) {
+	RateBucket * bucket;
+	struct timespec now;
+	int ok = 1;
+
+	pthread_mutex_lock(&state->lock);
+	if (!(bucket = bucket_find(state, key)) || BUCKET_TPS(state, bucket) <= 0) {
+		pthread_mutex_unlock(&state->lock);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	bucket_refill(state, bucket, &now);
+
+	ok = !bucket->waiters && bucket->tokens >= 1;
+	if (ok) {
+		bucket->tokens -= 1;
+		bucket->acquired++;
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	return ok;
+}
@@ -0,0 +1,153 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/*
+ * Each face of an image is registered by a worker of the client: the person is
+ * created, and its face added as soon as the personId comes back, so the
+ * faces of an image take two round trips together rather than two each.
+ * A person whose face can't be added is deleted again, so a face is either
+ * registered whole or not at all.
+ */
+
+typedef struct registerJob {
+	FaceClient * client;			// client the faces are registered with
+	char * pgid;					// persongroup the persons are created in
+	FaceBody * body;				// create_p body, shared by every face
+	const void * image;				// the image the faces are in
+	size_t size;					// size of the image
+} RegisterJob;
+
+typedef struct registerTask {
+	const RegisterJob * job;		// what every face shares
+	int index;						// the face's place in detect order
+	RegResult * result;				// rectangle of the face; gets its personId
+	long status;					// http status of the call that failed; 200 if registered
+} RegisterTask;
+
+/**
+ * Description:
+ *		Creates the person of a face and adds the face to it, deleting the
+ *		person again if the face can't be added
+ */
+static void * register_face(void * arg)
+{
+	RegisterTask * task = arg;
+	const RegisterJob * job = task->job;
+	RegResult * result = task->result;
+	struct json_object * resp;
+	struct json_object * param;
+	struct json_object * pid;
+	char rect[64];
+
+	task->status = face_create_p_body(job->pgid, job->body, &resp);
+	if (!statusOk(task->status)) {
+		json_object_put(resp);
+		return NULL;
+	}
+	if (!json_object_object_get_ex(resp, FACE_PID, &pid)) {
+		json_object_put(resp);
+		task->status = -1;
+		return NULL;
+	}
+	snprintf(result->pid, sizeof(result->pid), "%s", json_object_get_string(pid));
+	json_object_put(resp);
+
+	snprintf(rect, sizeof(rect), FACE_TARGET_RECT, result->rt.x, result->rt.y, result->rt.width, result->rt.height);
+	param = json_object_new_object();
+	json_object_object_add(param, FACE_TARGET_FACE, json_object_new_string(rect));
+
+	task->status = face_add_face_buffer(job->image, job->size, job->pgid, result->pid, param, &resp);
+	json_object_put(param);
+	json_object_put(resp);
+	if (statusOk(task->status)) return NULL;
+
+#ifdef _DEBUG_
+	fprintf(stderr, FACE_REGISTER_ROLLBACK, result->pid, task->index);
+#endif
+
+	face_delete_p(job->pgid, result->pid, &resp);
+	json_object_put(resp);
+	result->pid[0] = '\0';
+	return NULL;
+}
+
+/**
+ * Description:
+ *		Registers every face of an image as a new person of a persongroup,
+ *		all of them at once: each face's person is created, then the face
+ *		added to it by PersonGroup Person Add Face (POST) as soon as its
+ *		personId is back. A face whose person was created but whose face
+ *		couldn't be added has its person deleted again
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *		body: create_p body every person is created with, see
+ *			  face_body_create_p
+ *		image: the image the faces are in; must stay valid until the call
+ *			   returns
+ *		size: the size of the image
+ *		results: the faces to register, each with its rectangle set; the
+ *				 personIds of those registered are filled in, and emptied
+ *				 for the others
+ *		status: return parameter; count entries, each the http status of
+ *				the call that failed for that face, 200 if it registered; may
+ *				be NULL
+ *		count: number of faces
+ *
+ * Return:
+ *		number of faces registered; -1 if a parameter is invalid or out of
+ *		memory
+ */
+int face_register_faces(char * pgid, FaceBody * body, const void * image, size_t size, RegResult * results,
+	long * status, int count) {
+	RegisterJob job = {
+		.client = face_client_current(),
+		.pgid = pgid,
+		.body = body,
+		.image = image,
+		.size = size
+	};
+	RegisterTask * tasks;
+	int registered = 0;
+	int i;
+
+	if (!pgid || !body || !image || !results || count < 0) {
+		fprintf(stderr, "%s\n", strerror(EINVAL));
+		return -1;
+	}
+	if (!count) return 0;
+
+	tasks = (RegisterTask *)calloc(count, sizeof(RegisterTask));
+	if (!tasks) {
+		fprintf(stderr, "Calloc Error: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < count; ++i) {
+		tasks[i].job = &job;
+		tasks[i].index = i;
+		tasks[i].result = &results[i];
+		results[i].pid[0] = '\0';
+	}
+
+	face_client_fan(job.client, register_face, tasks, sizeof(RegisterTask), count);
+
+	for (i = 0; i < count; ++i) {
+		if (statusOk(tasks[i].status)) {
+			registered++;
+		}
+#ifdef _DEBUG_
+		else {
+			fprintf(stderr, FACE_REGISTER_FAILED, i, tasks[i].status);
+		}
+#endif
+		if (status) {
+			status[i] = tasks[i].status;
+		}
+	}
+
+	free(tasks);
+	return registered;
+}
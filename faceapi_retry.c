@@ -0,0 +1,328 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+#define FACE_RETRY_DEFAULT(post) { \
+	.max_attempts = FACE_RETRY_ATTEMPTS, \
+	.base_delay = FACE_RETRY_BASE_DELAY, \
+	.max_delay = FACE_RETRY_MAX_DELAY, \
+	.max_retry_after = FACE_RETRY_MAX_AFTER, \
+	.retry_post = (post), \
+	.timeout_ms = FACE_RETRY_TIMEOUT, \
+	.connect_timeout_ms = FACE_RETRY_CONNECT_TIMEOUT \
+}
+
+// POST is only retried after reaching the server where repeating it can't
+// create a duplicate: detect, verify and identify are read-only and
+// training twice is harmless, but create person and add face are not
+static const RetryPolicy retry_defaults[FACE_EP_COUNT] = {
+	[FACE_EP_DETECT] = FACE_RETRY_DEFAULT(1),
+	[FACE_EP_VERIFY] = FACE_RETRY_DEFAULT(1),
+	[FACE_EP_IDENTIFY] = FACE_RETRY_DEFAULT(1),
+	[FACE_EP_CREATE_PG] = FACE_RETRY_DEFAULT(0),
+	[FACE_EP_DELETE_PG] = FACE_RETRY_DEFAULT(0),
+	[FACE_EP_GET_PG] = FACE_RETRY_DEFAULT(0),
+	[FACE_EP_TRAIN_PG] = FACE_RETRY_DEFAULT(1),
+	[FACE_EP_CREATE_P] = FACE_RETRY_DEFAULT(0),
+	[FACE_EP_DELETE_P] = FACE_RETRY_DEFAULT(0),
+	[FACE_EP_GET_P] = FACE_RETRY_DEFAULT(0),
+	[FACE_EP_LIST_P] = FACE_RETRY_DEFAULT(0),
+	[FACE_EP_ADD_FACE] = FACE_RETRY_DEFAULT(0),
+	[FACE_EP_DELETE_FACE] = FACE_RETRY_DEFAULT(0),
+	[FACE_EP_GET_FACE] = FACE_RETRY_DEFAULT(0),
+	[FACE_EP_GET_TRAINING] = FACE_RETRY_DEFAULT(0)
+};
+
+/**
+ * Description:
+ *		Sets up the retry policies and budget of a client
+ */
+void face_retry_init(RetryState * state) {
+	memcpy(state->policies, retry_defaults, sizeof(retry_defaults));
+	state->ratio = FACE_RETRY_BUDGET_RATIO;
+	state->min_rate = FACE_RETRY_BUDGET_MIN_RATE;
+	state->tokens = FACE_RETRY_BUDGET_MAX;
+	pthread_mutex_init(&state->lock, NULL);
+}
+
+/**
+ * Description:
+ *		Releases what face_retry_init set up
+ */
+void face_retry_destroy(RetryState * state) {
+	pthread_mutex_destroy(&state->lock);
+}
+
+/**
+ * Description:
+ *		Sets the retry policy of an endpoint
+ *
+ * Params:
+ *		ep: the endpoint
+ *		policy: the new policy; max_attempts of 1 turns retrying off
+ */
+void face_set_retry_policy(FaceEndpoint ep, const RetryPolicy * policy) {
+	RetryState * state = &face_client_current()->retry;
+
+	if (ep < 0 || ep >= FACE_EP_COUNT || !policy) return;
+
+	pthread_mutex_lock(&state->lock);
+	state->policies[ep] = *policy;
+	if (state->policies[ep].max_attempts < 1) {
+		state->policies[ep].max_attempts = 1;
+	}
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Gets the retry policy of an endpoint
+ *
+ * Params:
+ *		ep: the endpoint
+ *		policy: return parameter; the current policy
+ */
+void face_get_retry_policy(FaceEndpoint ep, RetryPolicy * policy) {
+	RetryState * state = &face_client_current()->retry;
+
+	if (ep < 0 || ep >= FACE_EP_COUNT || !policy) return;
+
+	pthread_mutex_lock(&state->lock);
+	*policy = state->policies[ep];
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Sets the retry budget shared by every endpoint. Each request earns
+ *		ratio of a retry and each retry spends a whole one, so retries stay
+ *		below that share of the traffic no matter how much of it fails
+ *
+ * Params:
+ *		ratio: retries allowed per request, e.g. 0.1 for 10%
+ *		min_per_sec: retries allowed per second even with little traffic
+ */
+void face_set_retry_budget(double ratio, double min_per_sec) {
+	RetryState * state = &face_client_current()->retry;
+
+	pthread_mutex_lock(&state->lock);
+	state->ratio = ratio < 0 ? 0 : ratio;
+	state->min_rate = min_per_sec < 0 ? 0 : min_per_sec;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Gets the retry counters and the current budget
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_retry_stats(RetryStats * stats) {
+	RetryState * state = &face_client_current()->retry;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&state->lock);
+	*stats = state->stats;
+	stats->budget = state->tokens;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Counts a new request and pays its share into the retry budget
+ */
+void face_retry_begin(RetryState * state) {
+	pthread_mutex_lock(&state->lock);
+	state->stats.requests++;
+	state->tokens += state->ratio;
+	if (state->tokens > FACE_RETRY_BUDGET_MAX) {
+		state->tokens = FACE_RETRY_BUDGET_MAX;
+	}
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Spends one retry from the budget, first adding what min_per_sec
+ *		earned since the last call. Must hold state->lock
+ *
+ * Return:
+ *		1 if the retry may be sent; 0 if the budget is used up
+ */
+static int budget_withdraw(RetryState * state)
+{
+	struct timespec now;
+	double elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (state->stamp.tv_sec || state->stamp.tv_nsec) {
+		elapsed = (now.tv_sec - state->stamp.tv_sec)
+			+ (now.tv_nsec - state->stamp.tv_nsec) / 1e9;
+		state->tokens += elapsed * state->min_rate;
+		if (state->tokens > FACE_RETRY_BUDGET_MAX) {
+			state->tokens = FACE_RETRY_BUDGET_MAX;
+		}
+	}
+	state->stamp = now;
+
+	if (state->tokens < 1) {
+		return 0;
+	}
+	state->tokens -= 1;
+	return 1;
+}
+
+/**
+ * Description:
+ *		Checks if an http status means the service may succeed later
+ */
+static int status_retryable(long status)
+{
+	return status == 429 || status == 500 || status == 502
+		|| status == 503 || status == 504;
+}
+
+/**
+ * Description:
+ *		Checks if a libcurl error happened before any of the request could
+ *		have reached the service
+ */
+static int error_unsent(CURLcode res)
+{
+	return res == CURLE_COULDNT_RESOLVE_HOST || res == CURLE_COULDNT_RESOLVE_PROXY
+		|| res == CURLE_COULDNT_CONNECT || res == CURLE_SSL_CONNECT_ERROR;
+}
+
+/**
+ * Description:
+ *		Checks if a libcurl error is a transient network failure
+ */
+static int error_retryable(CURLcode res)
+{
+	return error_unsent(res) || res == CURLE_OPERATION_TIMEDOUT
+		|| res == CURLE_SEND_ERROR || res == CURLE_RECV_ERROR
+		|| res == CURLE_GOT_NOTHING || res == CURLE_PARTIAL_FILE;
+}
+
+/**
+ * Description:
+ *		Decides if a failed attempt should be sent again and how long to wait
+ *		first. The wait is drawn uniformly from zero up to the exponential
+ *		backoff (full jitter) and is never shorter than Retry-After
+ *
+ * Params:
+ *		state: retry state of the client sending the request
+ *		call: the request
+ *		policy: retry policy of the request's endpoint
+ *		attempt: number of attempts made so far
+ *		status: http status of the last attempt; 0 if there was no response
+ *		res: libcurl result of the last attempt
+ *		retry_after: Retry-After of the last response in ms; -1 if absent
+ *		delay: return parameter; how long to wait in ms
+ *
+ * Return:
+ *		1 if the request should be retried; 0 otherwise
+ */
+int face_retry_should(RetryState * state, const FaceCall * call, const RetryPolicy * policy,
+	int attempt, long status, CURLcode res, long retry_after, long * delay) {
+	static __thread unsigned int seed = 0;		// per thread seed for jitter
+	int idempotent;								// method may be repeated freely
+	int safe;									// repeating this attempt is safe
+	long backoff;								// upper bound of the wait
+	int i;
+
+	if (attempt >= policy->max_attempts) {
+		return 0;
+	}
+
+	idempotent = strcmp(call->method, FACE_POST) != 0;
+
+	if (res == CURLE_OK) {
+		if (!status_retryable(status)) return 0;
+		// a throttled request was turned away before it was processed
+		safe = idempotent || status == 429 || policy->retry_post;
+	}
+	else {
+		if (!error_retryable(res)) return 0;
+		safe = idempotent || error_unsent(res) || policy->retry_post;
+	}
+
+	if (!safe) {
+		return 0;
+	}
+
+	// waiting longer than the caller allows is the same as failing now
+	if (retry_after > policy->max_retry_after) {
+		pthread_mutex_lock(&state->lock);
+		state->stats.gave_up++;
+		pthread_mutex_unlock(&state->lock);
+		return 0;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	if (!budget_withdraw(state)) {
+		state->stats.budget_exhausted++;
+		pthread_mutex_unlock(&state->lock);
+		return 0;
+	}
+	state->stats.retries++;
+	if (retry_after >= 0) {
+		state->stats.retry_after_waits++;
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	// exponential backoff capped at max_delay
+	backoff = policy->base_delay;
+	for (i = 1; i < attempt && backoff < policy->max_delay; ++i) {
+		backoff *= 2;
+	}
+	if (backoff > policy->max_delay) {
+		backoff = policy->max_delay;
+	}
+
+	if (!seed) {
+		seed = (unsigned int)time(NULL) ^ (unsigned int)pthread_self();
+	}
+	*delay = backoff > 0 ? (long)(rand_r(&seed) % (backoff + 1)) : 0;
+
+	if (*delay < retry_after) {
+		*delay = retry_after;
+	}
+
+	return 1;
+}
+
+/**
+ * Description:
+ *		Parses the value of a Retry-After header, which is either a number of
+ *		seconds or an http date
+ *
+ * Params:
+ *		value: the header value without the header name
+ *
+ * Return:
+ *		the wait in ms; -1 if value can't be parsed
+ */
+long face_retry_after_parse(const char * value) {
+	char * end;
+	long seconds;
+	time_t date;
+
+	while (*value == ' ' || *value == '\t') ++value;
+
+	seconds = strtol(value, &end, 10);
+	if (end != value) {
+		return seconds < 0 ? 0 : seconds * 1000;
+	}
+
+	date = curl_getdate(value, NULL);
+	if (date < 0) {
+		return -1;
+	}
+
+	seconds = (long)(date - time(NULL));
+	return seconds < 0 ? 0 : seconds * 1000;
+}
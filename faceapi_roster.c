@@ -0,0 +1,811 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/*
+ * Lookups take no lock. A person is added by filling its slot and then
+ * storing the slot's state, and a table or name that is replaced stays
+ * alive on a retired list until a moment when no lookup is in progress,
+ * which the writers check after every change.
+ */
+
+// set by the refresh thread while it lists a group: the group's clears
+// plus one, so a list that raced a delete of the group is dropped
+static __thread unsigned long refresh_clears;
+
+static RosterTable * roster_table_new(size_t capacity)
+{
+	RosterTable * table = (RosterTable *)calloc(1, sizeof(RosterTable));
+
+	if (!table) return NULL;
+
+	table->slots = (RosterSlot *)calloc(capacity, sizeof(RosterSlot));
+	if (!table->slots) {
+		free(table);
+		return NULL;
+	}
+	table->capacity = capacity;
+	return table;
+}
+
+/**
+ * Description:
+ *		Frees a table and, if asked to, the names of its persons
+ */
+static void roster_table_free(RosterTable * table, int names)
+{
+	size_t i;
+
+	if (names) {
+		for (i = 0; i < table->capacity; ++i) {
+			if (table->slots[i].state == FACE_SLOT_USED) {
+				free(table->slots[i].name);
+			}
+		}
+	}
+	free(table->slots);
+	free(table);
+}
+
+/**
+ * Description:
+ *		Sets up the roster mirror of a client; empty, and not refreshed
+ *		until face_set_roster_refresh
+ */
+void face_roster_init(RosterMirror * mirror) {
+	pthread_condattr_t attr;
+
+	memset(mirror, 0, sizeof(RosterMirror));
+	pthread_mutex_init(&mirror->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&mirror->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_rwlock_init(&mirror->index_lock, NULL);
+}
+
+/**
+ * Description:
+ *		Stops the refresh thread and frees the mirror. Must be called before
+ *		the client's share handle is cleaned up
+ */
+void face_roster_destroy(RosterMirror * mirror) {
+	RosterTable * table;
+	RosterName * name;
+	int i;
+
+	pthread_mutex_lock(&mirror->lock);
+	mirror->stopping = 1;
+	pthread_cond_broadcast(&mirror->cond);
+	pthread_mutex_unlock(&mirror->lock);
+
+	if (mirror->running) {
+		pthread_join(mirror->thread, NULL);
+		mirror->running = 0;
+	}
+
+	for (i = 0; i < mirror->count; ++i) {
+		face_search_clear(mirror, &mirror->groups[i]);
+		roster_table_free(mirror->groups[i].table, 1);
+	}
+	while ((table = mirror->retired_tables)) {
+		mirror->retired_tables = table->retired;
+		roster_table_free(table, 0);
+	}
+	while ((name = mirror->retired_names)) {
+		mirror->retired_names = name->retired;
+		free(name);
+	}
+
+	pthread_rwlock_destroy(&mirror->index_lock);
+	pthread_cond_destroy(&mirror->cond);
+	pthread_mutex_destroy(&mirror->lock);
+}
+
+/**
+ * Description:
+ *		Frees the retired tables and names if no lookup is in progress. Any
+ *		lookup starting later sees what replaced them. Must be called with
+ *		the lock held
+ */
+static void roster_reclaim(RosterMirror * mirror)
+{
+	RosterTable * table;
+	RosterName * name;
+
+	if (__atomic_load_n(&mirror->readers, __ATOMIC_SEQ_CST)) return;
+
+	while ((table = mirror->retired_tables)) {
+		mirror->retired_tables = table->retired;
+		roster_table_free(table, 0);
+	}
+	while ((name = mirror->retired_names)) {
+		mirror->retired_names = name->retired;
+		free(name);
+	}
+}
+
+static void retire_name(RosterMirror * mirror, RosterName * name)
+{
+	if (!name) return;
+
+	name->retired = mirror->retired_names;
+	mirror->retired_names = name;
+}
+
+static RosterName * name_new(const char * text)
+{
+	size_t len = strnlen(text, FACE_NAME_SIZE - 1);
+	RosterName * name = (RosterName *)malloc(sizeof(RosterName) + len + 1);
+
+	if (name) {
+		name->retired = NULL;
+		memcpy(name->text, text, len);
+		name->text[len] = '\0';
+	}
+	return name;
+}
+
+/**
+ * Description:
+ *		Reads a personId into its 16 bytes
+ *
+ * Return:
+ *		0 if successful; -1 if text is not a uuid
+ */
+static int parse_uuid(const char * text, unsigned char * uuid)
+{
+	int digits = 0;
+	int value;
+
+	for (; *text; ++text) {
+		if (*text == '-') continue;
+
+		if (*text >= '0' && *text <= '9') value = *text - '0';
+		else if (*text >= 'a' && *text <= 'f') value = *text - 'a' + 10;
+		else if (*text >= 'A' && *text <= 'F') value = *text - 'A' + 10;
+		else return -1;
+
+		if (digits == FACE_UUID_SIZE * 2) return -1;
+		if (digits % 2) uuid[digits / 2] |= value;
+		else uuid[digits / 2] = value << 4;
+		digits++;
+	}
+
+	return digits == FACE_UUID_SIZE * 2 ? 0 : -1;
+}
+
+static size_t uuid_hash(const unsigned char * uuid)
+{
+	unsigned long long high;
+	unsigned long long low;
+	unsigned long long hash;
+
+	memcpy(&high, uuid, sizeof(high));
+	memcpy(&low, uuid + sizeof(high), sizeof(low));
+	hash = (high ^ low) * 0x9e3779b97f4a7c15ULL;
+	return (size_t)(hash ^ (hash >> 32));
+}
+
+/**
+ * Description:
+ *		Finds the slot of a person, removed or not. Safe without the lock;
+ *		a slot's uuid never changes once its state is set
+ *
+ * Return:
+ *		the slot; NULL if the person was never in the table
+ */
+static RosterSlot * roster_find(RosterTable * table, const unsigned char * uuid)
+{
+	size_t mask = table->capacity - 1;
+	size_t i = uuid_hash(uuid) & mask;
+
+	// tables are never more than half used, so an empty slot is ahead
+	while (__atomic_load_n(&table->slots[i].state, __ATOMIC_ACQUIRE) != FACE_SLOT_EMPTY) {
+		if (!memcmp(table->slots[i].uuid, uuid, FACE_UUID_SIZE)) {
+			return &table->slots[i];
+		}
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+static RosterSlot * roster_empty_slot(RosterTable * table, const unsigned char * uuid)
+{
+	size_t mask = table->capacity - 1;
+	size_t i = uuid_hash(uuid) & mask;
+
+	while (table->slots[i].state != FACE_SLOT_EMPTY) {
+		i = (i + 1) & mask;
+	}
+	return &table->slots[i];
+}
+
+/**
+ * Description:
+ *		Replaces the table of a group by one with room for twice its persons
+ *		and without the slots of removed ones. Must be called with the lock
+ *		held
+ *
+ * Return:
+ *		0 if successful; -1 if out of memory
+ */
+static int group_rehash(RosterMirror * mirror, RosterGroup * group)
+{
+	RosterTable * old = group->table;
+	RosterTable * table;
+	RosterSlot * slot;
+	size_t capacity = FACE_ROSTER_MIN_SLOTS;
+	size_t i;
+
+	while (capacity < (old->persons + 1) * 4) {
+		capacity *= 2;
+	}
+
+	table = roster_table_new(capacity);
+	if (!table) {
+		fprintf(stderr, "Malloc Error: %s\n", strerror(errno));
+		return -1;
+	}
+
+	// the names move over as they are
+	for (i = 0; i < old->capacity; ++i) {
+		if (old->slots[i].state != FACE_SLOT_USED) continue;
+
+		slot = roster_empty_slot(table, old->slots[i].uuid);
+		*slot = old->slots[i];
+		table->used++;
+		table->persons++;
+	}
+
+	__atomic_store_n(&group->table, table, __ATOMIC_SEQ_CST);
+	old->retired = mirror->retired_tables;
+	mirror->retired_tables = old;
+	return 0;
+}
+
+/**
+ * Description:
+ *		Adds a person to a group or updates it. Must be called with the lock
+ *		held
+ *
+ * Params:
+ *		name: name of the person; NULL to only update a person already there
+ *		userData: userData of the person; NULL to keep it
+ *		faces: persisted faces of the person; negative if not known
+ *		seen: mark of the list the person was in; a newer mark is kept
+ *		listing: 1 if the person comes from a list, which sorts it into the
+ *				 search indexes when it ends
+ */
+static void roster_put(RosterMirror * mirror, RosterGroup * group, const unsigned char * uuid, const char * name,
+	const char * userData, int faces, unsigned long seen, int listing)
+{
+	RosterTable * table = group->table;
+	RosterSlot * slot = roster_find(table, uuid);
+	RosterName * text;
+
+	if (slot && slot->state == FACE_SLOT_USED) {
+		if (name && strncmp(slot->name->text, name, FACE_NAME_SIZE - 1)) {
+			if (!(text = name_new(name))) return;
+			retire_name(mirror, __atomic_exchange_n(&slot->name, text, __ATOMIC_SEQ_CST));
+			mirror->stats.renamed++;
+		}
+		if (faces >= 0) {
+			__atomic_store_n(&slot->faces, faces, __ATOMIC_RELAXED);
+		}
+		if (slot->record) {
+			face_search_update(mirror, group, slot->record, name, userData);
+		}
+		if (seen > slot->seen) {
+			slot->seen = seen;
+		}
+		return;
+	}
+
+	if (!name || !(text = name_new(name))) return;
+
+	if (!slot) {
+		if ((table->used + 1) * 2 > table->capacity) {
+			if (group_rehash(mirror, group)) {
+				free(text);
+				return;
+			}
+			table = group->table;
+		}
+		slot = roster_empty_slot(table, uuid);
+		memcpy(slot->uuid, uuid, FACE_UUID_SIZE);
+		table->used++;
+	}
+
+	// a removed person coming back keeps its slot
+	__atomic_store_n(&slot->name, text, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&slot->faces, faces > 0 ? faces : 0, __ATOMIC_RELAXED);
+	slot->seen = seen;
+	slot->record = face_search_add(mirror, group, uuid, name, userData, listing);
+	__atomic_store_n(&slot->state, FACE_SLOT_USED, __ATOMIC_RELEASE);
+
+	table->persons++;
+	mirror->stats.persons++;
+	mirror->stats.added++;
+}
+
+/**
+ * Description:
+ *		Removes a person from a group. Must be called with the lock held
+ */
+static void roster_remove(RosterMirror * mirror, RosterGroup * group, RosterSlot * slot)
+{
+	if (!slot || slot->state != FACE_SLOT_USED) return;
+
+	__atomic_store_n(&slot->state, FACE_SLOT_DELETED, __ATOMIC_SEQ_CST);
+	retire_name(mirror, __atomic_exchange_n(&slot->name, NULL, __ATOMIC_SEQ_CST));
+	face_search_remove(mirror, group, slot->record);
+	slot->record = NULL;
+
+	group->table->persons--;
+	mirror->stats.persons--;
+	mirror->stats.removed++;
+}
+
+/**
+ * Description:
+ *		Removes every person of a group. Must be called with the lock held
+ */
+static void group_clear(RosterMirror * mirror, RosterGroup * group)
+{
+	RosterTable * old = group->table;
+	RosterTable * table = roster_table_new(FACE_ROSTER_MIN_SLOTS);
+	size_t i;
+
+	if (!table) {
+		fprintf(stderr, "Malloc Error: %s\n", strerror(errno));
+		return;
+	}
+
+	__atomic_store_n(&group->table, table, __ATOMIC_SEQ_CST);
+	face_search_clear(mirror, group);
+	for (i = 0; i < old->capacity; ++i) {
+		if (old->slots[i].state == FACE_SLOT_USED) {
+			retire_name(mirror, old->slots[i].name);
+		}
+	}
+	old->retired = mirror->retired_tables;
+	mirror->retired_tables = old;
+
+	mirror->stats.persons -= old->persons;
+	mirror->stats.removed += old->persons;
+	group->listed = 0;
+	group->clears++;
+}
+
+/**
+ * Description:
+ *		Finds a mirrored group, adding it if asked to. Must be called with
+ *		the lock held
+ *
+ * Return:
+ *		the group; NULL if not mirrored, or if there is no room to add it
+ */
+static RosterGroup * group_find(RosterMirror * mirror, const char * pgid, int add)
+{
+	RosterGroup * group;
+	int i;
+
+	for (i = 0; i < mirror->count; ++i) {
+		if (!strcmp(mirror->groups[i].pgid, pgid)) {
+			return &mirror->groups[i];
+		}
+	}
+
+	if (!add || mirror->count == FACE_ROSTER_GROUPS || strlen(pgid) >= FACE_PGID_SIZE) {
+		return NULL;
+	}
+
+	group = &mirror->groups[mirror->count];
+	group->table = roster_table_new(FACE_ROSTER_MIN_SLOTS);
+	if (!group->table) {
+		fprintf(stderr, "Malloc Error: %s\n", strerror(errno));
+		return NULL;
+	}
+	snprintf(group->pgid, sizeof(group->pgid), "%s", pgid);
+	group->listed = 0;
+	group->lists = 0;
+	group->clears = 0;
+
+	// lookups only read groups below count
+	__atomic_store_n(&mirror->count, mirror->count + 1, __ATOMIC_RELEASE);
+	return group;
+}
+
+/**
+ * Description:
+ *		Forgets the persons of every group; used by face_client_login. The
+ *		groups stay, but aren't refreshed until listed again
+ */
+void face_roster_reset(RosterMirror * mirror) {
+	int i;
+
+	pthread_mutex_lock(&mirror->lock);
+	for (i = 0; i < mirror->count; ++i) {
+		group_clear(mirror, &mirror->groups[i]);
+	}
+	roster_reclaim(mirror);
+	pthread_mutex_unlock(&mirror->lock);
+}
+
+static const char * person_name(struct json_object * person)
+{
+	struct json_object * name;
+
+	if (!json_object_object_get_ex(person, FACE_NAME, &name)) return NULL;
+	return json_object_get_string(name);
+}
+
+static const char * person_userdata(struct json_object * person)
+{
+	struct json_object * userData;
+
+	if (!json_object_object_get_ex(person, FACE_USERDATA, &userData) || !userData) return "";
+	return json_object_get_string(userData);
+}
+
+static int person_faces(struct json_object * person)
+{
+	struct json_object * faces;
+
+	if (!json_object_object_get_ex(person, FACE_PFIDS, &faces)) return -1;
+	return json_object_array_length(faces);
+}
+
+/**
+ * Description:
+ *		Starts applying a list of the persons of a group, which arrives a
+ *		person at a time, possibly from several threads: persons are added,
+ *		renamed and updated in place, and, if the list turns out complete,
+ *		those not in it are removed. Nothing else is touched, so lookups
+ *		carry on undisturbed
+ *
+ * Params:
+ *		add: 1 to start mirroring the group; 0 to only update it if it is
+ *			 mirrored already
+ *		list: return parameter; passed to face_roster_list_person and
+ *			  face_roster_list_end
+ */
+void face_roster_list_begin(RosterMirror * mirror, const char * pgid, int add, RosterList * list) {
+	memset(list, 0, sizeof(RosterList));
+
+	pthread_mutex_lock(&mirror->lock);
+
+	list->group = group_find(mirror, pgid, add);
+	if (list->group && refresh_clears && refresh_clears != list->group->clears + 1) {
+		list->group = NULL;
+	}
+	if (list->group) {
+		list->seen = ++list->group->lists;
+		list->clears = list->group->clears;
+		list->before = mirror->stats;
+	}
+
+	pthread_mutex_unlock(&mirror->lock);
+}
+
+/**
+ * Description:
+ *		Applies one person of a list; dropped if the group was emptied since
+ *		the list began
+ */
+void face_roster_list_person(RosterMirror * mirror, RosterList * list, struct json_object * person) {
+	struct json_object * pid;
+	unsigned char uuid[FACE_UUID_SIZE];
+
+	if (!list->group
+		|| !json_object_object_get_ex(person, FACE_PID, &pid)
+		|| parse_uuid(json_object_get_string(pid), uuid)
+		|| !person_name(person)) {
+		return;
+	}
+
+	pthread_mutex_lock(&mirror->lock);
+	if (list->group->clears == list->clears) {
+		roster_put(mirror, list->group, uuid, person_name(person), person_userdata(person), person_faces(person),
+			list->seen, 1);
+		roster_reclaim(mirror);
+	}
+	pthread_mutex_unlock(&mirror->lock);
+}
+
+/**
+ * Description:
+ *		Finishes a list, sorting the persons it brought in into the search
+ *		indexes
+ *
+ * Params:
+ *		complete: 1 if every person of the group was listed
+ */
+void face_roster_list_end(RosterMirror * mirror, RosterList * list, int complete) {
+	RosterGroup * group = list->group;
+	RosterTable * table;
+	size_t i;
+
+	if (!group) return;
+
+	pthread_mutex_lock(&mirror->lock);
+
+	face_search_sort(mirror, group);
+
+	// persons a later list saw, or added since, are newer than the mark
+	if (complete && group->clears == list->clears) {
+		table = group->table;
+		for (i = 0; i < table->capacity; ++i) {
+			if (table->slots[i].state == FACE_SLOT_USED && table->slots[i].seen < list->seen) {
+				roster_remove(mirror, group, &table->slots[i]);
+			}
+		}
+		group->listed = 1;
+		mirror->stats.lists++;
+	}
+
+#ifdef _DEBUG_
+	fprintf(stderr, FACE_ROSTER_SYNC, group->pgid, mirror->stats.added - list->before.added,
+		mirror->stats.renamed - list->before.renamed, mirror->stats.removed - list->before.removed);
+#endif
+
+	roster_reclaim(mirror);
+	pthread_mutex_unlock(&mirror->lock);
+}
+
+/**
+ * Description:
+ *		Keeps the mirror current with a response to the client's own call.
+ *		Only groups brought in by a list are kept; other calls update them
+ *		but never add one, so a mirrored group is never partial
+ *
+ * Params:
+ *		call: the request
+ *		status: http status of its response
+ *		resp: its response
+ */
+void face_roster_record(RosterMirror * mirror, const FaceCall * call, long status, struct json_object * resp) {
+	RosterGroup * group;
+	RosterSlot * slot;
+	struct json_object * body = NULL;
+	struct json_object * pid;
+	unsigned char uuid[FACE_UUID_SIZE];
+	const char * person = call->pid;
+	int faces;
+
+	if (!call->pgid || !statusOk(status)) return;
+
+	// lists are applied page by page as they are read, see face_list_p
+	if (call->ep == FACE_EP_LIST_P) return;
+
+	// the personId of a new person is in the response, its name in the body
+	if (call->ep == FACE_EP_CREATE_P) {
+		if (!json_object_object_get_ex(resp, FACE_PID, &pid) || !call->body) return;
+		person = json_object_get_string(pid);
+		body = json_tokener_parse(call->body);
+	}
+
+	pthread_mutex_lock(&mirror->lock);
+
+	if (!(group = group_find(mirror, call->pgid, 0))
+		|| (call->ep != FACE_EP_DELETE_PG && (!person || parse_uuid(person, uuid)))) {
+		pthread_mutex_unlock(&mirror->lock);
+		json_object_put(body);
+		return;
+	}
+
+	switch (call->ep) {
+	case FACE_EP_CREATE_P:
+		if (body && person_name(body)) {
+			roster_put(mirror, group, uuid, person_name(body), person_userdata(body), 0, group->lists, 0);
+		}
+		break;
+	case FACE_EP_GET_P:
+		if (person_name(resp)) {
+			roster_put(mirror, group, uuid, person_name(resp), person_userdata(resp), person_faces(resp), group->lists, 0);
+		}
+		break;
+	case FACE_EP_ADD_FACE:
+	case FACE_EP_DELETE_FACE:
+		slot = roster_find(group->table, uuid);
+		if (slot && slot->state == FACE_SLOT_USED) {
+			faces = slot->faces + (call->ep == FACE_EP_ADD_FACE ? 1 : -1);
+			__atomic_store_n(&slot->faces, faces > 0 ? faces : 0, __ATOMIC_RELAXED);
+		}
+		break;
+	case FACE_EP_DELETE_P:
+		roster_remove(mirror, group, roster_find(group->table, uuid));
+		break;
+	case FACE_EP_DELETE_PG:
+		group_clear(mirror, group);
+		break;
+	default:
+		break;
+	}
+
+	roster_reclaim(mirror);
+	pthread_mutex_unlock(&mirror->lock);
+	json_object_put(body);
+}
+
+/**
+ * Description:
+ *		Lists every listed group again every refresh_ms until the client is
+ *		freed. The lists go through face_list_p, which applies them
+ */
+static void * roster_run(void * arg)
+{
+	FaceClient * client = arg;
+	RosterMirror * mirror = &client->roster;
+	struct json_object * resp;
+	struct timespec deadline;
+	char pgid[FACE_PGID_SIZE];
+	int i;
+
+	face_client_bind(client);
+
+	pthread_mutex_lock(&mirror->lock);
+	while (!mirror->stopping) {
+		if (!mirror->refresh_ms) {
+			pthread_cond_wait(&mirror->cond, &mirror->lock);
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += mirror->refresh_ms / 1000;
+		deadline.tv_nsec += (mirror->refresh_ms % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		if (pthread_cond_timedwait(&mirror->cond, &mirror->lock, &deadline) != ETIMEDOUT) {
+			// stopping, or the period changed and the wait starts over
+			continue;
+		}
+
+		for (i = 0; i < mirror->count && !mirror->stopping; ++i) {
+			if (!mirror->groups[i].listed) continue;
+
+			snprintf(pgid, sizeof(pgid), "%s", mirror->groups[i].pgid);
+			refresh_clears = mirror->groups[i].clears + 1;
+			pthread_mutex_unlock(&mirror->lock);
+
+			face_list_p(pgid, &resp);
+			json_object_put(resp);
+
+			pthread_mutex_lock(&mirror->lock);
+			refresh_clears = 0;
+		}
+	}
+	pthread_mutex_unlock(&mirror->lock);
+
+	return NULL;
+}
+
+/**
+ * Description:
+ *		Lists the persons of a persongroup into the calling thread's
+ *		client's roster mirror. face_list_p does the same; this only says
+ *		what it is for
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *
+ * Return:
+ *		http status code of the list; -1 if user hasn't logged in via
+ *		face_login
+ */
+long face_mirror_roster(char * pgid) {
+	struct json_object * resp;
+	long status;
+
+	status = face_list_p(pgid, &resp);
+	json_object_put(resp);
+
+	return status;
+}
+
+/**
+ * Description:
+ *		Sets how often the mirrored groups are listed again, to catch
+ *		changes made by other clients. Changes made by the client itself
+ *		are mirrored as they are made
+ *
+ * Params:
+ *		ms: time between refreshes; 0 to stop refreshing
+ */
+void face_set_roster_refresh(long ms) {
+	FaceClient * client = face_client_current();
+	RosterMirror * mirror = &client->roster;
+	int start = 0;
+
+	pthread_mutex_lock(&mirror->lock);
+	mirror->refresh_ms = ms > 0 ? ms : 0;
+	if (mirror->refresh_ms && !mirror->running && !mirror->stopping) {
+		start = 1;
+		mirror->running = 1;
+	}
+	pthread_cond_broadcast(&mirror->cond);
+	pthread_mutex_unlock(&mirror->lock);
+
+	if (start && pthread_create(&mirror->thread, NULL, roster_run, client)) {
+		fprintf(stderr, "Error: can't start the roster refresh thread\n");
+		pthread_mutex_lock(&mirror->lock);
+		mirror->running = 0;
+		pthread_mutex_unlock(&mirror->lock);
+	}
+}
+
+/**
+ * Description:
+ *		Looks a person up in the roster mirror of the calling thread's
+ *		client. Makes no call and takes no lock, so it can be used for
+ *		every identify result, e.g. while rendering
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *		pid: the personId
+ *		person: return parameter; the person's name and face count
+ *
+ * Return:
+ *		0 if the person is mirrored; -1 if not
+ */
+int face_roster_lookup(const char * pgid, const char * pid, RosterPerson * person) {
+	RosterMirror * mirror = &face_client_current()->roster;
+	RosterTable * table;
+	RosterSlot * slot;
+	RosterName * name;
+	unsigned char uuid[FACE_UUID_SIZE];
+	int count;
+	int found = 0;
+	int i;
+
+	__atomic_add_fetch(&mirror->stats.lookups, 1, __ATOMIC_RELAXED);
+
+	if (pgid && pid && person && !parse_uuid(pid, uuid)) {
+		// keeps what is read below from being freed
+		__atomic_add_fetch(&mirror->readers, 1, __ATOMIC_SEQ_CST);
+
+		count = __atomic_load_n(&mirror->count, __ATOMIC_ACQUIRE);
+		for (i = 0; i < count && strcmp(mirror->groups[i].pgid, pgid); ++i);
+
+		if (i < count) {
+			table = __atomic_load_n(&mirror->groups[i].table, __ATOMIC_SEQ_CST);
+			slot = roster_find(table, uuid);
+			if (slot && __atomic_load_n(&slot->state, __ATOMIC_SEQ_CST) == FACE_SLOT_USED
+				&& (name = __atomic_load_n(&slot->name, __ATOMIC_SEQ_CST))) {
+				snprintf(person->name, sizeof(person->name), "%s", name->text);
+				person->faces = __atomic_load_n(&slot->faces, __ATOMIC_RELAXED);
+				found = 1;
+			}
+		}
+
+		__atomic_sub_fetch(&mirror->readers, 1, __ATOMIC_SEQ_CST);
+	}
+
+	if (!found) {
+		__atomic_add_fetch(&mirror->stats.misses, 1, __ATOMIC_RELAXED);
+	}
+	return found ? 0 : -1;
+}
+
+/**
+ * Description:
+ *		Gets the roster mirror counters of the calling thread's client
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_roster_stats(RosterStats * stats) {
+	RosterMirror * mirror = &face_client_current()->roster;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&mirror->lock);
+	*stats = mirror->stats;
+	stats->lookups = __atomic_load_n(&mirror->stats.lookups, __ATOMIC_RELAXED);
+	stats->misses = __atomic_load_n(&mirror->stats.misses, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&mirror->lock);
+}
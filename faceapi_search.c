@@ -0,0 +1,442 @@
+
+#include <strings.h>
+#include <ctype.h>
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/*
+ * Each mirrored group indexes the name and userData of its persons. An
+ * entry is kept for the whole field and for the field from the start of
+ * each later word, sorted ignoring case, so an exact search and a search
+ * for words starting with a prefix are both a binary search and a walk
+ * over the matches. The indexes change with the roster, under the roster
+ * lock, and are read under index_lock. Persons a list brings in are only
+ * appended, and sorted in all at once when the list ends; searches read
+ * the sorted entries alone.
+ */
+
+static int word_start(const char * field, size_t i)
+{
+	unsigned char c = field[i];
+	unsigned char prev;
+
+	if (!i) return 1;
+	prev = field[i - 1];
+
+	// bytes of multibyte characters count as letters
+	return (isalnum(c) || c >= 0x80) && !(isalnum(prev) || prev >= 0x80);
+}
+
+/**
+ * Description:
+ *		Finds the first entry whose term is not before value
+ *
+ * Params:
+ *		len: compare only that many bytes; 0 to compare whole terms
+ */
+static size_t index_lower_bound(const SearchIndex * index, const char * value, size_t len)
+{
+	size_t low = 0;
+	size_t high = index->sorted;
+	size_t mid;
+	int cmp;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		cmp = len ? strncasecmp(index->entries[mid].term, value, len) : strcasecmp(index->entries[mid].term, value);
+		if (cmp < 0) low = mid + 1;
+		else high = mid;
+	}
+	return low;
+}
+
+/**
+ * Description:
+ *		Adds an entry in order, or after the others for the end of a list to
+ *		sort in
+ */
+static int index_insert(SearchIndex * index, const char * term, RosterRecord * record, int append)
+{
+	SearchEntry * entries;
+	size_t capacity;
+	size_t i;
+
+	if (index->count == index->capacity) {
+		capacity = index->capacity ? index->capacity * 2 : FACE_SEARCH_MIN_ENTRIES;
+		entries = (SearchEntry *)realloc(index->entries, capacity * sizeof(SearchEntry));
+		if (!entries) {
+			fprintf(stderr, "Malloc Error: %s\n", strerror(errno));
+			return -1;
+		}
+		index->entries = entries;
+		index->capacity = capacity;
+	}
+
+	i = append ? index->count : index_lower_bound(index, term, 0);
+	memmove(&index->entries[i + 1], &index->entries[i], (index->count - i) * sizeof(SearchEntry));
+	index->entries[i].term = term;
+	index->entries[i].record = record;
+	index->count++;
+	if (!append) index->sorted++;
+	return 0;
+}
+
+static void index_remove(SearchIndex * index, const char * term)
+{
+	size_t i;
+
+	for (i = index_lower_bound(index, term, 0); i < index->sorted && !strcasecmp(index->entries[i].term, term); ++i) {
+		if (index->entries[i].term == term) break;
+	}
+	if (i == index->sorted || index->entries[i].term != term) {
+		for (i = index->sorted; i < index->count && index->entries[i].term != term; ++i);
+		if (i == index->count) return;
+	}
+
+	if (i < index->sorted) index->sorted--;
+	index->count--;
+	memmove(&index->entries[i], &index->entries[i + 1], (index->count - i) * sizeof(SearchEntry));
+}
+
+static int compare_entry(const void * a, const void * b)
+{
+	return strcasecmp(((const SearchEntry *)a)->term, ((const SearchEntry *)b)->term);
+}
+
+/**
+ * Description:
+ *		Indexes one field of a person under the field and each later word
+ */
+static void field_add(SearchIndex * index, RosterRecord * record, int field, int append)
+{
+	const char * text = record->fields[field];
+	size_t i;
+
+	// an empty field still has its whole-field entry
+	for (i = 0; i == 0 || (text[i - 1] && text[i]); ++i) {
+		if (word_start(text, i)) {
+			index_insert(index, text + i, record, append);
+		}
+	}
+}
+
+static void field_remove(SearchIndex * index, RosterRecord * record, int field)
+{
+	const char * text = record->fields[field];
+	size_t i;
+
+	for (i = 0; i == 0 || (text[i - 1] && text[i]); ++i) {
+		if (word_start(text, i)) {
+			index_remove(index, text + i);
+		}
+	}
+}
+
+/**
+ * Description:
+ *		Indexes a person added to a group. Must be called with the roster
+ *		lock held
+ *
+ * Params:
+ *		name: name of the person
+ *		userData: userData of the person; NULL if it has none
+ *		listing: 1 if a list brought the person in; it is found once
+ *				 face_search_sort is called at the end of the list
+ *
+ * Return:
+ *		the person's record, to update or remove it by; NULL if out of memory
+ */
+RosterRecord * face_search_add(RosterMirror * mirror, RosterGroup * group, const unsigned char * uuid,
+	const char * name, const char * userData, int listing) {
+	RosterRecord * record = (RosterRecord *)calloc(1, sizeof(RosterRecord));
+	int i;
+
+	if (!record) return NULL;
+
+	memcpy(record->uuid, uuid, FACE_UUID_SIZE);
+	record->fields[FACE_SEARCH_NAME] = strdup(name);
+	record->fields[FACE_SEARCH_USERDATA] = strdup(userData ? userData : "");
+	if (!record->fields[FACE_SEARCH_NAME] || !record->fields[FACE_SEARCH_USERDATA]) {
+		free(record->fields[FACE_SEARCH_NAME]);
+		free(record->fields[FACE_SEARCH_USERDATA]);
+		free(record);
+		return NULL;
+	}
+
+	pthread_rwlock_wrlock(&mirror->index_lock);
+	for (i = 0; i < FACE_SEARCH_FIELDS; ++i) {
+		field_add(&group->index[i], record, i, listing);
+	}
+	pthread_rwlock_unlock(&mirror->index_lock);
+
+	return record;
+}
+
+/**
+ * Description:
+ *		Indexes a person again if its name or userData changed. Must be
+ *		called with the roster lock held
+ *
+ * Params:
+ *		name: name of the person; NULL to keep it
+ *		userData: userData of the person; NULL to keep it
+ */
+void face_search_update(RosterMirror * mirror, RosterGroup * group, RosterRecord * record, const char * name,
+	const char * userData) {
+	const char * values[FACE_SEARCH_FIELDS] = { name, userData };
+	char * text;
+	int i;
+
+	for (i = 0; i < FACE_SEARCH_FIELDS; ++i) {
+		if (!values[i] || !strcmp(values[i], record->fields[i])) continue;
+		if (!(text = strdup(values[i]))) continue;
+
+		pthread_rwlock_wrlock(&mirror->index_lock);
+		field_remove(&group->index[i], record, i);
+		free(record->fields[i]);
+		record->fields[i] = text;
+		field_add(&group->index[i], record, i, 0);
+		pthread_rwlock_unlock(&mirror->index_lock);
+	}
+}
+
+/**
+ * Description:
+ *		Removes a person from the indexes of a group and frees its record.
+ *		Must be called with the roster lock held
+ */
+void face_search_remove(RosterMirror * mirror, RosterGroup * group, RosterRecord * record) {
+	int i;
+
+	if (!record) return;
+
+	pthread_rwlock_wrlock(&mirror->index_lock);
+	for (i = 0; i < FACE_SEARCH_FIELDS; ++i) {
+		field_remove(&group->index[i], record, i);
+	}
+	pthread_rwlock_unlock(&mirror->index_lock);
+
+	for (i = 0; i < FACE_SEARCH_FIELDS; ++i) {
+		free(record->fields[i]);
+	}
+	free(record);
+}
+
+/**
+ * Description:
+ *		Sorts the entries lists appended into the indexes of a group: the
+ *		new ones are sorted and merged with the others into a new array,
+ *		which only takes index_lock to be swapped in, so searches aren't
+ *		held up while tens of thousands of persons are listed. Must be
+ *		called with the roster lock held
+ */
+void face_search_sort(RosterMirror * mirror, RosterGroup * group) {
+	SearchIndex * index;
+	SearchEntry * entries;
+	SearchEntry * old;
+	size_t i, j, k;
+	int field;
+
+	for (field = 0; field < FACE_SEARCH_FIELDS; ++field) {
+		index = &group->index[field];
+		if (index->sorted == index->count) continue;
+
+		// searches don't read past the sorted entries, and writers hold the
+		// roster lock
+		qsort(&index->entries[index->sorted], index->count - index->sorted, sizeof(SearchEntry), compare_entry);
+
+		entries = (SearchEntry *)malloc(index->capacity * sizeof(SearchEntry));
+		if (!entries) {
+			fprintf(stderr, "Malloc Error: %s\n", strerror(errno));
+			pthread_rwlock_wrlock(&mirror->index_lock);
+			qsort(index->entries, index->count, sizeof(SearchEntry), compare_entry);
+			index->sorted = index->count;
+			pthread_rwlock_unlock(&mirror->index_lock);
+			continue;
+		}
+
+		for (i = 0, j = index->sorted, k = 0; i < index->sorted || j < index->count; ++k) {
+			if (j == index->count || (i < index->sorted && compare_entry(&index->entries[i], &index->entries[j]) <= 0)) {
+				entries[k] = index->entries[i++];
+			}
+			else {
+				entries[k] = index->entries[j++];
+			}
+		}
+
+		pthread_rwlock_wrlock(&mirror->index_lock);
+		old = index->entries;
+		index->entries = entries;
+		index->sorted = index->count;
+		pthread_rwlock_unlock(&mirror->index_lock);
+		free(old);
+	}
+}
+
+/**
+ * Description:
+ *		Empties the indexes of a group and frees the records of its
+ *		persons. Must be called with the roster lock held
+ */
+void face_search_clear(RosterMirror * mirror, RosterGroup * group) {
+	SearchIndex * names = &group->index[FACE_SEARCH_NAME];
+	RosterRecord * record;
+	size_t persons = 0;
+	size_t i;
+	int j;
+
+	pthread_rwlock_wrlock(&mirror->index_lock);
+
+	// every person has exactly one entry for its whole name; they are
+	// gathered first, as the entries of a freed person can't be read
+	for (i = 0; i < names->count; ++i) {
+		record = names->entries[i].record;
+		if (names->entries[i].term == record->fields[FACE_SEARCH_NAME]) {
+			names->entries[persons++].record = record;
+		}
+	}
+	for (i = 0; i < persons; ++i) {
+		record = names->entries[i].record;
+		for (j = 0; j < FACE_SEARCH_FIELDS; ++j) {
+			free(record->fields[j]);
+		}
+		free(record);
+	}
+	for (j = 0; j < FACE_SEARCH_FIELDS; ++j) {
+		free(group->index[j].entries);
+		memset(&group->index[j], 0, sizeof(SearchIndex));
+	}
+
+	pthread_rwlock_unlock(&mirror->index_lock);
+}
+
+static int compare_record(const void * a, const void * b)
+{
+	const RosterRecord * x = *(RosterRecord * const *)a;
+	const RosterRecord * y = *(RosterRecord * const *)b;
+	int cmp = strcasecmp(x->fields[FACE_SEARCH_NAME], y->fields[FACE_SEARCH_NAME]);
+
+	return cmp ? cmp : (x > y) - (x < y);
+}
+
+static struct json_object * record_person(const RosterRecord * record)
+{
+	struct json_object * person = json_object_new_object();
+	char pid[FACE_UUID_SIZE * 2 + 5];
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < FACE_UUID_SIZE; ++i) {
+		if (i == 4 || i == 6 || i == 8 || i == 10) {
+			pid[len++] = '-';
+		}
+		len += snprintf(pid + len, sizeof(pid) - len, "%02x", record->uuid[i]);
+	}
+
+	json_object_object_add(person, FACE_PID, json_object_new_string(pid));
+	json_object_object_add(person, FACE_NAME, json_object_new_string(record->fields[FACE_SEARCH_NAME]));
+	json_object_object_add(person, FACE_USERDATA, json_object_new_string(record->fields[FACE_SEARCH_USERDATA]));
+	return person;
+}
+
+/**
+ * Description:
+ *		Searches the persons of a persongroup by name or userData in the
+ *		roster mirror, ignoring case. A group not mirrored yet is listed
+ *		first, which is the only call made; after that the mirror, kept
+ *		current by face_list_p and the client's own calls, answers in a
+ *		binary search
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *		name: the field searched, FACE_NAME ("name") or FACE_USERDATA
+ *			  ("userData")
+ *		value: the value searched for
+ *		mode: FACE_SEARCH_EXACT for persons whose whole field is value;
+ *			  FACE_SEARCH_PREFIX for persons with a word of the field
+ *			  starting with value
+ *		resp: return parameter; array of the persons found, each with its
+ *			  personId, name and userData
+ *
+ * Return:
+ *		number of persons found; -1 if the arguments are wrong or the group
+ *		can't be listed
+ */
+int face_search_p(char * pgid, char * name, char * value, FaceSearchMode mode, struct json_object ** resp) {
+	RosterMirror * mirror = &face_client_current()->roster;
+	RosterGroup * group = NULL;
+	SearchIndex * index;
+	RosterRecord ** found;
+	size_t len;
+	size_t i;
+	size_t n = 0;
+	int field;
+	int listed = 0;
+
+	*resp = NULL;
+
+	if (!pgid || !name || !value) {
+		fprintf(stderr, "%s\n", strerror(EINVAL));
+		return -1;
+	}
+	if (!strcmp(name, FACE_NAME)) field = FACE_SEARCH_NAME;
+	else if (!strcmp(name, FACE_USERDATA)) field = FACE_SEARCH_USERDATA;
+	else {
+		fprintf(stderr, "%s\n", strerror(EINVAL));
+		return -1;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&mirror->lock);
+		for (i = 0; i < (size_t)mirror->count; ++i) {
+			if (!strcmp(mirror->groups[i].pgid, pgid) && mirror->groups[i].listed) {
+				group = &mirror->groups[i];
+			}
+		}
+		pthread_mutex_unlock(&mirror->lock);
+
+		if (group) break;
+		if (listed || face_mirror_roster(pgid) != 200) return -1;
+		listed = 1;
+	}
+
+	pthread_rwlock_rdlock(&mirror->index_lock);
+
+	index = &group->index[field];
+	len = strlen(value);
+	i = index_lower_bound(index, value, mode == FACE_SEARCH_PREFIX ? len : 0);
+	found = (RosterRecord **)malloc((index->sorted - i + 1) * sizeof(RosterRecord *));
+	if (!found) {
+		pthread_rwlock_unlock(&mirror->index_lock);
+		fprintf(stderr, "Malloc Error: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (; i < index->sorted; ++i) {
+		if (mode == FACE_SEARCH_PREFIX) {
+			if (strncasecmp(index->entries[i].term, value, len)) break;
+			found[n++] = index->entries[i].record;
+		}
+		else {
+			if (strcasecmp(index->entries[i].term, value)) break;
+			if (index->entries[i].term == index->entries[i].record->fields[field]) {
+				found[n++] = index->entries[i].record;
+			}
+		}
+	}
+
+	// by name; a person with two words starting with the prefix is found twice
+	qsort(found, n, sizeof(RosterRecord *), compare_record);
+	*resp = json_object_new_array();
+	for (i = 0, len = 0; i < n; ++i) {
+		if (i && found[i] == found[i - 1]) continue;
+		json_object_array_add(*resp, record_person(found[i]));
+		len++;
+	}
+
+	pthread_rwlock_unlock(&mirror->index_lock);
+	free(found);
+
+	return (int)len;
+}
@@ -0,0 +1,521 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/*
+ * A sharded client spreads its persons over count persongroups named
+ * <prefix>-0 to <prefix>-<count - 1>, picked by a hash of the person's
+ * name. An identify is sent to every shard at once, each from a worker
+ * of the client, so it takes about as long as the slowest shard whatever the
+ * number of persons, and the candidates of every shard are merged by
+ * confidence.
+ */
+
+typedef struct shardTask ShardTask;
+
+typedef struct shardJob {
+	FaceClient * client;			// client the shards are called with
+	long (*func)(ShardTask *);		// call made to each shard
+	char ** fids;					// identify: faceIds
+	int nfids;						// identify: length of fids
+	int max_candidates;				// identify: maxNumOfCandidatesReturned
+	double threshold;				// identify: confidenceThreshold
+	FaceBody * body;				// ensure: request body of persongroup create
+} ShardJob;
+
+struct shardTask {
+	const ShardJob * job;			// what to do
+	char pgid[FACE_PGID_SIZE];		// persongroupId of the shard
+	long status;					// http status of its call
+	struct json_object * resp;		// response of its call
+};
+
+/**
+ * Description:
+ *		Sets up the persongroup settings of a client: PersonGroups, not
+ *		sharded
+ */
+void face_shard_init(ShardState * state) {
+	memset(state, 0, sizeof(ShardState));
+	pthread_mutex_init(&state->lock, NULL);
+}
+
+/**
+ * Description:
+ *		Releases what face_shard_init set up
+ */
+void face_shard_destroy(ShardState * state) {
+	pthread_mutex_destroy(&state->lock);
+}
+
+/**
+ * Description:
+ *		Url base of the persongroup endpoints of the calling thread's
+ *		client
+ */
+const char * face_pg_base() {
+	return __atomic_load_n(&face_client_current()->shard.large, __ATOMIC_RELAXED) ? FACE_LPG_URL : FACE_PG_URL;
+}
+
+/**
+ * Description:
+ *		Request key naming the persongroup in an identify of the calling
+ *		thread's client
+ */
+const char * face_pg_key() {
+	return __atomic_load_n(&face_client_current()->shard.large, __ATOMIC_RELAXED) ? FACE_LPGID : FACE_PGID;
+}
+
+/**
+ * Description:
+ *		Makes every persongroup call of the calling thread's client go to
+ *		the LargePersonGroup endpoints, which take far more persons, or back
+ *		to the PersonGroup ones. The two are separate groups even with the
+ *		same id, so what the client remembers of its groups is forgotten
+ *
+ * Params:
+ *		on: 1 for LargePersonGroups, 0 for PersonGroups
+ */
+void face_set_large_groups(int on) {
+	FaceClient * client = face_client_current();
+
+	on = on ? 1 : 0;
+	if (__atomic_exchange_n(&client->shard.large, on, __ATOMIC_RELAXED) != on) {
+		face_pg_reset(&client->pgcache);
+		face_roster_reset(&client->roster);
+	}
+}
+
+/**
+ * Description:
+ *		Spreads the persons of the calling thread's client over count
+ *		persongroups, named <prefix>-0 to <prefix>-<count - 1>
+ *
+ * Params:
+ *		prefix: persongroupId the shards are named after
+ *		count: shards, at most FACE_SHARD_MAX; 0 to stop sharding
+ *
+ * Return:
+ *		0 if successful; -1 if the arguments are invalid
+ */
+int face_set_shards(const char * prefix, int count) {
+	ShardState * state = &face_client_current()->shard;
+
+	if (count < 0 || count > FACE_SHARD_MAX || (count && (!prefix || strlen(prefix) >= FACE_SHARD_PREFIX_SIZE))) {
+		fprintf(stderr, "%s\n", strerror(EINVAL));
+		return -1;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	snprintf(state->prefix, sizeof(state->prefix), "%s", count ? prefix : "");
+	state->count = count;
+	pthread_mutex_unlock(&state->lock);
+	return 0;
+}
+
+/**
+ * Description:
+ *		Finds the shard a person belongs to
+ *
+ * Params:
+ *		name: name of the person
+ *		pgid: return parameter; persongroupId of the shard
+ *		size: size of pgid
+ *
+ * Return:
+ *		number of the shard; -1 if the client isn't sharded
+ */
+int face_shard_pgid(const char * name, char * pgid, size_t size) {
+	ShardState * state = &face_client_current()->shard;
+	unsigned long long hash = 14695981039346656037ULL;
+	int shard = -1;
+
+	if (!name || !pgid) return -1;
+
+	// fnv-1a
+	for (; *name; ++name) {
+		hash ^= (unsigned char)*name;
+		hash *= 1099511628211ULL;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	if (state->count) {
+		shard = (int)(hash % (unsigned long long)state->count);
+		snprintf(pgid, size, FACE_SHARD_PGID, state->prefix, shard);
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	return shard;
+}
+
+static void * shard_run(void * arg)
+{
+	ShardTask * task = arg;
+
+	task->status = task->job->func(task);
+	return NULL;
+}
+
+/**
+ * Description:
+ *		Makes a call to every shard at once on the client's workers; the
+ *		first shard is called from the calling thread
+ *
+ * Params:
+ *		tasks: return parameter; FACE_SHARD_MAX tasks, filled with the
+ *			   status and response of each shard
+ *
+ * Return:
+ *		number of shards; 0 if the client isn't sharded
+ */
+static int shard_fan(const ShardJob * job, ShardTask * tasks)
+{
+	ShardState * state = &job->client->shard;
+	int count;
+	int i;
+
+	pthread_mutex_lock(&state->lock);
+	count = state->count;
+	for (i = 0; i < count; ++i) {
+		tasks[i].job = job;
+		tasks[i].resp = NULL;
+		snprintf(tasks[i].pgid, sizeof(tasks[i].pgid), FACE_SHARD_PGID, state->prefix, i);
+	}
+	pthread_mutex_unlock(&state->lock);
+
+	face_client_fan(job->client, shard_run, tasks, sizeof(ShardTask), count);
+
+	return count;
+}
+
+/**
+ * Description:
+ *		Gives the status and response of the first shard that failed, and
+ *		frees the other responses
+ *
+ * Return:
+ *		http status of the first shard that failed; 200 if none did
+ */
+static long shard_first_error(ShardTask * tasks, int count, struct json_object ** resp)
+{
+	long status = 200;
+	int i;
+
+	*resp = NULL;
+	for (i = 0; i < count; ++i) {
+		if (statusOk(tasks[i].status)) {
+			json_object_put(tasks[i].resp);
+			continue;
+		}
+
+#ifdef _DEBUG_
+		fprintf(stderr, FACE_SHARD_FAILED, tasks[i].pgid, tasks[i].status);
+#endif
+		if (statusOk(status)) {
+			status = tasks[i].status;
+			*resp = tasks[i].resp;
+		}
+		else {
+			json_object_put(tasks[i].resp);
+		}
+	}
+	return status;
+}
+
+static long shard_ensure(ShardTask * task)
+{
+	return face_ensure_pg(task->pgid, task->job->body, &task->resp);
+}
+
+static long shard_train(ShardTask * task)
+{
+	return face_train_pg(task->pgid, &task->resp);
+}
+
+static long shard_identify(ShardTask * task)
+{
+	const ShardJob * job = task->job;
+
+	return face_identify_coalesced(task->pgid, job->fids, job->nfids, job->max_candidates, job->threshold,
+		&task->resp);
+}
+
+/**
+ * Description:
+ *		Creates every shard not known to exist yet
+ *
+ * Params:
+ *		body: the request body; see face_body_create_pg
+ *		resp: return parameter; the response of the first shard that
+ *			  failed, NULL if none did
+ *
+ * Return:
+ *		http status code of the first shard that failed, 200 if none did;
+ *		-1 if the client isn't sharded or the user hasn't logged in via
+ *		face_login
+ */
+long face_ensure_shards(FaceBody * body, struct json_object ** resp) {
+	ShardTask tasks[FACE_SHARD_MAX];
+	ShardJob job = {
+		.client = face_client_current(),
+		.func = shard_ensure,
+		.body = body
+	};
+	int count;
+
+	*resp = NULL;
+	if (!body || !(count = shard_fan(&job, tasks))) return -1;
+
+	return shard_first_error(tasks, count, resp);
+}
+
+/**
+ * Description:
+ *		Starts training every shard
+ *
+ * Params:
+ *		resp: return parameter; the response of the first shard that
+ *			  failed, NULL if none did
+ *
+ * Return:
+ *		http status code of the first shard that failed, 200 if none did;
+ *		-1 if the client isn't sharded or the user hasn't logged in via
+ *		face_login
+ */
+long face_train_shards(struct json_object ** resp) {
+	ShardTask tasks[FACE_SHARD_MAX];
+	ShardJob job = {
+		.client = face_client_current(),
+		.func = shard_train
+	};
+	int count;
+
+	*resp = NULL;
+	if (!(count = shard_fan(&job, tasks))) return -1;
+
+	return shard_first_error(tasks, count, resp);
+}
+
+/**
+ * Description:
+ *		Creates a person in the shard its name hashes to
+ *
+ * Params:
+ *		name: name of the person
+ *		userData: userData of the person; may be NULL
+ *		pgid: return parameter; persongroupId of the shard, to add the
+ *			  person's faces to
+ *		size: size of pgid
+ *		resp: return parameter; collects the response
+ *
+ * Return:
+ *		http status code; -1 if the client isn't sharded, out of memory or
+ *		the user hasn't logged in via face_login
+ */
+long face_create_p_sharded(const char * name, const char * userData, char * pgid, size_t size,
+	struct json_object ** resp) {
+	FaceBody * body;
+	long status;
+
+	*resp = NULL;
+	if (face_shard_pgid(name, pgid, size) < 0) return -1;
+
+	if (!(body = face_body_acquire())) return -1;
+	if (face_body_create_p(body, name, userData)) {
+		face_body_release(body);
+		return -1;
+	}
+	status = face_create_p_body(pgid, body, resp);
+	face_body_release(body);
+
+	return status;
+}
+
+static double candidate_confidence(struct json_object * candidate)
+{
+	struct json_object * confidence;
+
+	if (!json_object_object_get_ex(candidate, FACE_CONFIDENCE, &confidence)) return 0;
+	return json_object_get_double(confidence);
+}
+
+static int compare_candidate(const void * a, const void * b)
+{
+	double x = candidate_confidence(*(struct json_object * const *)a);
+	double y = candidate_confidence(*(struct json_object * const *)b);
+
+	return (x < y) - (x > y);
+}
+
+/**
+ * Description:
+ *		Makes a candidate of a shard's result with the shard it came from.
+ *		The result may be the response of a coalesced identify, which is
+ *		left as it is
+ *
+ * Return:
+ *		the new candidate; NULL if out of memory
+ */
+static struct json_object * candidate_copy(struct json_object * candidate, const char * pgid)
+{
+	struct json_object * copy = json_object_new_object();
+
+	if (!copy) return NULL;
+
+	json_object_object_foreach(candidate, key, value) {
+		json_object_object_add(copy, key, json_object_get(value));
+	}
+	json_object_object_add(copy, face_pg_key(), json_object_new_string(pgid));
+
+	return copy;
+}
+
+/**
+ * Description:
+ *		Merges the results of every shard into the result of each faceId,
+ *		keeping its best candidates, each with the shard it came from
+ *
+ * Return:
+ *		the merged results; NULL if out of memory
+ */
+static struct json_object * shard_merge(const ShardJob * job, ShardTask * tasks, int count)
+{
+	struct json_object * merged;
+	struct json_object ** found;
+	struct json_object * result;
+	struct json_object * candidates;
+	struct json_object * candidate;
+	struct json_object * best;
+	int max = job->max_candidates > 0 ? job->max_candidates : FACE_SHARD_DEFAULT_CANDIDATES;
+	size_t n;
+	size_t len;
+	size_t j;
+	size_t k;
+	int i;
+	int t;
+
+	found = (struct json_object **)malloc((size_t)count * max * sizeof(struct json_object *));
+	if (!found) {
+		fprintf(stderr, "Malloc Error: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	merged = json_object_new_array();
+	for (i = 0; i < job->nfids; ++i) {
+		n = 0;
+
+		// every shard answers each faceId in the order asked
+		for (t = 0; t < count; ++t) {
+			result = json_object_array_get_idx(tasks[t].resp, i);
+			if (!json_object_object_get_ex(result, FACE_CANDIDATES, &candidates)) continue;
+
+			len = json_object_array_length(candidates);
+			for (j = 0; j < len && j < (size_t)max; ++j) {
+				candidate = candidate_copy(json_object_array_get_idx(candidates, j), tasks[t].pgid);
+				if (candidate) {
+					found[n++] = candidate;
+				}
+			}
+		}
+
+		qsort(found, n, sizeof(struct json_object *), compare_candidate);
+		best = json_object_new_array();
+		for (k = 0; k < n; ++k) {
+			if (k < (size_t)max) {
+				json_object_array_add(best, found[k]);
+			}
+			else {
+				json_object_put(found[k]);
+			}
+		}
+
+		result = json_object_new_object();
+		json_object_object_add(result, FACE_FID, json_object_new_string(job->fids[i]));
+		json_object_object_add(result, FACE_CANDIDATES, best);
+		json_object_array_add(merged, result);
+	}
+
+	free(found);
+	return merged;
+}
+
+/**
+ * Description:
+ *		Identifies faces against every shard at once and merges the
+ *		candidates by confidence. Each shard's identify is coalesced with
+ *		others against the same shard, see face_identify_coalesced
+ *
+ * Params:
+ *		fids: faceIds to identify, at most FACE_IDENTIFY_MAX_FIDS
+ *		nfids: length of fids
+ *		maxCandidates: maxNumOfCandidatesReturned; 0 for default
+ *		threshold: confidenceThreshold; negative for default
+ *		resp: return parameter; an array with the result of each faceId in
+ *			  the order of fids, each candidate naming its shard, or the
+ *			  error response of the first shard that failed
+ *
+ * Return:
+ *		http status code; -1 if the arguments are invalid, the client isn't
+ *		sharded or the user hasn't logged in via face_login
+ */
+long face_identify_sharded(char ** fids, int nfids, int maxCandidates, double threshold, struct json_object ** resp) {
+	ShardState * state = &face_client_current()->shard;
+	ShardTask tasks[FACE_SHARD_MAX];
+	ShardJob job = {
+		.client = face_client_current(),
+		.func = shard_identify,
+		.fids = fids,
+		.nfids = nfids,
+		.max_candidates = maxCandidates,
+		.threshold = threshold
+	};
+	unsigned long failed = 0;
+	int count;
+	int i;
+
+	*resp = NULL;
+	if (!fids || nfids <= 0 || nfids > FACE_IDENTIFY_MAX_FIDS) {
+		fprintf(stderr, "%s\n", strerror(EINVAL));
+		return -1;
+	}
+	if (!(count = shard_fan(&job, tasks))) return -1;
+
+	for (i = 0; i < count; ++i) {
+		if (!statusOk(tasks[i].status)) failed++;
+	}
+
+	pthread_mutex_lock(&state->lock);
+	state->stats.identifies++;
+	state->stats.calls += count;
+	state->stats.failed += failed;
+	pthread_mutex_unlock(&state->lock);
+
+	// a shard missing would drop its persons from the results
+	if (failed) {
+		return shard_first_error(tasks, count, resp);
+	}
+
+	*resp = shard_merge(&job, tasks, count);
+	for (i = 0; i < count; ++i) {
+		json_object_put(tasks[i].resp);
+	}
+	return *resp ? 200 : -1;
+}
+
+/**
+ * Description:
+ *		Gets the sharding counters of the calling thread's client
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_shard_stats(ShardStats * stats) {
+	ShardState * state = &face_client_current()->shard;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&state->lock);
+	*stats = state->stats;
+	pthread_mutex_unlock(&state->lock);
+}
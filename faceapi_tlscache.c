@@ -0,0 +1,526 @@
+
+#include <openssl/ssl.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+typedef struct tlsConn {
+	TlsCache * cache;				// cache of the client that opened the connection
+	char peer[FACE_TLS_PEER_SIZE];	// "host:port" of the connection
+	int (*next)(SSL *, SSL_SESSION *);	// libcurl's own new session callback
+} TlsConn;
+
+static int conn_index = -1;			// where a TlsConn hangs off an SSL_CTX
+static pthread_once_t conn_once = PTHREAD_ONCE_INIT;
+
+static void conn_free(void * parent, void * conn, CRYPTO_EX_DATA * ad, int idx, long argl, void * argp)
+{
+	(void)parent;
+	(void)ad;
+	(void)idx;
+	(void)argl;
+	(void)argp;
+	free(conn);
+}
+
+static void conn_index_init()
+{
+	conn_index = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, conn_free);
+}
+
+/**
+ * Description:
+ *		Sets up the tls session cache of a client; off until
+ *		face_client_tls_cache
+ */
+void face_tls_init(TlsCache * cache) {
+	memset(cache, 0, sizeof(TlsCache));
+	pthread_mutex_init(&cache->lock, NULL);
+}
+
+/**
+ * Description:
+ *		Releases what face_tls_init and the cached sessions hold. Must be
+ *		called after the client's share handle is cleaned up, since its
+ *		connections point at the cache
+ */
+void face_tls_destroy(TlsCache * cache) {
+	int i;
+
+	for (i = 0; i < FACE_TLS_CACHE_SIZE; ++i) {
+		free(cache->tickets[i].session);
+	}
+	OPENSSL_cleanse(cache->key, sizeof(cache->key));
+	pthread_mutex_destroy(&cache->lock);
+}
+
+/**
+ * Description:
+ *		Reads the key the cache file is encrypted with, creating it with a
+ *		random key readable only by the user the first time
+ *
+ * Return:
+ *		0 if successful; corresponding errno code if unsuccessful
+ */
+static int key_load(const char * key_path, unsigned char * key)
+{
+	ssize_t got = 0;
+	int fd;
+
+	fd = open(key_path, O_RDONLY);
+	if (fd < 0 && errno == ENOENT) {
+		fd = open(key_path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+		if (fd >= 0) {
+			if (RAND_bytes(key, FACE_TLS_KEY_SIZE) != 1
+				|| write(fd, key, FACE_TLS_KEY_SIZE) != FACE_TLS_KEY_SIZE) {
+				close(fd);
+				unlink(key_path);
+				return EIO;
+			}
+			close(fd);
+			return 0;
+		}
+		// another process created it first
+		fd = open(key_path, O_RDONLY);
+	}
+	if (fd < 0) {
+		return errno;
+	}
+
+	got = read(fd, key, FACE_TLS_KEY_SIZE);
+	close(fd);
+
+	return got == FACE_TLS_KEY_SIZE ? 0 : EINVAL;
+}
+
+/**
+ * Description:
+ *		Encrypts or decrypts with aes-256-gcm; the magic is authenticated too
+ *
+ * Params:
+ *		encrypt: 1 to encrypt, 0 to decrypt
+ *		tag: written when encrypting, checked when decrypting
+ *
+ * Return:
+ *		0 if successful; -1 if the data was tampered with or the key is wrong
+ */
+static int tls_crypt(int encrypt, const unsigned char * key, const unsigned char * nonce,
+	const unsigned char * in, int len, unsigned char * out, unsigned char * tag)
+{
+	EVP_CIPHER_CTX * ctx;
+	int outl;
+	int ok;
+
+	ctx = EVP_CIPHER_CTX_new();
+	if (!ctx) return -1;
+
+	ok = EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), NULL, key, nonce, encrypt)
+		&& EVP_CipherUpdate(ctx, NULL, &outl, (const unsigned char *)FACE_TLS_MAGIC, FACE_TLS_MAGIC_SIZE)
+		&& (!len || EVP_CipherUpdate(ctx, out, &outl, in, len))
+		&& (encrypt || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, FACE_TLS_TAG_SIZE, tag))
+		&& EVP_CipherFinal_ex(ctx, out + len, &outl)
+		&& (!encrypt || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, FACE_TLS_TAG_SIZE, tag));
+
+	EVP_CIPHER_CTX_free(ctx);
+	return ok ? 0 : -1;
+}
+
+/**
+ * Description:
+ *		Writes the sessions that haven't expired to the cache file. It is
+ *		written next to the old one and renamed over it, so a process killed
+ *		halfway leaves the old file. Must hold cache->lock
+ */
+static void cache_save(TlsCache * cache)
+{
+	unsigned char * plain;
+	unsigned char * file;
+	char tmp[PATH_MAX + 8];
+	time_t now = time(NULL);
+	size_t len = 0;
+	size_t size;
+	unsigned short peer_len;
+	int64_t expires;
+	uint32_t session_len;
+	int fd;
+	int i;
+
+	plain = malloc(FACE_TLS_CACHE_SIZE * (sizeof(peer_len) + FACE_TLS_PEER_SIZE
+		+ sizeof(expires) + sizeof(session_len) + FACE_TLS_SESSION_MAX));
+	if (!plain) return;
+
+	// records of peer length, peer, expiry, session length and session in
+	// host byte order; the file never leaves the machine
+	for (i = 0; i < FACE_TLS_CACHE_SIZE; ++i) {
+		if (!cache->tickets[i].session || cache->tickets[i].expires <= now) continue;
+
+		peer_len = (unsigned short)strlen(cache->tickets[i].peer);
+		expires = cache->tickets[i].expires;
+		session_len = cache->tickets[i].size;
+		memcpy(plain + len, &peer_len, sizeof(peer_len));
+		len += sizeof(peer_len);
+		memcpy(plain + len, cache->tickets[i].peer, peer_len);
+		len += peer_len;
+		memcpy(plain + len, &expires, sizeof(expires));
+		len += sizeof(expires);
+		memcpy(plain + len, &session_len, sizeof(session_len));
+		len += sizeof(session_len);
+		memcpy(plain + len, cache->tickets[i].session, session_len);
+		len += session_len;
+	}
+
+	size = FACE_TLS_MAGIC_SIZE + FACE_TLS_NONCE_SIZE + len + FACE_TLS_TAG_SIZE;
+	file = malloc(size);
+	if (!file) {
+		free(plain);
+		return;
+	}
+	memcpy(file, FACE_TLS_MAGIC, FACE_TLS_MAGIC_SIZE);
+
+	if (RAND_bytes(file + FACE_TLS_MAGIC_SIZE, FACE_TLS_NONCE_SIZE) == 1
+		&& !tls_crypt(1, cache->key, file + FACE_TLS_MAGIC_SIZE, plain, len,
+			file + FACE_TLS_MAGIC_SIZE + FACE_TLS_NONCE_SIZE, file + size - FACE_TLS_TAG_SIZE)) {
+		snprintf(tmp, sizeof(tmp), "%s.tmp", cache->path);
+		fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd >= 0) {
+			if (write(fd, file, size) == (ssize_t)size && !close(fd) && !rename(tmp, cache->path)) {
+				cache->stats.saved++;
+			}
+			else {
+				unlink(tmp);
+			}
+		}
+	}
+
+	OPENSSL_cleanse(plain, len);
+	free(plain);
+	free(file);
+}
+
+/**
+ * Description:
+ *		Keeps a session as the latest one with a host, replacing the one
+ *		closest to expiring if every slot is taken. Must hold cache->lock
+ */
+static void cache_put(TlsCache * cache, const char * peer, const unsigned char * session, int size, time_t expires)
+{
+	TlsTicket * ticket = NULL;
+	unsigned char * copy;
+	int i;
+
+	for (i = 0; i < FACE_TLS_CACHE_SIZE; ++i) {
+		if (!strcmp(cache->tickets[i].peer, peer)) {
+			ticket = &cache->tickets[i];
+			break;
+		}
+		if (!ticket || !cache->tickets[i].session
+			|| (ticket->session && cache->tickets[i].expires < ticket->expires)) {
+			ticket = &cache->tickets[i];
+		}
+	}
+
+	copy = malloc(size);
+	if (!copy) return;
+	memcpy(copy, session, size);
+
+	if (!ticket->session) {
+		cache->stats.sessions++;
+	}
+	free(ticket->session);
+	snprintf(ticket->peer, sizeof(ticket->peer), "%s", peer);
+	ticket->session = copy;
+	ticket->size = size;
+	ticket->expires = expires;
+}
+
+/**
+ * Description:
+ *		Reads the sessions that haven't expired from the cache file. A file
+ *		that can't be decrypted is ignored; it is replaced on the next save
+ */
+static void cache_load(TlsCache * cache)
+{
+	unsigned char * file = NULL;
+	unsigned char * plain = NULL;
+	char peer[FACE_TLS_PEER_SIZE];
+	struct stat st;
+	time_t now = time(NULL);
+	size_t len = 0;
+	size_t pos = 0;
+	unsigned short peer_len;
+	int64_t expires;
+	uint32_t session_len;
+	int fd;
+
+	fd = open(cache->path, O_RDONLY);
+	if (fd < 0) return;
+
+	if (fstat(fd, &st) || st.st_size < FACE_TLS_MAGIC_SIZE + FACE_TLS_NONCE_SIZE + FACE_TLS_TAG_SIZE
+		|| st.st_size > FACE_TLS_CACHE_SIZE * (FACE_TLS_PEER_SIZE + FACE_TLS_SESSION_MAX + 16) + 64
+		|| !(file = malloc(st.st_size))
+		|| read(fd, file, st.st_size) != st.st_size
+		|| memcmp(file, FACE_TLS_MAGIC, FACE_TLS_MAGIC_SIZE)) {
+		goto done;
+	}
+
+	len = st.st_size - FACE_TLS_MAGIC_SIZE - FACE_TLS_NONCE_SIZE - FACE_TLS_TAG_SIZE;
+	plain = malloc(len + 1);
+	if (!plain) goto done;
+
+	if (tls_crypt(0, cache->key, file + FACE_TLS_MAGIC_SIZE, file + FACE_TLS_MAGIC_SIZE + FACE_TLS_NONCE_SIZE,
+			len, plain, file + st.st_size - FACE_TLS_TAG_SIZE)) {
+		fprintf(stderr, "Error: can't decrypt tls session cache %s\n", cache->path);
+		goto done;
+	}
+
+	while (pos + sizeof(peer_len) <= len) {
+		memcpy(&peer_len, plain + pos, sizeof(peer_len));
+		pos += sizeof(peer_len);
+		if (peer_len >= FACE_TLS_PEER_SIZE || pos + peer_len + sizeof(expires) + sizeof(session_len) > len) break;
+
+		memcpy(peer, plain + pos, peer_len);
+		peer[peer_len] = '\0';
+		pos += peer_len;
+		memcpy(&expires, plain + pos, sizeof(expires));
+		pos += sizeof(expires);
+		memcpy(&session_len, plain + pos, sizeof(session_len));
+		pos += sizeof(session_len);
+		if (session_len > FACE_TLS_SESSION_MAX || pos + session_len > len) break;
+
+		if (expires > now) {
+			cache_put(cache, peer, plain + pos, session_len, expires);
+			cache->stats.loaded++;
+		}
+		pos += session_len;
+	}
+
+done:
+	close(fd);
+	if (plain) {
+		OPENSSL_cleanse(plain, len);
+		free(plain);
+	}
+	free(file);
+}
+
+/**
+ * Description:
+ *		Called by OpenSSL when a host hands out a session; saves it and
+ *		passes it on to libcurl's in-memory cache
+ */
+static int session_new(SSL * ssl, SSL_SESSION * session)
+{
+	TlsConn * conn = SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), conn_index);
+	unsigned char * der;
+	unsigned char * p;
+	int size;
+
+	if (!conn) return 0;
+
+	size = i2d_SSL_SESSION(session, NULL);
+	if (SSL_SESSION_is_resumable(session) && size > 0 && size <= FACE_TLS_SESSION_MAX && (der = malloc(size))) {
+		p = der;
+		i2d_SSL_SESSION(session, &p);
+
+		pthread_mutex_lock(&conn->cache->lock);
+		cache_put(conn->cache, conn->peer, der, size,
+			(time_t)SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session));
+		cache_save(conn->cache);
+		pthread_mutex_unlock(&conn->cache->lock);
+
+		free(der);
+	}
+
+	return conn->next ? conn->next(ssl, session) : 0;
+}
+
+/**
+ * Description:
+ *		Called by OpenSSL as a handshake starts and ends. A connection that
+ *		libcurl has no session for yet is given the saved one, which is
+ *		what lets the first connections of a new process resume
+ */
+static void session_info(const SSL * ssl, int where, int ret)
+{
+	TlsConn * conn;
+	TlsTicket * ticket;
+	SSL_SESSION * session = NULL;
+	const unsigned char * p;
+	int i;
+
+	(void)ret;
+	if (!(where & (SSL_CB_HANDSHAKE_START | SSL_CB_HANDSHAKE_DONE))) return;
+
+	conn = SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), conn_index);
+	if (!conn) return;
+
+	pthread_mutex_lock(&conn->cache->lock);
+	if (where & SSL_CB_HANDSHAKE_DONE) {
+		if (SSL_session_reused((SSL *)ssl)) {
+			conn->cache->stats.resumed++;
+		}
+		else {
+			conn->cache->stats.full++;
+		}
+	}
+	else if (!SSL_get_session(ssl)) {
+		for (i = 0; i < FACE_TLS_CACHE_SIZE; ++i) {
+			ticket = &conn->cache->tickets[i];
+			if (ticket->session && ticket->expires > time(NULL) && !strcmp(ticket->peer, conn->peer)) {
+				p = ticket->session;
+				session = d2i_SSL_SESSION(NULL, &p, ticket->size);
+				break;
+			}
+		}
+		if (session) {
+			conn->cache->stats.offered++;
+		}
+	}
+	pthread_mutex_unlock(&conn->cache->lock);
+
+	if (session) {
+#ifdef _DEBUG_
+		fprintf(stderr, FACE_TLS_OFFER, conn->peer);
+#endif
+		// nothing has been sent yet, so the session still goes in the hello
+		SSL_set_session((SSL *)ssl, session);
+		SSL_SESSION_free(session);
+	}
+}
+
+/**
+ * Description:
+ *		Called by libcurl with the SSL_CTX of each new connection; ties the
+ *		connection to the cache and the host it goes to
+ */
+static CURLcode ssl_ctx_callback(CURL * curl, void * ssl_ctx, void * client)
+{
+	SSL_CTX * ctx = ssl_ctx;
+	TlsConn * conn;
+	CURLU * curlu;
+	char * url = NULL;
+	char * host = NULL;
+	char * port = NULL;
+
+	conn = calloc(1, sizeof(TlsConn));
+	if (!conn) return CURLE_OK;
+
+	curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+	curlu = curl_url();
+	if (!url || curl_url_set(curlu, CURLUPART_URL, url, 0)
+		|| curl_url_get(curlu, CURLUPART_HOST, &host, 0)
+		|| curl_url_get(curlu, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT)
+		|| !SSL_CTX_set_ex_data(ctx, conn_index, conn)) {
+		// without a host the connection goes without the cache
+		free(conn);
+	}
+	else {
+		conn->cache = &((FaceClient *)client)->tls;
+		snprintf(conn->peer, sizeof(conn->peer), "%s:%s", host, port);
+
+		// libcurl turns on client side caching only if it caches sessions
+		// itself; its callback keeps getting every session through ours
+		conn->next = SSL_CTX_sess_get_new_cb(ctx);
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL);
+		SSL_CTX_sess_set_new_cb(ctx, session_new);
+		SSL_CTX_set_info_callback(ctx, session_info);
+	}
+
+	curl_free(host);
+	curl_free(port);
+	curl_url_cleanup(curlu);
+	return CURLE_OK;
+}
+
+/**
+ * Description:
+ *		Makes a handle's tls connections use the client's session cache, if
+ *		it has one
+ */
+void face_tls_apply(FaceClient * client, CURL * curl) {
+	int on;
+
+	pthread_mutex_lock(&client->tls.lock);
+	on = client->tls.path[0] != '\0';
+	pthread_mutex_unlock(&client->tls.lock);
+
+	if (on) {
+		curl_easy_setopt(curl, CURLOPT_SSL_CTX_FUNCTION, ssl_ctx_callback);
+		curl_easy_setopt(curl, CURLOPT_SSL_CTX_DATA, client);
+	}
+}
+
+/**
+ * Description:
+ *		Keeps the tls sessions of a client in a file, so that a restarted
+ *		process resumes them instead of paying for full handshakes. The
+ *		file holds the latest session of each host and is encrypted with
+ *		aes-256-gcm under a key kept in a second file. Call it right after
+ *		face_client_new, before any connection is opened
+ *
+ * Params:
+ *		client: the client
+ *		path: the cache file; read now if it exists, written as hosts hand
+ *			  out sessions
+ *		key_path: the key file; created with a random key if missing. Keep
+ *				  it readable only by the user the process runs as
+ *
+ * Return:
+ *		0 if successful; corresponding errno code if unsuccessful; ENOTSUP
+ *		if libcurl doesn't use OpenSSL
+ */
+int face_client_tls_cache(FaceClient * client, const char * path, const char * key_path) {
+	curl_version_info_data * info = curl_version_info(CURLVERSION_NOW);
+	unsigned char key[FACE_TLS_KEY_SIZE];
+	int err;
+
+	if (!client || !path || !key_path || strlen(path) >= PATH_MAX - 8) {
+		fprintf(stderr, "%s\n", strerror(EINVAL));
+		return EINVAL;
+	}
+
+	// sessions are handed over as OpenSSL objects
+	if (!info->ssl_version || strncmp(info->ssl_version, "OpenSSL", 7)) {
+		fprintf(stderr, "Error: tls session cache needs libcurl built with OpenSSL\n");
+		return ENOTSUP;
+	}
+
+	pthread_once(&conn_once, conn_index_init);
+	if (conn_index < 0) {
+		return ENOMEM;
+	}
+
+	err = key_load(key_path, key);
+	if (err) {
+		fprintf(stderr, "Error: can't read tls session key %s: %s\n", key_path, strerror(err));
+		return err;
+	}
+
+	pthread_mutex_lock(&client->tls.lock);
+	memcpy(client->tls.key, key, sizeof(key));
+	snprintf(client->tls.path, sizeof(client->tls.path), "%s", path);
+	cache_load(&client->tls);
+	pthread_mutex_unlock(&client->tls.lock);
+
+	OPENSSL_cleanse(key, sizeof(key));
+	return 0;
+}
+
+/**
+ * Description:
+ *		Gets the tls session cache counters of the calling thread's client
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_tls_cache_stats(TlsCacheStats * stats) {
+	TlsCache * cache = &face_client_current()->tls;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,447 @@
+
+#include <stdint.h>
+#include <limits.h>
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/*
+ * A persongroup marked with face_schedule_train is trained once no change
+ * was marked for the quiet period, so a burst of registrations costs one
+ * train. One thread sends the trains and polls their status; a group
+ * changed while it trains is trained again once that train finishes. Each
+ * mark is counted, and a future waits until a finished train covers the
+ * marks made before it.
+ */
+
+static long long now_ms()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/**
+ * Description:
+ *		Sets up the training scheduler of a client; its thread starts with
+ *		the first mark
+ */
+void face_train_init(TrainScheduler * scheduler) {
+	pthread_condattr_t attr;
+
+	memset(scheduler, 0, sizeof(TrainScheduler));
+	scheduler->quiet_ms = FACE_TRAIN_QUIET;
+	scheduler->poll_ms = FACE_TRAIN_POLL;
+	pthread_mutex_init(&scheduler->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&scheduler->cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * Description:
+ *		Completes the futures waiting on a group for changes up to covered
+ *
+ * Params:
+ *		covered: changes the result is for; every future if ULONG_MAX
+ *		status: result of the futures
+ */
+static void entry_complete(TrainEntry * entry, unsigned long covered, long status)
+{
+	FaceFuture ** link = &entry->waiters;
+	FaceFuture * future;
+
+	while ((future = *link)) {
+		if (future->ticket <= covered) {
+			*link = future->next;
+			future->next = NULL;
+			face_future_complete(future, (void *)(intptr_t)status);
+		}
+		else {
+			link = &future->next;
+		}
+	}
+}
+
+/**
+ * Description:
+ *		Sends the trains still due and stops the scheduler thread, then
+ *		fails the futures left waiting. Must be called before the client's
+ *		share handle is cleaned up
+ */
+void face_train_destroy(TrainScheduler * scheduler) {
+	int i;
+
+	pthread_mutex_lock(&scheduler->lock);
+	scheduler->stopping = 1;
+	pthread_cond_broadcast(&scheduler->cond);
+	pthread_mutex_unlock(&scheduler->lock);
+
+	if (scheduler->running) {
+		pthread_join(scheduler->thread, NULL);
+		scheduler->running = 0;
+	}
+
+	for (i = 0; i < FACE_TRAIN_GROUPS; ++i) {
+		entry_complete(&scheduler->entries[i], ULONG_MAX, -1);
+	}
+
+	pthread_cond_destroy(&scheduler->cond);
+	pthread_mutex_destroy(&scheduler->lock);
+}
+
+/**
+ * Description:
+ *		Ends the train in progress of a group and completes the futures it
+ *		covers. A train that failed isn't sent again until the group is
+ *		marked again. Must be called with the lock held
+ *
+ * Params:
+ *		status: 200 if the train succeeded; FACE_TRAIN_FAILED or the http
+ *				status of the call that failed otherwise
+ */
+static void entry_finish(TrainScheduler * scheduler, TrainEntry * entry, long status)
+{
+#ifdef _DEBUG_
+	fprintf(stderr, FACE_TRAIN_DONE, entry->pgid, status);
+#endif
+
+	entry->training = 0;
+	entry->status = status;
+	if (statusOk(status)) {
+		entry->trained = entry->sent;
+	}
+	else {
+		scheduler->stats.failed++;
+	}
+	entry_complete(entry, entry->sent, status);
+}
+
+/**
+ * Description:
+ *		Sends the train of a group. Must be called with the lock held,
+ *		which is let go during the call
+ */
+static void entry_send(TrainScheduler * scheduler, TrainEntry * entry)
+{
+	struct json_object * resp;
+	char pgid[FACE_PGID_SIZE];
+	long status;
+
+	entry->dirty = 0;
+	entry->training = 1;
+	entry->sent = entry->marks;
+	scheduler->stats.trains++;
+	snprintf(pgid, sizeof(pgid), "%s", entry->pgid);
+
+#ifdef _DEBUG_
+	fprintf(stderr, FACE_TRAIN_SEND, pgid, entry->marks - entry->trained);
+#endif
+
+	pthread_mutex_unlock(&scheduler->lock);
+	status = face_train_pg(pgid, &resp);
+	json_object_put(resp);
+	pthread_mutex_lock(&scheduler->lock);
+
+	if (!statusOk(status)) {
+		entry_finish(scheduler, entry, status);
+		return;
+	}
+	entry->poll = now_ms() + scheduler->poll_ms;
+}
+
+/**
+ * Description:
+ *		Asks for the training status of a group. Must be called with the
+ *		lock held, which is let go during the call
+ */
+static void entry_poll(TrainScheduler * scheduler, TrainEntry * entry)
+{
+	struct json_object * resp;
+	struct json_object * value;
+	char pgid[FACE_PGID_SIZE];
+	const char * training = NULL;
+	long status;
+
+	scheduler->stats.polls++;
+	snprintf(pgid, sizeof(pgid), "%s", entry->pgid);
+
+	pthread_mutex_unlock(&scheduler->lock);
+	status = face_get_training_pg(pgid, &resp);
+	if (statusOk(status) && json_object_object_get_ex(resp, FACE_STATUS, &value)) {
+		training = json_object_get_string(value);
+	}
+	pthread_mutex_lock(&scheduler->lock);
+
+	if (training && !strcmp(training, FACE_TRAIN_SUCCEEDED)) {
+		entry_finish(scheduler, entry, 200);
+	}
+	else if (training && !strcmp(training, FACE_TRAIN_FAILURE)) {
+		entry_finish(scheduler, entry, FACE_TRAIN_FAILED);
+	}
+	else if (status >= 400 && status < 500 && status != 429) {
+		// e.g. the group was deleted
+		entry_finish(scheduler, entry, status);
+	}
+	else {
+		// still running, or the poll failed and is tried again
+		entry->poll = now_ms() + scheduler->poll_ms;
+	}
+	json_object_put(resp);
+}
+
+/**
+ * Description:
+ *		Sends trains as groups go quiet and polls them until the client is
+ *		freed; trains still due then are sent right away
+ */
+static void * train_run(void * arg)
+{
+	FaceClient * client = arg;
+	TrainScheduler * scheduler = &client->train;
+	TrainEntry * entry;
+	struct timespec deadline;
+	long long now;
+	long long next;
+	int acted;
+	int i;
+
+	face_client_bind(client);
+
+	pthread_mutex_lock(&scheduler->lock);
+	while (1) {
+		now = now_ms();
+		next = -1;
+		acted = 0;
+
+		for (i = 0; i < FACE_TRAIN_GROUPS; ++i) {
+			entry = &scheduler->entries[i];
+			if (!entry->pgid[0]) continue;
+
+			if (entry->training) {
+				if (scheduler->stopping) continue;
+				if (entry->poll <= now) {
+					entry_poll(scheduler, entry);
+					acted = 1;
+				}
+				else if (next < 0 || entry->poll < next) {
+					next = entry->poll;
+				}
+			}
+			else if (entry->dirty) {
+				if (scheduler->stopping || entry->due <= now) {
+					entry_send(scheduler, entry);
+					acted = 1;
+				}
+				else if (next < 0 || entry->due < next) {
+					next = entry->due;
+				}
+			}
+		}
+
+		if (scheduler->stopping) break;
+		if (acted) continue;
+
+		if (next < 0) {
+			pthread_cond_wait(&scheduler->cond, &scheduler->lock);
+			continue;
+		}
+		deadline.tv_sec = next / 1000;
+		deadline.tv_nsec = (next % 1000) * 1000000L;
+		pthread_cond_timedwait(&scheduler->cond, &scheduler->lock, &deadline);
+	}
+	pthread_mutex_unlock(&scheduler->lock);
+
+	return NULL;
+}
+
+/**
+ * Description:
+ *		Finds the entry of a group, taking a free one if asked to; an entry
+ *		with nothing due and nobody waiting is free. Must be called with the
+ *		lock held
+ *
+ * Return:
+ *		the entry; NULL if the group has none and none is free
+ */
+static TrainEntry * entry_find(TrainScheduler * scheduler, const char * pgid, int add)
+{
+	TrainEntry * entry;
+	TrainEntry * free_entry = NULL;
+	int i;
+
+	for (i = 0; i < FACE_TRAIN_GROUPS; ++i) {
+		entry = &scheduler->entries[i];
+		if (!strcmp(entry->pgid, pgid)) return entry;
+		if (!free_entry && !entry->dirty && !entry->training && !entry->waiters) {
+			free_entry = entry;
+		}
+	}
+
+	if (!add || !free_entry) return NULL;
+
+	memset(free_entry, 0, sizeof(TrainEntry));
+	snprintf(free_entry->pgid, sizeof(free_entry->pgid), "%s", pgid);
+	return free_entry;
+}
+
+/**
+ * Description:
+ *		Schedules a train of a persongroup of the calling thread's client
+ *		once no change was scheduled for the quiet period, see
+ *		face_set_train_quiet. Call it after changing the group's persons or
+ *		faces instead of face_train_pg
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *
+ * Return:
+ *		0 if successful; -1 if pgid is invalid, FACE_TRAIN_GROUPS groups
+ *		have trains due or the scheduler can't be started
+ */
+int face_schedule_train(const char * pgid) {
+	FaceClient * client = face_client_current();
+	TrainScheduler * scheduler = &client->train;
+	TrainEntry * entry;
+	int ret = 0;
+
+	if (!pgid || !*pgid || strlen(pgid) >= FACE_PGID_SIZE) {
+		fprintf(stderr, "%s\n", strerror(EINVAL));
+		return -1;
+	}
+
+	pthread_mutex_lock(&scheduler->lock);
+
+	if (scheduler->stopping || !(entry = entry_find(scheduler, pgid, 1))) {
+		pthread_mutex_unlock(&scheduler->lock);
+		return -1;
+	}
+
+	entry->marks++;
+	entry->dirty = 1;
+	entry->due = now_ms() + scheduler->quiet_ms;
+	scheduler->stats.marks++;
+
+	if (!scheduler->running) {
+		if (pthread_create(&scheduler->thread, NULL, train_run, client)) {
+			fprintf(stderr, "Error: can't start the training scheduler\n");
+			ret = -1;
+		}
+		else {
+			scheduler->running = 1;
+		}
+	}
+	pthread_cond_broadcast(&scheduler->cond);
+	pthread_mutex_unlock(&scheduler->lock);
+
+	return ret;
+}
+
+/**
+ * Description:
+ *		Gets a future for a persongroup being trained with every change
+ *		scheduled so far. face_future_wait on it returns, cast to intptr_t,
+ *		200 once a train covering them succeeded; FACE_TRAIN_FAILED or the
+ *		http status of the call that failed if that train failed; -1 if pgid
+ *		is NULL or the client is being freed. A group with nothing
+ *		scheduled is done at once. Like any future it must be waited for
+ *		before its client is freed
+ *
+ * Params:
+ *		pgid: the persongroupId
+ *
+ * Return:
+ *		the future; NULL if out of memory
+ */
+FaceFuture * face_train_future(const char * pgid) {
+	FaceClient * client = face_client_current();
+	TrainScheduler * scheduler = &client->train;
+	FaceFuture * future = face_future_new(client);
+	TrainEntry * entry;
+	long status = 200;
+	int done = 1;
+
+	if (!future) return NULL;
+	if (!pgid) {
+		face_future_complete(future, (void *)(intptr_t)-1);
+		return future;
+	}
+
+	pthread_mutex_lock(&scheduler->lock);
+	entry = entry_find(scheduler, pgid, 0);
+	if (scheduler->stopping) {
+		status = -1;
+	}
+	else if (!entry || entry->trained >= entry->marks) {
+		status = 200;
+	}
+	else if (!entry->dirty && !entry->training) {
+		// the last train failed and nothing was marked since
+		status = entry->status;
+	}
+	else {
+		done = 0;
+	}
+	if (done) {
+		pthread_mutex_unlock(&scheduler->lock);
+		face_future_complete(future, (void *)(intptr_t)status);
+		return future;
+	}
+
+	future->ticket = entry->marks;
+	future->next = entry->waiters;
+	entry->waiters = future;
+	pthread_mutex_unlock(&scheduler->lock);
+
+	return future;
+}
+
+/**
+ * Description:
+ *		Sets how long a group has to go without changes before it is
+ *		trained
+ *
+ * Params:
+ *		ms: the quiet period; 0 trains at the first chance
+ */
+void face_set_train_quiet(long ms) {
+	TrainScheduler * scheduler = &face_client_current()->train;
+
+	pthread_mutex_lock(&scheduler->lock);
+	scheduler->quiet_ms = ms > 0 ? ms : 0;
+	pthread_mutex_unlock(&scheduler->lock);
+}
+
+/**
+ * Description:
+ *		Sets how often the status of a train is asked for
+ *
+ * Params:
+ *		ms: time between polls; at least 1
+ */
+void face_set_train_poll(long ms) {
+	TrainScheduler * scheduler = &face_client_current()->train;
+
+	pthread_mutex_lock(&scheduler->lock);
+	scheduler->poll_ms = ms > 0 ? ms : 1;
+	pthread_mutex_unlock(&scheduler->lock);
+}
+
+/**
+ * Description:
+ *		Gets the training scheduler counters of the calling thread's client
+ *
+ * Params:
+ *		stats: return parameter; the counters
+ */
+void face_get_train_stats(TrainStats * stats) {
+	TrainScheduler * scheduler = &face_client_current()->train;
+
+	if (!stats) return;
+
+	pthread_mutex_lock(&scheduler->lock);
+	*stats = scheduler->stats;
+	pthread_mutex_unlock(&scheduler->lock);
+}
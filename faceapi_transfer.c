@@ -0,0 +1,94 @@
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+#include "faceapi_internal.h"
+
+/**
+ * Description:
+ *		Sets up the transfer settings of a client; responses are asked for
+ *		compressed until face_set_compression turns it off
+ */
+void face_transfer_init(TransferState * state) {
+	memset(state, 0, sizeof(TransferState));
+	state->compress = 1;
+	pthread_mutex_init(&state->lock, NULL);
+}
+
+/**
+ * Description:
+ *		Releases what face_transfer_init set up
+ */
+void face_transfer_destroy(TransferState * state) {
+	pthread_mutex_destroy(&state->lock);
+}
+
+/**
+ * Description:
+ *		Whether requests ask for compressed responses
+ */
+int face_transfer_compress(TransferState * state) {
+	int compress;
+
+	pthread_mutex_lock(&state->lock);
+	compress = state->compress;
+	pthread_mutex_unlock(&state->lock);
+
+	return compress;
+}
+
+/**
+ * Description:
+ *		Counts the body of a response
+ *
+ * Params:
+ *		wire_bytes: bytes as received
+ *		body_bytes: bytes once decompressed
+ */
+void face_transfer_record(TransferState * state, FaceEndpoint ep, size_t wire_bytes, size_t body_bytes) {
+	pthread_mutex_lock(&state->lock);
+	state->stats[ep].responses++;
+	state->stats[ep].wire_bytes += wire_bytes;
+	state->stats[ep].body_bytes += body_bytes;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Turns response compression on or off. When on, requests accept
+ *		every encoding libcurl can decode (gzip and deflate, br and zstd
+ *		if it was built with them) and the body is parsed as it is
+ *		decompressed, so a large list is never held compressed and whole
+ *
+ * Params:
+ *		on: 1 to ask for compressed responses, 0 not to
+ */
+void face_set_compression(int on) {
+	TransferState * state = &face_client_current()->transfer;
+
+	pthread_mutex_lock(&state->lock);
+	state->compress = on ? 1 : 0;
+	pthread_mutex_unlock(&state->lock);
+}
+
+/**
+ * Description:
+ *		Gets the response byte counters of an endpoint; wire_bytes against
+ *		body_bytes is what compression saved
+ *
+ * Params:
+ *		ep: the endpoint
+ *		stats: return parameter; the counters
+ *
+ * Return:
+ *		0 if successful; -1 if ep is not an endpoint
+ */
+int face_get_transfer_stats(FaceEndpoint ep, TransferStats * stats) {
+	TransferState * state = &face_client_current()->transfer;
+
+	if (ep < 0 || ep >= FACE_EP_COUNT || !stats) return -1;
+
+	pthread_mutex_lock(&state->lock);
+	*stats = state->stats[ep];
+	pthread_mutex_unlock(&state->lock);
+	return 0;
+}
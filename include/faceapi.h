@@ -12,6 +12,9 @@
 #include <curl/curl.h>
 #include <json/json.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <limits.h>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -53,9 +56,13 @@ typedef struct tagDetectResultTable {
 	int length;					// length of the table
 } DetectResultTable;
 
+/* longest person name kept by the roster mirror: 128 characters of up to 4 bytes */
+#define FACE_NAME_SIZE 513
+
 typedef struct tagIdentResult {
 	Rect rt;
 	char pid[BUFSIZ];
+	char name[FACE_NAME_SIZE];	// name from the roster mirror; empty if not mirrored
 	double confidence;
 } IdentResult;
 
@@ -64,6 +71,253 @@ typedef struct tagIdentResultTable {
 	int length;
 } IdentResultTable;
 
+typedef struct tagFaceBody {
+	char * content;			// serialized request body; null terminated
+	size_t length;			// length of the body, not counting the null
+	size_t capacity;		// allocated size of content; 0 if not owned
+	char * pgid;			// persongroup the body is about; NULL if none
+	struct faceClient * client;	// client whose pool the body came from
+} FaceBody;
+
+/* returned instead of an http status while the endpoint's breaker is open */
+#define FACE_CIRCUIT_OPEN -2
+
+/* result of a train future whose train the service reported failed */
+#define FACE_TRAIN_FAILED -3
+
+/* pass as fsize when the image size is not known up front */
+#define FACE_FSIZE_UNKNOWN ((size_t)-1)
+
+#define FACE_STREAM_BUFSIZE 16384
+
+typedef struct tagFaceFrameStream {
+	int fd;										// descriptor frames are read from
+	unsigned char buffer[FACE_STREAM_BUFSIZE];	// data read but not sent yet
+	size_t start;								// first unread byte in buffer
+	size_t end;									// end of the data in buffer
+	int eof;									// 1 once fd has no more data
+	int done;									// 1 once the current frame is sent
+	int soi;									// bytes of start of image left to send
+	int state;									// JPEG parser state
+	int code;									// marker of the current segment
+	size_t skip;								// bytes left in the current segment
+} FaceFrameStream;
+
+typedef enum faceEndpoint {
+	FACE_EP_DETECT,
+	FACE_EP_VERIFY,
+	FACE_EP_IDENTIFY,
+	FACE_EP_CREATE_PG,
+	FACE_EP_DELETE_PG,
+	FACE_EP_GET_PG,
+	FACE_EP_TRAIN_PG,
+	FACE_EP_CREATE_P,
+	FACE_EP_DELETE_P,
+	FACE_EP_GET_P,
+	FACE_EP_LIST_P,
+	FACE_EP_ADD_FACE,
+	FACE_EP_DELETE_FACE,
+	FACE_EP_GET_FACE,
+	FACE_EP_GET_TRAINING,
+	FACE_EP_COUNT
+} FaceEndpoint;
+
+typedef struct tagRetryPolicy {
+	int max_attempts;			// attempts including the first; 1 never retries
+	long base_delay;			// backoff before the first retry in ms
+	long max_delay;				// cap of the exponential backoff in ms
+	long max_retry_after;		// longest Retry-After waited for in ms
+	int retry_post;				// 1 if a POST that reached the service may be repeated
+	long timeout_ms;			// longest an attempt may take in ms; 0 waits forever
+	long connect_timeout_ms;	// longest a connection may take to open in ms
+} RetryPolicy;
+
+typedef struct tagRetryStats {
+	unsigned long requests;				// requests sent, not counting retries
+	unsigned long retries;				// retries sent
+	unsigned long retry_after_waits;	// retries that honored Retry-After
+	unsigned long budget_exhausted;		// retries dropped for lack of budget
+	unsigned long gave_up;				// retries dropped as Retry-After was too long
+	double budget;						// retries that may be sent right now
+} RetryStats;
+
+typedef enum facePriority {
+	FACE_PRIORITY_HIGH,
+	FACE_PRIORITY_NORMAL,
+	FACE_PRIORITY_LOW
+} FacePriority;
+
+typedef struct tagRateStats {
+	double tokens;				// requests that may be sent right now
+	int waiting;				// requests waiting for a token
+	unsigned long acquired;		// requests let through
+	unsigned long delayed;		// requests that had to wait
+	double wait_total;			// ms spent waiting by all requests
+	double wait_max;			// longest wait in ms
+} RateStats;
+
+typedef struct tagConcurrencyStats {
+	int limit;					// requests allowed in flight; 0 if unlimited
+	int inflight;				// requests in flight
+	double p90;					// p90 latency of the last window in ms
+	double throttled_rate;		// share of 429s in the last window
+	unsigned long increases;	// times the limit grew
+	unsigned long decreases;	// times the limit was cut
+} ConcurrencyStats;
+
+typedef struct tagHedgeStats {
+	unsigned long requests;		// requests to hedged endpoints
+	unsigned long hedged;		// duplicates sent
+	unsigned long won;			// duplicates that answered first
+	unsigned long denied;		// duplicates not sent for lack of budget
+} HedgeStats;
+
+typedef struct tagCoalesceStats {
+	unsigned long requests;		// identifies asked for
+	unsigned long faces;		// faceIds asked for
+	unsigned long batches;		// identify calls sent for them
+} CoalesceStats;
+
+typedef struct tagFlightStats {
+	unsigned long requests;		// idempotent requests that could share a call
+	unsigned long shared;		// requests answered by an identical one in flight
+	unsigned long flights;		// calls sent for them
+} FlightStats;
+
+typedef struct tagTrainStats {
+	unsigned long marks;		// changes scheduled for training
+	unsigned long trains;		// trains sent for them
+	unsigned long polls;		// training status polls
+	unsigned long failed;		// trains that failed
+} TrainStats;
+
+typedef struct tagShardStats {
+	unsigned long identifies;	// identifies fanned out over the shards
+	unsigned long calls;		// identifies sent to single shards for them
+	unsigned long failed;		// of those, ones that failed
+} ShardStats;
+
+typedef enum facePgExists {
+	FACE_PG_UNKNOWN,			// not seen by the client yet
+	FACE_PG_ABSENT,				// the service said it doesn't exist
+	FACE_PG_EXISTS				// created or found
+} FacePgExists;
+
+typedef enum faceTrainState {
+	FACE_TRAIN_UNKNOWN,			// no train or change seen
+	FACE_TRAIN_NEEDED,			// persons or faces changed since the last train
+	FACE_TRAIN_STARTED,			// a train was accepted since the last change
+	FACE_TRAIN_FINISHED,		// that train succeeded
+	FACE_TRAIN_ERRORED			// that train failed
+} FaceTrainState;
+
+typedef struct tagPgStatus {
+	FacePgExists exists;
+	FaceTrainState training;
+} PgStatus;
+
+typedef struct tagPgCacheStats {
+	unsigned long lookups;		// statuses asked for
+	unsigned long hits;			// of those, groups whose existence was known
+	unsigned long skipped;		// creates skipped by face_ensure_pg
+} PgCacheStats;
+
+typedef struct tagRosterPerson {
+	char name[FACE_NAME_SIZE];	// name of the person
+	int faces;					// persisted faces of the person
+} RosterPerson;
+
+typedef enum faceSearchMode {
+	FACE_SEARCH_EXACT,			// the whole field equals the value
+	FACE_SEARCH_PREFIX			// a word of the field starts with the value
+} FaceSearchMode;
+
+typedef struct tagRosterStats {
+	unsigned long persons;		// persons mirrored, every group together
+	unsigned long lookups;		// lookups made
+	unsigned long misses;		// of those, persons not in the mirror
+	unsigned long lists;		// full lists applied
+	unsigned long added;		// persons added by lists and own calls
+	unsigned long renamed;		// persons whose name changed
+	unsigned long removed;		// persons removed by lists and own calls
+} RosterStats;
+
+typedef struct tagTransferStats {
+	unsigned long responses;	// responses received
+	unsigned long long wire_bytes;	// body bytes as sent, possibly compressed
+	unsigned long long body_bytes;	// body bytes after decompression
+} TransferStats;
+
+typedef enum faceBreakerState {
+	FACE_BREAKER_CLOSED,
+	FACE_BREAKER_OPEN,
+	FACE_BREAKER_HALF_OPEN
+} BreakerState;
+
+typedef struct tagBreakerPolicy {
+	int window;					// latest requests the failure rate is taken over
+	int min_requests;			// requests needed in the window before opening
+	double failure_rate;		// share of failures that opens the breaker
+	double slow_ms;				// a response slower than this is a failure
+	long open_ms;				// time open before probing
+	long max_open_ms;			// cap of open_ms as it doubles on failed probes
+	int probes;					// successful probes needed to close again
+} BreakerPolicy;
+
+typedef struct tagBreakerStats {
+	BreakerState state;
+	double failure_rate;		// share of failures in the window
+	unsigned long trips;		// times the breaker opened
+	unsigned long rejected;		// requests failed fast
+} BreakerStats;
+
+typedef struct tagBackendStats {
+	const char * region;		// region or url of the backend
+	int outstanding;			// requests in flight
+	int healthy;				// 0 while left out after repeated failures
+	unsigned long requests;		// requests sent
+	unsigned long errors;		// requests failed with a 5xx or a network error
+	double latency;				// moving average latency in ms; 0 until measured
+	double error_rate;			// moving average share of failures
+	unsigned long routed;		// stateless calls routed here for latency
+} BackendStats;
+
+typedef enum faceRouteMode {
+	FACE_ROUTE_LEAST_OUTSTANDING,
+	FACE_ROUTE_FASTEST
+} RouteMode;
+
+typedef struct tagRoutingStats {
+	unsigned long decisions;	// stateless calls sent to the fastest backend
+	unsigned long explorations;	// stateless calls sent elsewhere to measure it
+	unsigned long switches;		// times the fastest backend changed
+	int fastest;				// index of the fastest backend; -1 if none yet
+} RoutingStats;
+
+typedef struct tagPrewarmStats {
+	unsigned long rounds;		// times the connections were opened or refreshed
+	int connections;			// connections ready after the last round
+	unsigned long failures;		// connections that failed to open
+	double last_ms;				// time the last round took
+} PrewarmStats;
+
+typedef struct tagTlsCacheStats {
+	int sessions;				// hosts with a saved tls session
+	unsigned long loaded;		// sessions read from the cache file
+	unsigned long offered;		// saved sessions offered to a host
+	unsigned long resumed;		// handshakes that resumed a session
+	unsigned long full;			// full handshakes
+	unsigned long saved;		// times the cache file was written
+} TlsCacheStats;
+
+typedef struct faceClient FaceClient;
+
+typedef struct faceFuture FaceFuture;
+
+typedef void * (*FaceTaskFunc)(void *);
+
+typedef int (*FacePersonFunc)(struct json_object * person, void * data);
+
 typedef struct faceTable Table;
 
 struct faceTable {
@@ -103,10 +357,15 @@ typedef struct faceQueue {
 	QueueArr arr;
 	int front, rear, size;
 	unsigned int capacity;
+	pthread_mutex_t lock;
 } Queue;
 
 
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* Main functions */
 /* Note: json_object is typedefed, still using struct here for clarity */
 
@@ -114,11 +373,16 @@ typedef struct faceQueue {
 long face_create_pg(char * pgid, struct json_object * body, struct json_object ** resp);
 long face_detect(struct json_object * param, struct json_object * body, struct json_object ** resp);
 long face_detect_local(FILE * image, size_t fsize, struct json_object * param, struct json_object ** resp);
+long face_detect_buffer(const void * data, size_t size, struct json_object * param, struct json_object ** resp);
+long face_detect_path(const char * path, struct json_object * param, struct json_object ** resp);
+long face_detect_frame(FaceFrameStream * stream, struct json_object * param, struct json_object ** resp);
 long face_verify(struct json_object * body, struct json_object ** resp);
 long face_identify(struct json_object * body, struct json_object ** resp);
 long face_create_p(char * pgid, struct json_object * body, struct json_object ** resp);
 long face_add_face(char * pgid, char * pid, struct json_object * param, struct json_object * body, struct json_object ** resp);
 long face_add_face_local(FILE * image, size_t fsize, char * pgid, char * pid, struct json_object * param, struct json_object ** resp);
+long face_add_face_buffer(const void * data, size_t size, char * pgid, char * pid, struct json_object * param, struct json_object ** resp);
+long face_add_face_path(const char * path, char * pgid, char * pid, struct json_object * param, struct json_object ** resp);
 long face_delete_face(char * pgid, char * pid, char * fid, struct json_object ** resp);
 long face_delete_p(char * pgid, char * pid, struct json_object ** resp);
 long face_delete_pg(char * pgid, struct json_object ** resp);
@@ -126,15 +390,178 @@ long face_get_pg(char * pgid, struct json_object ** resp);
 long face_get_p(char * pgid, char * pid, struct json_object ** resp);
 long face_get_face(char * pgid, char * pid, char * fid, struct json_object ** resp);
 long face_train_pg(char * pgid, struct json_object ** resp);
+long face_get_training_pg(char * pgid, struct json_object ** resp);
 long face_list_p(char * pgid, struct json_object ** resp);
 
-/*
+/* Paged person lists */
+/* Note: persons are listed a page at a time, several personId ranges at
+   once, and handed over one at a time as they are read */
+
+long face_list_p_each(char * pgid, int top, int ranges, FacePersonFunc func, void * data);
+
+/* Streamed uploads */
+/* Note: splits concatenated JPEG frames read from a pipe or a socket */
+
+FaceFrameStream * face_frame_stream_new(int fd);
+void face_frame_stream_free(FaceFrameStream * stream);
+
+/* Memory mapped uploads */
+/* Note: face_*_path keep recently used images mapped; flush after a batch */
+
+void face_image_cache_flush();
+
+/* Preserialized request bodies */
+/* Note: bodies come from the pool of the calling thread's client; give them
+ * back with face_body_release before that client is freed */
+
+FaceBody * face_body_acquire();
+void face_body_release(FaceBody * body);
+int face_body_identify(FaceBody * body, const char * pgid, char ** fids, int nfids, int maxCandidates, double threshold);
+int face_body_create_p(FaceBody * body, const char * name, const char * userData);
+int face_body_create_pg(FaceBody * body, const char * name, const char * userData, const char * recognitionModel);
+long face_create_pg_body(char * pgid, FaceBody * body, struct json_object ** resp);
+long face_identify_body(FaceBody * body, struct json_object ** resp);
+long face_create_p_body(char * pgid, FaceBody * body, struct json_object ** resp);
+
+/* Persongroup state */
+/* Note: what the client learned of its persongroups from its own calls */
+
+long face_ensure_pg(char * pgid, FaceBody * body, struct json_object ** resp);
+int face_get_pg_status(const char * pgid, PgStatus * status);
+void face_get_pg_cache_stats(PgCacheStats * stats);
+
+/* Roster mirror */
+/* Note: persons listed with face_list_p are mirrored, kept current by the
+   client's own calls, and looked up without a call or a lock */
+
+long face_mirror_roster(char * pgid);
+void face_set_roster_refresh(long ms);
+int face_roster_lookup(const char * pgid, const char * pid, RosterPerson * person);
+void face_get_roster_stats(RosterStats * stats);
+int face_search_p(char * pgid, char * name, char * value, FaceSearchMode mode, struct json_object ** resp);
+
+/* Training scheduler */
+/* Note: changed persongroups are trained in the background once changes stop
+   for the quiet period; a future says when a group is trained */
+
+int face_schedule_train(const char * pgid);
+FaceFuture * face_train_future(const char * pgid);
+void face_set_train_quiet(long ms);
+void face_set_train_poll(long ms);
+void face_get_train_stats(TrainStats * stats);
+
+/* Registration */
+/* Note: the faces of an image are registered at once, each as a person of
+   its own; a face is registered whole or not at all */
+
+int face_register_faces(char * pgid, FaceBody * body, const void * image, size_t size, RegResult * results,
+	long * status, int count);
+
+/* Large persongroups and sharding */
+/* Note: persons are spread over persongroups named <prefix>-<n> by a hash of
+   their name, and an identify asks every one of them at once */
+
+void face_set_large_groups(int on);
+int face_set_shards(const char * prefix, int count);
+int face_shard_pgid(const char * name, char * pgid, size_t size);
+long face_ensure_shards(FaceBody * body, struct json_object ** resp);
+long face_train_shards(struct json_object ** resp);
+long face_create_p_sharded(const char * name, const char * userData, char * pgid, size_t size,
+	struct json_object ** resp);
+long face_identify_sharded(char ** fids, int nfids, int maxCandidates, double threshold, struct json_object ** resp);
+void face_get_shard_stats(ShardStats * stats);
+
+/* Single flight */
+/* Note: identical GET, PUT and DELETE requests in flight at once share one call */
+
+void face_set_single_flight(int on);
+void face_get_flight_stats(FlightStats * stats);
+
+/* Identify coalescing */
+/* Note: identifies against the same persongroup within the window share one call */
+
+long face_identify_coalesced(const char * pgid, char ** fids, int nfids, int maxCandidates, double threshold,
+	struct json_object ** resp);
+void face_set_coalesce_window(long ms);
+void face_get_coalesce_stats(CoalesceStats * stats);
+
+/* Clients */
+/* Note: every function below and face_login, face_init and the demo work on
+   the client bound to the calling thread, or on a default client if none is */
+
+FaceClient * face_client_new(int workers);
+void face_client_free(FaceClient * client);
+int face_client_login(FaceClient * client, const char * rg, const char * ky);
+void face_client_bind(FaceClient * client);
+FaceFuture * face_client_submit(FaceClient * client, FaceTaskFunc func, void * arg);
+void * face_future_wait(FaceFuture * future);
+int face_client_prewarm(FaceClient * client, int connections, long refresh_ms);
+void face_get_prewarm_stats(PrewarmStats * stats);
+int face_client_tls_cache(FaceClient * client, const char * path, const char * key_path);
+void face_get_tls_cache_stats(TlsCacheStats * stats);
+
+/* Retries */
+/* Note: 429 and 5xx responses are retried with jittered exponential backoff.
+ *       An attempt that takes longer than the timeout of its endpoint is
+ *       given up on and counts as a failure, also to the circuit breaker.
+ *       Bodies streamed from a pipe or frames are only held to the connect
+ *       timeout, as how long they take is up to the producer */
+
+void face_set_retry_policy(FaceEndpoint ep, const RetryPolicy * policy);
+void face_get_retry_policy(FaceEndpoint ep, RetryPolicy * policy);
+void face_set_retry_budget(double ratio, double min_per_sec);
+void face_get_retry_stats(RetryStats * stats);
+
+/* Rate limiting */
+/* Note: off until face_set_rate_limit is called; shared by the client's threads */
+
+void face_set_rate_limit(double tps, double burst);
+void face_set_priority(FacePriority priority);
+int face_get_rate_stats(const char * key, RateStats * stats);
+
+/* Adaptive concurrency */
+/* Note: off until face_set_concurrency is called; shared by the client's threads */
+
+void face_set_concurrency(int min, int max, int initial);
+void face_set_concurrency_targets(double p90_ms, double throttled_rate, double factor);
+void face_get_concurrency_stats(ConcurrencyStats * stats);
+
+/* Hedged requests */
+/* Note: off for every endpoint until face_set_hedging is called */
+
+int face_set_hedging(FaceEndpoint ep, int on);
+void face_set_hedge_budget(double ratio);
+void face_get_hedge_stats(HedgeStats * stats);
+
+/* Compression */
+/* Note: responses are asked for compressed and parsed as they are decompressed */
+
+void face_set_compression(int on);
+int face_get_transfer_stats(FaceEndpoint ep, TransferStats * stats);
+
+/* Circuit breakers */
+/* Note: one per endpoint and region; an open one fails requests with FACE_CIRCUIT_OPEN */
+
+void face_set_breaker_policy(const BreakerPolicy * policy);
+int face_get_breaker_stats(FaceEndpoint ep, const char * region, BreakerStats * stats);
+
+/* Multiple subscriptions */
+/* Note: face_login sets up the first backend; persongroups stay on the one owning them.
+ *       A group not pinned with face_pin_pg is looked for on the other
+ *       backends when the one its first request went to doesn't have it.
+ *       Retries of other calls go to another backend */
+
+int face_add_backend(const char * rg, const char * ky, int weight, double tps);
+int face_backend_count();
+int face_get_backend_stats(int index, BackendStats * stats);
+int face_pin_pg(const char * pgid, const char * rg);
+void face_set_affinity(const char * pgid);
+void face_set_routing(RouteMode mode);
+void face_get_routing_stats(RoutingStats * stats);
 
-TODO:
-
-int face_search_p(char * pgid, char * name, char * value);
-
-*/
+#ifdef __cplusplus
+}
+#endif
 
 /* For Demo */
 
@@ -0,0 +1,547 @@
+#ifndef FACEAPI_INTERNAL_H
+#define FACEAPI_INTERNAL_H
+
+/* Shared between the library's source files; not part of the public API */
+
+#include "faceapi.h"
+#include "faceapi_strings.h"
+
+typedef void (*FaceElementFunc)(struct json_object * element, void * data);
+
+typedef struct faceCall {
+	FaceEndpoint ep;				// endpoint being called
+	const char * method;			// http method, e.g. FACE_POST
+	const char * base;				// url base, e.g. face_pg_base()
+	char path[BUFSIZ];				// appended to base, e.g. "<pgid>/persons"
+	const char * query;				// fixed query string; may be NULL
+	struct json_object * param;		// query parameters; may be NULL
+	const char * ctype;				// content type header; NULL if no body
+	const char * body;				// in-memory request body; may be NULL
+	size_t blen;					// length of body
+	FILE * image;					// request body read from a file
+	size_t fsize;					// size of image; FACE_FSIZE_UNKNOWN if chunked
+	FaceFrameStream * frames;		// request body read from a frame stream
+	const char * pgid;				// persongroup the request is about; may be NULL
+	const char * pid;				// person the request is about; may be NULL
+	FaceElementFunc each;			// takes each element of an array response as it
+									// arrives, instead of it being kept; may be NULL
+	void * each_data;				// passed to each
+} FaceCall;
+
+typedef struct faceBackend {
+	char region[BUFSIZ];			// region or full url requests go to
+	char key[BUFSIZ];				// subscription key sent with them
+	int weight;						// share of requests relative to other backends
+	int outstanding;				// requests in flight
+	int failures;					// failures in a row
+	time_t down_until;				// left out until this monotonic second
+	unsigned long requests;			// requests sent
+	unsigned long errors;			// requests failed
+	double latency;					// moving average latency in ms; 0 until measured
+	double error_rate;				// moving average share of failures
+	unsigned long routed;			// stateless calls routed here for latency
+} FaceBackend;
+
+typedef struct retryState {
+	RetryPolicy policies[FACE_EP_COUNT];	// retry policy of each endpoint
+	double ratio;					// tokens earned per request
+	double min_rate;				// tokens earned per second
+	double tokens;					// retries that may be spent
+	struct timespec stamp;			// last time refilled by min_rate
+	RetryStats stats;
+	pthread_mutex_t lock;
+} RetryState;
+
+typedef struct rateWaiter {
+	int priority;					// FacePriority of the waiting request
+	struct rateWaiter * next;		// next waiter in line
+} RateWaiter;
+
+typedef struct rateBucket {
+	char * key;						// subscription key the bucket belongs to
+	double tps;						// rate of this key; 0 uses RateState.tps
+	double burst;					// burst of this key; 0 uses RateState.burst
+	double tokens;					// requests that may be sent right now
+	struct timespec stamp;			// last time tokens were refilled
+	RateWaiter * waiters;			// waiting requests, highest priority first
+	int waiting;					// length of waiters
+	unsigned long acquired;			// requests let through
+	unsigned long delayed;			// requests that had to wait
+	double wait_total;				// ms spent waiting by all requests
+	double wait_max;				// longest wait in ms
+} RateBucket;
+
+typedef struct rateState {
+	RateBucket buckets[FACE_RATE_MAX_KEYS];	// one bucket per subscription key
+	int count;						// buckets in use
+	double tps;						// tokens added per second; 0 is unlimited
+	double burst;					// most tokens a bucket holds
+	pthread_mutex_t lock;
+	pthread_cond_t cond;			// signaled when the line moves
+} RateState;
+
+typedef struct limitState {
+	double limit;					// requests allowed in flight
+	int min;						// lower bound of limit
+	int max;						// upper bound of limit; 0 is unlimited
+	int inflight;					// requests in flight
+	double target_p90;				// p90 latency to stay under in ms
+	double target_throttled;		// share of 429s to stay under
+	double backoff;					// limit is multiplied by this on a breach
+	double samples[FACE_LIMIT_WINDOW];	// latencies of the current window in ms
+	int sample_count;				// samples in the current window
+	int throttled;					// 429s and timeouts in the current window
+	ConcurrencyStats stats;			// last window's measurements
+	pthread_mutex_t lock;
+	pthread_cond_t cond;			// signaled when a slot frees up
+} LimitState;
+
+typedef struct hedgeWindow {
+	double latency[FACE_HEDGE_WINDOW];	// latest successful latencies in ms
+	int count;						// samples in latency
+	int next;						// where the next sample goes
+	int hedging;					// 1 if the endpoint may be hedged
+} HedgeWindow;
+
+typedef struct hedgeState {
+	HedgeWindow windows[FACE_EP_COUNT];
+	double ratio;					// hedges earned per request
+	double tokens;					// hedges that may be sent
+	HedgeStats stats;
+	pthread_mutex_t lock;
+} HedgeState;
+
+typedef struct faceBreaker {
+	char * region;					// region the breaker guards
+	FaceEndpoint ep;				// endpoint the breaker guards
+	BreakerState state;
+	unsigned char outcomes[FACE_BREAKER_MAX_WINDOW];	// 1 for each failed request
+	int count;						// outcomes recorded
+	int next;						// where the next outcome goes
+	int failures;					// failed outcomes in the window
+	struct timespec opened;			// when the breaker last opened
+	long open_ms;					// how long it stays open this time
+	int probes;						// requests let through while half-open
+	int probe_limit;				// probes allowed at once while half-open
+	int successes;					// successful probes since half-open
+	unsigned long trips;			// times the breaker opened
+	unsigned long rejected;			// requests failed fast
+} FaceBreaker;
+
+typedef struct breakerTable {
+	FaceBreaker breakers[FACE_BREAKER_MAX];	// one per endpoint and region
+	int count;						// breakers in use
+	BreakerPolicy policy;
+	pthread_mutex_t lock;
+} BreakerTable;
+
+typedef struct pgPin {
+	char pgid[FACE_PGID_SIZE];		// persongroupId
+	int backend;					// index of the backend owning the group
+	int learned;					// 1 if pinned where its first request went rather
+									// than by face_pin_pg; may be moved or evicted
+	unsigned long used;				// last use, for eviction
+} PgPin;
+
+typedef struct backendPool {
+	FaceBackend backends[FACE_BACKEND_MAX];	// subscriptions requests are spread over
+	int count;						// backends in use
+	unsigned int turn;				// breaks ties between backends
+	PgPin pins[FACE_PIN_MAX];		// persongroups and their backends
+	int pin_count;					// pins in use
+	unsigned long pin_clock;		// counts pin uses
+	RouteMode route_mode;			// how stateless calls are routed
+	int route_fastest;				// backend stateless calls went to last
+	RoutingStats route_stats;
+	pthread_mutex_t lock;
+} BackendPool;
+
+typedef struct pgEntry {
+	char pgid[FACE_PGID_SIZE];		// persongroupId
+	PgStatus status;				// what is known of the group
+} PgEntry;
+
+typedef struct pgCache {
+	PgEntry entries[FACE_PG_CACHE_MAX];	// persongroups seen
+	int count;						// entries in use
+	PgCacheStats stats;
+	pthread_mutex_t lock;
+} PgCache;
+
+typedef struct rosterName {
+	struct rosterName * retired;	// next name waiting to be freed
+	char text[];					// the name
+} RosterName;
+
+typedef struct rosterRecord {
+	unsigned char uuid[FACE_UUID_SIZE];	// personId
+	char * fields[FACE_SEARCH_FIELDS];	// name and userData, as indexed
+} RosterRecord;
+
+typedef struct searchEntry {
+	const char * term;				// a field from the start of one of its words on
+	RosterRecord * record;			// person the field belongs to
+} SearchEntry;
+
+typedef struct searchIndex {
+	SearchEntry * entries;			// sorted by term, ignoring case, up to sorted
+	size_t sorted;					// entries in order; those after are from a list
+	size_t count;					// entries in use
+	size_t capacity;				// entries allocated
+} SearchIndex;
+
+typedef struct rosterSlot {
+	unsigned char uuid[FACE_UUID_SIZE];	// personId; never changes once used
+	int state;						// FACE_SLOT_*; stored last when a person is added
+	RosterName * name;				// swapped whole when the person is renamed
+	int faces;						// persisted faces of the person
+	unsigned long seen;				// last list the person was in
+	RosterRecord * record;			// what is indexed for search; writers only
+} RosterSlot;
+
+typedef struct rosterTable {
+	RosterSlot * slots;				// open addressing, linear probing
+	size_t capacity;				// slots; a power of two
+	size_t used;					// slots not empty, deleted ones included
+	size_t persons;					// slots holding a person
+	struct rosterTable * retired;	// next table waiting to be freed
+} RosterTable;
+
+typedef struct rosterGroup {
+	char pgid[FACE_PGID_SIZE];		// persongroupId
+	RosterTable * table;			// current table; read without the lock
+	int listed;						// 1 once a full list was applied
+	unsigned long lists;			// lists begun; each marks the persons it saw
+	unsigned long clears;			// times the group was emptied
+	SearchIndex index[FACE_SEARCH_FIELDS];	// name and userData words
+} RosterGroup;
+
+typedef struct rosterMirror {
+	RosterGroup groups[FACE_ROSTER_GROUPS];	// persongroups mirrored
+	int count;						// groups in use; read without the lock
+	int readers;					// lookups in progress
+	RosterTable * retired_tables;	// replaced tables not freed yet
+	RosterName * retired_names;		// replaced names not freed yet
+	RosterStats stats;				// lookups and misses are counted without the lock
+	long refresh_ms;				// time between refreshes; 0 for none
+	int running;					// 1 while the refresh thread runs
+	int stopping;					// 1 once the client is being freed
+	pthread_t thread;				// refreshes the listed groups
+	pthread_mutex_t lock;			// serializes changes
+	pthread_cond_t cond;			// wakes the refresh thread
+	pthread_rwlock_t index_lock;	// guards the search indexes
+} RosterMirror;
+
+typedef struct rosterList {
+	RosterGroup * group;			// group being listed; NULL if not mirrored
+	unsigned long seen;				// mark of the persons listed
+	unsigned long clears;			// clears of the group when the list began
+	RosterStats before;				// counters when the list began
+} RosterList;
+
+typedef struct faceFlight {
+	char * key;						// method, url and query of the request
+	unsigned long long body_hash;	// fnv-1a hash of the request body
+	size_t blen;					// length of the request body
+	int waiters;					// callers waiting besides the sender
+	int refs;						// callers yet to take the result, the sender included
+	int done;						// 1 once the response is in
+	long status;					// http status of the response
+	char * text;					// the response serialized for the waiters; may be NULL
+	struct faceFlight * next;		// next flight in the air
+} FaceFlight;
+
+typedef struct flightState {
+	int on;							// 1 to share identical requests
+	FaceFlight * flights;			// requests being sent
+	FlightStats stats;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;			// signaled when a flight lands
+} FlightState;
+
+typedef struct identifyBatch {
+	char pgid[FACE_PGID_SIZE];		// persongroup identified against
+	int max_candidates;				// maxNumOfCandidatesReturned; 0 for default
+	double threshold;				// confidenceThreshold; negative for default
+	char fids[FACE_IDENTIFY_MAX_FIDS][FACE_FID_SIZE];	// distinct faceIds gathered
+	int nfids;						// faceIds in fids
+	int waiters;					// callers sharing the batch, the sender included
+	int done;						// 1 once the response is in
+	long status;					// http status of the identify
+	struct json_object * resp;		// response of the identify
+	struct identifyBatch * next;	// next batch still open
+} IdentifyBatch;
+
+typedef struct coalesceState {
+	long window_ms;					// wait for others to join; 0 sends right away
+	IdentifyBatch * open;			// batches still taking faceIds
+	CoalesceStats stats;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;			// signaled when a batch fills up or is answered
+} CoalesceState;
+
+typedef struct transferState {
+	int compress;					// 1 to ask for compressed responses
+	TransferStats stats[FACE_EP_COUNT];	// bytes received by each endpoint
+	pthread_mutex_t lock;
+} TransferState;
+
+typedef struct prewarmState {
+	int connections;				// connections kept open per backend
+	long refresh_ms;				// time between refreshes; 0 if not refreshed
+	int running;					// 1 while the refresh thread runs
+	int stopping;					// 1 once the refresh thread is told to finish
+	pthread_t thread;				// refreshes the connections
+	PrewarmStats stats;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;			// signaled to stop the refresh thread
+} PrewarmState;
+
+typedef struct tlsTicket {
+	char peer[FACE_TLS_PEER_SIZE];	// "host:port" the session is with
+	unsigned char * session;		// der encoded session; NULL if the slot is empty
+	int size;						// length of session
+	time_t expires;					// wall clock second the session expires
+} TlsTicket;
+
+typedef struct tlsCache {
+	char path[PATH_MAX];			// file the sessions are kept in; empty if off
+	unsigned char key[FACE_TLS_KEY_SIZE];	// encrypts the file
+	TlsTicket tickets[FACE_TLS_CACHE_SIZE];	// latest session of each host
+	TlsCacheStats stats;
+	pthread_mutex_t lock;
+} TlsCache;
+
+typedef struct imageMap {
+	char path[PATH_MAX];			// path of the mapped image
+	dev_t dev;						// device of the mapped image
+	ino_t ino;						// inode of the mapped image
+	time_t mtime;					// modification time of the image when mapped
+	void * data;					// start of the mapping; NULL if the slot is empty
+	size_t size;					// size of the image
+	int refs;						// number of requests using the mapping
+	int cached;						// 0 if the mapping is not kept in image_cache
+	unsigned long used;				// last use of the mapping, for eviction
+} ImageMap;
+
+typedef struct shardState {
+	int large;						// 1 to call LargePersonGroup endpoints; read without the lock
+	char prefix[FACE_SHARD_PREFIX_SIZE];	// shards are named after it; empty if not sharded
+	int count;						// shards
+	ShardStats stats;
+	pthread_mutex_t lock;
+} ShardState;
+
+struct faceFuture {
+	FaceClient * client;			// client the task was submitted to
+	FaceTaskFunc func;				// the task
+	void * arg;						// argument of func
+	void * result;					// what func returned
+	int state;						// FACE_TASK_PENDING, _RUNNING or _DONE
+	struct faceFuture * next;		// next task in line, or next future waiting for a train
+	unsigned long ticket;			// train futures: changes the train has to cover
+};
+
+typedef struct trainEntry {
+	char pgid[FACE_PGID_SIZE];		// persongroupId; empty if the entry is free
+	int dirty;						// 1 if changed since the last train was sent
+	long long due;					// when a dirty group is trained, in monotonic ms
+	int training;					// 1 from sending a train until it finishes
+	long long poll;					// when the training status is asked next, in monotonic ms
+	unsigned long marks;			// changes marked so far
+	unsigned long sent;				// changes the train in progress covers
+	unsigned long trained;			// changes covered by trains that succeeded
+	long status;					// result of the last train that finished
+	FaceFuture * waiters;			// futures waiting for a train
+} TrainEntry;
+
+typedef struct trainScheduler {
+	TrainEntry entries[FACE_TRAIN_GROUPS];	// persongroups scheduled
+	long quiet_ms;					// time without changes before a train
+	long poll_ms;					// time between training status polls
+	TrainStats stats;
+	int running;					// 1 while the scheduler thread runs
+	int stopping;					// 1 once the client is being freed
+	pthread_t thread;				// sends trains and polls them
+	pthread_mutex_t lock;
+	pthread_cond_t cond;			// wakes the scheduler thread
+} TrainScheduler;
+
+struct faceClient {
+	char region[BUFSIZ];			// region given to face_client_login
+	char key[BUFSIZ];				// subscription key given to face_client_login
+	int login;						// 1 once logged in
+
+	RetryState retry;
+	RateState rate;
+	LimitState limit;
+	HedgeState hedge;
+	TransferState transfer;
+	CoalesceState coalesce;
+	FlightState flight;
+	PgCache pgcache;
+	RosterMirror roster;
+	ShardState shard;
+	TrainScheduler train;
+	BreakerTable breaker;
+	BackendPool backend;
+	PrewarmState prewarm;
+	TlsCache tls;
+
+	FaceBody * body_pool[FACE_BODY_POOL_SIZE];	// reusable request bodies
+	int body_pool_size;				// number of bodies in body_pool
+	pthread_mutex_t body_pool_lock;
+
+	ImageMap image_cache[FACE_IMAGE_CACHE_SIZE];	// recycled image mappings
+	unsigned long image_clock;		// stamps ImageMap.used
+	pthread_mutex_t image_cache_lock;
+
+	CURLSH * share;					// dns cache, connections and tls sessions
+	pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];	// one per kind of shared data
+
+	FaceFuture * tasks;				// submitted tasks not started yet
+	FaceFuture * tasks_tail;		// last of tasks
+	pthread_t * workers;			// threads running tasks; started on first submit
+	int worker_count;				// threads to start
+	int workers_started;			// threads running
+	int stopping;					// 1 once the workers are told to finish
+	pthread_mutex_t task_lock;
+	pthread_cond_t task_cond;		// signaled when a task is queued or done
+
+	Queue * request_queue;			// demo requests, see face_init
+	Queue * response_queue;			// demo responses, see getResponse
+	sem_t request_counter;			// demo requests waiting
+	pthread_t request_thread;		// thread running demo requests
+	int demo;						// 1 while the demo thread runs
+};
+
+/* faceapi.c */
+long face_perform(FaceCall * call, struct json_object ** resp);
+void face_sleep_ms(long ms);
+void setUriBase(CURLU * curlu, const char * rg, const char * base);
+int statusOk(long status);
+void face_client_demo_stop(FaceClient * client);
+
+/* faceapi_client.c */
+FaceClient * face_client_current();
+
+/* faceapi_retry.c */
+void face_retry_init(RetryState * state);
+void face_retry_destroy(RetryState * state);
+void face_retry_begin(RetryState * state);
+int face_retry_should(RetryState * state, const FaceCall * call, const RetryPolicy * policy,
+	int attempt, long status, CURLcode res, long retry_after, long * delay);
+long face_retry_after_parse(const char * value);
+
+/* faceapi_ratelimit.c */
+void face_rate_init(RateState * state);
+void face_rate_destroy(RateState * state);
+double face_rate_acquire(RateState * state, const char * key);
+int face_rate_try(RateState * state, const char * key);
+int face_rate_configure(RateState * state, const char * key, double tps, double burst);
+
+/* faceapi_concurrency.c */
+void face_limit_init(LimitState * state);
+void face_limit_destroy(LimitState * state);
+void face_limit_acquire(LimitState * state);
+int face_limit_try(LimitState * state);
+void face_limit_release(LimitState * state, double latency, long status, CURLcode res);
+void face_limit_cancel(LimitState * state);
+
+/* faceapi_hedge.c */
+void face_hedge_init(HedgeState * state);
+void face_hedge_destroy(HedgeState * state);
+long face_hedge_delay(HedgeState * state, FaceEndpoint ep);
+void face_hedge_record(HedgeState * state, FaceEndpoint ep, double latency);
+int face_hedge_withdraw(HedgeState * state);
+void face_hedge_refund(HedgeState * state);
+void face_hedge_won(HedgeState * state);
+
+/* faceapi_transfer.c */
+void face_transfer_init(TransferState * state);
+void face_transfer_destroy(TransferState * state);
+int face_transfer_compress(TransferState * state);
+void face_transfer_record(TransferState * state, FaceEndpoint ep, size_t wire_bytes, size_t body_bytes);
+
+/* faceapi_pgcache.c */
+void face_pg_init(PgCache * cache);
+void face_pg_destroy(PgCache * cache);
+void face_pg_reset(PgCache * cache);
+void face_pg_record(PgCache * cache, const FaceCall * call, long status, struct json_object * resp);
+int face_pg_missing(struct json_object * resp);
+
+/* faceapi_roster.c */
+void face_roster_init(RosterMirror * mirror);
+void face_roster_destroy(RosterMirror * mirror);
+void face_roster_reset(RosterMirror * mirror);
+void face_roster_record(RosterMirror * mirror, const FaceCall * call, long status, struct json_object * resp);
+void face_roster_list_begin(RosterMirror * mirror, const char * pgid, int add, RosterList * list);
+void face_roster_list_person(RosterMirror * mirror, RosterList * list, struct json_object * person);
+void face_roster_list_end(RosterMirror * mirror, RosterList * list, int complete);
+
+/* faceapi_list.c */
+long face_list_run(const char * pgid, int top, int ranges, int stream, int add, FacePersonFunc func, void * data,
+	struct json_object ** error);
+
+/* faceapi_client.c */
+FaceFuture * face_future_new(FaceClient * client);
+void face_future_complete(FaceFuture * future, void * result);
+void face_client_fan(FaceClient * client, FaceTaskFunc func, void * items, size_t size, int count);
+
+/* faceapi_train.c */
+void face_train_init(TrainScheduler * scheduler);
+void face_train_destroy(TrainScheduler * scheduler);
+
+/* faceapi_shard.c */
+void face_shard_init(ShardState * state);
+void face_shard_destroy(ShardState * state);
+const char * face_pg_base();
+const char * face_pg_key();
+
+/* faceapi_search.c */
+RosterRecord * face_search_add(RosterMirror * mirror, RosterGroup * group, const unsigned char * uuid,
+	const char * name, const char * userData, int listing);
+void face_search_update(RosterMirror * mirror, RosterGroup * group, RosterRecord * record, const char * name,
+	const char * userData);
+void face_search_remove(RosterMirror * mirror, RosterGroup * group, RosterRecord * record);
+void face_search_sort(RosterMirror * mirror, RosterGroup * group);
+void face_search_clear(RosterMirror * mirror, RosterGroup * group);
+
+/* faceapi_flight.c */
+void face_flight_init(FlightState * state);
+void face_flight_destroy(FlightState * state);
+int face_flight_join(FlightState * state, const FaceCall * call, FaceFlight ** flight, long * status,
+	struct json_object ** resp);
+void face_flight_land(FlightState * state, FaceFlight * flight, long status, struct json_object * resp);
+
+/* faceapi_coalesce.c */
+void face_coalesce_init(CoalesceState * state);
+void face_coalesce_destroy(CoalesceState * state);
+
+/* faceapi_breaker.c */
+void face_breaker_init(BreakerTable * table);
+void face_breaker_destroy(BreakerTable * table);
+int face_breaker_allow(BreakerTable * table, FaceEndpoint ep, const char * region, FaceBreaker ** breaker);
+void face_breaker_record(BreakerTable * table, FaceBreaker * breaker, double latency, long status, CURLcode res);
+void face_breaker_cancel(BreakerTable * table, FaceBreaker * breaker);
+
+/* faceapi_backend.c */
+void face_backend_init(BackendPool * pool);
+void face_backend_destroy(BackendPool * pool);
+void face_backend_reset(BackendPool * pool);
+int face_backend_add(FaceClient * client, const char * rg, const char * ky, int weight, double tps);
+FaceBackend * face_backend_acquire(BackendPool * pool, FaceEndpoint ep, const char * pgid);
+void face_backend_release(BackendPool * pool, FaceBackend * backend, int failed, double latency);
+FaceBackend * face_backend_reroute(BackendPool * pool, FaceBackend * failed, const char * pgid);
+FaceBackend * face_backend_probe(BackendPool * pool, FaceBackend * missing, const char * pgid, unsigned int * tried);
+
+/* faceapi_prewarm.c */
+void face_prewarm_init(PrewarmState * state);
+void face_prewarm_destroy(PrewarmState * state);
+
+/* faceapi_tlscache.c */
+void face_tls_init(TlsCache * cache);
+void face_tls_destroy(TlsCache * cache);
+void face_tls_apply(FaceClient * client, CURL * curl);
+
+#endif /* FACEAPI_INTERNAL_H */
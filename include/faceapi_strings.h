@@ -2,30 +2,41 @@
 #define FACEAPI_STRINGS_H
 
 // request type constants
+#define FACE_GET "GET"
+#define FACE_POST "POST"
+#define FACE_PUT "PUT"
 #define FACE_DELETE "DELETE"
 #define FACE_PATCH "PATCH"
 
 // face api request constants
 #define FACE_JSON "Content-Type: application/json"
 #define FACE_OCTET "Content-Type: application/octet-stream"
+#define FACE_CHUNKED "Transfer-Encoding: chunked"
+#define FACE_NO_EXPECT "Expect:"
 #define FACE_KEYTYPE "Ocp-Apim-Subscription-Key: "
+#define FACE_RETRY_AFTER "Retry-After:"
 
 // URLs
 #define FACE_HTTPS "https://"
+#define FACE_SCHEME_SEP "://"
+#define FACE_HOST ".api.cognitive.microsoft.com"
 #define FACE_DETECT_URL ".api.cognitive.microsoft.com/face/v1.0/detect"
 #define FACE_IDENTIFY_URL ".api.cognitive.microsoft.com/face/v1.0/identify"
 #define FACE_VERIFY_URL ".api.cognitive.microsoft.com/face/v1.0/verify"
 #define FACE_PG_URL ".api.cognitive.microsoft.com/face/v1.0/persongroups/"
+#define FACE_LPG_URL ".api.cognitive.microsoft.com/face/v1.0/largepersongroups/"
 
 // URL parts
 #define FACE_SLASH "/"
 #define FACE_URLPART_P "persons"
 #define FACE_URLPART_FACE "persistedFaces"
 #define FACE_URLPART_TRAIN "train"
+#define FACE_URLPART_TRAINING "training"
 #define FACE_URLPART_GET_PG_PARAM "returnRecognitionModel=true"
 
 // error strings
 #define FACE_LOGIN_ERROR "Error: need to call face_login to initialize region and key\n"
+#define FACE_PIN_ERROR "Error: can't pin %s; all %d pins were set with face_pin_pg\n"
 
 // default values
 #define FACE_DEFAULT_REGION "westcentralus"
@@ -37,13 +48,50 @@
 #define FACE_WRITE_DATA "We've written %lu bytes\n"
 #define FACE_REQUEST_URL "Request URL: %s\n"
 #define FACE_HTTP_STATUS "Status Code: %ld\n"
+#define FACE_RETRY "Retrying attempt %d in %ld ms\n"
+#define FACE_RATE_WAIT "Rate limited for %lf ms\n"
+#define FACE_HEDGE "Hedging after %ld ms\n"
+#define FACE_BREAKER_OPENED "Breaker of %s endpoint %d open for %ld ms\n"
+#define FACE_BREAKER_REJECTED "Breaker open; failing fast\n"
+#define FACE_PREWARM "Prewarmed %d of %d connections to %s in %.1f ms\n"
+#define FACE_COALESCE_SEND "Identifying %d faceIds for %d callers\n"
+#define FACE_ROSTER_SYNC "Roster of %s: %lu added, %lu renamed, %lu removed\n"
+#define FACE_SHARD_FAILED "Shard %s failed with %ld\n"
+#define FACE_TRAIN_SEND "Training %s after %lu changes\n"
+#define FACE_TRAIN_DONE "Training of %s finished with %ld\n"
+#define FACE_REGISTER_FAILED "Registering face %d failed with %ld\n"
+#define FACE_REGISTER_ROLLBACK "Deleting person %s of face %d\n"
+#define FACE_TLS_OFFER "Offering saved tls session to %s\n"
+#define FACE_ROUTE_SWITCH "Routing stateless calls to %s (%lf ms)\n"
+#define FACE_PIN_EVICTED "Unpinning %s to make room\n"
+#define FACE_PIN_MOVED "Persongroup %s not found in %s; trying %s\n"
+#define FACE_REROUTE "Retrying on %s\n"
 
 // Face API json response keys
 #define FACE_PGID "personGroupId"
+#define FACE_LPGID "largePersonGroupId"
 #define FACE_PID "personId"
 #define FACE_FID "faceId"
 #define FACE_FIDS "faceIds"			// used by identify
+#define FACE_CANDIDATES "candidates"	// used by identify
+#define FACE_TARGET_FACE "targetFace"	// used by add face
+#define FACE_TARGET_RECT "%d,%d,%d,%d"	// left,top,width,height of a target face
+#define FACE_CONFIDENCE "confidence"	// used by identify
+#define FACE_ERROR "error"				// error responses
+#define FACE_ERROR_CODE "code"			// used by error responses
+#define FACE_PG_NOT_FOUND "PersonGroupNotFound"	// error code ending of a missing group
 #define FACE_RECT "faceRectangle"
+#define FACE_PFIDS "persistedFaceIds"	// used by person get and list
+#define FACE_STATUS "status"			// used by training status
+#define FACE_TRAIN_SUCCEEDED "succeeded"	// training status of a finished train
+#define FACE_TRAIN_FAILURE "failed"		// training status of a failed train
+
+// Face API json request keys
+#define FACE_NAME "name"
+#define FACE_USERDATA "userData"
+#define FACE_RECOGNITION_MODEL "recognitionModel"
+#define FACE_MAXCANDIDATES "maxNumOfCandidatesReturned"
+#define FACE_THRESHOLD "confidenceThreshold"
 
 // demo string
 #define FACE_DEMO_PRINT_FACE "Face information:\n%s\n"
@@ -57,4 +105,133 @@
 #define FACE_QUEUE_CAPACITY 10
 #define FACE_RQSTTYPE_END ';'
 
+// request body constants
+#define FACE_BODY_INIT_SIZE 256			// first allocation of a FaceBody
+#define FACE_BODY_POOL_SIZE 8			// bodies kept for reuse
+#define FACE_BODY_POOL_MAXSIZE 65536	// larger bodies are freed on release
+
+// memory mapped upload constants
+#define FACE_IMAGE_CACHE_SIZE 4			// image mappings kept for reuse
+
+// retry constants
+#define FACE_RETRY_ATTEMPTS 4			// attempts including the first
+#define FACE_RETRY_BASE_DELAY 100		// ms before the first retry
+#define FACE_RETRY_MAX_DELAY 2000		// cap of the exponential backoff in ms
+#define FACE_RETRY_MAX_AFTER 30000		// longest Retry-After waited for in ms
+#define FACE_RETRY_TIMEOUT 30000		// longest an attempt may take in ms
+#define FACE_RETRY_CONNECT_TIMEOUT 5000	// longest a connection may take to open in ms
+#define FACE_RETRY_BUDGET_RATIO 0.1		// retries earned per request
+#define FACE_RETRY_BUDGET_MIN_RATE 1.0	// retries earned per second
+#define FACE_RETRY_BUDGET_MAX 10.0		// most retries saved up
+
+// rate limit constants
+#define FACE_RATE_MAX_KEYS 16			// subscription keys with their own bucket
+
+// adaptive concurrency constants
+#define FACE_LIMIT_WINDOW 50			// requests measured before the limit moves
+#define FACE_LIMIT_TARGET_P90 1000.0	// default p90 latency target in ms
+#define FACE_LIMIT_TARGET_429 0.02		// default share of 429s allowed
+#define FACE_LIMIT_BACKOFF 0.9			// default cut of the limit on a breach
+
+// hedging constants
+#define FACE_HEDGE_WINDOW 200			// latencies kept per endpoint for the p95
+#define FACE_HEDGE_MIN_SAMPLES 20		// latencies needed before hedging
+#define FACE_HEDGE_MIN_DELAY 5			// shortest wait before hedging in ms
+#define FACE_HEDGE_POLL 100				// longest wait for socket activity in ms
+#define FACE_HEDGE_BUDGET_RATIO 0.1	// hedges earned per request
+#define FACE_HEDGE_BUDGET_MAX 10.0		// most hedges saved up
+
+// circuit breaker constants
+#define FACE_BREAKER_MAX 64				// endpoint and region pairs with a breaker
+#define FACE_BREAKER_MAX_WINDOW 100		// largest window of a breaker
+#define FACE_BREAKER_WINDOW 20			// default requests in the window
+#define FACE_BREAKER_MIN_REQUESTS 10	// default requests before opening
+#define FACE_BREAKER_FAILURE_RATE 0.5	// default share of failures that opens
+#define FACE_BREAKER_SLOW 10000.0		// default ms counted as a failure
+#define FACE_BREAKER_OPEN_TIME 5000		// default ms open before probing
+#define FACE_BREAKER_MAX_OPEN_TIME 60000	// default cap of the open time in ms
+#define FACE_BREAKER_PROBES 5			// default successful probes to close
+
+// backend constants
+#define FACE_BACKEND_MAX 16				// subscriptions requests are spread over
+#define FACE_BACKEND_MAX_FAILURES 5		// failures in a row before a backend is left out
+#define FACE_BACKEND_COOLDOWN 10		// seconds a failing backend is left out
+#define FACE_PIN_MAX 256				// persongroups pinned to a backend
+#define FACE_PGID_SIZE 128				// longest persongroupId plus one
+
+// latency routing constants
+#define FACE_ROUTE_ALPHA 0.2			// weight of the newest sample in the averages
+#define FACE_ROUTE_EXPLORE 5			// percent of stateless calls sent elsewhere
+#define FACE_ROUTE_MAX_ERRORS 0.25		// error rate above which a backend is avoided
+
+// client constants
+#define FACE_CLIENT_WORKERS 16			// default threads running submitted tasks and fan-outs
+#define FACE_CLIENT_MAX_WORKERS 64		// most threads running submitted tasks
+#define FACE_TASK_PENDING 0				// task waiting for a worker
+#define FACE_TASK_RUNNING 1				// task being run
+#define FACE_TASK_DONE 2				// task finished; result is set
+
+// coalescing constants
+#define FACE_IDENTIFY_MAX_FIDS 10		// most faceIds Face Identify takes at once
+#define FACE_FID_SIZE 64				// longest faceId plus one
+#define FACE_COALESCE_WINDOW 5			// default ms an identify waits for others to join
+
+// persongroup state constants
+#define FACE_PG_CACHE_MAX 256			// persongroups whose state is kept
+
+// roster mirror constants
+#define FACE_ROSTER_GROUPS 16			// persongroups mirrored
+#define FACE_ROSTER_MIN_SLOTS 64		// slots of a new roster table
+#define FACE_UUID_SIZE 16				// personId in binary
+#define FACE_SLOT_EMPTY 0				// slot never used
+#define FACE_SLOT_USED 1				// slot holds a person
+#define FACE_SLOT_DELETED 2				// slot held a person that was removed
+
+// person search constants
+#define FACE_SEARCH_NAME 0				// index of the name field
+#define FACE_SEARCH_USERDATA 1			// index of the userData field
+#define FACE_SEARCH_FIELDS 2			// fields indexed
+#define FACE_SEARCH_MIN_ENTRIES 64		// first allocation of an index
+
+// person list constants
+#define FACE_LIST_TOP 1000				// most persons the service lists per page
+#define FACE_LIST_RANGES 4				// personId ranges face_list_p lists at once
+#define FACE_LIST_MAX_RANGES 16			// most personId ranges listed at once
+#define FACE_LIST_QUERY "top=%d"		// query of the first page of a range
+#define FACE_LIST_QUERY_START "start=%s&top=%d"	// query of a later page
+#define FACE_LIST_BOUND "%08x-0000-0000-0000-000000000000"	// first personId of a range
+#define FACE_PID_SIZE 64				// longest personId plus one
+#define FACE_STREAM_UNKNOWN 0			// response body not started
+#define FACE_STREAM_ARRAY 1				// array body split into its elements
+#define FACE_STREAM_WHOLE 2				// other body parsed whole
+
+// training scheduler constants
+#define FACE_TRAIN_GROUPS 64			// persongroups scheduled at once
+#define FACE_TRAIN_QUIET 1000			// default ms without changes before a train
+#define FACE_TRAIN_POLL 1000			// default ms between training status polls
+
+// sharding constants
+#define FACE_SHARD_MAX 64				// most persongroups persons are spread over
+#define FACE_SHARD_PGID "%s-%d"			// persongroupId of a shard: prefix and number
+#define FACE_SHARD_PREFIX_SIZE (FACE_PGID_SIZE - 12)	// longest prefix plus one; room for "-<n>"
+#define FACE_SHARD_DEFAULT_CANDIDATES 1	// maxNumOfCandidatesReturned when not given
+
+// prewarm constants
+#define FACE_PREWARM_CONNECTIONS 2		// default connections opened per backend
+#define FACE_PREWARM_MAX 16				// most connections opened per backend
+#define FACE_PREWARM_REFRESH 45000		// default ms between refreshes; under the
+										// 60 s dns cache and 118 s connection age
+#define FACE_PREWARM_TIMEOUT 5000		// longest a connection may take to open in ms
+#define FACE_PREWARM_POLL 100			// longest wait for socket activity in ms
+
+// tls session cache constants
+#define FACE_TLS_MAGIC "FACETLS1"		// starts the cache file
+#define FACE_TLS_MAGIC_SIZE 8			// length of FACE_TLS_MAGIC
+#define FACE_TLS_KEY_SIZE 32			// aes-256 key read from the key file
+#define FACE_TLS_NONCE_SIZE 12			// gcm nonce written after the magic
+#define FACE_TLS_TAG_SIZE 16			// gcm tag ending the cache file
+#define FACE_TLS_CACHE_SIZE 16			// most hosts with a saved session
+#define FACE_TLS_PEER_SIZE 320			// longest "host:port" a session is saved for
+#define FACE_TLS_SESSION_MAX 8192		// largest encoded session saved
+
 #endif /* _FACEAPI_STRINGS_H */
@@ -1,6 +1,7 @@
 #include <cstdio>
 #include <opencv2/opencv.hpp>
 #include "include/faceapi.h"
+#include "include/faceapi_strings.h"
 using namespace cv;
 
 
@@ -9,6 +10,9 @@ using namespace cv;
 #define SERVER "westcentralus"
 #define FACEAPI_KEY "85607bdb3b22476a913a2834d22cd3b5"
 #define IMAGE_NAME_SIZE 64
+#define TLS_CACHE "innofaceguard.tls"
+#define TLS_CACHE_KEY "innofaceguard.key"
+#define ROSTER_REFRESH 60000
 
 
 
@@ -26,6 +30,26 @@ int main(){
 	char filename [IMAGE_NAME_SIZE];
 	Response * resp = NULL;
 
+	// one client for the whole run; its connections stay open between frames
+	FaceClient * client = face_client_new(0);
+	if(client != NULL)
+	{
+		// restarts resume the tls sessions of the last run
+		face_client_tls_cache(client, TLS_CACHE, TLS_CACHE_KEY);
+	}
+	if(client == NULL || face_client_login(client, SERVER, FACEAPI_KEY) != EXIT_SUCCESS)
+	{
+		printf("face_login failed.\n");
+		return -1;
+	}
+	face_client_bind(client);
+	face_client_prewarm(client, 0, 0);
+
+	// identified persons are named from the mirror, never with a call
+	face_mirror_roster((char *)FACE_DEMO_PGID);
+	face_set_roster_refresh(ROSTER_REFRESH);
+	face_init();
+
 	while(!bIsStop){
 		video >> videoFrame;
 		if(videoFrame.empty()){
@@ -33,14 +57,6 @@ int main(){
 		}
 		imshow("video demo", videoFrame);
 
-		face_init();
-
-		if(face_login(SERVER, FACEAPI_KEY) != EXIT_SUCCESS)
-		{
-			printf("face_login failed.\n");
-			break;
-		}
-
 		switch(waitKey(33)){
 			// Key "D" or "d" triggers detection
 			case 'd':
@@ -183,6 +199,9 @@ int main(){
 
 							// null check the identification result
 							if (!(arr + i)->pid || !(arr + i)->confidence) sprintf(info, "No result");
+							else if ((arr + i)->name[0]) {
+								snprintf(info, sizeof(info), "%s,%.2lf", (arr + i)->name, (arr + i)->confidence);
+							}
 							else {
 								// extract face information
 								snprintf(pid_char, 6, "%s", (arr + i)->pid + strlen((arr + i)->pid) - 5);
@@ -200,5 +219,6 @@ int main(){
 			}
 		}
 	}
+	face_client_free(client);
 	return 0;
 }
@@ -0,0 +1,526 @@
+/*
+ * File Name: faceenroll.c
+ * File Description: Enrolls a directory tree shaped like root/<person>/<n>.jpg
+ *                   into a persongroup: every directory becomes a person
+ *                   named after it, and every image in it a face of that
+ *                   person. Persons are enrolled by several threads at once
+ *                   under the client's rate limit, and the group is trained
+ *                   once at the end. Every person created and face added is
+ *                   written to a journal first thing, so a run that is
+ *                   interrupted picks up where it stopped when started
+ *                   again with the same journal, without creating anyone
+ *                   twice.
+ *
+ * Usage: faceenroll -k key [-u region] [-g pgid] [-c threads] [-r tps]
+ *                   [-j journal] [-l] root
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define ENROLL_DEFAULT_REGION "westus"
+#define ENROLL_DEFAULT_PGID "enrolled"
+#define ENROLL_DEFAULT_THREADS 4
+#define ENROLL_DEFAULT_TPS 10
+#define ENROLL_DEFAULT_JOURNAL "faceenroll.journal"
+#define ENROLL_MAX_THREADS 64
+#define ENROLL_NAME_SIZE 129			// longest person name the service takes plus one
+#define ENROLL_PID_SIZE 64
+#define ENROLL_TAG_PREFIX "faceenroll:"	// userData of an enrolled person, before its name
+#define ENROLL_TAG ENROLL_TAG_PREFIX "%s"
+#define ENROLL_STATUSES 16				// distinct failure statuses reported
+
+// journal lines; a C line is written before a person is created and a P
+// line once it is, so a C without its P is a create that may have happened
+#define ENROLL_JOURNAL_CREATE "C\t%s\n"
+#define ENROLL_JOURNAL_PERSON "P\t%s\t%s\n"
+#define ENROLL_JOURNAL_FACE "F\t%s\t%s\n"
+
+typedef struct enrollPerson {
+	char name[ENROLL_NAME_SIZE];		// directory name and person name
+	char pid[ENROLL_PID_SIZE];			// personId; empty until created
+	int pending;						// 1 if a create may have happened without its personId
+	char ** files;						// image file names, sorted
+	unsigned char * done;				// 1 for each file already added
+	int nfiles;
+} EnrollPerson;
+
+typedef struct enrollStatus {
+	long status;						// http status; 0 for network errors
+	unsigned long count;				// calls that failed with it
+} EnrollStatus;
+
+typedef struct enrollRun {
+	const char * root;					// directory enrolled
+	char * pgid;						// persongroup enrolled into
+	EnrollPerson * persons;				// one per directory, sorted by name
+	int npersons;
+	int next;							// next person to enroll
+	FILE * journal;						// appended to as persons and faces are done
+	unsigned long created;				// persons created by this run
+	unsigned long added;				// faces added by this run
+	unsigned long skipped;				// faces the journal said were done
+	unsigned long failed;				// calls that failed
+	EnrollStatus statuses[ENROLL_STATUSES];	// failures by status
+	pthread_mutex_t lock;
+} EnrollRun;
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int sig)
+{
+	(void)sig;
+	interrupted = 1;
+}
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int compare_string(const void * a, const void * b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int compare_person(const void * a, const void * b)
+{
+	return strcmp(((const EnrollPerson *)a)->name, ((const EnrollPerson *)b)->name);
+}
+
+static int is_image(const char * name)
+{
+	const char * ext = strrchr(name, '.');
+
+	return ext && (!strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg") || !strcasecmp(ext, ".png")
+		|| !strcasecmp(ext, ".bmp") || !strcasecmp(ext, ".gif"));
+}
+
+/* names are written to the journal between tabs and newlines */
+static int is_plain(const char * name)
+{
+	return !strpbrk(name, "\t\n\r");
+}
+
+static EnrollPerson * find_person(EnrollRun * run, const char * name)
+{
+	EnrollPerson key;
+
+	snprintf(key.name, sizeof(key.name), "%s", name);
+	return bsearch(&key, run->persons, run->npersons, sizeof(EnrollPerson), compare_person);
+}
+
+/* reads the images of a person's directory; 0 if there are none */
+static int scan_person(const char * root, EnrollPerson * person)
+{
+	char path[PATH_MAX];
+	struct dirent * entry;
+	struct stat st;
+	DIR * dir;
+	char ** grown;
+	int capacity = 0;
+
+	snprintf(path, sizeof(path), "%s/%s", root, person->name);
+	if (!(dir = opendir(path))) return 0;
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.' || !is_image(entry->d_name) || !is_plain(entry->d_name)) continue;
+
+		snprintf(path, sizeof(path), "%s/%s/%s", root, person->name, entry->d_name);
+		if (stat(path, &st) || !S_ISREG(st.st_mode)) continue;
+
+		if (person->nfiles == capacity) {
+			capacity = capacity ? capacity * 2 : 8;
+			if (!(grown = realloc(person->files, capacity * sizeof(char *)))) break;
+			person->files = grown;
+		}
+		person->files[person->nfiles++] = strdup(entry->d_name);
+	}
+	closedir(dir);
+
+	qsort(person->files, person->nfiles, sizeof(char *), compare_string);
+	person->done = calloc(person->nfiles ? person->nfiles : 1, 1);
+	return person->nfiles;
+}
+
+/* finds every person directory under root; -1 if root can't be read */
+static int scan_root(EnrollRun * run)
+{
+	struct dirent * entry;
+	struct stat st;
+	char path[PATH_MAX];
+	EnrollPerson * grown;
+	int capacity = 0;
+	DIR * dir;
+
+	if (!(dir = opendir(run->root))) {
+		fprintf(stderr, "%s: %s\n", run->root, strerror(errno));
+		return -1;
+	}
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.') continue;
+
+		snprintf(path, sizeof(path), "%s/%s", run->root, entry->d_name);
+		if (stat(path, &st) || !S_ISDIR(st.st_mode)) continue;
+
+		if (strlen(entry->d_name) >= ENROLL_NAME_SIZE || !is_plain(entry->d_name)) {
+			fprintf(stderr, "Skipping %s: name too long or not plain\n", entry->d_name);
+			continue;
+		}
+
+		if (run->npersons == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			if (!(grown = realloc(run->persons, capacity * sizeof(EnrollPerson)))) break;
+			run->persons = grown;
+		}
+		memset(&run->persons[run->npersons], 0, sizeof(EnrollPerson));
+		snprintf(run->persons[run->npersons].name, ENROLL_NAME_SIZE, "%s", entry->d_name);
+		if (scan_person(run->root, &run->persons[run->npersons])) {
+			run->npersons++;
+		}
+		else {
+			free(run->persons[run->npersons].files);
+			free(run->persons[run->npersons].done);
+		}
+	}
+	closedir(dir);
+
+	qsort(run->persons, run->npersons, sizeof(EnrollPerson), compare_person);
+	return 0;
+}
+
+/* applies what an earlier run wrote to the journal; returns the persons
+   whose create may have happened without its personId being written */
+static int replay_journal(EnrollRun * run, const char * path)
+{
+	char line[ENROLL_NAME_SIZE + PATH_MAX + 8];
+	EnrollPerson * person;
+	FILE * file = fopen(path, "r");
+	char ** found;
+	char * name;
+	char * value;
+	int pending = 0;
+	int i;
+
+	if (!file) return 0;
+
+	while (fgets(line, sizeof(line), file)) {
+		// a line cut short by the interruption is ignored
+		if (!strchr(line, '\n') || line[1] != '\t') continue;
+		line[strcspn(line, "\n")] = '\0';
+
+		name = line + 2;
+		value = strchr(name, '\t');
+		if (value) *value++ = '\0';
+		if (!(person = find_person(run, name))) continue;
+
+		if (line[0] == 'C' && !person->pid[0]) {
+			person->pending = 1;
+		}
+		else if (line[0] == 'P' && value) {
+			snprintf(person->pid, sizeof(person->pid), "%s", value);
+			person->pending = 0;
+		}
+		else if (line[0] == 'F' && value) {
+			found = bsearch(&value, person->files, person->nfiles, sizeof(char *), compare_string);
+			if (found) person->done[found - person->files] = 1;
+		}
+	}
+	fclose(file);
+
+	for (i = 0; i < run->npersons; ++i) {
+		pending += run->persons[i].pending;
+	}
+	return pending;
+}
+
+static void journal(EnrollRun * run, const char * format, const char * name, const char * value)
+{
+	pthread_mutex_lock(&run->lock);
+	fprintf(run->journal, format, name, value);
+	fflush(run->journal);
+	pthread_mutex_unlock(&run->lock);
+}
+
+/* takes over a person of the group an interrupted create made */
+static int adopt_person(struct json_object * person, void * data)
+{
+	EnrollRun * run = data;
+	EnrollPerson * found;
+	struct json_object * value;
+	const char * userData;
+	const char * pid;
+
+	if (!json_object_object_get_ex(person, "userData", &value) || !(userData = json_object_get_string(value))
+		|| strncmp(userData, ENROLL_TAG_PREFIX, strlen(ENROLL_TAG_PREFIX))) {
+		return 0;
+	}
+	if (!json_object_object_get_ex(person, "personId", &value) || !(pid = json_object_get_string(value))) {
+		return 0;
+	}
+
+	found = find_person(run, userData + strlen(ENROLL_TAG_PREFIX));
+	if (found && found->pending && !found->pid[0]) {
+		snprintf(found->pid, sizeof(found->pid), "%s", pid);
+		found->pending = 0;
+		fprintf(run->journal, ENROLL_JOURNAL_PERSON, found->name, found->pid);
+		fflush(run->journal);
+	}
+	return 0;
+}
+
+static void count_failure(EnrollRun * run, long status)
+{
+	int i;
+
+	pthread_mutex_lock(&run->lock);
+	run->failed++;
+	for (i = 0; i < ENROLL_STATUSES; ++i) {
+		if (run->statuses[i].count && run->statuses[i].status != status) continue;
+		run->statuses[i].status = status;
+		run->statuses[i].count++;
+		break;
+	}
+	pthread_mutex_unlock(&run->lock);
+}
+
+/* creates a person unless it was, then adds the faces not added yet */
+static void enroll_person(EnrollRun * run, EnrollPerson * person, FaceBody * body)
+{
+	struct json_object * resp;
+	struct json_object * pid;
+	char path[PATH_MAX];
+	char tag[ENROLL_NAME_SIZE + 16];
+	unsigned long skipped = 0;
+	long status;
+	int i;
+
+	if (!person->pid[0]) {
+		snprintf(tag, sizeof(tag), ENROLL_TAG, person->name);
+		face_body_create_p(body, person->name, tag);
+
+		journal(run, ENROLL_JOURNAL_CREATE, person->name, NULL);
+		status = face_create_p_body(run->pgid, body, &resp);
+		if (status != 200 || !json_object_object_get_ex(resp, "personId", &pid)) {
+			fprintf(stderr, "Creating %s failed with %ld\n", person->name, status);
+			count_failure(run, status);
+			json_object_put(resp);
+			return;
+		}
+		snprintf(person->pid, sizeof(person->pid), "%s", json_object_get_string(pid));
+		json_object_put(resp);
+
+		journal(run, ENROLL_JOURNAL_PERSON, person->name, person->pid);
+		pthread_mutex_lock(&run->lock);
+		run->created++;
+		pthread_mutex_unlock(&run->lock);
+	}
+
+	for (i = 0; i < person->nfiles && !interrupted; ++i) {
+		if (person->done[i]) {
+			skipped++;
+			continue;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s/%s", run->root, person->name, person->files[i]);
+		status = face_add_face_path(path, run->pgid, person->pid, NULL, &resp);
+		json_object_put(resp);
+		if (status != 200) {
+			fprintf(stderr, "Adding %s failed with %ld\n", path, status);
+			count_failure(run, status);
+			continue;
+		}
+
+		person->done[i] = 1;
+		journal(run, ENROLL_JOURNAL_FACE, person->name, person->files[i]);
+		pthread_mutex_lock(&run->lock);
+		run->added++;
+		pthread_mutex_unlock(&run->lock);
+	}
+
+	pthread_mutex_lock(&run->lock);
+	run->skipped += skipped;
+	pthread_mutex_unlock(&run->lock);
+}
+
+static void * enroll_run(void * arg)
+{
+	EnrollRun * run = arg;
+	FaceBody * body = face_body_acquire();
+	int i;
+
+	if (!body) return NULL;
+
+	while (!interrupted) {
+		pthread_mutex_lock(&run->lock);
+		i = run->next < run->npersons ? run->next++ : -1;
+		pthread_mutex_unlock(&run->lock);
+		if (i < 0) break;
+
+		enroll_person(run, &run->persons[i], body);
+	}
+
+	face_body_release(body);
+	return NULL;
+}
+
+static void usage(const char * name)
+{
+	fprintf(stderr, "Usage: %s -k key [-u region] [-g pgid] [-c threads] [-r tps] [-j journal] [-l] root\n", name);
+}
+
+int main(int argc, char * argv[]) {
+	EnrollRun run = { .pgid = ENROLL_DEFAULT_PGID };
+	FaceFuture * workers[ENROLL_MAX_THREADS] = {0};
+	FaceClient * client;
+	char * region = ENROLL_DEFAULT_REGION;
+	char * key = NULL;
+	char * journal_path = ENROLL_DEFAULT_JOURNAL;
+	int nthreads = ENROLL_DEFAULT_THREADS;
+	double tps = ENROLL_DEFAULT_TPS;
+	int large = 0;
+	struct json_object * resp;
+	FaceBody * body;
+	RetryStats retry;
+	HedgeStats hedge;
+	double start;
+	double elapsed;
+	long status = 0;
+	int faces = 0;
+	int pending;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "k:u:g:c:r:j:l")) != -1) {
+		switch (opt) {
+			case 'k': key = optarg; break;
+			case 'u': region = optarg; break;
+			case 'g': run.pgid = optarg; break;
+			case 'c': nthreads = atoi(optarg); break;
+			case 'r': tps = atof(optarg); break;
+			case 'j': journal_path = optarg; break;
+			case 'l': large = 1; break;
+			default: usage(argv[0]); return EXIT_FAILURE;
+		}
+	}
+	if (!key || optind != argc - 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (nthreads < 1) nthreads = 1;
+	if (nthreads > ENROLL_MAX_THREADS) nthreads = ENROLL_MAX_THREADS;
+	run.root = argv[optind];
+
+	if (scan_root(&run)) return EXIT_FAILURE;
+	for (i = 0; i < run.npersons; ++i) {
+		faces += run.persons[i].nfiles;
+	}
+	pending = replay_journal(&run, journal_path);
+
+	if (!(run.journal = fopen(journal_path, "a+"))) {
+		fprintf(stderr, "%s: %s\n", journal_path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	// a line cut short by the interruption is ended so the next one isn't
+	// read as part of it
+	if (!fseek(run.journal, -1, SEEK_END) && fgetc(run.journal) != '\n') {
+		fputc('\n', run.journal);
+		fflush(run.journal);
+	}
+	pthread_mutex_init(&run.lock, NULL);
+
+	// every enrolling thread is a worker of the client
+	client = face_client_new(nthreads);
+	if (!client || face_client_login(client, region, key)) {
+		return EXIT_FAILURE;
+	}
+	face_client_bind(client);
+	face_set_large_groups(large);
+	if (tps > 0) {
+		face_set_rate_limit(tps, tps);
+	}
+
+	body = face_body_acquire();
+	face_body_create_pg(body, run.pgid, NULL, NULL);
+	status = face_ensure_pg(run.pgid, body, &resp);
+	json_object_put(resp);
+	face_body_release(body);
+	if (status != 200 && status != 409) {
+		fprintf(stderr, "Creating persongroup %s failed with %ld\n", run.pgid, status);
+		return EXIT_FAILURE;
+	}
+
+	// creates that were cut short before their personId was written are
+	// found by the tag they left in the group
+	if (pending) {
+		printf("Looking for %d persons created by an interrupted run\n", pending);
+		status = face_list_p_each(run.pgid, 0, 0, adopt_person, &run);
+		if (status != 200) {
+			fprintf(stderr, "Listing %s failed with %ld\n", run.pgid, status);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("Enrolling %d persons with %d faces from %s into %s\n", run.npersons, faces, run.root, run.pgid);
+
+	signal(SIGINT, on_interrupt);
+	signal(SIGTERM, on_interrupt);
+	start = now_ms();
+
+	// the calling thread enrolls too
+	for (i = 1; i < nthreads; ++i) {
+		workers[i] = face_client_submit(client, enroll_run, &run);
+	}
+	enroll_run(&run);
+	for (i = 1; i < nthreads; ++i) {
+		face_future_wait(workers[i]);
+	}
+	elapsed = now_ms() - start;
+	face_image_cache_flush();
+
+	if (!interrupted) {
+		face_set_train_quiet(0);
+		face_schedule_train(run.pgid);
+		status = (long)(intptr_t)face_future_wait(face_train_future(run.pgid));
+		if (status != 200) {
+			count_failure(&run, status);
+		}
+	}
+
+	face_get_retry_stats(&retry);
+	face_get_hedge_stats(&hedge);
+
+	printf("\n%s after %.1f s\n", interrupted ? "Interrupted; run again to resume" : "Done", elapsed / 1e3);
+	printf("%lu persons created, %lu faces added (%.1f faces/s), %lu already done\n", run.created, run.added,
+		elapsed > 0 ? run.added * 1e3 / elapsed : 0, run.skipped);
+	if (!interrupted) {
+		printf("Training %s: %ld\n", run.pgid, status);
+	}
+	printf("%lu calls failed\n", run.failed);
+	for (i = 0; i < ENROLL_STATUSES && run.statuses[i].count; ++i) {
+		printf("\t%ld: %lu\n", run.statuses[i].status, run.statuses[i].count);
+	}
+	printf("%lu billable transactions (%lu requests, %lu retries, %lu hedges)\n",
+		retry.requests + retry.retries + hedge.hedged, retry.requests, retry.retries, hedge.hedged);
+
+	fclose(run.journal);
+	pthread_mutex_destroy(&run.lock);
+	for (i = 0; i < run.npersons; ++i) {
+		while (run.persons[i].nfiles--) free(run.persons[i].files[run.persons[i].nfiles]);
+		free(run.persons[i].files);
+		free(run.persons[i].done);
+	}
+	free(run.persons);
+
+	return interrupted || run.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
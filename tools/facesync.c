@@ -0,0 +1,603 @@
+/*
+ * File Name: facesync.c
+ * File Description: Brings a persongroup in line with a roster file. The
+ *                   group is listed and compared with the roster, and only
+ *                   what differs is changed: persons missing from the group
+ *                   are created with their faces, faces and persons missing
+ *                   from the roster are deleted, and new images are added.
+ *                   The changes are made by several threads at once under
+ *                   the client's rate limit, and the group is trained once
+ *                   at the end. -n prints the changes without making them.
+ *
+ *                   The roster has a line per person: its name, then its
+ *                   faces, all separated by tabs. A face is the
+ *                   persistedFaceId of a face the person has and keeps, or
+ *                   the path of an image to add. Lines starting with # are
+ *                   comments. Persons are matched by name; when the group
+ *                   has several of one name, the others are deleted.
+ *
+ * Usage: facesync -k key -g pgid [-u region] [-c threads] [-r tps] [-l] [-n]
+ *                 roster
+ */
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include "faceapi.h"
+
+#define SYNC_DEFAULT_REGION "westus"
+#define SYNC_DEFAULT_THREADS 4
+#define SYNC_DEFAULT_TPS 10
+#define SYNC_MAX_THREADS 64
+#define SYNC_NAME_SIZE 129				// longest person name the service takes plus one
+#define SYNC_PID_SIZE 64
+#define SYNC_LINE_SIZE 65536
+#define SYNC_STATUSES 16				// distinct failure statuses reported
+#define SYNC_PROGRESS_MS 1000			// time between progress lines
+
+typedef struct syncPerson {
+	char name[SYNC_NAME_SIZE];
+	char pid[SYNC_PID_SIZE];			// personId; empty for a person of the roster
+	char ** faces;						// persistedFaceIds, and image paths for the roster
+	int nfaces;
+	int capacity;
+} SyncPerson;
+
+typedef struct syncTask {
+	SyncPerson * want;					// the person in the roster; NULL to delete it
+	SyncPerson * have;					// the person in the group; NULL to create it
+	char ** add;						// image paths to add
+	int nadd;
+	char ** remove;						// persistedFaceIds to delete
+	int nremove;
+} SyncTask;
+
+typedef struct syncStatus {
+	long status;						// http status; 0 for network errors
+	unsigned long count;				// operations that failed with it
+} SyncStatus;
+
+typedef struct syncRun {
+	char * pgid;						// persongroup synced
+	SyncPerson * want;					// persons of the roster, sorted by name
+	int nwant;
+	SyncPerson * have;					// persons of the group, sorted by name then personId
+	int nhave;
+	int capacity;						// persons of the group allocated
+	int truncated;						// 1 if the group couldn't all be copied
+	SyncTask * tasks;					// one per person that changes
+	int ntasks;
+	int next;							// next task to run
+	unsigned long planned;				// operations planned
+	unsigned long done;					// operations made
+	unsigned long created;				// persons created
+	unsigned long added;				// faces added
+	unsigned long removed;				// faces deleted
+	unsigned long deleted;				// persons deleted
+	unsigned long missing;				// faces the roster keeps but the group doesn't have
+	unsigned long failed;				// operations that failed
+	SyncStatus statuses[SYNC_STATUSES];	// failures by status
+	double start;						// when the changes started, in ms
+	double progress;					// when progress was printed last, in ms
+	pthread_mutex_t lock;
+} SyncRun;
+
+static double now_ms()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static int compare_string(const void * a, const void * b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int compare_person(const void * a, const void * b)
+{
+	const SyncPerson * x = a;
+	const SyncPerson * y = b;
+	int ret = strcmp(x->name, y->name);
+
+	return ret ? ret : strcmp(x->pid, y->pid);
+}
+
+/* a face of the roster that is a persistedFaceId rather than a path */
+static int is_face_id(const char * face)
+{
+	int i;
+
+	for (i = 0; face[i]; ++i) {
+		if (i == 8 || i == 13 || i == 18 || i == 23) {
+			if (face[i] != '-') return 0;
+		}
+		else if (!isxdigit((unsigned char)face[i])) {
+			return 0;
+		}
+	}
+	return i == 36;
+}
+
+/* persistedFaceIds are kept lowercase so they compare as they sort */
+static int add_face(SyncPerson * person, const char * face)
+{
+	char ** grown;
+	char * p;
+
+	if (person->nfaces == person->capacity) {
+		person->capacity = person->capacity ? person->capacity * 2 : 4;
+		if (!(grown = realloc(person->faces, person->capacity * sizeof(char *)))) return -1;
+		person->faces = grown;
+	}
+	if (!(person->faces[person->nfaces] = strdup(face))) return -1;
+	if (is_face_id(face)) {
+		for (p = person->faces[person->nfaces]; *p; ++p) *p = tolower((unsigned char)*p);
+	}
+	person->nfaces++;
+	return 0;
+}
+
+static void free_persons(SyncPerson * persons, int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		while (persons[i].nfaces--) free(persons[i].faces[persons[i].nfaces]);
+		free(persons[i].faces);
+	}
+	free(persons);
+}
+
+/* reads the roster; lines of one name are merged. -1 if it can't be read */
+static int read_roster(SyncRun * run, const char * path)
+{
+	FILE * file = fopen(path, "r");
+	char * line = malloc(SYNC_LINE_SIZE);
+	SyncPerson * grown;
+	SyncPerson * person;
+	char * field;
+	char * save;
+	int capacity = 0;
+	int merged = 0;
+	int lineno = 0;
+	int i;
+
+	if (!file || !line) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		if (file) fclose(file);
+		free(line);
+		return -1;
+	}
+
+	while (fgets(line, SYNC_LINE_SIZE, file)) {
+		lineno++;
+		line[strcspn(line, "\r\n")] = '\0';
+		if (!line[0] || line[0] == '#') continue;
+
+		field = strtok_r(line, "\t", &save);
+		if (!field || strlen(field) >= SYNC_NAME_SIZE) {
+			fprintf(stderr, "%s:%d: bad name\n", path, lineno);
+			continue;
+		}
+
+		if (run->nwant == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			if (!(grown = realloc(run->want, capacity * sizeof(SyncPerson)))) break;
+			run->want = grown;
+		}
+		person = &run->want[run->nwant++];
+		memset(person, 0, sizeof(SyncPerson));
+		snprintf(person->name, sizeof(person->name), "%s", field);
+
+		while ((field = strtok_r(NULL, "\t", &save))) {
+			if (*field) add_face(person, field);
+		}
+	}
+	fclose(file);
+	free(line);
+
+	qsort(run->want, run->nwant, sizeof(SyncPerson), compare_person);
+
+	// merging persons named on several lines into the first
+	for (i = 1; i < run->nwant; ++i) {
+		person = &run->want[merged];
+		if (!strcmp(person->name, run->want[i].name)) {
+			while (run->want[i].nfaces) {
+				add_face(person, run->want[i].faces[--run->want[i].nfaces]);
+				free(run->want[i].faces[run->want[i].nfaces]);
+			}
+			free(run->want[i].faces);
+		}
+		else {
+			run->want[++merged] = run->want[i];
+		}
+	}
+	if (run->nwant) run->nwant = merged + 1;
+
+	for (i = 0; i < run->nwant; ++i) {
+		qsort(run->want[i].faces, run->want[i].nfaces, sizeof(char *), compare_string);
+	}
+	return 0;
+}
+
+/* copies a person of the group as it is listed */
+static int collect_person(struct json_object * json, void * data)
+{
+	SyncRun * run = data;
+	SyncPerson * grown;
+	SyncPerson * person;
+	struct json_object * value;
+	struct json_object * faces;
+	const char * text;
+	size_t i;
+
+	if (run->nhave == run->capacity) {
+		run->capacity = run->capacity ? run->capacity * 2 : 1024;
+		if (!(grown = realloc(run->have, run->capacity * sizeof(SyncPerson)))) {
+			run->truncated = 1;
+			return 1;
+		}
+		run->have = grown;
+	}
+	person = &run->have[run->nhave];
+	memset(person, 0, sizeof(SyncPerson));
+
+	if (!json_object_object_get_ex(json, "personId", &value) || !(text = json_object_get_string(value))) return 0;
+	snprintf(person->pid, sizeof(person->pid), "%s", text);
+	if (json_object_object_get_ex(json, "name", &value) && (text = json_object_get_string(value))) {
+		snprintf(person->name, sizeof(person->name), "%s", text);
+	}
+	if (json_object_object_get_ex(json, "persistedFaceIds", &faces)) {
+		for (i = 0; i < json_object_array_length(faces); ++i) {
+			if ((text = json_object_get_string(json_object_array_get_idx(faces, i)))) add_face(person, text);
+		}
+	}
+	qsort(person->faces, person->nfaces, sizeof(char *), compare_string);
+
+	run->nhave++;
+	return 0;
+}
+
+static SyncTask * new_task(SyncRun * run, SyncPerson * want, SyncPerson * have)
+{
+	SyncTask * task = &run->tasks[run->ntasks++];
+
+	memset(task, 0, sizeof(SyncTask));
+	task->want = want;
+	task->have = have;
+	if (want) {
+		task->add = calloc(want->nfaces ? want->nfaces : 1, sizeof(char *));
+	}
+	if (have) {
+		task->remove = calloc(have->nfaces ? have->nfaces : 1, sizeof(char *));
+	}
+	return task;
+}
+
+/* works out what changes a person needs, and plans them unless none */
+static void plan_person(SyncRun * run, SyncPerson * want, SyncPerson * have)
+{
+	SyncTask * task;
+	int i = 0;
+	int j = 0;
+	int cmp;
+
+	if (!want || !have) {
+		task = new_task(run, want, have);
+		if (want) {
+			for (i = 0; i < want->nfaces; ++i) {
+				if (is_face_id(want->faces[i])) run->missing++;
+				else task->add[task->nadd++] = want->faces[i];
+			}
+		}
+		run->planned += 1 + task->nadd;
+		return;
+	}
+
+	task = new_task(run, want, have);
+
+	// both are sorted; persistedFaceIds are matched, paths are added
+	while (i < want->nfaces || j < have->nfaces) {
+		if (i < want->nfaces && !is_face_id(want->faces[i])) {
+			task->add[task->nadd++] = want->faces[i++];
+			continue;
+		}
+
+		cmp = i == want->nfaces ? 1 : j == have->nfaces ? -1 : strcmp(want->faces[i], have->faces[j]);
+		if (!cmp) {
+			i++;
+			j++;
+		}
+		else if (cmp < 0) {
+			run->missing++;
+			i++;
+		}
+		else {
+			task->remove[task->nremove++] = have->faces[j++];
+		}
+	}
+
+	if (!task->nadd && !task->nremove) {
+		free(task->add);
+		free(task->remove);
+		run->ntasks--;
+		return;
+	}
+	run->planned += task->nadd + task->nremove;
+}
+
+/* compares the roster with the group; -1 if out of memory */
+static int plan(SyncRun * run)
+{
+	int i = 0;
+	int j = 0;
+	int cmp;
+
+	run->tasks = calloc(run->nwant + run->nhave + 1, sizeof(SyncTask));
+	if (!run->tasks) return -1;
+
+	while (i < run->nwant || j < run->nhave) {
+		cmp = i == run->nwant ? 1 : j == run->nhave ? -1 : strcmp(run->want[i].name, run->have[j].name);
+		if (!cmp) {
+			plan_person(run, &run->want[i++], &run->have[j++]);
+
+			// others of the same name are deleted
+			while (j < run->nhave && !strcmp(run->have[j].name, run->want[i - 1].name)) {
+				plan_person(run, NULL, &run->have[j++]);
+			}
+		}
+		else if (cmp < 0) {
+			plan_person(run, &run->want[i++], NULL);
+		}
+		else {
+			plan_person(run, NULL, &run->have[j++]);
+		}
+	}
+	return 0;
+}
+
+static void print_plan(SyncRun * run)
+{
+	SyncTask * task;
+	int i;
+	int j;
+
+	for (i = 0; i < run->ntasks; ++i) {
+		task = &run->tasks[i];
+		if (!task->want) {
+			printf("delete_p\t%s\t%s\n", task->have->name, task->have->pid);
+			continue;
+		}
+		if (!task->have) {
+			printf("create_p\t%s\n", task->want->name);
+		}
+		for (j = 0; j < task->nremove; ++j) {
+			printf("delete_face\t%s\t%s\n", task->want->name, task->remove[j]);
+		}
+		for (j = 0; j < task->nadd; ++j) {
+			printf("add_face\t%s\t%s\n", task->want->name, task->add[j]);
+		}
+	}
+}
+
+/* counts an operation made, and prints the progress now and then */
+static void count_op(SyncRun * run, unsigned long * counter, long status)
+{
+	double now = now_ms();
+	int i;
+
+	pthread_mutex_lock(&run->lock);
+	run->done++;
+	if (status == 200) {
+		(*counter)++;
+	}
+	else {
+		run->failed++;
+		for (i = 0; i < SYNC_STATUSES; ++i) {
+			if (run->statuses[i].count && run->statuses[i].status != status) continue;
+			run->statuses[i].status = status;
+			run->statuses[i].count++;
+			break;
+		}
+	}
+	if (now - run->progress >= SYNC_PROGRESS_MS) {
+		run->progress = now;
+		printf("%lu of %lu operations, %.1f/s\n", run->done, run->planned, run->done * 1e3 / (now - run->start));
+		fflush(stdout);
+	}
+	pthread_mutex_unlock(&run->lock);
+}
+
+/* makes the changes of a person; faces are deleted before others are
+   added, as a person holds a limited number */
+static void sync_person(SyncRun * run, SyncTask * task, FaceBody * body)
+{
+	struct json_object * resp;
+	struct json_object * value;
+	char pid[SYNC_PID_SIZE];
+	long status;
+	int i;
+
+	if (!task->want) {
+		status = face_delete_p(run->pgid, task->have->pid, &resp);
+		json_object_put(resp);
+		count_op(run, &run->deleted, status);
+		return;
+	}
+
+	if (task->have) {
+		snprintf(pid, sizeof(pid), "%s", task->have->pid);
+	}
+	else {
+		face_body_create_p(body, task->want->name, NULL);
+		status = face_create_p_body(run->pgid, body, &resp);
+		if (status == 200 && !json_object_object_get_ex(resp, "personId", &value)) status = -1;
+		if (status == 200) snprintf(pid, sizeof(pid), "%s", json_object_get_string(value));
+		json_object_put(resp);
+		count_op(run, &run->created, status);
+
+		if (status != 200) {
+			fprintf(stderr, "Creating %s failed with %ld\n", task->want->name, status);
+			return;
+		}
+	}
+
+	for (i = 0; i < task->nremove; ++i) {
+		status = face_delete_face(run->pgid, pid, task->remove[i], &resp);
+		json_object_put(resp);
+		count_op(run, &run->removed, status);
+	}
+	for (i = 0; i < task->nadd; ++i) {
+		status = face_add_face_path(task->add[i], run->pgid, pid, NULL, &resp);
+		json_object_put(resp);
+		count_op(run, &run->added, status);
+		if (status != 200) {
+			fprintf(stderr, "Adding %s to %s failed with %ld\n", task->add[i], task->want->name, status);
+		}
+	}
+}
+
+static void * sync_run(void * arg)
+{
+	SyncRun * run = arg;
+	FaceBody * body = face_body_acquire();
+	int i;
+
+	if (!body) return NULL;
+
+	while (1) {
+		pthread_mutex_lock(&run->lock);
+		i = run->next < run->ntasks ? run->next++ : -1;
+		pthread_mutex_unlock(&run->lock);
+		if (i < 0) break;
+
+		sync_person(run, &run->tasks[i], body);
+	}
+
+	face_body_release(body);
+	return NULL;
+}
+
+static void usage(const char * name)
+{
+	fprintf(stderr, "Usage: %s -k key -g pgid [-u region] [-c threads] [-r tps] [-l] [-n] roster\n", name);
+}
+
+int main(int argc, char * argv[]) {
+	SyncRun run = { .pgid = NULL };
+	FaceFuture * workers[SYNC_MAX_THREADS] = {0};
+	FaceClient * client;
+	char * region = SYNC_DEFAULT_REGION;
+	char * key = NULL;
+	int nthreads = SYNC_DEFAULT_THREADS;
+	double tps = SYNC_DEFAULT_TPS;
+	int large = 0;
+	int dry_run = 0;
+	RetryStats retry;
+	HedgeStats hedge;
+	double elapsed;
+	long status;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "k:g:u:c:r:ln")) != -1) {
+		switch (opt) {
+			case 'k': key = optarg; break;
+			case 'g': run.pgid = optarg; break;
+			case 'u': region = optarg; break;
+			case 'c': nthreads = atoi(optarg); break;
+			case 'r': tps = atof(optarg); break;
+			case 'l': large = 1; break;
+			case 'n': dry_run = 1; break;
+			default: usage(argv[0]); return EXIT_FAILURE;
+		}
+	}
+	if (!key || !run.pgid || optind != argc - 1) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (nthreads < 1) nthreads = 1;
+	if (nthreads > SYNC_MAX_THREADS) nthreads = SYNC_MAX_THREADS;
+
+	if (read_roster(&run, argv[optind])) return EXIT_FAILURE;
+
+	// every syncing thread is a worker of the client
+	client = face_client_new(nthreads);
+	if (!client || face_client_login(client, region, key)) {
+		return EXIT_FAILURE;
+	}
+	face_client_bind(client);
+	face_set_large_groups(large);
+	if (tps > 0) {
+		face_set_rate_limit(tps, tps);
+	}
+
+	// a group not listed whole would have its persons created again
+	status = face_list_p_each(run.pgid, 0, 0, collect_person, &run);
+	if (status != 200 || run.truncated) {
+		fprintf(stderr, "Listing %s failed with %ld\n", run.pgid, status);
+		return EXIT_FAILURE;
+	}
+	qsort(run.have, run.nhave, sizeof(SyncPerson), compare_person);
+
+	if (plan(&run)) {
+		fprintf(stderr, "Calloc Error: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	printf("%d persons in the roster, %d in %s; %d to change with %lu operations\n", run.nwant, run.nhave,
+		run.pgid, run.ntasks, run.planned);
+	if (run.missing) {
+		printf("%lu faces of the roster are no longer in the group and are left out\n", run.missing);
+	}
+
+	if (dry_run) {
+		print_plan(&run);
+	}
+	else if (run.ntasks) {
+		pthread_mutex_init(&run.lock, NULL);
+		run.start = run.progress = now_ms();
+
+		// the calling thread syncs too
+		for (i = 1; i < nthreads; ++i) {
+			workers[i] = face_client_submit(client, sync_run, &run);
+		}
+		sync_run(&run);
+		for (i = 1; i < nthreads; ++i) {
+			face_future_wait(workers[i]);
+		}
+		elapsed = now_ms() - run.start;
+		face_image_cache_flush();
+		pthread_mutex_destroy(&run.lock);
+
+		face_set_train_quiet(0);
+		face_schedule_train(run.pgid);
+		status = (long)(intptr_t)face_future_wait(face_train_future(run.pgid));
+
+		printf("\nDone after %.1f s, %.1f operations/s\n", elapsed / 1e3, elapsed > 0 ? run.done * 1e3 / elapsed : 0);
+		printf("%lu persons created, %lu faces added, %lu faces deleted, %lu persons deleted\n", run.created,
+			run.added, run.removed, run.deleted);
+		printf("Training %s: %ld\n", run.pgid, status);
+		printf("%lu operations failed\n", run.failed);
+		for (i = 0; i < SYNC_STATUSES && run.statuses[i].count; ++i) {
+			printf("\t%ld: %lu\n", run.statuses[i].status, run.statuses[i].count);
+		}
+	}
+
+	face_get_retry_stats(&retry);
+	face_get_hedge_stats(&hedge);
+	printf("%lu billable transactions (%lu requests, %lu retries, %lu hedges)\n",
+		retry.requests + retry.retries + hedge.hedged, retry.requests, retry.retries, hedge.hedged);
+
+	for (i = 0; i < run.ntasks; ++i) {
+		free(run.tasks[i].add);
+		free(run.tasks[i].remove);
+	}
+	free(run.tasks);
+	free_persons(run.want, run.nwant);
+	free_persons(run.have, run.nhave);
+
+	return run.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}